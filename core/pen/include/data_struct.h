@@ -101,6 +101,7 @@ namespace pen
 
         void create(u32 capacity);
         void put(const T& item);
+        bool try_put(const T& item); // returns false instead of overwriting when full
         T*   get();
         T*   check();
     };
@@ -139,6 +140,27 @@ namespace pen
         void     swap_buffers();
     };
 
+    // lockless single producer single consumer - the producer can swap any number of times while the consumer reads,
+    // neither side ever touches the buffer the other is using and the consumer always picks up the latest swap.
+    template <typename T>
+    struct triple_buffer
+    {
+        static const u32 k_fresh = 1 << 2; // set on the shared index when it holds a swap the consumer has not taken
+
+        T     _data[3];
+        a_u32 _shared;
+        u32   _bb;
+        u32   _fb;
+
+        triple_buffer();
+
+        T&       backbuffer();
+        const T& frontbuffer(); // takes the latest swapped buffer, which stays valid until the next call
+        void     swap_buffers();
+
+        u32 exchange_shared(u32 index);
+    };
+
     // lockless single producer multiple consumer - thread safe multi buffer of arrays
     template <typename T, size_t N>
     struct multi_array_buffer
@@ -251,6 +273,18 @@ namespace pen
         put_pos = (put_pos + 1) % _capacity;
     }
 
+    template <typename T>
+    pen_inline bool ring_buffer<T>::try_put(const T& item)
+    {
+        u32 next = (put_pos + 1) % _capacity;
+        if (next == get_pos)
+            return false;
+
+        data[put_pos] = item;
+        put_pos = next;
+        return true;
+    }
+
     template <typename T>
     pen_inline T* ring_buffer<T>::get()
     {
@@ -356,6 +390,47 @@ namespace pen
         _swaps++;
     }
 
+    template <typename T>
+    pen_inline triple_buffer<T>::triple_buffer()
+    {
+        _bb = 0;
+        _shared = 1;
+        _fb = 2;
+    }
+
+    template <typename T>
+    pen_inline T& triple_buffer<T>::backbuffer()
+    {
+        return _data[_bb];
+    }
+
+    template <typename T>
+    pen_inline const T& triple_buffer<T>::frontbuffer()
+    {
+        if (pen_atomic_load(_shared) & k_fresh)
+            _fb = exchange_shared(_fb) & ~k_fresh;
+
+        return _data[_fb];
+    }
+
+    template <typename T>
+    pen_inline void triple_buffer<T>::swap_buffers()
+    {
+        _bb = exchange_shared(_bb | k_fresh) & ~k_fresh;
+    }
+
+    template <typename T>
+    pen_inline u32 triple_buffer<T>::exchange_shared(u32 index)
+    {
+#if PEN_SINGLE_THREADED
+        u32 prev = _shared;
+        _shared = index;
+        return prev;
+#else
+        return _shared.exchange(index, std::memory_order_acq_rel);
+#endif
+    }
+
     template <typename T, size_t N>
     pen_inline multi_array_buffer<T, N>::multi_array_buffer()
     {
@@ -404,16 +479,18 @@ namespace pen
     template <typename T, size_t N>
     pen_inline void multi_array_buffer<T, N>::grow(size_t size)
     {
-        if (_capacity[_bb].load() >= size)
+        // size is the index about to be written, as res_pool::grow
+        if (_capacity[_bb].load() > size)
             return;
 
-        _data[_bb] = (T*)pen::memory_realloc(_data[_bb], sizeof(T) * size);
+        size_t new_cap = size * 2;
+        _data[_bb] = (T*)pen::memory_realloc(_data[_bb], sizeof(T) * new_cap);
 
         // zero the rest
         size_t cur = _capacity[_bb].load();
-        size_t diff = size - cur;
-        memset(&_data[cur], 0x00, sizeof(T) * diff);
-        _capacity[_bb] = size;
+        size_t diff = new_cap - cur;
+        memset(_data[_bb] + cur, 0x00, sizeof(T) * diff);
+        _capacity[_bb] = new_cap;
     }
 
     template <typename T>
@@ -7,11 +7,14 @@
 // Can read files and also enumerate file system and volumes as an fs_tree_node.
 // Make sure to free p_buffer yourself allocated from filesystem_read_file_to_buffer.
 // Make sure to call filesystem_enum_free_mem with your fs_tree_node once finished with it.
+// Files mapped with filesystem_map_file are read only and must be released with filesystem_unmap_file.
+// Files can be watched for changes, which are detected on a background thread and queued for the user thread.
 
 // Implemented with:
 //      win32 (windows)
 //      dirent (mac, ios, linux)
 //      android not implemented.
+//      file watching uses inotify (linux) and falls back to mtime polling on other platforms.
 
 #pragma once
 
@@ -28,6 +31,8 @@ namespace pen
 
     bool       filesystem_file_exists(const c8* filename);
     pen_error  filesystem_read_file_to_buffer(const c8* filename, void** p_buffer, u32& buffer_size);
+    pen_error  filesystem_map_file(const c8* filename, const void** p_data, size_t& size);
+    void       filesystem_unmap_file(const void* data, size_t size);
     pen_error  filesystem_getmtime(const c8* filename, u32& mtime_out);
     void       filesystem_toggle_hidden_files();
     pen_error  filesystem_enum_volumes(fs_tree_node& results);
@@ -38,4 +43,8 @@ namespace pen
     const c8** filesystem_get_user_directory(s32& directory_depth); // returns array of directories like the above
     s32        filesystem_exclude_slash_depth();
 
+    // file watching, id is PEN_HASH(filename) with filename as passed to filesystem_watch_file
+    void filesystem_watch_file(const c8* filename);
+    bool filesystem_watch_next(hash_id& id_changed); // returns false when there are no more changes
+
 } // namespace pen
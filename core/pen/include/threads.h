@@ -4,6 +4,7 @@
 
 // Minimalist cross platform thread wrapper api.
 // Includes functions to create jobs, threads, mutex and semaphore.
+// Plus a small pool of worker threads to split data parallel work across cores.
 
 #pragma once
 
@@ -18,6 +19,7 @@ namespace pen
     typedef void (*completion_callback)(void*);
     typedef void* (*dispatch_thread)(void*);
     typedef loop_t (*single_thread_update_func)();
+    typedef void (*parallel_for_func)(void* user_data, u32 begin, u32 end);
 
     // A Job is just a thread with some user data, a callback
     // and some syncronisation semaphores
@@ -71,6 +73,12 @@ namespace pen
     void jobs_create_single_thread_update(single_thread_update_func func);
     void jobs_run_single_threaded();
 
+    // Workers
+    // workers are created on first use, the calling thread also takes batches and returns when all are complete.
+    // on single threaded platforms func is called once with the whole range.
+    void jobs_parallel_for(u32 count, u32 batch_size, parallel_for_func func, void* user_data);
+    u32  jobs_get_num_workers();
+
     // Mutex
     mutex* mutex_create();
     void   mutex_destroy(mutex* p_mutex);
@@ -0,0 +1,300 @@
+// file_watcher.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Watches files for changes on a background thread so the user thread never needs to stat them.
+// Directories are watched with inotify on linux, which survives editors that save by replacing the file.
+// Files in directories which cannot be watched (or on other platforms) are polled by mtime at a low rate.
+
+#include "data_struct.h"
+#include "file_system.h"
+#include "hash.h"
+#include "memory.h"
+#include "pen_string.h"
+#include "str_utilities.h"
+#include "threads.h"
+#include "timer.h"
+
+#include "str/Str.h"
+
+#if PEN_PLATFORM_LINUX
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace pen;
+
+namespace
+{
+    const u32 k_queue_size = 4096;
+    const f64 k_poll_interval_ms = 250.0;
+    const u32 k_wait_ms = 16;
+
+    struct watched_dir
+    {
+        Str path;
+        s32 wd;
+    };
+
+    struct watched_file
+    {
+        hash_id id;
+        hash_id id_name; // file name without directory, to match notifications
+        Str     filename;
+        u32     dir;
+        u32     mtime;
+    };
+
+    // shared between threads, user thread produces requests and consumes changes
+    ring_buffer<c8*>     s_watch_requests;
+    ring_buffer<hash_id> s_changes;
+    job*                 s_watch_job = nullptr;
+
+    // only touched by the watcher thread
+    watched_dir*  s_dirs = nullptr;
+    watched_file* s_files = nullptr;
+    s32           s_inotify = -1;
+
+    void push_change(hash_id id)
+    {
+        while (!s_changes.try_put(id))
+            thread_sleep_ms(1);
+    }
+
+    s32 add_dir_watch(const c8* path)
+    {
+#if PEN_PLATFORM_LINUX
+        if (s_inotify >= 0)
+            return inotify_add_watch(s_inotify, path, IN_CLOSE_WRITE | IN_MOVED_TO);
+#endif
+        return -1;
+    }
+
+    u32 get_dir(const Str& path)
+    {
+        u32 num_dirs = sb_count(s_dirs);
+        for (u32 i = 0; i < num_dirs; ++i)
+            if (s_dirs[i].path == path)
+                return i;
+
+        watched_dir wd;
+        wd.path = path;
+        wd.wd = add_dir_watch(path.c_str());
+
+        sb_push(s_dirs, wd);
+        return num_dirs;
+    }
+
+    void add_file(c8* filename)
+    {
+        hash_id id = PEN_HASH(filename);
+
+        u32 num_files = sb_count(s_files);
+        for (u32 i = 0; i < num_files; ++i)
+            if (s_files[i].id == id)
+                return;
+
+        Str fn = filename;
+        Str dir = ".";
+        Str name = fn;
+
+        s32 loc = str_find_reverse(fn, "/");
+        if (loc != -1)
+        {
+            dir = str_substr(fn, 0, loc);
+            name = str_substr(fn, loc + 1, fn.length());
+        }
+
+        watched_file wf;
+        wf.id = id;
+        wf.id_name = PEN_HASH(name.c_str());
+        wf.filename = fn;
+        wf.dir = get_dir(dir);
+        wf.mtime = 0;
+
+        if (filesystem_file_exists(filename))
+            filesystem_getmtime(filename, wf.mtime);
+
+        sb_push(s_files, wf);
+    }
+
+    void process_requests()
+    {
+        c8** req = s_watch_requests.get();
+        while (req)
+        {
+            add_file(*req);
+            memory_free(*req);
+            req = s_watch_requests.get();
+        }
+    }
+
+#if PEN_PLATFORM_LINUX
+    void read_notifications()
+    {
+        c8 buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+        for (;;)
+        {
+            ssize_t len = read(s_inotify, buf, sizeof(buf));
+            if (len <= 0)
+                break;
+
+            for (c8* p = buf; p < buf + len;)
+            {
+                inotify_event* ev = (inotify_event*)p;
+                p += sizeof(inotify_event) + ev->len;
+
+                u32 num_dirs = sb_count(s_dirs);
+                u32 dir = 0;
+                for (; dir < num_dirs; ++dir)
+                    if (s_dirs[dir].wd == ev->wd)
+                        break;
+
+                if (dir == num_dirs)
+                    continue;
+
+                // directory was removed, files in it are polled until it can be watched again
+                if (ev->mask & IN_IGNORED)
+                {
+                    s_dirs[dir].wd = -1;
+                    continue;
+                }
+
+                if (ev->len == 0)
+                    continue;
+
+                hash_id id_name = PEN_HASH(ev->name);
+
+                u32 num_files = sb_count(s_files);
+                for (u32 i = 0; i < num_files; ++i)
+                    if (s_files[i].dir == dir && s_files[i].id_name == id_name)
+                        push_change(s_files[i].id);
+            }
+        }
+    }
+#endif
+
+    void poll_unwatched()
+    {
+        // retry directories which could not be watched
+        u32 num_dirs = sb_count(s_dirs);
+        for (u32 i = 0; i < num_dirs; ++i)
+            if (s_dirs[i].wd < 0)
+                s_dirs[i].wd = add_dir_watch(s_dirs[i].path.c_str());
+
+        u32 num_files = sb_count(s_files);
+        for (u32 i = 0; i < num_files; ++i)
+        {
+            watched_file& wf = s_files[i];
+            if (s_dirs[wf.dir].wd >= 0 && s_inotify >= 0)
+                continue;
+
+            if (!filesystem_file_exists(wf.filename.c_str()))
+                continue;
+
+            u32 mtime = 0;
+            filesystem_getmtime(wf.filename.c_str(), mtime);
+            if (mtime != wf.mtime)
+            {
+                wf.mtime = mtime;
+                push_change(wf.id);
+            }
+        }
+    }
+
+    void* file_watcher_thread(void* params)
+    {
+        job_thread_params* job_params = (job_thread_params*)params;
+        job*               p_thread_info = job_params->job_info;
+        semaphore_post(p_thread_info->p_sem_continue, 1);
+
+#if PEN_PLATFORM_LINUX
+        s_inotify = inotify_init1(IN_NONBLOCK);
+#endif
+
+        timer* poll_timer = timer_create();
+        timer_start(poll_timer);
+
+        for (;;)
+        {
+            process_requests();
+
+#if PEN_PLATFORM_LINUX
+            if (s_inotify >= 0)
+            {
+                pollfd pfd;
+                pfd.fd = s_inotify;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+
+                if (poll(&pfd, 1, k_wait_ms) > 0)
+                    read_notifications();
+            }
+            else
+            {
+                thread_sleep_ms(k_wait_ms);
+            }
+#else
+            thread_sleep_ms(k_wait_ms);
+#endif
+
+            if (timer_elapsed_ms(poll_timer) > k_poll_interval_ms)
+            {
+                poll_unwatched();
+                timer_start(poll_timer);
+            }
+
+            if (semaphore_try_wait(p_thread_info->p_sem_exit))
+                break;
+        }
+
+#if PEN_PLATFORM_LINUX
+        if (s_inotify >= 0)
+            close(s_inotify);
+        s_inotify = -1;
+#endif
+
+        timer_destroy(poll_timer);
+
+        semaphore_post(p_thread_info->p_sem_continue, 1);
+        semaphore_post(p_thread_info->p_sem_terminated, 1);
+        return PEN_THREAD_OK;
+    }
+} // namespace
+
+namespace pen
+{
+    void filesystem_watch_file(const c8* filename)
+    {
+        PEN_HOTLOADING_ENABLED;
+
+#if !PEN_SINGLE_THREADED
+        if (!s_watch_job)
+        {
+            s_watch_requests.create(k_queue_size);
+            s_changes.create(k_queue_size);
+            s_watch_job = jobs_create_job(file_watcher_thread, 1024 * 1024, nullptr, e_thread_start_flags::detached);
+        }
+
+        u32 len = string_length(filename);
+        c8* req = (c8*)memory_alloc(len + 1);
+        memcpy(req, filename, len);
+        req[len] = '\0';
+
+        while (!s_watch_requests.try_put(req))
+            thread_sleep_ms(1);
+#endif
+    }
+
+    bool filesystem_watch_next(hash_id& id_changed)
+    {
+        hash_id* id = s_changes.get();
+        if (!id)
+            return false;
+
+        id_changed = *id;
+        return true;
+    }
+} // namespace pen
@@ -7,7 +7,12 @@
 #include "renderer.h"
 #include "threads.h"
 
+#include <algorithm>
+#include <thread>
+
 #define MAX_THREADS 32 // lazy fixed sized array to avoid any thread saftey issues
+#define MAX_WORKERS 16
+#define MAX_PARALLEL_WORK 32
 
 using namespace pen;
 
@@ -16,6 +21,145 @@ namespace
     job                        s_jt[MAX_THREADS];
     u32                        s_num_active_threads = 0;
     single_thread_update_func* s_single_thread_funcs = nullptr;
+
+#if !PEN_SINGLE_THREADED
+    struct parallel_work
+    {
+        parallel_for_func func;
+        void*             user_data;
+        u32               count;
+        u32               batch_size;
+        u32               num_batches;
+        a_u32             next;
+        a_u32             complete;
+        a_u32             active;
+    };
+
+    namespace e_worker_state
+    {
+        enum worker_state_t
+        {
+            none,
+            creating,
+            running,
+            terminated
+        };
+    }
+
+    struct worker_pool
+    {
+        thread*        threads[MAX_WORKERS];
+        u32            num_workers = 0;
+        semaphore*     sem_work = nullptr;
+        semaphore*     sem_exited = nullptr;
+        mutex*         work_mutex = nullptr;
+        parallel_work* work[MAX_PARALLEL_WORK];
+        u32            num_work = 0;
+        a_bool         exit = {false};
+        a_u32          state = {e_worker_state::none};
+    };
+    worker_pool s_workers;
+
+    void run_batches(parallel_work* w)
+    {
+        for (;;)
+        {
+            u32 b = w->next++;
+            if (b >= w->num_batches)
+                break;
+
+            u32 begin = b * w->batch_size;
+            u32 end = std::min(begin + w->batch_size, w->count);
+            w->func(w->user_data, begin, end);
+
+            w->complete++;
+        }
+    }
+
+    parallel_work* acquire_work()
+    {
+        parallel_work* w = nullptr;
+
+        mutex_lock(s_workers.work_mutex);
+        for (u32 i = 0; i < s_workers.num_work; ++i)
+        {
+            if (s_workers.work[i]->next < s_workers.work[i]->num_batches)
+            {
+                w = s_workers.work[i];
+                w->active++;
+                break;
+            }
+        }
+        mutex_unlock(s_workers.work_mutex);
+
+        return w;
+    }
+
+    void* worker_thread(void* params)
+    {
+        for (;;)
+        {
+            semaphore_wait(s_workers.sem_work);
+
+            if (s_workers.exit)
+                break;
+
+            parallel_work* w = acquire_work();
+            if (!w)
+                continue;
+
+            run_batches(w);
+            w->active--;
+        }
+
+        semaphore_post(s_workers.sem_exited, 1);
+        return PEN_THREAD_OK;
+    }
+
+    bool workers_init()
+    {
+        u32 expected = e_worker_state::none;
+        if (s_workers.state.compare_exchange_strong(expected, e_worker_state::creating))
+        {
+            // leave a core for the calling thread
+            u32 hw = std::thread::hardware_concurrency();
+            u32 num = hw > 1 ? hw - 1 : 1;
+            num = std::min<u32>(num, MAX_WORKERS);
+
+            s_workers.sem_work = semaphore_create(0, MAX_WORKERS * MAX_PARALLEL_WORK);
+            s_workers.sem_exited = semaphore_create(0, MAX_WORKERS);
+            s_workers.work_mutex = mutex_create();
+
+            for (u32 i = 0; i < num; ++i)
+                s_workers.threads[i] = thread_create(worker_thread, 1024 * 1024, nullptr, e_thread_start_flags::detached);
+
+            s_workers.num_workers = num;
+            s_workers.state = e_worker_state::running;
+        }
+
+        // another thread may be mid creation
+        while (s_workers.state == e_worker_state::creating)
+            std::this_thread::yield();
+
+        return s_workers.state == e_worker_state::running;
+    }
+
+    void workers_terminate()
+    {
+        u32 expected = e_worker_state::running;
+        if (!s_workers.state.compare_exchange_strong(expected, e_worker_state::terminated))
+            return;
+
+        s_workers.exit = true;
+
+        // posix semaphores only post once per call
+        for (u32 i = 0; i < s_workers.num_workers; ++i)
+            semaphore_post(s_workers.sem_work, 1);
+
+        for (u32 i = 0; i < s_workers.num_workers; ++i)
+            semaphore_wait(s_workers.sem_exited);
+    }
+#endif
 } // namespace
 
 namespace pen
@@ -49,6 +193,10 @@ namespace pen
 
     bool jobs_terminate_all()
     {
+#if !PEN_SINGLE_THREADED
+        workers_terminate();
+#endif
+
         // remove threads in reverse order
         for (s32 i = s_num_active_threads - 1; i >= 0; --i)
         {
@@ -79,4 +227,77 @@ namespace pen
             ((single_thread_update_func)s_single_thread_funcs[i])();
         }
     }
+
+    void jobs_parallel_for(u32 count, u32 batch_size, parallel_for_func func, void* user_data)
+    {
+        if (count == 0)
+            return;
+
+        batch_size = std::max<u32>(batch_size, 1);
+        u32 num_batches = (count + batch_size - 1) / batch_size;
+
+#if PEN_SINGLE_THREADED
+        func(user_data, 0, count);
+#else
+        if (num_batches == 1 || !workers_init())
+        {
+            func(user_data, 0, count);
+            return;
+        }
+
+        parallel_work w;
+        w.func = func;
+        w.user_data = user_data;
+        w.count = count;
+        w.batch_size = batch_size;
+        w.num_batches = num_batches;
+        w.next = 0;
+        w.complete = 0;
+        w.active = 0;
+
+        // queue the work, run inline if the queue is full
+        mutex_lock(s_workers.work_mutex);
+        if (s_workers.num_work >= MAX_PARALLEL_WORK)
+        {
+            mutex_unlock(s_workers.work_mutex);
+            func(user_data, 0, count);
+            return;
+        }
+        s_workers.work[s_workers.num_work++] = &w;
+        mutex_unlock(s_workers.work_mutex);
+
+        u32 wake = std::min(num_batches - 1, s_workers.num_workers);
+        for (u32 i = 0; i < wake; ++i)
+            semaphore_post(s_workers.sem_work, 1);
+
+        // calling thread takes batches too
+        run_batches(&w);
+
+        // remove from the queue so no more workers can pick it up
+        mutex_lock(s_workers.work_mutex);
+        for (u32 i = 0; i < s_workers.num_work; ++i)
+        {
+            if (s_workers.work[i] == &w)
+            {
+                s_workers.work[i] = s_workers.work[--s_workers.num_work];
+                break;
+            }
+        }
+        mutex_unlock(s_workers.work_mutex);
+
+        // wait for any batches still running on workers
+        while (w.complete < num_batches || w.active > 0)
+            std::this_thread::yield();
+#endif
+    }
+
+    u32 jobs_get_num_workers()
+    {
+#if PEN_SINGLE_THREADED
+        return 0;
+#else
+        workers_init();
+        return s_workers.num_workers;
+#endif
+    }
 } // namespace pen
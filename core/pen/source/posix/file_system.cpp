@@ -3,9 +3,11 @@
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/stat.h>
@@ -105,6 +107,44 @@ namespace pen
         return PEN_ERR_FILE_NOT_FOUND;
     }
 
+    pen_error filesystem_map_file(const c8* filename, const void** p_data, size_t& size)
+    {
+        WRITE_FILE_DEPENDENCIES(filename);
+
+        const Str resource_name = os_path_for_resource(filename);
+
+        *p_data = nullptr;
+        size = 0;
+
+        s32 fd = open(resource_name.c_str(), O_RDONLY);
+        if (fd < 0)
+            return PEN_ERR_FILE_NOT_FOUND;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return PEN_ERR_FAILED;
+        }
+
+        // the mapping keeps the file alive once the descriptor is closed
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+            return PEN_ERR_FAILED;
+
+        *p_data = data;
+        size = (size_t)st.st_size;
+        return PEN_ERR_OK;
+    }
+
+    void filesystem_unmap_file(const void* data, size_t size)
+    {
+        if (data)
+            munmap((void*)data, size);
+    }
+
     pen_error filesystem_enum_volumes(fs_tree_node& results)
     {
         static const c8* volumes_name = "Volumes";
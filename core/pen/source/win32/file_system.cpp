@@ -122,6 +122,52 @@ namespace pen
         return PEN_ERR_FILE_NOT_FOUND;
     }
 
+    pen_error filesystem_map_file(const c8* filename, const void** p_data, size_t& size)
+    {
+        c8* windir_filename = swap_slashes(filename);
+
+        *p_data = nullptr;
+        size = 0;
+
+        HANDLE file = CreateFileA(windir_filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        pen::memory_free(windir_filename);
+
+        if (file == INVALID_HANDLE_VALUE)
+            return PEN_ERR_FILE_NOT_FOUND;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return PEN_ERR_FAILED;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+
+        if (!mapping)
+            return PEN_ERR_FAILED;
+
+        // the view keeps the mapping alive once the handles are closed
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (!data)
+            return PEN_ERR_FAILED;
+
+        *p_data = data;
+        size = (size_t)file_size.QuadPart;
+        return PEN_ERR_OK;
+    }
+
+    void filesystem_unmap_file(const void* data, size_t size)
+    {
+        if (data)
+            UnmapViewOfFile(data);
+    }
+
     pen_error filesystem_enum_volumes(fs_tree_node& tree)
     {
         DWORD drive_bit_mask = GetLogicalDrives();
@@ -68,6 +68,9 @@ project "put"
     }
     includedirs { "include" }
     
+    -- must match the bullet build
+    defines { "BT_THREADSAFE=1" }
+    
     if platform_dir == "web" then
     	excludes
     	{
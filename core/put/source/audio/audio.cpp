@@ -9,9 +9,9 @@
 #include "pen_string.h"
 #include "slot_resource.h"
 #include "threads.h"
+#include "timer.h"
 
-#include "fmod.hpp"
-
+#include <algorithm>
 #include <math.h>
 
 using namespace pen;
@@ -39,7 +39,11 @@ namespace
             group_set_pitch,
             group_set_volume,
             dsp_set_three_band_eq,
-            dsp_set_gain
+            dsp_set_gain,
+            channel_set_volume,
+            channel_set_priority,
+            channel_set_distance,
+            set_voice_params
         };
     }
 
@@ -67,19 +71,373 @@ namespace
         u32 resource_slot;
 
         union {
-            c8*           filename;
-            u32           resource_index;
-            ::set_valuei  set_valuei;
-            ::set_valuef  set_valuef;
-            ::set_value3f set_value3f;
-            music_file    music;
+            c8*                 filename;
+            u32                 resource_index;
+            ::set_valuei        set_valuei;
+            ::set_valuef        set_valuef;
+            ::set_value3f       set_value3f;
+            music_file          music;
+            audio_voice_params* voice_params;
         };
     };
 
+    const u32 k_cmd_capacity = 1024;
+
     pen::job*                   _audio_job_thread_info;
     pen::slot_resources         _audio_slot_resources;
     pen::ring_buffer<audio_cmd> _cmd_buffer;
     a_u8                        _shutdown = {0};
+
+    // command queue load, only touched by the user thread
+    u32 _cmds_pending = 0;
+    u32 _cmds_last_frame = 0;
+    u32 _cmds_peak = 0;
+    u32 _cmds_dropped = 0;
+
+    // voice manager, channels are voices which only have a platform channel while they are real
+    struct voice
+    {
+        u32  sound;
+        u32  group;
+        u32  priority;
+        f32  volume;
+        f32  distance;
+        f32  frequency;      // 0 until set, plays at the sound rate
+        f32  base_frequency; // sound rate, read back from the platform channel once it has been real
+        f32  applied_volume; // last volume sent to the platform channel
+        f32  audibility;
+        f64  position_ms;
+        u32  play_state;
+        u32  real_updates; // platform channel state lags an update behind creation
+        bool real;
+        bool started;
+        bool active;
+    };
+
+    struct group_info
+    {
+        f32  pitch;
+        bool paused;
+        bool muted;
+        bool active;
+    };
+
+    audio_voice_params                            _voice_params;
+    pen::res_pool<voice>                          _voices;
+    pen::res_pool<group_info>                     _groups;
+    pen::res_pool<u8>                             _sound_loops;
+    u32*                                          _voice_list = nullptr;
+    u32*                                          _candidates = nullptr;
+    f64                                           _last_voice_update_ms = 0.0;
+    pen::multi_buffer<audio_stats, 2>             _voice_stats;
+    pen::multi_array_buffer<audio_voice_state, 2> _voice_states;
+
+    voice* get_voice(u32 slot)
+    {
+        if (slot == 0 || slot >= _voices._capacity || !_voices[slot].active)
+            return nullptr;
+
+        return &_voices[slot];
+    }
+
+    group_info* get_group(u32 slot)
+    {
+        if (slot == 0 || slot >= _groups._capacity || !_groups[slot].active)
+            return nullptr;
+
+        return &_groups[slot];
+    }
+
+    f32 voice_attenuation(f32 distance)
+    {
+        if (distance <= _voice_params.min_distance)
+            return 1.0f;
+
+        if (distance >= _voice_params.max_distance)
+            return 0.0f;
+
+        return _voice_params.min_distance / distance;
+    }
+
+    f32 voice_volume(const voice& v)
+    {
+        return v.volume * voice_attenuation(v.distance);
+    }
+
+    void voice_promote(u32 slot)
+    {
+        voice& v = _voices[slot];
+
+        direct::audio_create_channel_for_sound(v.sound, slot);
+
+        if (v.group)
+            direct::audio_add_channel_to_group(slot, v.group);
+
+        if (v.frequency > 0.0f)
+            direct::audio_channel_set_frequency(slot, v.frequency);
+
+        // resumes where the virtual voice got to
+        if (v.position_ms > 0.0)
+            direct::audio_channel_set_position(slot, (u32)v.position_ms);
+
+        v.applied_volume = voice_volume(v);
+        direct::audio_channel_set_volume(slot, v.applied_volume);
+
+        v.real = true;
+        v.real_updates = 0;
+    }
+
+    void voice_demote(u32 slot)
+    {
+        direct::audio_channel_stop(slot);
+        direct::audio_release_resource(slot);
+
+        _voices[slot].real = false;
+    }
+
+    void voice_create(u32 sound, u32 slot)
+    {
+        _voices.grow(slot);
+
+        voice& v = _voices[slot];
+        v = voice();
+        v.sound = sound;
+        v.volume = 1.0f;
+        v.play_state = e_audio_play_state::playing;
+        v.active = true;
+
+        sb_push(_voice_list, slot);
+    }
+
+    void voice_release(u32 slot)
+    {
+        voice& v = _voices[slot];
+        if (v.real)
+            voice_demote(slot);
+
+        v.active = false;
+
+        u32 num = sb_count(_voice_list);
+        for (u32 i = 0; i < num; ++i)
+        {
+            if (_voice_list[i] == slot)
+            {
+                _voice_list[i] = _voice_list[num - 1];
+                --stb__sbn(_voice_list);
+                break;
+            }
+        }
+    }
+
+    void group_release(u32 slot, group_info& g)
+    {
+        g.active = false;
+
+        // orphaned voices play ungrouped, as the platform does
+        u32 num = sb_count(_voice_list);
+        for (u32 i = 0; i < num; ++i)
+            if (_voices[_voice_list[i]].group == slot)
+                _voices[_voice_list[i]].group = 0;
+    }
+
+    void voice_track_real(u32 slot, voice& v)
+    {
+        if (v.real_updates++ == 0)
+            return;
+
+        audio_channel_state cs;
+        if (audio_channel_get_state(slot, &cs) != PEN_ERR_OK)
+            return;
+
+        if (cs.play_state == e_audio_play_state::not_playing)
+        {
+            v.play_state = e_audio_play_state::not_playing;
+            return;
+        }
+
+        v.position_ms = (f64)cs.position_ms;
+
+        if (v.frequency == 0.0f)
+            v.base_frequency = cs.frequency;
+    }
+
+    void voice_track_virtual(voice& v, const group_info* g, f64 dt_ms)
+    {
+        // nothing has elapsed for a voice created this update
+        if (!v.started || (g && g->paused))
+            return;
+
+        f64 rate = g ? g->pitch : 1.0;
+        if (v.frequency > 0.0f && v.base_frequency > 0.0f)
+            rate *= v.frequency / v.base_frequency;
+
+        v.position_ms += dt_ms * rate;
+
+        audio_sound_file_info info;
+        if (audio_channel_get_sound_file_info(v.sound, &info) != PEN_ERR_OK || info.length_ms == 0)
+            return;
+
+        if (v.position_ms >= (f64)info.length_ms)
+        {
+            if (_sound_loops[v.sound])
+                v.position_ms = fmod(v.position_ms, (f64)info.length_ms);
+            else
+                v.play_state = e_audio_play_state::not_playing;
+        }
+    }
+
+    bool voice_more_important(u32 a, u32 b)
+    {
+        const voice& va = _voices[a];
+        const voice& vb = _voices[b];
+
+        if (va.priority != vb.priority)
+            return va.priority > vb.priority;
+
+        if (va.audibility != vb.audibility)
+            return va.audibility > vb.audibility;
+
+        // keep real voices real when scores tie to avoid swapping every update
+        if (va.real != vb.real)
+            return va.real;
+
+        return a < b;
+    }
+
+    // scores every playing voice and gives the platform channels to the most important max_real_voices
+    void voices_update()
+    {
+        f64 now_ms = pen::get_time_ms();
+        f64 dt_ms = now_ms - _last_voice_update_ms;
+        _last_voice_update_ms = now_ms;
+
+        u32 promotions = 0;
+        u32 demotions = 0;
+
+        if (_candidates)
+            stb__sbn(_candidates) = 0;
+
+        u32 num_voices = sb_count(_voice_list);
+        for (u32 i = 0; i < num_voices; ++i)
+        {
+            u32    slot = _voice_list[i];
+            voice& v = _voices[slot];
+
+            const group_info* g = get_group(v.group);
+
+            if (v.play_state == e_audio_play_state::playing)
+            {
+                if (v.real)
+                    voice_track_real(slot, v);
+                else
+                    voice_track_virtual(v, g, dt_ms);
+            }
+
+            v.started = true;
+
+            if (v.play_state != e_audio_play_state::playing)
+            {
+                if (v.real)
+                {
+                    voice_demote(slot);
+                    ++demotions;
+                }
+
+                continue;
+            }
+
+            v.audibility = (g && g->muted) ? 0.0f : voice_volume(v);
+            sb_push(_candidates, slot);
+        }
+
+        u32 num_candidates = sb_count(_candidates);
+        std::sort(_candidates, _candidates + num_candidates, voice_more_important);
+
+        // demote first so the platform has the channels free before promoting
+        u32 budget = std::min(_voice_params.max_real_voices, num_candidates);
+        for (u32 i = 0; i < num_candidates; ++i)
+        {
+            u32    slot = _candidates[i];
+            voice& v = _voices[slot];
+
+            bool want_real = i < budget && v.audibility >= _voice_params.audible_threshold;
+            if (v.real && !want_real)
+            {
+                voice_demote(slot);
+                ++demotions;
+            }
+        }
+
+        u32 num_real = 0;
+        for (u32 i = 0; i < num_candidates; ++i)
+        {
+            u32    slot = _candidates[i];
+            voice& v = _voices[slot];
+
+            bool want_real = i < budget && v.audibility >= _voice_params.audible_threshold;
+            if (!want_real)
+                continue;
+
+            if (!v.real)
+            {
+                voice_promote(slot);
+                ++promotions;
+            }
+            else
+            {
+                f32 vol = voice_volume(v);
+                if (vol != v.applied_volume)
+                {
+                    direct::audio_channel_set_volume(slot, vol);
+                    v.applied_volume = vol;
+                }
+            }
+
+            ++num_real;
+        }
+
+        // readable state for the user thread
+        for (u32 i = 0; i < num_voices; ++i)
+        {
+            u32          slot = _voice_list[i];
+            const voice& v = _voices[slot];
+
+            _voice_states.grow(slot);
+            audio_voice_state& vs = _voice_states.backbuffer()[slot];
+
+            vs.play_state = v.play_state;
+            const group_info* g = get_group(v.group);
+            if (v.play_state == e_audio_play_state::playing && g && g->paused)
+                vs.play_state = e_audio_play_state::paused;
+
+            vs.position_ms = (u32)v.position_ms;
+            vs.audibility = v.audibility;
+            vs.real = v.real;
+        }
+
+        audio_stats& st = _voice_stats.backbuffer();
+        st.max_real_voices = _voice_params.max_real_voices;
+        st.num_voices = num_voices;
+        st.num_real_voices = num_real;
+        st.num_virtual_voices = num_candidates - num_real;
+        st.promotions = promotions;
+        st.demotions = demotions;
+
+        _voice_stats.swap_buffers();
+        _voice_states.swap_buffers();
+    }
+
+    void put_cmd(const audio_cmd& ac)
+    {
+        ++_cmds_pending;
+
+        // a full ring is still overwritten, but counted so it shows up in the stats
+        if (!_cmd_buffer.try_put(ac))
+        {
+            ++_cmds_dropped;
+            _cmd_buffer.put(ac);
+        }
+    }
 } // namespace
 
 namespace put
@@ -89,42 +447,91 @@ namespace put
         switch (cmd.command_index)
         {
             case e_cmd::create_stream:
+                _sound_loops.grow(cmd.resource_slot);
+                _sound_loops[cmd.resource_slot] = 1;
                 direct::audio_create_stream(cmd.filename, cmd.resource_slot);
                 pen::memory_free(cmd.filename);
                 break;
             case e_cmd::create_sound:
+                _sound_loops.grow(cmd.resource_slot);
+                _sound_loops[cmd.resource_slot] = 0;
                 direct::audio_create_sound(cmd.filename, cmd.resource_slot);
                 pen::memory_free(cmd.filename);
                 break;
             case e_cmd::create_sound_music:
+                _sound_loops.grow(cmd.resource_slot);
+                _sound_loops[cmd.resource_slot] = 0;
                 direct::audio_create_sound(cmd.music, cmd.resource_slot);
                 break;
             case e_cmd::create_group:
+                _groups.grow(cmd.resource_slot);
+                _groups[cmd.resource_slot] = {1.0f, false, false, true};
                 direct::audio_create_channel_group(cmd.resource_slot);
                 break;
             case e_cmd::add_channel_to_group:
-                direct::audio_add_channel_to_group(cmd.set_valuei.resource_index, cmd.set_valuei.value);
+                if (voice* v = get_voice(cmd.set_valuei.resource_index))
+                {
+                    v->group = cmd.set_valuei.value;
+                    if (v->real)
+                        direct::audio_add_channel_to_group(cmd.set_valuei.resource_index, cmd.set_valuei.value);
+                }
                 break;
             case e_cmd::add_dsp_to_group:
                 direct::audio_add_dsp_to_group(cmd.set_valuei.resource_index, (dsp_type)cmd.set_valuei.value,
                                                cmd.resource_slot);
                 break;
             case e_cmd::create_channel_for_sound:
-                direct::audio_create_channel_for_sound(cmd.resource_index, cmd.resource_slot);
+                // the platform channel is created when the voice manager makes the voice real
+                voice_create(cmd.resource_index, cmd.resource_slot);
                 break;
             case e_cmd::channel_set_position:
-                direct::audio_channel_set_position(cmd.set_valuei.resource_index, cmd.set_valuei.value);
+                if (voice* v = get_voice(cmd.set_valuei.resource_index))
+                {
+                    v->position_ms = (f64)cmd.set_valuei.value;
+                    if (v->real)
+                        direct::audio_channel_set_position(cmd.set_valuei.resource_index, cmd.set_valuei.value);
+                }
                 break;
             case e_cmd::channel_set_frequency:
-                direct::audio_channel_set_frequency(cmd.resource_index, cmd.set_valuef.value);
+                if (voice* v = get_voice(cmd.set_valuef.resource_index))
+                {
+                    v->frequency = cmd.set_valuef.value;
+                    if (v->real)
+                        direct::audio_channel_set_frequency(cmd.set_valuef.resource_index, cmd.set_valuef.value);
+                }
                 break;
             case e_cmd::channel_stop:
-                direct::audio_channel_stop(cmd.resource_index);
+                if (voice* v = get_voice(cmd.resource_index))
+                {
+                    v->play_state = e_audio_play_state::not_playing;
+                    if (v->real)
+                        voice_demote(cmd.resource_index);
+                }
+                break;
+            case e_cmd::channel_set_volume:
+                if (voice* v = get_voice(cmd.set_valuef.resource_index))
+                    v->volume = std::max(cmd.set_valuef.value, 0.0f);
+                break;
+            case e_cmd::channel_set_priority:
+                if (voice* v = get_voice(cmd.set_valuei.resource_index))
+                    v->priority = (u32)cmd.set_valuei.value;
+                break;
+            case e_cmd::channel_set_distance:
+                if (voice* v = get_voice(cmd.set_valuef.resource_index))
+                    v->distance = cmd.set_valuef.value;
+                break;
+            case e_cmd::set_voice_params:
+                _voice_params = *cmd.voice_params;
+                pen::memory_free(cmd.voice_params);
                 break;
             case e_cmd::group_set_mute:
+                if (group_info* g = get_group(cmd.set_valuei.resource_index))
+                    g->muted = (bool)cmd.set_valuei.value;
                 direct::audio_group_set_mute(cmd.set_valuei.resource_index, (bool)cmd.set_valuei.value);
                 break;
             case e_cmd::group_set_pause:
+                if (group_info* g = get_group(cmd.set_valuei.resource_index))
+                    g->paused = (bool)cmd.set_valuei.value;
                 direct::audio_group_set_pause(cmd.set_valuei.resource_index, (bool)cmd.set_valuei.value);
                 break;
             case e_cmd::group_set_volume:
@@ -134,10 +541,18 @@ namespace put
                 direct::audio_dsp_set_gain(cmd.set_valuef.resource_index, cmd.set_valuef.value);
                 break;
             case e_cmd::group_set_pitch:
+                if (group_info* g = get_group(cmd.set_valuef.resource_index))
+                    g->pitch = cmd.set_valuef.value;
                 direct::audio_group_set_pitch(cmd.set_valuef.resource_index, cmd.set_valuef.value);
                 break;
             case e_cmd::release_resource:
-                direct::audio_release_resource(cmd.resource_index);
+                if (get_voice(cmd.resource_index))
+                    voice_release(cmd.resource_index);
+                else
+                    direct::audio_release_resource(cmd.resource_index);
+
+                if (group_info* g = get_group(cmd.resource_index))
+                    group_release(cmd.resource_index, *g);
                 break;
             case e_cmd::dsp_set_three_band_eq:
                 direct::audio_dsp_set_three_band_eq(cmd.set_value3f.resource_index, cmd.set_value3f.value[0],
@@ -148,6 +563,10 @@ namespace put
 
     void audio_consume_command_buffer()
     {
+        _cmds_last_frame = _cmds_pending;
+        _cmds_peak = std::max(_cmds_peak, _cmds_pending);
+        _cmds_pending = 0;
+
         if (!_shutdown.load())
         {
             pen::semaphore_post(_audio_job_thread_info->p_sem_consume, 1);
@@ -162,7 +581,14 @@ namespace put
 
         // create resource slots
         pen::slot_resources_init(&_audio_slot_resources, 128);
-        _cmd_buffer.create(1024);
+        _cmd_buffer.create(k_cmd_capacity);
+
+        static u32 reserved = 128;
+        _voices.init(reserved);
+        _groups.init(reserved);
+        _sound_loops.init(reserved);
+        _voice_states.init(reserved);
+        _last_voice_update_ms = pen::get_time_ms();
 
         direct::audio_system_initialise();
 
@@ -182,6 +608,7 @@ namespace put
                     cmd = _cmd_buffer.get();
                 }
 
+                voices_update();
                 direct::audio_system_update();
             }
             else
@@ -198,6 +625,11 @@ namespace put
 
         direct::audio_system_shutdown();
 
+        sb_free(_voice_list);
+        sb_free(_candidates);
+        _voice_list = nullptr;
+        _candidates = nullptr;
+
         pen::semaphore_post(_audio_job_thread_info->p_sem_continue, 1);
         pen::semaphore_post(_audio_job_thread_info->p_sem_terminated, 1);
 
@@ -219,7 +651,7 @@ namespace put
         // set command (create stream or sound)
         ac.command_index = command;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     u32 audio_create_stream(const c8* filename)
@@ -250,7 +682,7 @@ namespace put
         ac.music = music;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
 
         return res;
     }
@@ -264,7 +696,7 @@ namespace put
         ac.command_index = e_cmd::create_group;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
 
         return res;
     }
@@ -284,7 +716,7 @@ namespace put
         ac.resource_index = sound_index;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
 
         return res;
     }
@@ -297,7 +729,7 @@ namespace put
         ac.set_valuei.resource_index = channel_index;
         ac.set_valuei.value = position_ms;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_channel_set_frequency(const u32 channel_index, const f32 frequency)
@@ -308,7 +740,7 @@ namespace put
         ac.set_valuef.resource_index = channel_index;
         ac.set_valuef.value = frequency;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_group_set_pause(const u32 group_index, const bool val)
@@ -319,7 +751,7 @@ namespace put
         ac.set_valuei.resource_index = group_index;
         ac.set_valuei.value = (s32)val;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_group_set_mute(const u32 group_index, const bool val)
@@ -330,7 +762,7 @@ namespace put
         ac.set_valuei.resource_index = group_index;
         ac.set_valuei.value = (s32)val;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_group_set_pitch(const u32 group_index, const f32 pitch)
@@ -341,7 +773,7 @@ namespace put
         ac.set_valuef.resource_index = group_index;
         ac.set_valuef.value = pitch;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_group_set_volume(const u32 group_index, const f32 volume)
@@ -352,7 +784,7 @@ namespace put
         ac.set_valuef.resource_index = group_index;
         ac.set_valuef.value = volume;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_add_channel_to_group(const u32 channel_index, const u32 group_index)
@@ -368,7 +800,7 @@ namespace put
         ac.set_valuei.resource_index = channel_index;
         ac.set_valuei.value = group_index;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_release_resource(u32 index)
@@ -381,7 +813,7 @@ namespace put
         ac.command_index = e_cmd::release_resource;
         ac.resource_index = index;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     u32 audio_add_dsp_to_group(const u32 group_index, dsp_type type)
@@ -395,7 +827,7 @@ namespace put
         ac.set_valuei.value = type;
         ac.resource_slot = res;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
 
         return res;
     }
@@ -410,7 +842,7 @@ namespace put
         ac.set_value3f.value[1] = med;
         ac.set_value3f.value[2] = high;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_dsp_set_gain(const u32 dsp_index, const f32 gain)
@@ -421,7 +853,7 @@ namespace put
         ac.set_valuef.resource_index = dsp_index;
         ac.set_valuef.value = gain;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
     }
 
     void audio_channel_stop(const u32 channel_index)
@@ -431,6 +863,96 @@ namespace put
         ac.command_index = e_cmd::channel_stop;
         ac.resource_index = channel_index;
 
-        _cmd_buffer.put(ac);
+        put_cmd(ac);
+    }
+
+    void audio_channel_set_volume(const u32 channel_index, const f32 volume)
+    {
+        audio_cmd ac;
+
+        ac.command_index = e_cmd::channel_set_volume;
+        ac.set_valuef.resource_index = channel_index;
+        ac.set_valuef.value = volume;
+
+        put_cmd(ac);
+    }
+
+    void audio_channel_set_priority(const u32 channel_index, const u32 priority)
+    {
+        audio_cmd ac;
+
+        ac.command_index = e_cmd::channel_set_priority;
+        ac.set_valuei.resource_index = channel_index;
+        ac.set_valuei.value = (s32)priority;
+
+        put_cmd(ac);
+    }
+
+    void audio_channel_set_distance(const u32 channel_index, const f32 distance)
+    {
+        audio_cmd ac;
+
+        ac.command_index = e_cmd::channel_set_distance;
+        ac.set_valuef.resource_index = channel_index;
+        ac.set_valuef.value = distance;
+
+        put_cmd(ac);
+    }
+
+    void audio_set_voice_params(const audio_voice_params& params)
+    {
+        audio_cmd ac;
+
+        ac.command_index = e_cmd::set_voice_params;
+        ac.voice_params = (audio_voice_params*)pen::memory_alloc(sizeof(audio_voice_params));
+        memcpy(ac.voice_params, &params, sizeof(audio_voice_params));
+
+        put_cmd(ac);
+    }
+
+    pen_error audio_channel_get_voice_state(const u32 channel_index, audio_voice_state* state)
+    {
+        if (channel_index >= _voice_states._capacity[_voice_states._fb])
+            return PEN_ERR_NOT_READY;
+
+        *state = _voice_states.frontbuffer()[channel_index];
+
+        return PEN_ERR_OK;
+    }
+
+    void audio_get_stats(audio_stats* stats)
+    {
+        *stats = _voice_stats.frontbuffer();
+
+        stats->cmd_capacity = k_cmd_capacity;
+        stats->cmds_last_frame = _cmds_last_frame;
+        stats->cmds_peak = _cmds_peak;
+        stats->cmds_dropped = _cmds_dropped;
+    }
+
+    void audio_memory_sink_write(void* user_data, const f32* frames, u32 num_frames)
+    {
+        audio_memory_sink* sink = (audio_memory_sink*)user_data;
+        sink->frames_written += num_frames;
+
+        if (!sink->buffer || sink->capacity_frames == 0)
+            return;
+
+        // only the most recent capacity_frames can be kept
+        if (num_frames > sink->capacity_frames)
+        {
+            frames += (num_frames - sink->capacity_frames) * 2;
+            num_frames = sink->capacity_frames;
+        }
+
+        while (num_frames > 0)
+        {
+            u32 n = std::min<u32>(num_frames, sink->capacity_frames - sink->write_frame);
+            memcpy(sink->buffer + sink->write_frame * 2, frames, n * 2 * sizeof(f32));
+
+            sink->write_frame = (sink->write_frame + n) % sink->capacity_frames;
+            frames += n * 2;
+            num_frames -= n;
+        }
     }
 } // namespace put
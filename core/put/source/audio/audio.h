@@ -11,12 +11,17 @@
 namespace put
 {
     // Simple C-Style generic audio API wrapper
-    // Currently implementation is in fmod.
+    // Implemented with fmod, or the built in software mixer when built with PEN_AUDIO_SOFTWARE (premake --audio=software).
 
     // Public API used by the user thread will store function call arguments in a command buffer
     // Dedicated thread will wait on a semaphore until audio_consume_command_buffer is called
     // command buffer will be consumed passing arguments to the direct:: functions.
 
+    // Channels are voices owned by the voice manager on the audio thread. Only the most important max_real_voices
+    // have a platform channel, the rest are virtual and keep tracking their position until they are promoted again.
+    // audio_channel_get_state reports the platform channel, which is released as soon as a voice stops, finishes or is
+    // made virtual. use audio_channel_get_voice_state to check play state and position.
+
     namespace e_audio_play_state
     {
         enum audio_play_state_t
@@ -72,8 +77,78 @@ namespace put
         f32* spectrum[32];
     };
 
-    // Threading
+    struct audio_voice_params
+    {
+        u32 max_real_voices = 32;
+        f32 min_distance = 1.0f;        // attenuation is 1 inside min_distance then falls off with min / distance
+        f32 max_distance = 100.0f;      // inaudible beyond
+        f32 audible_threshold = 0.001f; // quieter voices stay virtual even when there is budget
+    };
+
+    struct audio_voice_state
+    {
+        u32  play_state;
+        u32  position_ms;
+        f32  audibility; // volume * distance attenuation
+        bool real;
+    };
+
+    struct audio_stats
+    {
+        u32 cmd_capacity;
+        u32 cmds_last_frame;
+        u32 cmds_peak;
+        u32 cmds_dropped; // commands put while the ring was full, each one discards the commands still queued
+        u32 max_real_voices;
+        u32 num_voices;
+        u32 num_real_voices;
+        u32 num_virtual_voices;
+        u32 promotions; // last update
+        u32 demotions;
+    };
+
+    // Software mixer output is interleaved stereo float32 handed to a sink once per mixed block.
+    // frames_per_update 0 mixes in step with the clock, otherwise each update mixes that many frames as fast as it can.
+    typedef void (*audio_sink_write_func)(void* user_data, const f32* frames, u32 num_frames);
 
+    struct audio_sink
+    {
+        audio_sink_write_func write = nullptr;
+        void*                 user_data = nullptr;
+        u32                   sample_rate = 48000;
+        u32                   frames_per_update = 0;
+    };
+
+    // null sink, keeps the last capacity_frames in a ring or discards everything when buffer is null
+    struct audio_memory_sink
+    {
+        f32* buffer = nullptr;
+        u32  capacity_frames = 0;
+        u32  write_frame = 0;
+        u64  frames_written = 0;
+    };
+
+    struct audio_mixer_stats
+    {
+        u32 sample_rate;
+        u32 block_frames;
+        u32 active_voices;
+        u32 peak_voices;
+        u64 frames_mixed;
+        u64 voice_frames_mixed;
+        f64 mix_ms;
+        f64 voices_per_core; // voices a single core could keep mixing in real time at the measured cost
+
+        // resident memory, sounds are decoded once into a shared cache and streams only keep a small decoded ring
+        u32 num_cached_sounds;
+        u32 num_streams;
+        u64 sample_cache_bytes;
+        u64 stream_buffer_bytes;
+        u64 stream_file_bytes; // compressed data mapped for streams, paged in by the os as it is read
+        u64 stream_underrun_frames;
+    };
+
+    // Threading
     void* audio_thread_function(void* params);
     void  audio_consume_command_buffer();
 
@@ -93,6 +168,9 @@ namespace put
     void audio_channel_set_position(const u32 channel_index, const u32 position_ms);
     void audio_channel_set_frequency(const u32 channel_index, const f32 frequency);
     void audio_channel_stop(const u32 channel_index);
+    void audio_channel_set_volume(const u32 channel_index, const f32 volume);
+    void audio_channel_set_priority(const u32 channel_index, const u32 priority); // higher priorities are real first
+    void audio_channel_set_distance(const u32 channel_index, const f32 distance);
 
     void audio_group_set_pause(const u32 group_index, const bool val);
     void audio_group_set_mute(const u32 group_index, const bool val);
@@ -102,6 +180,8 @@ namespace put
     void audio_dsp_set_three_band_eq(const u32 eq_index, const f32 low, const f32 med, const f32 high);
     void audio_dsp_set_gain(const u32 dsp_index, const f32 gain);
 
+    void audio_set_voice_params(const audio_voice_params& params);
+
     // Accessors
     pen_error audio_channel_get_state(const u32 channel_index, audio_channel_state* state);
     pen_error audio_channel_get_sound_file_info(const u32 sound_index, audio_sound_file_info* info);
@@ -109,6 +189,13 @@ namespace put
     pen_error audio_dsp_get_spectrum(const u32 spectrum_dsp, audio_fft_spectrum* spectrum);
     pen_error audio_dsp_get_three_band_eq(const u32 eq_dsp, audio_eq_state* eq_state);
     pen_error audio_dsp_get_gain(const u32 dsp_index, f32* gain);
+    pen_error audio_channel_get_voice_state(const u32 channel_index, audio_voice_state* state);
+    void      audio_get_stats(audio_stats* stats);
+
+    // Software mixer, set the sink before creating the audio thread. fmod ignores the sink and has no stats.
+    void      audio_set_sink(const audio_sink& sink);
+    void      audio_memory_sink_write(void* user_data, const f32* frames, u32 num_frames);
+    pen_error audio_get_mixer_stats(audio_mixer_stats* stats);
 
     namespace direct
     {
@@ -135,6 +222,7 @@ namespace put
         void audio_channel_set_position(const u32 channel_index, const u32 position_ms);
         void audio_channel_set_frequency(const u32 channel_index, const f32 frequency);
         void audio_channel_stop(const u32 channel_index);
+        void audio_channel_set_volume(const u32 channel_index, const f32 volume);
 
         void audio_group_set_pause(const u32 group_index, const bool val);
         void audio_group_set_mute(const u32 group_index, const bool val);
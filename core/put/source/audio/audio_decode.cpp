@@ -0,0 +1,263 @@
+// audio_decode.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "audio_decode.h"
+
+#include "console.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace put;
+
+namespace
+{
+    const u16 k_wav_pcm = 1;
+    const u16 k_wav_float = 3;
+    const u16 k_wav_ima_adpcm = 0x11;
+
+    const s32 k_ima_index[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+    const s32 k_ima_step[89] = {
+        7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+        31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+        130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+        544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+        2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+        9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+    struct ima_channel
+    {
+        s32 predictor;
+        s32 index;
+    };
+
+    f32 ima_nibble(ima_channel& ch, u8 nibble)
+    {
+        s32 step = k_ima_step[ch.index];
+        s32 diff = step >> 3;
+
+        if (nibble & 1)
+            diff += step >> 2;
+        if (nibble & 2)
+            diff += step >> 1;
+        if (nibble & 4)
+            diff += step;
+
+        ch.predictor += (nibble & 8) ? -diff : diff;
+        ch.predictor = std::max(std::min(ch.predictor, 32767), -32768);
+        ch.index = std::max(std::min(ch.index + k_ima_index[nibble], 88), 0);
+
+        return (f32)ch.predictor / 32768.0f;
+    }
+
+    // blocks start with a predictor and step index per channel, followed by groups of 4 bytes per channel holding
+    // 8 nibbles each, low nibble first
+    void decode_ima_block(audio_decoder& dec, u32 block_index)
+    {
+        const u8* src = dec.data + block_index * dec.block_align;
+        u32       bytes = std::min(dec.block_align, dec.data_size - block_index * dec.block_align);
+        u32       nc = dec.num_channels;
+
+        memset(dec.block, 0x0, dec.frames_per_block * nc * sizeof(f32));
+
+        ima_channel ch[2];
+        for (u32 c = 0; c < nc; ++c)
+        {
+            s16 predictor;
+            memcpy(&predictor, src + c * 4, 2);
+
+            ch[c].predictor = predictor;
+            ch[c].index = std::min<s32>(src[c * 4 + 2], 88);
+            dec.block[c] = (f32)predictor / 32768.0f;
+        }
+
+        const u8* end = src + bytes;
+        src += nc * 4;
+
+        u32 frame = 1;
+        while (frame < dec.frames_per_block && src + nc * 4 <= end)
+        {
+            for (u32 c = 0; c < nc; ++c)
+            {
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    u8  b = src[c * 4 + i];
+                    u32 f = frame + i * 2;
+
+                    f32 lo = ima_nibble(ch[c], b & 0xf);
+                    f32 hi = ima_nibble(ch[c], b >> 4);
+
+                    if (f < dec.frames_per_block)
+                        dec.block[f * nc + c] = lo;
+                    if (f + 1 < dec.frames_per_block)
+                        dec.block[(f + 1) * nc + c] = hi;
+                }
+            }
+
+            src += nc * 4;
+            frame += 8;
+        }
+
+        dec.cached_block = (s32)block_index;
+    }
+} // namespace
+
+namespace put
+{
+    pen_error audio_decoder_open(audio_decoder& dec, const void* file_data, size_t file_size)
+    {
+        dec = audio_decoder();
+
+        const u8* data = (const u8*)file_data;
+        if (!data || file_size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+            return PEN_ERR_FAILED;
+
+        u32 size = (u32)std::min<size_t>(file_size, 0xffffffff);
+
+        u16 format = 0;
+        u16 channels = 0;
+        u16 bits = 0;
+        u16 samples_per_block = 0;
+        u32 fact_frames = 0;
+
+        u32 pos = 12;
+        while (pos + 8 <= size)
+        {
+            u32 chunk_size = 0;
+            memcpy(&chunk_size, data + pos + 4, 4);
+
+            const u8* chunk = data + pos + 8;
+            chunk_size = std::min(chunk_size, size - pos - 8);
+
+            if (memcmp(data + pos, "fmt ", 4) == 0 && chunk_size >= 16)
+            {
+                u16 block_align = 0;
+                memcpy(&format, chunk, 2);
+                memcpy(&channels, chunk + 2, 2);
+                memcpy(&dec.sample_rate, chunk + 4, 4);
+                memcpy(&block_align, chunk + 12, 2);
+                memcpy(&bits, chunk + 14, 2);
+                dec.block_align = block_align;
+
+                if (chunk_size >= 20)
+                    memcpy(&samples_per_block, chunk + 18, 2);
+            }
+            else if (memcmp(data + pos, "fact", 4) == 0 && chunk_size >= 4)
+            {
+                memcpy(&fact_frames, chunk, 4);
+            }
+            else if (memcmp(data + pos, "data", 4) == 0)
+            {
+                dec.data = chunk;
+                dec.data_size = chunk_size;
+            }
+
+            pos += 8 + chunk_size + (chunk_size & 1);
+        }
+
+        if (!dec.data || channels == 0 || channels > 2 || dec.sample_rate == 0)
+            return PEN_ERR_FAILED;
+
+        dec.num_channels = channels;
+
+        if (format == k_wav_pcm && bits == 16)
+        {
+            dec.format = e_audio_format::pcm16;
+            dec.num_frames = dec.data_size / (2 * channels);
+        }
+        else if (format == k_wav_float && bits == 32)
+        {
+            dec.format = e_audio_format::float32;
+            dec.num_frames = dec.data_size / (4 * channels);
+        }
+        else if (format == k_wav_ima_adpcm && bits == 4 && dec.block_align > 4 * channels)
+        {
+            dec.format = e_audio_format::ima_adpcm;
+            dec.frames_per_block = (dec.block_align - 4 * channels) * 2 / channels + 1;
+            if (samples_per_block > 0)
+                dec.frames_per_block = std::min<u32>(samples_per_block, dec.frames_per_block);
+
+            // the last block may be partial, the fact chunk holds the exact length when present
+            u32 full = dec.data_size / dec.block_align;
+            u32 rem = dec.data_size % dec.block_align;
+
+            dec.num_frames = full * dec.frames_per_block;
+            if (rem > 4 * channels)
+                dec.num_frames += std::min((rem - 4 * channels) * 2 / channels + 1, dec.frames_per_block);
+
+            if (fact_frames > 0)
+                dec.num_frames = std::min(dec.num_frames, fact_frames);
+
+            dec.block = (f32*)pen::memory_alloc(dec.frames_per_block * channels * sizeof(f32));
+        }
+        else
+        {
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_OK;
+    }
+
+    void audio_decoder_close(audio_decoder& dec)
+    {
+        pen::memory_free(dec.block);
+        dec = audio_decoder();
+    }
+
+    void audio_decoder_seek(audio_decoder& dec, u32 frame)
+    {
+        dec.cursor = std::min(frame, dec.num_frames);
+    }
+
+    u32 audio_decoder_read(audio_decoder& dec, f32* out, u32 num_frames)
+    {
+        u32 nc = dec.num_channels;
+        u32 n = std::min(num_frames, dec.num_frames - dec.cursor);
+
+        switch (dec.format)
+        {
+            case e_audio_format::pcm16:
+            {
+                const u8* src = dec.data + dec.cursor * nc * 2;
+                for (u32 i = 0; i < n * nc; ++i)
+                {
+                    s16 s;
+                    memcpy(&s, src + i * 2, 2);
+                    out[i] = (f32)s / 32768.0f;
+                }
+            }
+            break;
+
+            case e_audio_format::float32:
+            {
+                memcpy(out, dec.data + dec.cursor * nc * 4, n * nc * sizeof(f32));
+            }
+            break;
+
+            case e_audio_format::ima_adpcm:
+            {
+                u32 written = 0;
+                while (written < n)
+                {
+                    u32 frame = dec.cursor + written;
+                    u32 block = frame / dec.frames_per_block;
+                    u32 offset = frame % dec.frames_per_block;
+
+                    if ((s32)block != dec.cached_block)
+                        decode_ima_block(dec, block);
+
+                    u32 count = std::min(n - written, dec.frames_per_block - offset);
+                    memcpy(out + written * nc, dec.block + offset * nc, count * nc * sizeof(f32));
+                    written += count;
+                }
+            }
+            break;
+        }
+
+        dec.cursor += n;
+        return n;
+    }
+} // namespace put
@@ -0,0 +1,52 @@
+// audio_decode.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#ifndef _audio_decode_h
+#define _audio_decode_h
+
+#include "pen.h"
+
+namespace put
+{
+    // Incremental wav decoder used by the software mixer, decodes 16 bit pcm, 32 bit float and ima adpcm to
+    // interleaved float32. The decoder reads from memory it does not own, so a mapped file can be streamed in small
+    // pieces and only the compressed data and a single adpcm block need to be resident.
+
+    namespace e_audio_format
+    {
+        enum audio_format_t
+        {
+            pcm16,
+            float32,
+            ima_adpcm
+        };
+    }
+    typedef e_audio_format::audio_format_t audio_format;
+
+    struct audio_decoder
+    {
+        const u8*    data = nullptr; // start of the wav data chunk
+        u32          data_size = 0;
+        audio_format format = e_audio_format::pcm16;
+        u32          num_channels = 0;
+        u32          sample_rate = 0;
+        u32          num_frames = 0;
+        u32          block_align = 0;
+        u32          frames_per_block = 1;
+        u32          cursor = 0;      // next frame read returns
+        f32*         block = nullptr; // decoded adpcm block
+        s32          cached_block = -1;
+    };
+
+    // file_data must outlive the decoder, returns PEN_ERR_FAILED for anything but mono or stereo pcm16, float32 or
+    // ima adpcm wav.
+    pen_error audio_decoder_open(audio_decoder& dec, const void* file_data, size_t file_size);
+    void      audio_decoder_close(audio_decoder& dec);
+    void      audio_decoder_seek(audio_decoder& dec, u32 frame);
+
+    // decodes up to num_frames from the cursor into out, returns frames written which is short at the end of the data
+    u32 audio_decoder_read(audio_decoder& dec, f32* out, u32 num_frames);
+} // namespace put
+
+#endif
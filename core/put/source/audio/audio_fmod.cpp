@@ -2,6 +2,8 @@
 // Copyright 2014 - 2019 Alex Dixon.
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
+#ifndef PEN_AUDIO_SOFTWARE
+
 #include "audio.h"
 
 #include "console.h"
@@ -379,6 +381,13 @@ namespace put
         p_chan->stop();
     }
 
+    void direct::audio_channel_set_volume(const u32 channel_index, const f32 volume)
+    {
+        FMOD::Channel* p_chan = (FMOD::Channel*)_audio_resources[channel_index].resource;
+
+        p_chan->setVolume(volume);
+    }
+
     void direct::audio_group_set_pause(const u32 group_index, const bool val)
     {
         FMOD::ChannelGroup* p_group = (FMOD::ChannelGroup*)_audio_resources[group_index].resource;
@@ -645,4 +654,16 @@ namespace put
 
         return PEN_ERR_NOT_READY;
     }
+
+    void audio_set_sink(const audio_sink& sink)
+    {
+        // fmod owns the output device
+    }
+
+    pen_error audio_get_mixer_stats(audio_mixer_stats* stats)
+    {
+        return PEN_ERR_FAILED;
+    }
 } // namespace put
+
+#endif
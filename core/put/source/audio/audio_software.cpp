@@ -0,0 +1,1695 @@
+// audio_software.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Software mixer implementation of the direct:: audio api, built instead of fmod with PEN_AUDIO_SOFTWARE.
+// Voices are mixed in fixed blocks of interleaved stereo float32 into their group bus, groups run their dsp chain and
+// sum into the master bus which is handed to the sink. No device is opened here, the default sink discards the output.
+// Sounds loaded from file are decoded once into a reference counted sample cache shared by every sound of that file.
+// Streams map the file and a decode worker keeps a small ring of decoded frames ahead of the mixer, so only the
+// compressed data and the ring are resident.
+
+#ifdef PEN_AUDIO_SOFTWARE
+
+#include "audio.h"
+#include "audio_decode.h"
+
+#include "console.h"
+#include "data_struct.h"
+#include "file_system.h"
+#include "hash.h"
+#include "memory.h"
+#include "os.h"
+#include "threads.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if __SSE2__ || __AVX2__ || __AVX__
+#include <immintrin.h>
+#include <xmmintrin.h>
+#endif
+
+using namespace put;
+
+namespace
+{
+    const u32 k_block_frames = 256;
+    const u32 k_max_group_dsp = 8;
+    const u32 k_fft_size = 2048; // window size, the spectrum has half as many bins
+    const u32 k_fft_bins = k_fft_size / 2;
+    const f32 k_eq_low_hz = 400.0f; // crossovers match the fmod three eq defaults
+    const f32 k_eq_high_hz = 4000.0f;
+    const f32 k_min_db = -80.0f;
+    const f32 k_max_db = 10.0f;
+    const f64 k_max_catch_up_ms = 250.0;
+    const f32 k_pi = 3.14159265358979f;
+    const u32 k_stream_ring_frames = 16384; // ~340ms at 48khz, must be a power of 2
+    const u32 k_stream_refill_frames = k_stream_ring_frames / 4;
+    const u32 k_stream_poll_ms = 5;
+
+    enum audio_resource_type : s32
+    {
+        AUDIO_RESOURCE_VIRTUAL,
+        AUDIO_RESOURCE_SOUND,
+        AUDIO_RESOURCE_CHANNEL,
+        AUDIO_RESOURCE_GROUP,
+        AUDIO_RESOURCE_DSP_FFT,
+        AUDIO_RESOURCE_DSP_EQ,
+        AUDIO_RESOURCE_DSP_GAIN,
+        AUDIO_RESOURCE_DSP
+    };
+
+    struct cached_sample
+    {
+        hash_id hash;
+        f32*    pcm;
+        u32     num_frames;
+        u32     num_channels;
+        f32     sample_rate;
+        u32     ref_count;
+    };
+
+    // frames are counted along the looped timeline, the ring holds [read_frame, write_frame) and voice positions on
+    // streams are timeline frames
+    struct stream
+    {
+        const void*      file_data; // mapped
+        size_t           file_size;
+        audio_decoder    decoder;
+        f32*             ring;
+        std::atomic<u64> write_frame; // advanced by the decode worker
+        std::atomic<u64> read_frame;  // advanced by the mixer
+        std::atomic<u32> ended;       // the decoder stopped producing frames, the voice stops once the ring drains
+        u32              voice;       // a stream feeds one channel at a time, as with fmod
+    };
+
+    struct sound
+    {
+        f32*      pcm; // interleaved mono or stereo, null for streams
+        u32       num_frames;
+        u32       num_channels;
+        f32       sample_rate;
+        s32       cache_entry; // loaded from file, music files are mixed from in place and have no entry
+        ::stream* stream;
+        bool      loop;
+    };
+
+    struct voice
+    {
+        u32  sound;
+        u32  group;
+        f64  position; // in source frames
+        f32  frequency;
+        f32  volume;
+        bool playing;
+    };
+
+    struct group
+    {
+        f32* bus;
+        f32  volume;
+        f32  pitch;
+        u32  dsp[k_max_group_dsp];
+        u32  num_dsp;
+        u32  num_playing;
+        bool paused;
+        bool muted;
+    };
+
+    struct eq_dsp
+    {
+        f32 gain_db[3];
+        f32 low[2]; // one pole filter state per channel
+        f32 high[2];
+    };
+
+    struct fft_dsp
+    {
+        f32*               history; // ring of the last k_fft_size stereo frames
+        u32                write_frame;
+        f32*               bins[2];
+        audio_fft_spectrum spectrum[2];
+    };
+
+    struct audio_resource_allocation
+    {
+        audio_resource_type type;
+
+        std::atomic<u8> assigned_flag;
+
+        union {
+            ::sound   sound;
+            ::voice   voice;
+            ::group   group;
+            ::eq_dsp  eq;
+            ::fft_dsp fft;
+            f32       gain_db;
+        };
+    };
+
+    struct resource_state
+    {
+        union {
+            audio_channel_state channel_state;
+            audio_group_state   group_state;
+            audio_fft_spectrum* fft_spectrum;
+            audio_eq_state      eq_state;
+            f32                 gain_value;
+        };
+    };
+
+    struct mixer
+    {
+        audio_sink        sink;
+        audio_memory_sink null_sink;
+        f32*              master;
+        f32*              scratch;
+        f32*              stream_scratch; // stream frames for one block, unwrapped from the ring
+        f32               eq_coeff[2];
+        f64               last_update_ms;
+        f64               carry_frames;
+        u32               parity;
+
+        // fft tables
+        f32* window;
+        f32* twiddle_re;
+        f32* twiddle_im;
+        f32* fft_re;
+        f32* fft_im;
+        u32* bit_reverse;
+    };
+
+    mixer                                      _mixer;
+    pen::res_pool<audio_resource_allocation>   _audio_resources;
+    pen::multi_array_buffer<resource_state, 2> _resource_states;
+    pen::res_pool<std::atomic<bool>>           _sound_file_info_ready;
+    pen::res_pool<audio_sound_file_info>       _sound_file_info;
+    pen::multi_buffer<audio_mixer_stats, 2>    _stats;
+    audio_mixer_stats                          _totals;
+    cached_sample*                             _sample_cache = nullptr;
+
+    struct stream_worker
+    {
+        pen::job*        job;
+        pen::mutex*      mutex; // guards the stream list and decoders, the mixer reads the rings without it
+        stream**         streams;
+        stream**         pending;
+        std::atomic<u32> shutdown;
+        std::atomic<u32> exited;
+    };
+    stream_worker _worker;
+
+    f32* alloc_block()
+    {
+        f32* block = (f32*)pen::memory_alloc_align(k_block_frames * 2 * sizeof(f32), 16);
+        memset(block, 0x0, k_block_frames * 2 * sizeof(f32));
+        return block;
+    }
+
+    f32 db_to_linear(f32 db)
+    {
+        db = std::max(std::min(db, k_max_db), k_min_db);
+        if (db <= k_min_db)
+            return 0.0f;
+
+        return powf(10.0f, db / 20.0f);
+    }
+
+    bool is_type(u32 index, audio_resource_type type)
+    {
+        if (index == 0 || index >= _audio_resources._capacity)
+            return false;
+
+        return _audio_resources[index].assigned_flag && _audio_resources[index].type == type;
+    }
+
+    void assign(u32 resource_slot, audio_resource_type type)
+    {
+        _audio_resources.grow(resource_slot);
+        _sound_file_info.grow(resource_slot);
+        _sound_file_info_ready.grow(resource_slot);
+
+        _audio_resources[resource_slot].assigned_flag |= 0xff;
+        _audio_resources[resource_slot].type = type;
+    }
+
+    // block kernels, all buffers are interleaved stereo unless stated
+
+    void mix_stereo(f32* out, const f32* in, u32 num_frames, f32 gain)
+    {
+        u32 n = num_frames * 2;
+        u32 i = 0;
+
+#if __SSE2__ || __AVX2__ || __AVX__
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 o = _mm_loadu_ps(out + i);
+            _mm_storeu_ps(out + i, _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(in + i), g)));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] += in[i] * gain;
+    }
+
+    // in is mono, duplicated into both output channels
+    void mix_mono(f32* out, const f32* in, u32 num_frames, f32 gain)
+    {
+        u32 i = 0;
+
+#if __SSE2__ || __AVX2__ || __AVX__
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= num_frames; i += 4)
+        {
+            __m128 m = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+            f32*   o = out + i * 2;
+
+            _mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(m, m)));
+            _mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(m, m)));
+        }
+#endif
+        for (; i < num_frames; ++i)
+        {
+            out[i * 2 + 0] += in[i] * gain;
+            out[i * 2 + 1] += in[i] * gain;
+        }
+    }
+
+    void scale_block(f32* buf, f32 gain)
+    {
+        u32 i = 0;
+
+#if __SSE2__ || __AVX2__ || __AVX__
+        __m128 g = _mm_set1_ps(gain);
+        for (; i < k_block_frames * 2; i += 4)
+            _mm_store_ps(buf + i, _mm_mul_ps(_mm_load_ps(buf + i), g));
+#endif
+        for (; i < k_block_frames * 2; ++i)
+            buf[i] *= gain;
+    }
+
+    void clamp_block(f32* buf)
+    {
+        u32 i = 0;
+
+#if __SSE2__ || __AVX2__ || __AVX__
+        __m128 lo = _mm_set1_ps(-1.0f);
+        __m128 hi = _mm_set1_ps(1.0f);
+        for (; i < k_block_frames * 2; i += 4)
+            _mm_store_ps(buf + i, _mm_min_ps(_mm_max_ps(_mm_load_ps(buf + i), lo), hi));
+#endif
+        for (; i < k_block_frames * 2; ++i)
+            buf[i] = std::max(std::min(buf[i], 1.0f), -1.0f);
+    }
+
+    // linearly interpolates the voice into scratch at step source frames per output frame, returns frames written
+    // which is short when a one shot sound ends.
+    u32 resample_voice(voice& v, const sound& s, f32* out, u32 num_frames, f64 step)
+    {
+        u32 ch1 = s.num_channels > 1 ? 1 : 0;
+
+        for (u32 i = 0; i < num_frames; ++i)
+        {
+            if (v.position >= (f64)s.num_frames)
+            {
+                if (!s.loop)
+                    return i;
+
+                v.position = fmod(v.position, (f64)s.num_frames);
+            }
+
+            u32 i0 = (u32)v.position;
+            u32 i1 = i0 + 1;
+            if (i1 >= s.num_frames)
+                i1 = s.loop ? 0 : i0;
+
+            f32        t = (f32)(v.position - (f64)i0);
+            const f32* a = s.pcm + i0 * s.num_channels;
+            const f32* b = s.pcm + i1 * s.num_channels;
+
+            out[i * 2 + 0] = a[0] + (b[0] - a[0]) * t;
+            out[i * 2 + 1] = a[ch1] + (b[ch1] - a[ch1]) * t;
+
+            v.position += step;
+        }
+
+        return num_frames;
+    }
+
+    // mixes a block of s into bus, returns frames mixed which is short when a one shot sound ends
+    u32 mix_pcm(voice& v, const sound& s, f32* bus, f64 step, f32 gain)
+    {
+        u32 frames = k_block_frames;
+        u32 offset = 0;
+
+        // unit rate from a whole frame reads straight from the source
+        if (step == 1.0 && v.position == floor(v.position))
+        {
+            while (frames > 0)
+            {
+                u32 pos = (u32)v.position;
+                if (pos >= s.num_frames)
+                {
+                    if (!s.loop)
+                    {
+                        v.playing = false;
+                        break;
+                    }
+
+                    pos = 0;
+                }
+
+                u32        n = std::min(frames, s.num_frames - pos);
+                const f32* src = s.pcm + pos * s.num_channels;
+
+                if (gain != 0.0f)
+                {
+                    if (s.num_channels == 1)
+                        mix_mono(bus + offset * 2, src, n, gain);
+                    else
+                        mix_stereo(bus + offset * 2, src, n, gain);
+                }
+
+                v.position = (f64)(pos + n);
+                offset += n;
+                frames -= n;
+            }
+
+            return offset;
+        }
+
+        u32 n = resample_voice(v, s, _mixer.scratch, frames, step);
+        if (n < frames)
+            v.playing = false;
+
+        if (gain != 0.0f)
+            mix_stereo(bus, _mixer.scratch, n, gain);
+
+        return n;
+    }
+
+    // unwraps the decoded frames the block needs from the ring and mixes them as a one shot sound. frames the worker
+    // has not decoded yet are silent, the voice holds its position and continues once they arrive.
+    void mix_stream(voice& v, const sound& s, f32* bus, f64 step, f32 gain)
+    {
+        stream& st = *s.stream;
+        u32     nc = s.num_channels;
+        u64     base = (u64)v.position;
+        u64     write = st.write_frame;
+
+        u32 needed = (u32)ceil((v.position - (f64)base) + step * (f64)k_block_frames) + 2;
+        needed = std::min(needed, k_stream_ring_frames);
+
+        u32 available = write > base ? (u32)std::min<u64>(write - base, needed) : 0;
+
+        // an ended stream plays out what was decoded and then stops, rather than counting silence as underruns
+        if (available == 0 && st.ended)
+        {
+            v.playing = false;
+            return;
+        }
+        u32 ring_pos = (u32)(base & (k_stream_ring_frames - 1));
+        u32 first = std::min(available, k_stream_ring_frames - ring_pos);
+
+        memcpy(_mixer.stream_scratch, st.ring + ring_pos * nc, first * nc * sizeof(f32));
+        memcpy(_mixer.stream_scratch + first * nc, st.ring, (available - first) * nc * sizeof(f32));
+
+        sound view = s;
+        view.pcm = _mixer.stream_scratch;
+        view.num_frames = available;
+        view.stream = nullptr;
+        view.loop = false;
+
+        voice local = v;
+        local.position = v.position - (f64)base;
+
+        u32 n = available > 0 ? mix_pcm(local, view, bus, step, gain) : 0;
+        if (n < k_block_frames)
+            _totals.stream_underrun_frames += k_block_frames - n;
+
+        v.position = (f64)base + local.position;
+        st.read_frame = (u64)v.position;
+    }
+
+    // returns true if the voice contributed to the block
+    bool mix_voice(voice& v, u32 voice_index, f32* bus, f64 step, bool silent)
+    {
+        if (!is_type(v.sound, AUDIO_RESOURCE_SOUND))
+        {
+            v.playing = false;
+            return false;
+        }
+
+        const sound& s = _audio_resources[v.sound].sound;
+        if (s.num_frames == 0 || (s.stream && s.stream->voice != voice_index))
+        {
+            v.playing = false;
+            return false;
+        }
+
+        f32 gain = silent ? 0.0f : v.volume;
+
+        if (s.stream)
+            mix_stream(v, s, bus, step, gain);
+        else
+            mix_pcm(v, s, bus, step, gain);
+
+        return true;
+    }
+
+    void process_eq(eq_dsp& eq, f32* buf)
+    {
+        f32 g[3];
+        for (u32 i = 0; i < 3; ++i)
+            g[i] = db_to_linear(eq.gain_db[i]);
+
+        const f32 cl = _mixer.eq_coeff[0];
+        const f32 ch = _mixer.eq_coeff[1];
+
+        for (u32 c = 0; c < 2; ++c)
+        {
+            f32 low = eq.low[c];
+            f32 high = eq.high[c];
+
+            for (u32 i = 0; i < k_block_frames; ++i)
+            {
+                f32 x = buf[i * 2 + c];
+                low += cl * (x - low);
+                high += ch * (x - high);
+
+                buf[i * 2 + c] = low * g[0] + (high - low) * g[1] + (x - high) * g[2];
+            }
+
+            eq.low[c] = low;
+            eq.high[c] = high;
+        }
+    }
+
+    void process_fft_history(fft_dsp& fft, const f32* buf)
+    {
+        u32 n = std::min(k_block_frames, k_fft_size - fft.write_frame);
+        memcpy(fft.history + fft.write_frame * 2, buf, n * 2 * sizeof(f32));
+        memcpy(fft.history, buf + n * 2, (k_block_frames - n) * 2 * sizeof(f32));
+
+        fft.write_frame = (fft.write_frame + k_block_frames) % k_fft_size;
+    }
+
+    void mix_block()
+    {
+        u32 num_res = (u32)_audio_resources._capacity;
+        memset(_mixer.master, 0x0, k_block_frames * 2 * sizeof(f32));
+
+        for (u32 i = 1; i < num_res; ++i)
+            if (is_type(i, AUDIO_RESOURCE_GROUP))
+                memset(_audio_resources[i].group.bus, 0x0, k_block_frames * 2 * sizeof(f32));
+
+        // voices
+        u32 active = 0;
+        f64 out_rate = (f64)_mixer.sink.sample_rate;
+        for (u32 i = 1; i < num_res; ++i)
+        {
+            if (!is_type(i, AUDIO_RESOURCE_CHANNEL))
+                continue;
+
+            voice& v = _audio_resources[i].voice;
+            if (!v.playing)
+                continue;
+
+            f32* bus = _mixer.master;
+            f32  pitch = 1.0f;
+            bool silent = false;
+
+            if (is_type(v.group, AUDIO_RESOURCE_GROUP))
+            {
+                group& g = _audio_resources[v.group].group;
+                if (g.paused)
+                    continue;
+
+                bus = g.bus;
+                pitch = g.pitch;
+                silent = g.muted;
+            }
+
+            if (mix_voice(v, i, bus, (f64)v.frequency * pitch / out_rate, silent))
+                ++active;
+        }
+
+        // groups run their dsp chain then sum into the master bus
+        for (u32 i = 1; i < num_res; ++i)
+        {
+            if (!is_type(i, AUDIO_RESOURCE_GROUP))
+                continue;
+
+            group& g = _audio_resources[i].group;
+            if (g.paused)
+                continue;
+
+            for (u32 d = 0; d < g.num_dsp; ++d)
+            {
+                u32 di = g.dsp[d];
+                if (!_audio_resources[di].assigned_flag)
+                    continue;
+
+                switch (_audio_resources[di].type)
+                {
+                    case AUDIO_RESOURCE_DSP_FFT:
+                        process_fft_history(_audio_resources[di].fft, g.bus);
+                        break;
+                    case AUDIO_RESOURCE_DSP_EQ:
+                        process_eq(_audio_resources[di].eq, g.bus);
+                        break;
+                    case AUDIO_RESOURCE_DSP_GAIN:
+                        scale_block(g.bus, db_to_linear(_audio_resources[di].gain_db));
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            if (!g.muted)
+                mix_stereo(_mixer.master, g.bus, k_block_frames, g.volume);
+        }
+
+        clamp_block(_mixer.master);
+        _mixer.sink.write(_mixer.sink.user_data, _mixer.master, k_block_frames);
+
+        _totals.active_voices = active;
+        _totals.peak_voices = std::max(_totals.peak_voices, active);
+        _totals.frames_mixed += k_block_frames;
+        _totals.voice_frames_mixed += (u64)active * k_block_frames;
+    }
+
+    void fft_init()
+    {
+        _mixer.window = (f32*)pen::memory_alloc(k_fft_size * sizeof(f32));
+        _mixer.twiddle_re = (f32*)pen::memory_alloc(k_fft_bins * sizeof(f32));
+        _mixer.twiddle_im = (f32*)pen::memory_alloc(k_fft_bins * sizeof(f32));
+        _mixer.fft_re = (f32*)pen::memory_alloc(k_fft_size * sizeof(f32));
+        _mixer.fft_im = (f32*)pen::memory_alloc(k_fft_size * sizeof(f32));
+        _mixer.bit_reverse = (u32*)pen::memory_alloc(k_fft_size * sizeof(u32));
+
+        // hann window
+        for (u32 i = 0; i < k_fft_size; ++i)
+            _mixer.window[i] = 0.5f - 0.5f * cosf(2.0f * k_pi * (f32)i / (f32)(k_fft_size - 1));
+
+        for (u32 i = 0; i < k_fft_bins; ++i)
+        {
+            _mixer.twiddle_re[i] = cosf(-2.0f * k_pi * (f32)i / (f32)k_fft_size);
+            _mixer.twiddle_im[i] = sinf(-2.0f * k_pi * (f32)i / (f32)k_fft_size);
+        }
+
+        u32 bits = 0;
+        while ((1u << bits) < k_fft_size)
+            ++bits;
+
+        for (u32 i = 0; i < k_fft_size; ++i)
+        {
+            u32 r = 0;
+            for (u32 b = 0; b < bits; ++b)
+                if (i & (1u << b))
+                    r |= 1u << (bits - 1 - b);
+
+            _mixer.bit_reverse[i] = r;
+        }
+    }
+
+    void fft_shutdown()
+    {
+        pen::memory_free(_mixer.window);
+        pen::memory_free(_mixer.twiddle_re);
+        pen::memory_free(_mixer.twiddle_im);
+        pen::memory_free(_mixer.fft_re);
+        pen::memory_free(_mixer.fft_im);
+        pen::memory_free(_mixer.bit_reverse);
+    }
+
+    // windowed radix 2 fft of one channel of the history ring, magnitudes are normalised so a full scale sine is 1
+    void fft_channel(const fft_dsp& fft, u32 channel, f32* bins)
+    {
+        f32* re = _mixer.fft_re;
+        f32* im = _mixer.fft_im;
+
+        for (u32 i = 0; i < k_fft_size; ++i)
+        {
+            u32 src = (fft.write_frame + i) % k_fft_size;
+            u32 dst = _mixer.bit_reverse[i];
+
+            re[dst] = fft.history[src * 2 + channel] * _mixer.window[i];
+            im[dst] = 0.0f;
+        }
+
+        for (u32 size = 2; size <= k_fft_size; size *= 2)
+        {
+            u32 half = size / 2;
+            u32 stride = k_fft_size / size;
+
+            for (u32 start = 0; start < k_fft_size; start += size)
+            {
+                for (u32 k = 0; k < half; ++k)
+                {
+                    f32 wr = _mixer.twiddle_re[k * stride];
+                    f32 wi = _mixer.twiddle_im[k * stride];
+
+                    u32 a = start + k;
+                    u32 b = a + half;
+
+                    f32 tr = re[b] * wr - im[b] * wi;
+                    f32 ti = re[b] * wi + im[b] * wr;
+
+                    re[b] = re[a] - tr;
+                    im[b] = im[a] - ti;
+                    re[a] += tr;
+                    im[a] += ti;
+                }
+            }
+        }
+
+        // hann window has a coherent gain of 0.5
+        f32 norm = 4.0f / (f32)k_fft_size;
+        for (u32 i = 0; i < k_fft_bins; ++i)
+            bins[i] = sqrtf(re[i] * re[i] + im[i] * im[i]) * norm;
+    }
+
+    // sounds of the same file share one decoded copy, returns -1 if the file could not be decoded
+    s32 sample_cache_acquire(const c8* filename)
+    {
+        hash_id hash = PEN_HASH(filename);
+
+        u32 num_entries = sb_count(_sample_cache);
+        for (u32 i = 0; i < num_entries; ++i)
+        {
+            if (_sample_cache[i].ref_count > 0 && _sample_cache[i].hash == hash)
+            {
+                ++_sample_cache[i].ref_count;
+                return (s32)i;
+            }
+        }
+
+        void* file_data = nullptr;
+        u32   file_size = 0;
+        if (pen::filesystem_read_file_to_buffer(filename, &file_data, file_size) != PEN_ERR_OK)
+        {
+            PEN_LOG("[error] audio: failed to read %s", filename);
+            return -1;
+        }
+
+        audio_decoder dec;
+        if (audio_decoder_open(dec, file_data, file_size) != PEN_ERR_OK)
+        {
+            PEN_LOG("[error] audio: %s must be a mono or stereo 16 bit pcm, 32 bit float or ima adpcm wav", filename);
+            pen::memory_free(file_data);
+            return -1;
+        }
+
+        cached_sample cs;
+        cs.hash = hash;
+        cs.num_frames = dec.num_frames;
+        cs.num_channels = dec.num_channels;
+        cs.sample_rate = (f32)dec.sample_rate;
+        cs.ref_count = 1;
+        cs.pcm = (f32*)pen::memory_alloc(cs.num_frames * cs.num_channels * sizeof(f32));
+
+        audio_decoder_read(dec, cs.pcm, cs.num_frames);
+        audio_decoder_close(dec);
+        pen::memory_free(file_data);
+
+        _totals.sample_cache_bytes += (u64)cs.num_frames * cs.num_channels * sizeof(f32);
+        ++_totals.num_cached_sounds;
+
+        // released entries are reused so the indices held by sounds stay valid
+        for (u32 i = 0; i < num_entries; ++i)
+        {
+            if (_sample_cache[i].ref_count == 0)
+            {
+                _sample_cache[i] = cs;
+                return (s32)i;
+            }
+        }
+
+        sb_push(_sample_cache, cs);
+        return (s32)num_entries;
+    }
+
+    void sample_cache_release(s32 entry)
+    {
+        if (entry < 0)
+            return;
+
+        cached_sample& cs = _sample_cache[entry];
+        if (--cs.ref_count > 0)
+            return;
+
+        _totals.sample_cache_bytes -= (u64)cs.num_frames * cs.num_channels * sizeof(f32);
+        --_totals.num_cached_sounds;
+
+        pen::memory_free(cs.pcm);
+        cs.pcm = nullptr;
+    }
+
+    u64 stream_resident_bytes(const stream& st)
+    {
+        u32 nc = st.decoder.num_channels;
+        u32 block_frames = st.decoder.block ? st.decoder.frames_per_block : 0;
+
+        return (u64)(k_stream_ring_frames + block_frames) * nc * sizeof(f32);
+    }
+
+    // decodes into the free part of the ring and loops at the end of the data, the caller holds the worker mutex
+    void stream_refill(stream& st)
+    {
+        u32 nc = st.decoder.num_channels;
+        u64 write = st.write_frame;
+        u32 free_frames = k_stream_ring_frames - (u32)(write - st.read_frame);
+
+        bool rewound = false;
+        while (free_frames > 0 && !st.ended)
+        {
+            u32 ring_pos = (u32)(write & (k_stream_ring_frames - 1));
+            u32 n = std::min(free_frames, k_stream_ring_frames - ring_pos);
+            u32 decoded = audio_decoder_read(st.decoder, st.ring + ring_pos * nc, n);
+
+            if (decoded > 0)
+                rewound = false;
+
+            if (decoded < n)
+            {
+                // data which decodes nothing even from the start would rewind forever while holding the worker mutex
+                if (rewound)
+                {
+                    PEN_LOG("[error] audio: stream decoded no frames after rewinding, stopping it");
+                    st.ended = 1;
+                    break;
+                }
+
+                audio_decoder_seek(st.decoder, 0);
+                rewound = true;
+            }
+
+            write += decoded;
+            free_frames -= decoded;
+            st.write_frame = write;
+        }
+    }
+
+    // seeks are rare and run on the audio thread, the ring is primed before the mixer next reads it
+    void stream_seek(stream& st, u64 frame)
+    {
+        pen::mutex_lock(_worker.mutex);
+
+        audio_decoder_seek(st.decoder, (u32)(frame % st.decoder.num_frames));
+        st.read_frame = frame;
+        st.write_frame = frame;
+        st.ended = 0;
+        stream_refill(st);
+
+        pen::mutex_unlock(_worker.mutex);
+    }
+
+    void refill_streams_job(void* user_data, u32 begin, u32 end)
+    {
+        stream** streams = (stream**)user_data;
+        for (u32 i = begin; i < end; ++i)
+            stream_refill(*streams[i]);
+    }
+
+    // refills every stream with at least min_free frames of space, spread across the job workers
+    void refill_streams(u32 min_free)
+    {
+        pen::mutex_lock(_worker.mutex);
+
+        if (_worker.pending)
+            stb__sbn(_worker.pending) = 0;
+
+        u32 num_streams = sb_count(_worker.streams);
+        for (u32 i = 0; i < num_streams; ++i)
+        {
+            stream* st = _worker.streams[i];
+            if (k_stream_ring_frames - (u32)(st->write_frame - st->read_frame) >= min_free)
+                sb_push(_worker.pending, st);
+        }
+
+        pen::jobs_parallel_for(sb_count(_worker.pending), 1, refill_streams_job, _worker.pending);
+
+        pen::mutex_unlock(_worker.mutex);
+    }
+
+    void* stream_decode_thread(void* params)
+    {
+        pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+        pen::job*               p_thread_info = job_params->job_info;
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+        while (!_worker.shutdown)
+        {
+            refill_streams(k_stream_refill_frames);
+            pen::thread_sleep_ms(k_stream_poll_ms);
+
+            if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+                break;
+        }
+
+        _worker.exited = 1;
+        pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+        return PEN_THREAD_OK;
+    }
+
+    // maps the file and primes the ring, returns null if the file can not be streamed
+    stream* stream_create(const c8* filename)
+    {
+        const void* file_data = nullptr;
+        size_t      file_size = 0;
+        if (pen::filesystem_map_file(filename, &file_data, file_size) != PEN_ERR_OK)
+        {
+            PEN_LOG("[error] audio: failed to map %s", filename);
+            return nullptr;
+        }
+
+        stream* st = new stream();
+        if (audio_decoder_open(st->decoder, file_data, file_size) != PEN_ERR_OK || st->decoder.num_frames == 0)
+        {
+            PEN_LOG("[error] audio: %s must be a mono or stereo 16 bit pcm, 32 bit float or ima adpcm wav", filename);
+            pen::filesystem_unmap_file(file_data, file_size);
+            delete st;
+            return nullptr;
+        }
+
+        st->file_data = file_data;
+        st->file_size = file_size;
+        st->ring = (f32*)pen::memory_alloc(k_stream_ring_frames * st->decoder.num_channels * sizeof(f32));
+        st->write_frame = 0;
+        st->read_frame = 0;
+        st->ended = 0;
+        st->voice = 0;
+
+        pen::mutex_lock(_worker.mutex);
+        stream_refill(*st);
+        sb_push(_worker.streams, st);
+        pen::mutex_unlock(_worker.mutex);
+
+        // offline sinks and single threaded builds refill inline as they mix
+#if !PEN_SINGLE_THREADED
+        if (!_worker.job && _mixer.sink.frames_per_update == 0)
+        {
+            _worker.job =
+                pen::jobs_create_job(stream_decode_thread, 1024 * 1024, nullptr, pen::e_thread_start_flags::detached);
+        }
+#endif
+
+        ++_totals.num_streams;
+        _totals.stream_buffer_bytes += stream_resident_bytes(*st);
+        _totals.stream_file_bytes += file_size;
+
+        return st;
+    }
+
+    void stream_release(stream* st)
+    {
+        pen::mutex_lock(_worker.mutex);
+
+        u32 num_streams = sb_count(_worker.streams);
+        for (u32 i = 0; i < num_streams; ++i)
+        {
+            if (_worker.streams[i] == st)
+            {
+                _worker.streams[i] = _worker.streams[num_streams - 1];
+                --stb__sbn(_worker.streams);
+                break;
+            }
+        }
+
+        pen::mutex_unlock(_worker.mutex);
+
+        --_totals.num_streams;
+        _totals.stream_buffer_bytes -= stream_resident_bytes(*st);
+        _totals.stream_file_bytes -= st->file_size;
+
+        pen::memory_free(st->ring);
+        audio_decoder_close(st->decoder);
+        pen::filesystem_unmap_file(st->file_data, st->file_size);
+        delete st;
+    }
+
+    void set_sound_info(u32 resource_slot)
+    {
+        const sound& snd = _audio_resources[resource_slot].sound;
+        _sound_file_info[resource_slot].length_ms = (u32)((f64)snd.num_frames * 1000.0 / (f64)snd.sample_rate);
+        _sound_file_info_ready[resource_slot] = true;
+    }
+} // namespace
+
+namespace put
+{
+    void audio_set_sink(const audio_sink& sink)
+    {
+        _mixer.sink = sink;
+    }
+
+    pen_error audio_get_mixer_stats(audio_mixer_stats* stats)
+    {
+        *stats = _stats.frontbuffer();
+        return PEN_ERR_OK;
+    }
+
+    void direct::audio_system_initialise()
+    {
+        if (!_mixer.sink.write)
+        {
+            _mixer.sink.write = audio_memory_sink_write;
+            _mixer.sink.user_data = &_mixer.null_sink;
+        }
+
+        if (_mixer.sink.sample_rate == 0)
+            _mixer.sink.sample_rate = 48000;
+
+        _mixer.master = alloc_block();
+        _mixer.scratch = alloc_block();
+        _mixer.stream_scratch = (f32*)pen::memory_alloc(k_stream_ring_frames * 2 * sizeof(f32));
+
+        _worker.mutex = pen::mutex_create();
+        _worker.job = nullptr;
+        _worker.shutdown = 0;
+        _worker.exited = 0;
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+            f32 hz = i == 0 ? k_eq_low_hz : k_eq_high_hz;
+            _mixer.eq_coeff[i] = 1.0f - expf(-2.0f * k_pi * hz / (f32)_mixer.sink.sample_rate);
+        }
+
+        fft_init();
+
+        _totals = {};
+        _totals.sample_rate = _mixer.sink.sample_rate;
+        _totals.block_frames = k_block_frames;
+        _mixer.last_update_ms = pen::get_time_ms();
+        _mixer.carry_frames = 0.0;
+
+        static u32 reserved = 128;
+
+        _audio_resources.init(reserved);
+        _sound_file_info_ready.init(reserved);
+        _sound_file_info.init(reserved);
+        _resource_states.init(reserved);
+    }
+
+    void direct::audio_system_shutdown()
+    {
+        for (u32 i = 0; i < _audio_resources._capacity; ++i)
+            if (_audio_resources[i].assigned_flag)
+                direct::audio_release_resource(i);
+
+        if (_worker.job)
+        {
+            _worker.shutdown = 1;
+            while (!_worker.exited)
+                pen::thread_sleep_ms(1);
+        }
+
+        pen::mutex_destroy(_worker.mutex);
+        sb_free(_worker.streams);
+        sb_free(_worker.pending);
+        sb_free(_sample_cache);
+        _worker.streams = nullptr;
+        _worker.pending = nullptr;
+        _sample_cache = nullptr;
+
+        pen::memory_free_align(_mixer.master);
+        pen::memory_free_align(_mixer.scratch);
+        pen::memory_free(_mixer.stream_scratch);
+        fft_shutdown();
+    }
+
+    void update_channel_state(u32 resource_index)
+    {
+        _resource_states.grow(resource_index);
+
+        const voice& v = _audio_resources[resource_index].voice;
+
+        resource_state& rs = _resource_states.backbuffer()[resource_index];
+
+        audio_channel_state* state = &rs.channel_state;
+
+        f32  rate = 1.0f;
+        f64  position = v.position;
+        f32  pitch = 1.0f;
+        bool paused = false;
+
+        if (is_type(v.sound, AUDIO_RESOURCE_SOUND))
+        {
+            const sound& s = _audio_resources[v.sound].sound;
+            rate = s.sample_rate;
+
+            // streams count frames along the looped timeline
+            if (s.stream)
+                position = fmod(position, (f64)s.num_frames);
+        }
+
+        if (is_type(v.group, AUDIO_RESOURCE_GROUP))
+        {
+            pitch = _audio_resources[v.group].group.pitch;
+            paused = _audio_resources[v.group].group.paused;
+        }
+
+        state->position_ms = (u32)(position * 1000.0 / (f64)rate);
+        state->pitch = pitch;
+        state->volume = v.volume;
+        state->frequency = v.frequency;
+
+        if (!v.playing)
+        {
+            state->play_state = e_audio_play_state::not_playing;
+        }
+        else
+        {
+            state->play_state = e_audio_play_state::playing;
+
+            if (paused)
+            {
+                state->play_state = e_audio_play_state::paused;
+            }
+        }
+    }
+
+    void update_group_state(u32 resource_index)
+    {
+        _resource_states.grow(resource_index);
+
+        const group& g = _audio_resources[resource_index].group;
+
+        resource_state& rs = _resource_states.backbuffer()[resource_index];
+
+        audio_group_state* state = &rs.group_state;
+
+        state->pitch = g.pitch;
+        state->volume = g.volume;
+
+        if (g.num_playing == 0)
+        {
+            state->play_state = e_audio_play_state::not_playing;
+        }
+        else
+        {
+            state->play_state = e_audio_play_state::playing;
+
+            if (g.paused)
+            {
+                state->play_state = e_audio_play_state::paused;
+            }
+        }
+    }
+
+    void update_fft(u32 resource_index)
+    {
+        _resource_states.grow(resource_index);
+
+        fft_dsp& fft = _audio_resources[resource_index].fft;
+
+        resource_state& rs = _resource_states.backbuffer()[resource_index];
+
+        // alternate between two spectrums so the one the front buffer points at is not written this update
+        audio_fft_spectrum& spectrum = fft.spectrum[_mixer.parity];
+        spectrum.length = k_fft_bins;
+        spectrum.num_channels = 2;
+
+        for (u32 c = 0; c < 2; ++c)
+        {
+            spectrum.spectrum[c] = fft.bins[_mixer.parity] + c * k_fft_bins;
+            fft_channel(fft, c, spectrum.spectrum[c]);
+        }
+
+        rs.fft_spectrum = &spectrum;
+    }
+
+    void update_three_band_eq(u32 resource_index)
+    {
+        _resource_states.grow(resource_index);
+
+        const eq_dsp& eq = _audio_resources[resource_index].eq;
+
+        resource_state& rs = _resource_states.backbuffer()[resource_index];
+
+        rs.eq_state.low = eq.gain_db[0];
+        rs.eq_state.med = eq.gain_db[1];
+        rs.eq_state.high = eq.gain_db[2];
+    }
+
+    void update_gain(u32 resource_index)
+    {
+        _resource_states.grow(resource_index);
+
+        resource_state& rs = _resource_states.backbuffer()[resource_index];
+
+        rs.gain_value = _audio_resources[resource_index].gain_db;
+    }
+
+    void direct::audio_system_update()
+    {
+        // work out how many frames are due, offline sinks mix a fixed amount each update
+        f64 now_ms = pen::get_time_ms();
+        f64 due = (f64)_mixer.sink.frames_per_update;
+        if (_mixer.sink.frames_per_update == 0)
+        {
+            f64 elapsed = std::min(now_ms - _mixer.last_update_ms, k_max_catch_up_ms);
+            due = _mixer.carry_frames + elapsed * (f64)_mixer.sink.sample_rate / 1000.0;
+        }
+        _mixer.last_update_ms = now_ms;
+
+        u32 num_blocks = (u32)(due / (f64)k_block_frames);
+        if (_mixer.sink.frames_per_update == 0)
+            _mixer.carry_frames = due - (f64)(num_blocks * k_block_frames);
+        else if (_mixer.sink.frames_per_update % k_block_frames)
+            ++num_blocks;
+
+        f64 mix_start = pen::get_time_us();
+
+        // without the decode worker streams are refilled before every block, which keeps offline renders deterministic
+        bool refill_inline = !_worker.job || _mixer.sink.frames_per_update != 0;
+
+        for (u32 i = 0; i < num_blocks; ++i)
+        {
+            if (refill_inline)
+                refill_streams(k_block_frames);
+
+            mix_block();
+        }
+
+        _totals.mix_ms += (pen::get_time_us() - mix_start) / 1000.0;
+
+        if (_totals.mix_ms > 0.0)
+        {
+            f64 voice_seconds = (f64)_totals.voice_frames_mixed / (f64)_mixer.sink.sample_rate;
+            _totals.voices_per_core = voice_seconds / (_totals.mix_ms / 1000.0);
+        }
+
+        _stats.backbuffer() = _totals;
+        _stats.swap_buffers();
+
+        // group play state is derived from the voices routed to it
+        for (u32 i = 0; i < _audio_resources._capacity; ++i)
+            if (is_type(i, AUDIO_RESOURCE_GROUP))
+                _audio_resources[i].group.num_playing = 0;
+
+        for (u32 i = 0; i < _audio_resources._capacity; ++i)
+        {
+            if (!is_type(i, AUDIO_RESOURCE_CHANNEL))
+                continue;
+
+            const voice& v = _audio_resources[i].voice;
+            if (v.playing && is_type(v.group, AUDIO_RESOURCE_GROUP))
+                ++_audio_resources[v.group].group.num_playing;
+        }
+
+        for (u32 i = 0; i < _audio_resources._capacity; ++i)
+        {
+            if (_audio_resources[i].assigned_flag)
+            {
+                switch (_audio_resources[i].type)
+                {
+                    case AUDIO_RESOURCE_CHANNEL:
+                    {
+                        update_channel_state(i);
+                    }
+                    break;
+
+                    case AUDIO_RESOURCE_GROUP:
+                    {
+                        update_group_state(i);
+                    }
+                    break;
+
+                    case AUDIO_RESOURCE_DSP_FFT:
+                    {
+                        update_fft(i);
+                    }
+                    break;
+
+                    case AUDIO_RESOURCE_DSP_EQ:
+                    {
+                        update_three_band_eq(i);
+                    }
+                    break;
+
+                    case AUDIO_RESOURCE_DSP_GAIN:
+                    {
+                        update_gain(i);
+                    }
+                    break;
+
+                    default:
+                        break;
+                }
+            }
+        }
+
+        _mixer.parity ^= 1;
+        _resource_states.swap_buffers();
+    }
+
+    u32 direct::audio_create_sound(const c8* filename, u32 resource_slot)
+    {
+        assign(resource_slot, AUDIO_RESOURCE_SOUND);
+
+        sound& snd = _audio_resources[resource_slot].sound;
+        snd = {};
+        snd.num_channels = 1;
+        snd.sample_rate = 48000.0f;
+        snd.cache_entry = sample_cache_acquire(pen::os_path_for_resource(filename).c_str());
+
+        if (snd.cache_entry >= 0)
+        {
+            const cached_sample& cs = _sample_cache[snd.cache_entry];
+            snd.pcm = cs.pcm;
+            snd.num_frames = cs.num_frames;
+            snd.num_channels = cs.num_channels;
+            snd.sample_rate = cs.sample_rate;
+        }
+
+        set_sound_info(resource_slot);
+
+        return resource_slot;
+    }
+
+    u32 direct::audio_create_sound(const pen::music_file& music, u32 resource_slot)
+    {
+        assign(resource_slot, AUDIO_RESOURCE_SOUND);
+
+        sound& snd = _audio_resources[resource_slot].sound;
+        snd = {};
+        snd.num_channels = 1;
+        snd.sample_rate = 48000.0f;
+        snd.cache_entry = -1;
+
+        // the mixer reads frames with a stride of num_channels, an empty sound is created like a missing file
+        if (music.num_channels == 0 || music.num_channels > 2)
+        {
+            PEN_LOG("[error] audio: music must be mono or stereo, it has %u channels", music.num_channels);
+            set_sound_info(resource_slot);
+            return resource_slot;
+        }
+
+        // pcm is mixed from in place, the music file must outlive the sound
+        snd.pcm = music.pcm_data;
+        snd.num_channels = music.num_channels;
+        snd.num_frames = (u32)(music.len / (sizeof(f32) * music.num_channels));
+        snd.sample_rate = (f32)music.sample_frequency;
+
+        set_sound_info(resource_slot);
+
+        return resource_slot;
+    }
+
+    u32 direct::audio_create_stream(const c8* filename, u32 resource_slot)
+    {
+        assign(resource_slot, AUDIO_RESOURCE_SOUND);
+
+        // streams loop, as fmod streams are created looping
+        sound& snd = _audio_resources[resource_slot].sound;
+        snd = {};
+        snd.num_channels = 1;
+        snd.sample_rate = 48000.0f;
+        snd.cache_entry = -1;
+        snd.stream = stream_create(filename);
+        snd.loop = true;
+
+        if (snd.stream)
+        {
+            snd.num_frames = snd.stream->decoder.num_frames;
+            snd.num_channels = snd.stream->decoder.num_channels;
+            snd.sample_rate = (f32)snd.stream->decoder.sample_rate;
+        }
+
+        set_sound_info(resource_slot);
+
+        return resource_slot;
+    }
+
+    u32 direct::audio_create_channel_group(u32 resource_slot)
+    {
+        assign(resource_slot, AUDIO_RESOURCE_GROUP);
+
+        group& g = _audio_resources[resource_slot].group;
+        g.bus = alloc_block();
+        g.volume = 1.0f;
+        g.pitch = 1.0f;
+        g.num_dsp = 0;
+        g.num_playing = 0;
+        g.paused = false;
+        g.muted = false;
+
+        return resource_slot;
+    }
+
+    u32 direct::audio_create_channel_for_sound(u32 sound_index, u32 resource_slot)
+    {
+        assign(resource_slot, AUDIO_RESOURCE_CHANNEL);
+
+        voice& v = _audio_resources[resource_slot].voice;
+        v.sound = sound_index;
+        v.group = 0;
+        v.position = 0.0;
+        v.volume = 1.0f;
+        v.playing = is_type(sound_index, AUDIO_RESOURCE_SOUND);
+        v.frequency = v.playing ? _audio_resources[sound_index].sound.sample_rate : 0.0f;
+
+        // a new channel takes the stream over from any channel already playing it
+        if (v.playing && _audio_resources[sound_index].sound.stream)
+        {
+            stream* st = _audio_resources[sound_index].sound.stream;
+            st->voice = resource_slot;
+            stream_seek(*st, 0);
+        }
+
+        return resource_slot;
+    }
+
+    void direct::audio_channel_set_position(const u32 channel_index, const u32 position_ms)
+    {
+        if (!is_type(channel_index, AUDIO_RESOURCE_CHANNEL))
+            return;
+
+        voice& v = _audio_resources[channel_index].voice;
+        if (!is_type(v.sound, AUDIO_RESOURCE_SOUND))
+            return;
+
+        const sound& s = _audio_resources[v.sound].sound;
+        v.position = floor((f64)position_ms * (f64)s.sample_rate / 1000.0);
+
+        if (s.stream && s.stream->voice == channel_index)
+            stream_seek(*s.stream, (u64)v.position);
+    }
+
+    void direct::audio_channel_set_frequency(const u32 channel_index, const f32 frequency)
+    {
+        if (!is_type(channel_index, AUDIO_RESOURCE_CHANNEL))
+            return;
+
+        _audio_resources[channel_index].voice.frequency = std::max(frequency, 0.0f);
+    }
+
+    void direct::audio_channel_stop(const u32 channel_index)
+    {
+        if (!is_type(channel_index, AUDIO_RESOURCE_CHANNEL))
+            return;
+
+        _audio_resources[channel_index].voice.playing = false;
+    }
+
+    void direct::audio_channel_set_volume(const u32 channel_index, const f32 volume)
+    {
+        if (is_type(channel_index, AUDIO_RESOURCE_CHANNEL))
+            _audio_resources[channel_index].voice.volume = std::max(volume, 0.0f);
+    }
+
+    void direct::audio_group_set_pause(const u32 group_index, const bool val)
+    {
+        if (is_type(group_index, AUDIO_RESOURCE_GROUP))
+            _audio_resources[group_index].group.paused = val;
+    }
+
+    void direct::audio_group_set_mute(const u32 group_index, const bool val)
+    {
+        if (is_type(group_index, AUDIO_RESOURCE_GROUP))
+            _audio_resources[group_index].group.muted = val;
+    }
+
+    void direct::audio_group_set_pitch(const u32 group_index, const f32 pitch)
+    {
+        if (is_type(group_index, AUDIO_RESOURCE_GROUP))
+            _audio_resources[group_index].group.pitch = std::max(pitch, 0.0f);
+    }
+
+    void direct::audio_group_set_volume(const u32 group_index, const f32 volume)
+    {
+        if (is_type(group_index, AUDIO_RESOURCE_GROUP))
+            _audio_resources[group_index].group.volume = volume;
+    }
+
+    u32 direct::audio_release_resource(u32 index)
+    {
+        if (index == 0)
+        {
+            return 0;
+        }
+
+        if (_audio_resources[index].assigned_flag)
+        {
+            audio_resource_allocation& res = _audio_resources[index];
+
+            switch (res.type)
+            {
+                case AUDIO_RESOURCE_GROUP:
+                {
+                    pen::memory_free_align(res.group.bus);
+
+                    // orphaned voices fall back to the master bus
+                    for (u32 i = 0; i < _audio_resources._capacity; ++i)
+                        if (is_type(i, AUDIO_RESOURCE_CHANNEL) && _audio_resources[i].voice.group == index)
+                            _audio_resources[i].voice.group = 0;
+                }
+                break;
+
+                case AUDIO_RESOURCE_DSP_FFT:
+                {
+                    pen::memory_free(res.fft.history);
+                    pen::memory_free(res.fft.bins[0]);
+                    pen::memory_free(res.fft.bins[1]);
+                }
+                break;
+
+                case AUDIO_RESOURCE_SOUND:
+                {
+                    sample_cache_release(res.sound.cache_entry);
+
+                    if (res.sound.stream)
+                        stream_release(res.sound.stream);
+
+                    for (u32 i = 0; i < _audio_resources._capacity; ++i)
+                        if (is_type(i, AUDIO_RESOURCE_CHANNEL) && _audio_resources[i].voice.sound == index)
+                            _audio_resources[i].voice.playing = false;
+
+                    _sound_file_info_ready[index] = false;
+                }
+                break;
+
+                default:
+                    break;
+            }
+
+            res.assigned_flag = 0;
+        }
+
+        return 0;
+    }
+
+    void direct::audio_add_channel_to_group(const u32 channel_index, const u32 group_index)
+    {
+        if (!is_type(channel_index, AUDIO_RESOURCE_CHANNEL) || !is_type(group_index, AUDIO_RESOURCE_GROUP))
+            return;
+
+        _audio_resources[channel_index].voice.group = group_index;
+    }
+
+    u32 direct::audio_add_dsp_to_group(const u32 group_index, dsp_type type, u32 resource_slot)
+    {
+        audio_resource_type res_type = AUDIO_RESOURCE_DSP;
+        switch (type)
+        {
+            case e_dsp::fft:
+                res_type = AUDIO_RESOURCE_DSP_FFT;
+                break;
+            case e_dsp::three_band_eq:
+                res_type = AUDIO_RESOURCE_DSP_EQ;
+                break;
+            case e_dsp::gain:
+                res_type = AUDIO_RESOURCE_DSP_GAIN;
+                break;
+            default:
+                PEN_ERROR;
+        }
+
+        assign(resource_slot, res_type);
+
+        audio_resource_allocation& res = _audio_resources[resource_slot];
+        switch (res_type)
+        {
+            case AUDIO_RESOURCE_DSP_FFT:
+            {
+                res.fft.history = (f32*)pen::memory_calloc(k_fft_size * 2, sizeof(f32));
+                res.fft.write_frame = 0;
+
+                for (u32 i = 0; i < 2; ++i)
+                {
+                    res.fft.bins[i] = (f32*)pen::memory_calloc(k_fft_bins * 2, sizeof(f32));
+                    res.fft.spectrum[i] = {};
+                }
+            }
+            break;
+
+            case AUDIO_RESOURCE_DSP_EQ:
+            {
+                res.eq = {};
+            }
+            break;
+
+            case AUDIO_RESOURCE_DSP_GAIN:
+            {
+                res.gain_db = 0.0f;
+            }
+            break;
+
+            default:
+                break;
+        }
+
+        if (!is_type(group_index, AUDIO_RESOURCE_GROUP))
+            return resource_slot;
+
+        group& g = _audio_resources[group_index].group;
+        if (g.num_dsp >= k_max_group_dsp)
+        {
+            PEN_LOG("[error] audio: group %u already has %u dsp", group_index, k_max_group_dsp);
+            return resource_slot;
+        }
+
+        g.dsp[g.num_dsp++] = resource_slot;
+
+        return resource_slot;
+    }
+
+    void direct::audio_dsp_set_three_band_eq(const u32 eq_index, const f32 low, const f32 med, const f32 high)
+    {
+        if (!is_type(eq_index, AUDIO_RESOURCE_DSP_EQ))
+            return;
+
+        eq_dsp& eq = _audio_resources[eq_index].eq;
+        eq.gain_db[0] = low;
+        eq.gain_db[1] = med;
+        eq.gain_db[2] = high;
+    }
+
+    void direct::audio_dsp_set_gain(const u32 dsp_index, const f32 gain)
+    {
+        if (is_type(dsp_index, AUDIO_RESOURCE_DSP_GAIN))
+            _audio_resources[dsp_index].gain_db = gain;
+    }
+
+    pen_error audio_channel_get_state(const u32 channel_index, audio_channel_state* state)
+    {
+        if (_audio_resources[channel_index].assigned_flag)
+        {
+            if (_audio_resources[channel_index].type == AUDIO_RESOURCE_CHANNEL)
+            {
+                const resource_state& rs = _resource_states.frontbuffer()[channel_index];
+
+                *state = rs.channel_state;
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+
+    pen_error audio_channel_get_sound_file_info(const u32 sound_index, audio_sound_file_info* info)
+    {
+        if (_audio_resources[sound_index].assigned_flag && _sound_file_info_ready[sound_index])
+        {
+            if (_audio_resources[sound_index].type == AUDIO_RESOURCE_SOUND)
+            {
+                *info = _sound_file_info[sound_index];
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+
+    pen_error audio_group_get_state(const u32 group_index, audio_group_state* state)
+    {
+        if (_audio_resources[group_index].assigned_flag)
+        {
+            if (_audio_resources[group_index].type == AUDIO_RESOURCE_GROUP)
+            {
+                const resource_state& rs = _resource_states.frontbuffer()[group_index];
+
+                *state = rs.group_state;
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+
+    pen_error audio_dsp_get_spectrum(const u32 spectrum_dsp, audio_fft_spectrum* spectrum)
+    {
+        if (_audio_resources[spectrum_dsp].assigned_flag)
+        {
+            if (_audio_resources[spectrum_dsp].type == AUDIO_RESOURCE_DSP_FFT)
+            {
+                const resource_state& rs = _resource_states.frontbuffer()[spectrum_dsp];
+
+                if (rs.fft_spectrum != nullptr)
+                {
+                    *spectrum = *rs.fft_spectrum;
+                }
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+
+    pen_error audio_dsp_get_three_band_eq(const u32 eq_dsp, audio_eq_state* eq_state)
+    {
+        if (_audio_resources[eq_dsp].assigned_flag)
+        {
+            if (_audio_resources[eq_dsp].type == AUDIO_RESOURCE_DSP_EQ)
+            {
+                const resource_state& rs = _resource_states.frontbuffer()[eq_dsp];
+
+                *eq_state = rs.eq_state;
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+
+    pen_error audio_dsp_get_gain(const u32 dsp_index, f32* gain)
+    {
+        if (_audio_resources[dsp_index].assigned_flag)
+        {
+            if (_audio_resources[dsp_index].type == AUDIO_RESOURCE_DSP_GAIN)
+            {
+                const resource_state& rs = _resource_states.frontbuffer()[dsp_index];
+
+                *gain = rs.gain_value;
+
+                return PEN_ERR_OK;
+            }
+
+            return PEN_ERR_FAILED;
+        }
+
+        return PEN_ERR_NOT_READY;
+    }
+} // namespace put
+
+#endif
@@ -0,0 +1,788 @@
+// ecs_anim.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "ecs/ecs_anim.h"
+#include "ecs/ecs_resources.h"
+
+#include "data_struct.h"
+#include "memory.h"
+
+#include <algorithm>
+
+#if __SSE2__ || __AVX2__ || __AVX__
+#include <immintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    // decoded key pose, translate xyz, scale xyz, quat xyzw
+    const u32 k_pose_floats = 10;
+    const u32 k_pose_scale = 3;
+    const u32 k_pose_quat = 6;
+
+    const f32 k_sqrt2 = 1.41421356f;
+    const f32 k_u15_max = 32767.0f;
+    const f32 k_u16_max = 65535.0f;
+} // namespace
+
+namespace put
+{
+    namespace ecs
+    {
+        //
+        // quantisation
+        //
+
+        pen_inline u16 quantise_range(f32 v, f32 min, f32 extent)
+        {
+            if (extent <= 0.0f)
+                return 0;
+
+            f32 n = (v - min) / extent;
+            n = std::min(std::max(n, 0.0f), 1.0f);
+            return (u16)(n * k_u16_max + 0.5f);
+        }
+
+        pen_inline f32 dequantise_range(u16 v, f32 min, f32 extent)
+        {
+            return min + ((f32)v / k_u16_max) * extent;
+        }
+
+        void encode_quat_smallest_three(const f32* q, u16* out)
+        {
+            u32 largest = 0;
+            for (u32 i = 1; i < 4; ++i)
+                if (fabs(q[i]) > fabs(q[largest]))
+                    largest = i;
+
+            // q and -q are the same rotation, make the dropped component positive so we can rebuild it
+            f32 sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+            u16 c[3];
+            u32 ci = 0;
+            for (u32 i = 0; i < 4; ++i)
+            {
+                if (i == largest)
+                    continue;
+
+                // remaining components are within +/- 1/sqrt(2)
+                f32 v = q[i] * sign * k_sqrt2 * 0.5f + 0.5f;
+                v = std::min(std::max(v, 0.0f), 1.0f);
+                c[ci++] = (u16)(v * k_u15_max + 0.5f);
+            }
+
+            out[0] = (u16)(((largest >> 1) << 15) | c[0]);
+            out[1] = (u16)(((largest & 1) << 15) | c[1]);
+            out[2] = c[2];
+        }
+
+        pen_inline void decode_quat_smallest_three(const u16* in, f32* q)
+        {
+            u32 largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+
+            f32 sum = 0.0f;
+            u32 ci = 0;
+            for (u32 i = 0; i < 4; ++i)
+            {
+                if (i == largest)
+                    continue;
+
+                f32 v = (((f32)(in[ci++] & 0x7fff) / k_u15_max) * 2.0f - 1.0f) / k_sqrt2;
+                q[i] = v;
+                sum += v * v;
+            }
+
+            q[largest] = sqrtf(std::max(1.0f - sum, 0.0f));
+        }
+
+        pen_inline void decode_key(const compressed_anim_channel& channel, const anim_key_q& key, f32* pose)
+        {
+            for (u32 i = 0; i < 3; ++i)
+            {
+                pose[i] = dequantise_range(key.t[i], channel.t_min[i], channel.t_extent[i]);
+                pose[k_pose_scale + i] = dequantise_range(key.s[i], channel.s_min[i], channel.s_extent[i]);
+            }
+
+            decode_quat_smallest_three(key.q, &pose[k_pose_quat]);
+        }
+
+        pen_inline void interpolate_pose(const f32* p1, const f32* p2, f32 t, f32* out)
+        {
+            // lerp translation and scale
+            for (u32 i = 0; i < k_pose_quat; ++i)
+                out[i] = p1[i] + (p2[i] - p1[i]) * t;
+
+            // nlerp quaternion along the shortest path
+            const f32* q1 = &p1[k_pose_quat];
+            const f32* q2 = &p2[k_pose_quat];
+
+            f32 d = q1[0] * q2[0] + q1[1] * q2[1] + q1[2] * q2[2] + q1[3] * q2[3];
+            f32 sign = d < 0.0f ? -1.0f : 1.0f;
+
+            f32* q = &out[k_pose_quat];
+            f32  len2 = 0.0f;
+            for (u32 i = 0; i < 4; ++i)
+            {
+                q[i] = q1[i] + (q2[i] * sign - q1[i]) * t;
+                len2 += q[i] * q[i];
+            }
+
+            f32 inv_len = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+            for (u32 i = 0; i < 4; ++i)
+                q[i] *= inv_len;
+        }
+
+        //
+        // compression
+        //
+
+        bool keys_within_tolerance(const f32* poses, const f32* times, u32 start, u32 end, f32 tolerance)
+        {
+            f32 span = times[end] - times[start];
+
+            for (u32 k = start + 1; k < end; ++k)
+            {
+                f32 t = span > 0.0f ? (times[k] - times[start]) / span : 0.0f;
+
+                f32 ip[k_pose_floats];
+                interpolate_pose(&poses[start * k_pose_floats], &poses[end * k_pose_floats], t, ip);
+
+                const f32* src = &poses[k * k_pose_floats];
+
+                // q and -q are equivalent, compare against the closest
+                const f32* sq = &src[k_pose_quat];
+                const f32* iq = &ip[k_pose_quat];
+                f32        d = sq[0] * iq[0] + sq[1] * iq[1] + sq[2] * iq[2] + sq[3] * iq[3];
+                f32        sign = d < 0.0f ? -1.0f : 1.0f;
+
+                for (u32 i = 0; i < k_pose_quat; ++i)
+                    if (fabs(ip[i] - src[i]) > tolerance)
+                        return false;
+
+                for (u32 i = 0; i < 4; ++i)
+                    if (fabs(iq[i] * sign - sq[i]) > tolerance)
+                        return false;
+            }
+
+            return true;
+        }
+
+        void compress_anim(const soa_anim& soa, compressed_anim& out, f32 tolerance, anim_compression_stats* stats)
+        {
+            out.num_channels = soa.num_channels;
+            out.num_keys = 0;
+            out.channels = (compressed_anim_channel*)pen::memory_alloc(sizeof(compressed_anim_channel) * soa.num_channels);
+            pen::memory_zero(out.channels, sizeof(compressed_anim_channel) * soa.num_channels);
+
+            anim_key_q* keys = nullptr;
+            f32*        poses = nullptr;
+            f32*        times = nullptr;
+            u32*        order = nullptr;
+            u32*        kept = nullptr;
+
+            u32 src_keys = 0;
+
+            for (u32 c = 0; c < soa.num_channels; ++c)
+            {
+                const anim_channel&      src = soa.channels[c];
+                compressed_anim_channel& channel = out.channels[c];
+
+                u32 nf = src.num_frames;
+                src_keys += nf;
+
+                channel.key_offset = sb_count(keys);
+                channel.num_keys = 0;
+
+                if (src.flags & e_anim_flags::baked_quaternion)
+                    channel.flags |= e_anim_key_flags::baked_quaternion;
+
+                if (nf == 0)
+                    continue;
+
+                // sort frames by time
+                sb_clear(order);
+                for (u32 f = 0; f < nf; ++f)
+                    sb_push(order, f);
+
+                std::stable_sort(order, order + nf,
+                                 [&](u32 a, u32 b) { return soa.info[a][c].time < soa.info[b][c].time; });
+
+                // decode source frames into poses
+                sb_clear(poses);
+                sb_clear(times);
+                for (u32 i = 0; i < nf; ++i)
+                {
+                    u32              f = order[i];
+                    const anim_info& info = soa.info[f][c];
+                    const f32*       d = &soa.data[f][info.offset];
+
+                    f32* p = sb_add(poses, k_pose_floats);
+                    for (u32 j = 0; j < 3; ++j)
+                    {
+                        p[j] = 0.0f;
+                        p[k_pose_scale + j] = 1.0f;
+                    }
+
+                    quat q = quat(0.0f, 0.0f, 0.0f);
+                    for (u32 e = 0; e < src.element_count; ++e)
+                    {
+                        u32 eo = src.element_offset[e];
+
+                        if (eo == e_anim_output::quaternion)
+                        {
+                            // multiple rotation sources are combined in the same order the sampler applies them
+                            quat qs;
+                            memcpy(&qs.v[0], &d[e], 16);
+                            q = qs * q;
+
+                            channel.flags |= e_anim_key_flags::rotation;
+                            e += 3;
+                        }
+                        else if (eo < e_anim_output::scale_x)
+                        {
+                            p[eo] = d[e];
+                            channel.flags |= e_anim_key_flags::translate_x << eo;
+                        }
+                        else
+                        {
+                            p[k_pose_scale + eo - e_anim_output::scale_x] = d[e];
+                            channel.flags |= e_anim_key_flags::scale_x << (eo - e_anim_output::scale_x);
+                        }
+                    }
+
+                    f32 len2 = 0.0f;
+                    for (u32 j = 0; j < 4; ++j)
+                        len2 += q.v[j] * q.v[j];
+
+                    f32 inv_len = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+                    for (u32 j = 0; j < 4; ++j)
+                        p[k_pose_quat + j] = q.v[j] * inv_len;
+
+                    sb_push(times, info.time);
+                }
+
+                // remove keys which can be rebuilt by interpolating their neighbours
+                sb_clear(kept);
+                sb_push(kept, 0);
+
+                u32 start = 0;
+                for (u32 f = 1; f + 1 < nf; ++f)
+                {
+                    if (!keys_within_tolerance(poses, times, start, f + 1, tolerance))
+                    {
+                        sb_push(kept, f);
+                        start = f;
+                    }
+                }
+
+                if (nf > 1)
+                    sb_push(kept, nf - 1);
+
+                u32 nk = sb_count(kept);
+
+                // quantisation ranges
+                f32 t_max[3];
+                f32 s_max[3];
+                for (u32 j = 0; j < 3; ++j)
+                {
+                    channel.t_min[j] = t_max[j] = poses[j];
+                    channel.s_min[j] = s_max[j] = poses[k_pose_scale + j];
+                }
+
+                for (u32 k = 1; k < nk; ++k)
+                {
+                    const f32* p = &poses[kept[k] * k_pose_floats];
+                    for (u32 j = 0; j < 3; ++j)
+                    {
+                        channel.t_min[j] = std::min(channel.t_min[j], p[j]);
+                        channel.s_min[j] = std::min(channel.s_min[j], p[k_pose_scale + j]);
+                        t_max[j] = std::max(t_max[j], p[j]);
+                        s_max[j] = std::max(s_max[j], p[k_pose_scale + j]);
+                    }
+                }
+
+                for (u32 j = 0; j < 3; ++j)
+                {
+                    channel.t_extent[j] = t_max[j] - channel.t_min[j];
+                    channel.s_extent[j] = s_max[j] - channel.s_min[j];
+                }
+
+                // write keys
+                for (u32 k = 0; k < nk; ++k)
+                {
+                    const f32* p = &poses[kept[k] * k_pose_floats];
+
+                    anim_key_q key;
+                    key.time = times[kept[k]];
+                    key.pad = 0;
+
+                    for (u32 j = 0; j < 3; ++j)
+                    {
+                        key.t[j] = quantise_range(p[j], channel.t_min[j], channel.t_extent[j]);
+                        key.s[j] = quantise_range(p[k_pose_scale + j], channel.s_min[j], channel.s_extent[j]);
+                    }
+
+                    encode_quat_smallest_three(&p[k_pose_quat], key.q);
+
+                    sb_push(keys, key);
+                }
+
+                channel.num_keys = nk;
+            }
+
+            // copy keys into a single tight allocation
+            out.num_keys = sb_count(keys);
+            out.keys = (anim_key_q*)pen::memory_alloc(sizeof(anim_key_q) * out.num_keys);
+            if (out.num_keys)
+                memcpy(out.keys, keys, sizeof(anim_key_q) * out.num_keys);
+
+            if (stats)
+            {
+                stats->src_keys = src_keys;
+                stats->keys = out.num_keys;
+                stats->src_size = soa_anim_size(soa);
+                stats->size = compressed_anim_size(out);
+            }
+
+            sb_free(keys);
+            sb_free(poses);
+            sb_free(times);
+            sb_free(order);
+            sb_free(kept);
+        }
+
+        void free_compressed_anim(compressed_anim& ca)
+        {
+            pen::memory_free(ca.channels);
+            pen::memory_free(ca.keys);
+
+            ca.channels = nullptr;
+            ca.keys = nullptr;
+            ca.num_channels = 0;
+            ca.num_keys = 0;
+        }
+
+        size_t soa_anim_size(const soa_anim& soa)
+        {
+            size_t size = sizeof(anim_channel) * soa.num_channels;
+
+            u32 max_frames = 0;
+            for (u32 c = 0; c < soa.num_channels; ++c)
+            {
+                max_frames = std::max(max_frames, soa.channels[c].num_frames);
+                size += soa.channels[c].num_frames * soa.channels[c].element_count * sizeof(f32);
+            }
+
+            // info is padded to max frames for every channel
+            size += max_frames * soa.num_channels * sizeof(anim_info);
+            size += max_frames * (sizeof(anim_info*) + sizeof(f32*));
+
+            return size;
+        }
+
+        size_t compressed_anim_size(const compressed_anim& ca)
+        {
+            return sizeof(compressed_anim_channel) * ca.num_channels + sizeof(anim_key_q) * ca.num_keys;
+        }
+
+        //
+        // sampling
+        //
+
+        void sample_anim_soa(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            soa_anim& soa = instance.soa;
+            u32       num_channels = soa.num_channels;
+
+            for (s32 c = 0; c < num_channels; ++c)
+            {
+                anim_sampler& sampler = instance.samplers[c];
+                anim_channel& channel = soa.channels[c];
+
+                if (sampler.joint == PEN_INVALID_HANDLE)
+                    continue;
+
+                // find the frame we are on..
+                for (; sampler.pos < channel.num_frames; sampler.pos++)
+                    if (anim_t <= soa.info[sampler.pos][c].time)
+                    {
+                        sampler.pos -= 1;
+                        break;
+                    }
+
+                //reset flag
+                sampler.flags &= ~e_anim_flags::looped;
+
+                if (sampler.pos >= channel.num_frames || looped)
+                {
+                    sampler.pos = 0;
+                    sampler.flags = e_anim_flags::looped;
+                }
+
+                u32 next = (sampler.pos + 1) % channel.num_frames;
+
+                // get anim data
+                anim_info& info1 = soa.info[sampler.pos][c];
+                anim_info& info2 = soa.info[next][c];
+
+                f32* d1 = &soa.data[sampler.pos][info1.offset];
+                f32* d2 = &soa.data[next][info2.offset];
+
+                f32 a = (anim_t - info1.time);
+                f32 b = (info2.time - info1.time);
+
+                f32 it = min(max(a / b, 0.0f), 1.0f);
+
+                sampler.prev_t = sampler.cur_t;
+                sampler.cur_t = it;
+
+                for (u32 e = 0; e < channel.element_count; ++e)
+                {
+                    u32 eo = channel.element_offset[e];
+
+                    // slerp quats
+                    if (eo == e_anim_output::quaternion)
+                    {
+                        quat q1;
+                        quat q2;
+
+                        memcpy(&q1.v[0], &d1[e], 16);
+                        memcpy(&q2.v[0], &d2[e], 16);
+
+                        quat ql = slerp(q1, q2, it);
+
+                        instance.targets[sampler.joint].q = ql * instance.targets[sampler.joint].q;
+                        instance.targets[sampler.joint].flags |= channel.flags;
+                        e += 3;
+                    }
+                    else
+                    {
+                        // lerp translation / scale
+                        f32 lf = (1 - it) * d1[e] + it * d2[e];
+                        instance.targets[sampler.joint].t[eo] = lf;
+                    }
+                }
+            }
+        }
+
+        pen_inline f32 seek_keys(const compressed_anim& ca, u32 c, anim_sampler& sampler, f32 anim_t, bool looped,
+                                 const anim_key_q** k1, const anim_key_q** k2)
+        {
+            const compressed_anim_channel& channel = ca.channels[c];
+            const anim_key_q*              keys = &ca.keys[channel.key_offset];
+
+            // find the key we are on.. keys are sorted so we only move forward until we loop
+            for (; sampler.pos < channel.num_keys; sampler.pos++)
+                if (anim_t <= keys[sampler.pos].time)
+                {
+                    sampler.pos -= 1;
+                    break;
+                }
+
+            sampler.flags &= ~e_anim_flags::looped;
+
+            if (sampler.pos >= channel.num_keys || looped)
+            {
+                sampler.pos = 0;
+                sampler.flags = e_anim_flags::looped;
+            }
+
+            u32 next = (sampler.pos + 1) % channel.num_keys;
+
+            *k1 = &keys[sampler.pos];
+            *k2 = &keys[next];
+
+            f32 a = anim_t - (*k1)->time;
+            f32 b = (*k2)->time - (*k1)->time;
+
+            f32 it = b > 0.0f ? min(max(a / b, 0.0f), 1.0f) : 0.0f;
+
+            sampler.prev_t = sampler.cur_t;
+            sampler.cur_t = it;
+
+            return it;
+        }
+
+        pen_inline void write_target(anim_target& target, const compressed_anim_channel& channel, const f32* pose)
+        {
+            for (u32 i = 0; i < 3; ++i)
+            {
+                if (channel.flags & (e_anim_key_flags::translate_x << i))
+                    target.t[e_anim_output::translate_x + i] = pose[i];
+
+                if (channel.flags & (e_anim_key_flags::scale_x << i))
+                    target.t[e_anim_output::scale_x + i] = pose[k_pose_scale + i];
+            }
+
+            if (channel.flags & e_anim_key_flags::rotation)
+            {
+                quat ql;
+                memcpy(&ql.v[0], &pose[k_pose_quat], 16);
+
+                target.q = ql * target.q;
+
+                if (channel.flags & e_anim_key_flags::baked_quaternion)
+                    target.flags |= e_anim_flags::baked_quaternion;
+            }
+        }
+
+        pen_inline bool sampler_active(const compressed_anim& ca, const anim_sampler& sampler, u32 c)
+        {
+            return sampler.joint != PEN_INVALID_HANDLE && ca.channels[c].num_keys > 0;
+        }
+
+        //
+        // scalar float implementation
+        //
+
+        void sample_anim_compressed_scalar(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            const compressed_anim& ca = instance.compressed;
+
+            for (u32 c = 0; c < ca.num_channels; ++c)
+            {
+                anim_sampler& sampler = instance.samplers[c];
+                if (!sampler_active(ca, sampler, c))
+                    continue;
+
+                const anim_key_q* k1;
+                const anim_key_q* k2;
+                f32               it = seek_keys(ca, c, sampler, anim_t, looped, &k1, &k2);
+
+                f32 p1[k_pose_floats];
+                f32 p2[k_pose_floats];
+                decode_key(ca.channels[c], *k1, p1);
+                decode_key(ca.channels[c], *k2, p2);
+
+                f32 pose[k_pose_floats];
+                interpolate_pose(p1, p2, it, pose);
+
+                write_target(instance.targets[sampler.joint], ca.channels[c], pose);
+            }
+        }
+
+        // seek and decode keys for each lane in soa, unused lanes are padded with the first
+        template <u32 W>
+        void gather_lanes(anim_instance& instance, const u32* lane_channel, u32 num_lanes, f32 anim_t, bool looped,
+                          f32 (&p1)[k_pose_floats][W], f32 (&p2)[k_pose_floats][W], f32 (&it)[W])
+        {
+            const compressed_anim& ca = instance.compressed;
+
+            for (u32 l = 0; l < W; ++l)
+            {
+                if (l >= num_lanes)
+                {
+                    for (u32 i = 0; i < k_pose_floats; ++i)
+                    {
+                        p1[i][l] = p1[i][0];
+                        p2[i][l] = p2[i][0];
+                    }
+
+                    it[l] = it[0];
+                    continue;
+                }
+
+                u32 c = lane_channel[l];
+
+                const anim_key_q* k1;
+                const anim_key_q* k2;
+                it[l] = seek_keys(ca, c, instance.samplers[c], anim_t, looped, &k1, &k2);
+
+                f32 d1[k_pose_floats];
+                f32 d2[k_pose_floats];
+                decode_key(ca.channels[c], *k1, d1);
+                decode_key(ca.channels[c], *k2, d2);
+
+                for (u32 i = 0; i < k_pose_floats; ++i)
+                {
+                    p1[i][l] = d1[i];
+                    p2[i][l] = d2[i];
+                }
+            }
+        }
+
+        template <u32 W>
+        void scatter_lanes(anim_instance& instance, const u32* lane_channel, u32 num_lanes, f32 (&result)[k_pose_floats][W])
+        {
+            const compressed_anim& ca = instance.compressed;
+
+            for (u32 l = 0; l < num_lanes; ++l)
+            {
+                u32 c = lane_channel[l];
+
+                f32 pose[k_pose_floats];
+                for (u32 i = 0; i < k_pose_floats; ++i)
+                    pose[i] = result[i][l];
+
+                write_target(instance.targets[instance.samplers[c].joint], ca.channels[c], pose);
+            }
+        }
+
+        template <u32 W, void (*lanes_fn)(anim_instance&, const u32*, u32, f32, bool)>
+        void sample_anim_compressed_lanes(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            const compressed_anim& ca = instance.compressed;
+
+            u32 lane_channel[W];
+            u32 num_lanes = 0;
+
+            for (u32 c = 0; c < ca.num_channels; ++c)
+            {
+                if (!sampler_active(ca, instance.samplers[c], c))
+                    continue;
+
+                lane_channel[num_lanes++] = c;
+
+                if (num_lanes == W)
+                {
+                    lanes_fn(instance, lane_channel, num_lanes, anim_t, looped);
+                    num_lanes = 0;
+                }
+            }
+
+            if (num_lanes > 0)
+                lanes_fn(instance, lane_channel, num_lanes, anim_t, looped);
+        }
+
+        //
+        // sse2 128 implementation
+        //
+#if __SSE__ || __AVX__
+        void sample_lanes_simd128(anim_instance& instance, const u32* lane_channel, u32 num_lanes, f32 anim_t, bool looped)
+        {
+            f32 p1[k_pose_floats][4];
+            f32 p2[k_pose_floats][4];
+            f32 it[4];
+            f32 result[k_pose_floats][4];
+
+            gather_lanes<4>(instance, lane_channel, num_lanes, anim_t, looped, p1, p2, it);
+
+            __m128 t = _mm_loadu_ps(it);
+
+            // lerp translation and scale
+            for (u32 i = 0; i < k_pose_quat; ++i)
+            {
+                __m128 a = _mm_loadu_ps(p1[i]);
+                __m128 b = _mm_loadu_ps(p2[i]);
+                _mm_storeu_ps(result[i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+            }
+
+            // nlerp quaternions, flip b into the same hemisphere as a
+            __m128 qa[4];
+            __m128 qb[4];
+            for (u32 i = 0; i < 4; ++i)
+            {
+                qa[i] = _mm_loadu_ps(p1[k_pose_quat + i]);
+                qb[i] = _mm_loadu_ps(p2[k_pose_quat + i]);
+            }
+
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qa[0], qb[0]), _mm_mul_ps(qa[1], qb[1])),
+                                  _mm_add_ps(_mm_mul_ps(qa[2], qb[2]), _mm_mul_ps(qa[3], qb[3])));
+
+            __m128 sign = _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+
+            __m128 q[4];
+            __m128 len2 = _mm_setzero_ps();
+            for (u32 i = 0; i < 4; ++i)
+            {
+                __m128 b = _mm_xor_ps(qb[i], sign);
+                q[i] = _mm_add_ps(qa[i], _mm_mul_ps(_mm_sub_ps(b, qa[i]), t));
+                len2 = _mm_add_ps(len2, _mm_mul_ps(q[i], q[i]));
+            }
+
+            __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+            for (u32 i = 0; i < 4; ++i)
+                _mm_storeu_ps(result[k_pose_quat + i], _mm_mul_ps(q[i], inv_len));
+
+            scatter_lanes<4>(instance, lane_channel, num_lanes, result);
+        }
+
+        void sample_anim_compressed_simd128(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            sample_anim_compressed_lanes<4, sample_lanes_simd128>(instance, anim_t, looped);
+        }
+#else
+        void sample_anim_compressed_simd128(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            sample_anim_compressed_scalar(instance, anim_t, looped);
+        }
+#endif
+
+        //
+        // avx 256 implementation
+        //
+#if __AVX2__
+        void sample_lanes_simd256(anim_instance& instance, const u32* lane_channel, u32 num_lanes, f32 anim_t, bool looped)
+        {
+            f32 p1[k_pose_floats][8];
+            f32 p2[k_pose_floats][8];
+            f32 it[8];
+            f32 result[k_pose_floats][8];
+
+            gather_lanes<8>(instance, lane_channel, num_lanes, anim_t, looped, p1, p2, it);
+
+            __m256 t = _mm256_loadu_ps(it);
+
+            // lerp translation and scale
+            for (u32 i = 0; i < k_pose_quat; ++i)
+            {
+                __m256 a = _mm256_loadu_ps(p1[i]);
+                __m256 b = _mm256_loadu_ps(p2[i]);
+                _mm256_storeu_ps(result[i], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t)));
+            }
+
+            // nlerp quaternions, flip b into the same hemisphere as a
+            __m256 qa[4];
+            __m256 qb[4];
+            for (u32 i = 0; i < 4; ++i)
+            {
+                qa[i] = _mm256_loadu_ps(p1[k_pose_quat + i]);
+                qb[i] = _mm256_loadu_ps(p2[k_pose_quat + i]);
+            }
+
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qa[0], qb[0]), _mm256_mul_ps(qa[1], qb[1])),
+                                     _mm256_add_ps(_mm256_mul_ps(qa[2], qb[2]), _mm256_mul_ps(qa[3], qb[3])));
+
+            __m256 sign = _mm256_and_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(-0.0f));
+
+            __m256 q[4];
+            __m256 len2 = _mm256_setzero_ps();
+            for (u32 i = 0; i < 4; ++i)
+            {
+                __m256 b = _mm256_xor_ps(qb[i], sign);
+                q[i] = _mm256_add_ps(qa[i], _mm256_mul_ps(_mm256_sub_ps(b, qa[i]), t));
+                len2 = _mm256_add_ps(len2, _mm256_mul_ps(q[i], q[i]));
+            }
+
+            __m256 inv_len = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len2));
+            for (u32 i = 0; i < 4; ++i)
+                _mm256_storeu_ps(result[k_pose_quat + i], _mm256_mul_ps(q[i], inv_len));
+
+            scatter_lanes<8>(instance, lane_channel, num_lanes, result);
+        }
+
+        void sample_anim_compressed_simd256(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            sample_anim_compressed_lanes<8, sample_lanes_simd256>(instance, anim_t, looped);
+        }
+#else
+        void sample_anim_compressed_simd256(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            sample_anim_compressed_simd128(instance, anim_t, looped);
+        }
+#endif
+
+        void sample_anim(anim_instance& instance, f32 anim_t, bool looped)
+        {
+            if (!instance.compressed.keys)
+            {
+                sample_anim_soa(instance, anim_t, looped);
+                return;
+            }
+
+            sample_anim_compressed_simd256(instance, anim_t, looped);
+        }
+    } // namespace ecs
+} // namespace put
@@ -0,0 +1,88 @@
+// ecs_anim.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#pragma once
+
+#include "types.h"
+
+namespace put
+{
+    namespace ecs
+    {
+        struct soa_anim;
+        struct anim_instance;
+
+        namespace e_anim_key_flags
+        {
+            enum anim_key_flags_t
+            {
+                translate_x = 1 << 0,
+                translate_y = 1 << 1,
+                translate_z = 1 << 2,
+                scale_x = 1 << 3,
+                scale_y = 1 << 4,
+                scale_z = 1 << 5,
+                rotation = 1 << 6,
+                baked_quaternion = 1 << 7
+            };
+        }
+        typedef u32 anim_key_flags;
+
+        // 24 byte key, translation and scale are quantised to the channel range.
+        // rotation is 48 bit smallest three, 15 bits per component and the index of the largest in the top bits.
+        struct anim_key_q
+        {
+            f32 time;
+            u16 q[3];
+            u16 t[3];
+            u16 s[3];
+            u16 pad;
+        };
+
+        struct compressed_anim_channel
+        {
+            u32 num_keys;
+            u32 key_offset;
+            u32 flags;
+            f32 t_min[3];
+            f32 t_extent[3];
+            f32 s_min[3];
+            f32 s_extent[3];
+        };
+
+        // keys for each channel are contiguous and sorted by time, so a playing sampler only ever reads
+        // forward and both keys it interpolates are adjacent in memory.
+        struct compressed_anim
+        {
+            u32                      num_channels = 0;
+            u32                      num_keys = 0;
+            compressed_anim_channel* channels = nullptr;
+            anim_key_q*              keys = nullptr;
+        };
+
+        struct anim_compression_stats
+        {
+            u32    src_keys = 0;
+            u32    keys = 0;
+            size_t src_size = 0;
+            size_t size = 0;
+        };
+
+        // key reduce with error tolerance and quantise an uncompressed soa anim
+        void compress_anim(const soa_anim& soa, compressed_anim& out, f32 tolerance, anim_compression_stats* stats = nullptr);
+        void free_compressed_anim(compressed_anim& ca);
+
+        size_t soa_anim_size(const soa_anim& soa);
+        size_t compressed_anim_size(const compressed_anim& ca);
+
+        // sample all channels of the anim instance at time t into instance.targets
+        void sample_anim_soa(anim_instance& instance, f32 t, bool looped);
+        void sample_anim_compressed_scalar(anim_instance& instance, f32 t, bool looped);
+        void sample_anim_compressed_simd128(anim_instance& instance, f32 t, bool looped);
+        void sample_anim_compressed_simd256(anim_instance& instance, f32 t, bool looped);
+
+        // picks compressed or soa and the widest simd available, 4 or 8 joints at a time
+        void sample_anim(anim_instance& instance, f32 t, bool looped);
+    } // namespace ecs
+} // namespace put
@@ -1,8 +1,11 @@
 #include "ecs_cull.h"
 
 #include "ecs_scene.h"
+#include "threads.h"
 #include "timer.h"
 
+#include <algorithm>
+
 #if __SSE2__ || __AVX2__ || __AVX__
 #include <immintrin.h>
 #include <xmmintrin.h>
@@ -101,6 +104,126 @@ namespace put
             }
         }
 
+        void select_geometry_lods(ecs_scene* scene, const camera* cam, const u32* entities, u32 num_entities)
+        {
+            static const f32 k_lod_hysteresis = 0.75f;
+
+            // ndc spans 2 units of screen height, perspective cameras also divide by distance
+            f32  scale = cam->proj.m[5] * 0.5f;
+            bool perspective = cam->proj.m[15] == 0.0f;
+            f32  threshold = scene->lod_error_threshold;
+
+            for (u32 i = 0; i < num_entities; ++i)
+            {
+                u32           n = entities[i];
+                cmp_geometry& geom = scene->geometries[n];
+
+                if (geom.num_lods == 0)
+                    continue;
+
+                // lod errors are relative to the mesh extents, the bounding diameter is a conservative stand in
+                const cmp_pos_extent& pe = scene->pos_extent[n];
+                f32                   size = pe.extent.w * 2.0f * scale;
+                if (perspective)
+                    size /= std::max(mag(pe.pos.xyz - cam->pos), cam->near_plane);
+
+                u32 lod = std::min(geom.lod, geom.num_lods);
+                while (lod > 0 && geom.lods[lod - 1].error * size > threshold)
+                    --lod;
+
+                while (lod < geom.num_lods && geom.lods[lod].error * size < threshold * k_lod_hysteresis)
+                    ++lod;
+
+                geom.lod = lod;
+            }
+        }
+
+        void cull_geometry_clusters(const ecs_scene* scene, const camera* cam, const u32* entities, u32 num_entities,
+                                    cluster_range* ranges_out, u32** indices_out)
+        {
+            static const u64 k_whole_mask =
+                e_cmp::skinned | e_cmp::cpu_skinned | e_cmp::pre_skinned | e_cmp::master_instance | e_cmp::sub_geometry;
+
+            const frustum& frust = cam->camera_frustum;
+            bool           perspective = cam->proj.m[15] == 0.0f;
+
+            for (u32 i = 0; i < num_entities; ++i)
+            {
+                u32                 n = entities[i];
+                const cmp_geometry& geom = scene->geometries[n];
+                cluster_range&      range = ranges_out[i];
+
+                range.start = k_cluster_range_whole;
+                range.count = geom.num_indices;
+
+                if (geom.num_clusters == 0 || geom.lod > 0 || (scene->entities[n] & k_whole_mask))
+                    continue;
+
+                // spheres scale by the largest axis, cones are only valid while the scale is uniform
+                const mat4& wm = scene->world_matrices[n];
+                f32         sx = mag((vec3f)wm.get_column(0).xyz);
+                f32         sy = mag((vec3f)wm.get_column(1).xyz);
+                f32         sz = mag((vec3f)wm.get_column(2).xyz);
+                f32         scale = std::max(sx, std::max(sy, sz));
+                bool        cones = perspective && std::min(sx, std::min(sy, sz)) > scale * 0.99f;
+
+                u32 start = sb_count(*indices_out);
+                for (u32 c = 0; c < geom.num_clusters; ++c)
+                {
+                    const geometry_cluster& cl = geom.clusters[c];
+
+                    vec3f pos = wm.transform_vector((vec3f)cl.pos_radius.xyz);
+                    f32   radius = cl.pos_radius.w * scale;
+
+                    bool inside = true;
+                    for (s32 p = 0; p < 6; ++p)
+                    {
+                        if (maths::point_plane_distance(pos, frust.p[p], frust.n[p]) > radius)
+                        {
+                            inside = false;
+                            break;
+                        }
+                    }
+
+                    if (!inside)
+                        continue;
+
+                    // every triangle faces away when the view direction to the apex lies inside the cone
+                    if (cones && cl.cone_axis_cutoff.w < 1.0f)
+                    {
+                        vec3f apex = wm.transform_vector((vec3f)cl.cone_apex.xyz);
+                        vec3f axis = normalized((vec3f)wm.transform_vector(vec4f(cl.cone_axis_cutoff.xyz, 0.0f)).xyz);
+                        if (dot(normalized(apex - cam->pos), axis) >= cl.cone_axis_cutoff.w)
+                            continue;
+                    }
+
+                    if (geom.index_type == PEN_FORMAT_R16_UINT)
+                    {
+                        const u16* src = (const u16*)geom.cpu_index_buffer + cl.index_offset;
+                        for (u32 j = 0; j < cl.num_indices; ++j)
+                            sb_push(*indices_out, src[j]);
+                    }
+                    else
+                    {
+                        const u32* src = (const u32*)geom.cpu_index_buffer + cl.index_offset;
+                        for (u32 j = 0; j < cl.num_indices; ++j)
+                            sb_push(*indices_out, src[j]);
+                    }
+                }
+
+                // nothing was culled, the static index buffer is already on the gpu
+                u32 count = sb_count(*indices_out) - start;
+                if (count == geom.num_indices)
+                {
+                    stb__sbn(*indices_out) = start;
+                    continue;
+                }
+
+                range.start = start;
+                range.count = count;
+            }
+        }
+
         //
         // sse2 128 implementation
         //
@@ -539,6 +662,299 @@ namespace put
             //frustum_cull_sphere_simd256(scene, cam, entities_in, entities_out);
         }
 
+        //
+        // clustered light assignment
+        //
+
+        struct light_cluster_slice
+        {
+            f32* bounds = nullptr;  // min x, max x, min y, max y of tiles, each padded to 4
+            f32* dist_x = nullptr;  // squared distance from the current light to each tile column
+            f32* dist_y = nullptr;  // and each tile row
+            u32* hits = nullptr;    // pairs of tile and light index
+            u32* counts = nullptr;  // lights per tile
+            u32* indices = nullptr; // light indices grouped by tile
+        };
+
+        namespace
+        {
+            struct cluster_view_light
+            {
+                vec3f pos; // view space with z flipped so it is the depth along the view direction
+                f32   radius;
+                vec3f dir;
+                f32   cos_angle;
+                f32   sin_angle;
+                bool  spot;
+            };
+
+            struct cluster_job
+            {
+                light_clusters*           clusters;
+                const cluster_view_light* lights;
+                u32                       num_lights;
+                f32                       proj_x;
+                f32                       proj_y;
+            };
+
+            template <typename T>
+            void resize_cluster_array(T*& arr, u32 count)
+            {
+                u32 cur = sb_count(arr);
+                if (cur < count)
+                    sb_add(arr, count - cur);
+                else if (arr)
+                    stb__sbn(arr) = count;
+            }
+
+            f32 get_cluster_slice_depth(const light_clusters& lc, u32 z)
+            {
+                return lc.near_plane * pow(lc.far_plane / lc.near_plane, (f32)z / (f32)lc.dims[2]);
+            }
+
+            f32 range_distance_sq(f32 v, f32 mn, f32 mx)
+            {
+                f32 d = std::max(mn - v, 0.0f) + std::max(v - mx, 0.0f);
+                return d * d;
+            }
+
+            // squared distance from v to count ranges, count is a multiple of 4
+            void range_distance_sq(f32 v, const f32* mn, const f32* mx, f32* out, u32 count)
+            {
+#if __SSE__ || __AVX__
+                __m128 vv = _mm_set1_ps(v);
+                __m128 zero = _mm_set1_ps(0.0f);
+                for (u32 i = 0; i < count; i += 4)
+                {
+                    __m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(mn + i), vv), zero);
+                    __m128 above = _mm_max_ps(_mm_sub_ps(vv, _mm_loadu_ps(mx + i)), zero);
+                    __m128 d = _mm_add_ps(below, above);
+                    _mm_storeu_ps(out + i, _mm_mul_ps(d, d));
+                }
+#else
+                for (u32 i = 0; i < count; ++i)
+                    out[i] = range_distance_sq(v, mn[i], mx[i]);
+#endif
+            }
+
+            // cone against the bounding sphere of a cluster
+            bool cone_intersects_sphere(const cluster_view_light& l, const vec3f& centre, f32 radius)
+            {
+                vec3f v = centre - l.pos;
+                f32   v_len_sq = dot(v, v);
+                f32   v1_len = dot(v, l.dir);
+                f32   closest = l.cos_angle * sqrt(std::max(v_len_sq - v1_len * v1_len, 0.0f)) - v1_len * l.sin_angle;
+
+                if (closest > radius)
+                    return false;
+
+                if (v1_len > radius + l.radius)
+                    return false;
+
+                if (v1_len < -radius)
+                    return false;
+
+                return true;
+            }
+
+            void assign_light_cluster_slices(void* user_data, u32 begin, u32 end)
+            {
+                cluster_job*    job = (cluster_job*)user_data;
+                light_clusters& lc = *job->clusters;
+
+                u32 dx = lc.dims[0];
+                u32 dy = lc.dims[1];
+                u32 px = PEN_ALIGN(dx, 4);
+                u32 py = PEN_ALIGN(dy, 4);
+
+                for (u32 z = begin; z < end; ++z)
+                {
+                    light_cluster_slice& slice = lc.slices[z];
+
+                    f32 zn = get_cluster_slice_depth(lc, z);
+                    f32 zf = get_cluster_slice_depth(lc, z + 1);
+
+                    // tile bounds over the depth range of the slice, padding tiles are never hit
+                    resize_cluster_array(slice.bounds, (px + py) * 2);
+                    resize_cluster_array(slice.dist_x, px);
+                    resize_cluster_array(slice.dist_y, py);
+
+                    f32* min_x = slice.bounds;
+                    f32* max_x = min_x + px;
+                    f32* min_y = max_x + px;
+                    f32* max_y = min_y + py;
+
+                    for (u32 t = 0; t < px; ++t)
+                    {
+                        f32 n0 = -1.0f + 2.0f * (f32)t / (f32)dx;
+                        f32 n1 = n0 + 2.0f / (f32)dx;
+                        min_x[t] = t < dx ? std::min(n0 * zn, n0 * zf) / job->proj_x : FLT_MAX;
+                        max_x[t] = t < dx ? std::max(n1 * zn, n1 * zf) / job->proj_x : FLT_MAX;
+                    }
+
+                    for (u32 t = 0; t < py; ++t)
+                    {
+                        f32 n0 = -1.0f + 2.0f * (f32)t / (f32)dy;
+                        f32 n1 = n0 + 2.0f / (f32)dy;
+                        min_y[t] = t < dy ? std::min(n0 * zn, n0 * zf) / job->proj_y : FLT_MAX;
+                        max_y[t] = t < dy ? std::max(n1 * zn, n1 * zf) / job->proj_y : FLT_MAX;
+                    }
+
+                    resize_cluster_array(slice.counts, dx * dy);
+                    memset(slice.counts, 0x0, sizeof(u32) * dx * dy);
+                    resize_cluster_array(slice.hits, 0);
+
+                    for (u32 i = 0; i < job->num_lights; ++i)
+                    {
+                        const cluster_view_light& l = job->lights[i];
+
+                        f32 r2 = l.radius * l.radius;
+                        f32 dz = range_distance_sq(l.pos.z, zn, zf);
+                        if (dz > r2)
+                            continue;
+
+                        range_distance_sq(l.pos.x, min_x, max_x, slice.dist_x, px);
+                        range_distance_sq(l.pos.y, min_y, max_y, slice.dist_y, py);
+
+                        for (u32 y = 0; y < dy; ++y)
+                        {
+                            f32 dyz = slice.dist_y[y] + dz;
+                            if (dyz > r2)
+                                continue;
+
+                            for (u32 x = 0; x < dx; ++x)
+                            {
+                                if (slice.dist_x[x] + dyz > r2)
+                                    continue;
+
+                                if (l.spot)
+                                {
+                                    vec3f cmin = vec3f(min_x[x], min_y[y], zn);
+                                    vec3f cmax = vec3f(max_x[x], max_y[y], zf);
+                                    vec3f centre = (cmin + cmax) * 0.5f;
+                                    if (!cone_intersects_sphere(l, centre, mag(cmax - centre)))
+                                        continue;
+                                }
+
+                                u32 tile = y * dx + x;
+                                sb_push(slice.hits, tile);
+                                sb_push(slice.hits, i);
+                                slice.counts[tile]++;
+                            }
+                        }
+                    }
+
+                    // group by tile, counts becomes the start of each tile
+                    u32 num_hits = sb_count(slice.hits) / 2;
+                    resize_cluster_array(slice.indices, num_hits);
+
+                    u32 start = 0;
+                    for (u32 t = 0; t < dx * dy; ++t)
+                    {
+                        u32 c = slice.counts[t];
+                        slice.counts[t] = start;
+                        start += c;
+                    }
+
+                    for (u32 h = 0; h < num_hits; ++h)
+                        slice.indices[slice.counts[slice.hits[h * 2]]++] = slice.hits[h * 2 + 1];
+                }
+            }
+        } // namespace
+
+        void assign_light_clusters(light_clusters& clusters, const camera* cam, const cluster_light* lights, u32 num_lights)
+        {
+            light_clusters& lc = clusters;
+
+            u32 num_tiles = lc.dims[0] * lc.dims[1];
+            u32 num_clusters = num_tiles * lc.dims[2];
+
+            if (sb_count(lc.slices) != lc.dims[2])
+            {
+                free_light_clusters(lc);
+                sb_add(lc.slices, lc.dims[2]);
+            }
+
+            lc.near_plane = std::max(cam->near_plane, 0.001f);
+            lc.far_plane = std::max(cam->far_plane, lc.near_plane * 2.0f);
+            lc.slice_scale = (f32)lc.dims[2] / log(lc.far_plane / lc.near_plane);
+
+            // lights into view space, flip z so depth increases away from the camera
+            static cluster_view_light* view_lights = nullptr;
+            resize_cluster_array(view_lights, num_lights);
+
+            for (u32 i = 0; i < num_lights; ++i)
+            {
+                vec3f vp = cam->view.transform_vector(vec4f(lights[i].pos_radius.xyz, 1.0f)).xyz;
+                vec3f vd = cam->view.transform_vector(vec4f(lights[i].dir_angle.xyz, 0.0f)).xyz;
+
+                cluster_view_light& vl = view_lights[i];
+                vl.pos = vec3f(vp.x, vp.y, -vp.z);
+                vl.radius = lights[i].pos_radius.w;
+                vl.dir = normalized(vec3f(vd.x, vd.y, -vd.z));
+                vl.cos_angle = cos(lights[i].dir_angle.w);
+                vl.sin_angle = sin(lights[i].dir_angle.w);
+                vl.spot = lights[i].dir_angle.w > 0.0f;
+            }
+
+            cluster_job job;
+            job.clusters = &lc;
+            job.lights = view_lights;
+            job.num_lights = num_lights;
+            job.proj_x = cam->proj.m[0];
+            job.proj_y = cam->proj.m[5];
+
+            pen::jobs_parallel_for(lc.dims[2], 1, &assign_light_cluster_slices, &job);
+
+            // merge slices into compact offsets and indices
+            resize_cluster_array(lc.offsets, num_clusters * 2);
+            resize_cluster_array(lc.indices, 0);
+
+            for (u32 z = 0; z < lc.dims[2]; ++z)
+            {
+                light_cluster_slice& slice = lc.slices[z];
+
+                u32  base = sb_count(lc.indices);
+                u32  num_indices = sb_count(slice.indices);
+                u32* offsets = &lc.offsets[z * num_tiles * 2];
+
+                // counts now hold the end of each tile
+                u32 start = 0;
+                for (u32 t = 0; t < num_tiles; ++t)
+                {
+                    offsets[t * 2 + 0] = base + start;
+                    offsets[t * 2 + 1] = slice.counts[t] - start;
+                    start = slice.counts[t];
+                }
+
+                if (num_indices)
+                    memcpy(sb_add(lc.indices, num_indices), slice.indices, sizeof(u32) * num_indices);
+            }
+        }
+
+        void free_light_clusters(light_clusters& clusters)
+        {
+            u32 num_slices = sb_count(clusters.slices);
+            for (u32 z = 0; z < num_slices; ++z)
+            {
+                light_cluster_slice& slice = clusters.slices[z];
+                sb_free(slice.bounds);
+                sb_free(slice.dist_x);
+                sb_free(slice.dist_y);
+                sb_free(slice.hits);
+                sb_free(slice.counts);
+                sb_free(slice.indices);
+            }
+
+            sb_free(clusters.slices);
+            sb_free(clusters.offsets);
+            sb_free(clusters.indices);
+
+            clusters.slices = nullptr;
+            clusters.offsets = nullptr;
+            clusters.indices = nullptr;
+        }
+
         void debug_culling()
         {
             // debug culling
@@ -9,6 +9,33 @@ namespace put
     {
         struct ecs_scene;
 
+        struct cluster_light
+        {
+            vec4f pos_radius; // world space position and radius
+            vec4f dir_angle;  // spot light direction and cone half angle in radians, w is 0 for point lights
+        };
+
+        struct light_cluster_slice;
+
+        static const u32 k_cluster_range_whole = 0xffffffff;
+
+        struct cluster_range
+        {
+            u32 start; // into the culled indices, k_cluster_range_whole to draw the geometry's own index buffer
+            u32 count; // 0 when every cluster was culled
+        };
+
+        struct light_clusters
+        {
+            u32                  dims[3] = {16, 9, 24};
+            u32*                 offsets = nullptr; // start and count into indices for each cluster, x then y then z
+            u32*                 indices = nullptr; // light indices, compact
+            f32                  near_plane = 0.0f; // z slices are exponential from near_plane to far_plane
+            f32                  far_plane = 0.0f;
+            f32                  slice_scale = 0.0f; // slice = log(depth / near_plane) * slice_scale
+            light_cluster_slice* slices = nullptr;   // per z slice scratch for the worker threads
+        };
+
         // run time detect of simd extensions and setup function pointers to the fastest implementation
         void simd_init();
 
@@ -20,5 +47,21 @@ namespace put
         // frustum_cull_xxx functions are replaced by simd where available and fall back to scalar if no simd is available
         void frustum_cull_aabb(const ecs_scene* scene, const camera* cam, u32* entities_in, u32** entities_out);
         void frustum_cull_sphere(const ecs_scene* scene, const camera* cam, u32* entities_in, u32** entities_out);
+
+        // picks a geometry lod for each entity from its projected size in cam, a level is used while its error stays
+        // under scene->lod_error_threshold screen heights, coarser levels need a margin below it to avoid popping.
+        void select_geometry_lods(ecs_scene* scene, const camera* cam, const u32* entities, u32 num_entities);
+
+        // culls the meshlets of full detail geometry outside of cam's frustum, perspective cameras also cull meshlets whose
+        // normal cone faces away. surviving triangles are appended to indices_out as 32 bit indices with a range for each
+        // entity, skinned, instanced, lod and unclustered geometry gets a whole range.
+        void cull_geometry_clusters(const ecs_scene* scene, const camera* cam, const u32* entities, u32 num_entities,
+                                    cluster_range* ranges_out, u32** indices_out);
+
+        // bins lights into a froxel grid over the view frustum of a perspective camera. each z slice is assigned
+        // on a worker thread, lights are tested against 4 clusters at a time with simd where available.
+        // does not touch the renderer so it can be run and checked without a gpu.
+        void assign_light_clusters(light_clusters& clusters, const camera* cam, const cluster_light* lights, u32 num_lights);
+        void free_light_clusters(light_clusters& clusters);
     } // namespace ecs
 } // namespace put
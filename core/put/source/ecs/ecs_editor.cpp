@@ -4,8 +4,10 @@
 
 #include "ecs/ecs_editor.h"
 #include "ecs/ecs_resources.h"
+#include "ecs/ecs_skin.h"
 #include "ecs/ecs_utilities.h"
 
+#include "audio/audio.h"
 #include "camera.h"
 #include "debug_render.h"
 #include "dev_ui.h"
@@ -214,9 +216,9 @@ namespace put
             u32 light = get_new_entity(scene);
             scene->names[light] = "front_light";
             scene->id_name[light] = PEN_HASH("front_light");
-            scene->lights[light].colour = vec3f::one();
-            scene->lights[light].direction = vec3f::one();
-            scene->lights[light].type = e_light_type::dir;
+            scene->lights.write(light).colour = vec3f::one();
+            scene->lights.write(light).direction = vec3f::one();
+            scene->lights.write(light).type = e_light_type::dir;
             scene->transforms[light].translation = vec3f::zero();
             scene->transforms[light].rotation = quat();
             scene->transforms[light].scale = vec3f::one();
@@ -309,8 +311,8 @@ namespace put
 
             scene->entities[master] |= e_cmp::master_instance;
 
-            scene->master_instances[master].num_instances = selection_size;
-            scene->master_instances[master].instance_stride = sizeof(cmp_draw_call);
+            scene->master_instances.write(master).num_instances = selection_size;
+            scene->master_instances.write(master).instance_stride = sizeof(cmp_draw_call);
 
             pen::buffer_creation_params bcp;
             bcp.usage_flags = PEN_USAGE_DYNAMIC;
@@ -319,7 +321,7 @@ namespace put
             bcp.data = nullptr;
             bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
 
-            scene->master_instances[master].instance_buffer = pen::renderer_create_buffer(bcp);
+            scene->master_instances.write(master).instance_buffer = pen::renderer_create_buffer(bcp);
 
             // todo - must ensure list is contiguous.
             dev_console_log("[instance] master instance: %i with %i sub instances", master, selection_size);
@@ -374,7 +376,7 @@ namespace put
                     clone_entity(scene, scene->selection_list[i], nn++, start, e_clone_mode::move, vec3f::zero(), "");
             }
 
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
         }
 
         void clear_selection(ecs_scene* scene)
@@ -388,7 +390,7 @@ namespace put
             }
 
             sb_clear(scene->selection_list);
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
         }
 
         void add_selection(ecs_scene* scene, u32 index, u32 select_mode)
@@ -458,7 +460,7 @@ namespace put
 
             initialise_free_list(scene);
 
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
         }
 
         void enumerate_selection_ui(const ecs_scene* scene, bool* opened)
@@ -1427,6 +1429,39 @@ namespace put
                         debug_show_icons();
                     }
 
+#ifndef PEN_PLATFORM_WEB
+                    if (ImGui::CollapsingHeader("Audio"))
+                    {
+                        put::audio_stats as;
+                        put::audio_get_stats(&as);
+
+                        ImGui::Text("Commands: %u / %u (peak %u, dropped %u)", as.cmds_last_frame, as.cmd_capacity,
+                                    as.cmds_peak, as.cmds_dropped);
+                        ImGui::ProgressBar((f32)as.cmds_last_frame / (f32)std::max<u32>(as.cmd_capacity, 1));
+                        ImGui::Text("Voices: %u Real: %u / %u Virtual: %u", as.num_voices, as.num_real_voices,
+                                    as.max_real_voices, as.num_virtual_voices);
+                        ImGui::Text("Promoted: %u Demoted: %u", as.promotions, as.demotions);
+
+                        // memory is only tracked by the software mixer
+                        put::audio_mixer_stats ms;
+                        if (put::audio_get_mixer_stats(&ms) == PEN_ERR_OK)
+                        {
+                            f32 mb = 1.0f / (1024.0f * 1024.0f);
+                            ImGui::Text("Sample Cache: %u sounds %.2f mb", ms.num_cached_sounds,
+                                        (f32)ms.sample_cache_bytes * mb);
+                            ImGui::Text("Streams: %u decoded %.2f mb mapped %.2f mb underruns %llu", ms.num_streams,
+                                        (f32)ms.stream_buffer_bytes * mb, (f32)ms.stream_file_bytes * mb,
+                                        (unsigned long long)ms.stream_underrun_frames);
+                        }
+                    }
+#endif
+
+                    if (ImGui::CollapsingHeader("Shaders"))
+                    {
+                        // techniques not pre-warmed ahead of use are loaded synchronously and hitch the frame
+                        ImGui::Text("Lazy Loads: %u", pmfx::get_lazy_load_count());
+                    }
+
                     ImGui::End();
                 }
             }
@@ -1551,7 +1586,7 @@ namespace put
                         if (scene->entities[i] & e_cmp::constraint)
                             continue;
 
-                        scene->physics_data[i].constraint = preview_constraint;
+                        scene->physics_data.write(i).constraint = preview_constraint;
 
                         instantiate_constraint(scene, i);
                     }
@@ -1559,7 +1594,7 @@ namespace put
             }
 
             if (sb_count(scene->selection_list) == 1)
-                scene->physics_data[scene->selection_list[0]].constraint = preview_constraint;
+                scene->physics_data.write(scene->selection_list[0]).constraint = preview_constraint;
         }
 
         void scene_rigid_body_ui(ecs_scene* scene)
@@ -1612,8 +1647,8 @@ namespace put
                 for (u32 s = 0; s < sel_num; ++s)
                 {
                     u32 i = scene->selection_list[s];
-                    scene->physics_data[i].rigid_body = s_physics_preview.params.rigid_body;
-                    scene->physics_offset[i].translation = s_physics_preview.offset.translation;
+                    scene->physics_data.write(i).rigid_body = s_physics_preview.params.rigid_body;
+                    scene->physics_offset.write(i).translation = s_physics_preview.offset.translation;
 
                     if (!(scene->entities[i] & e_cmp::physics))
                         instantiate_rigid_body(scene, i);
@@ -1682,6 +1717,11 @@ namespace put
                 {
                     // rb
                     scene_rigid_body_ui(scene);
+
+                    // mesh and hull shapes use collision cooked by mesh_opt when the .pmc exists
+                    physics::shape_build_stats sbs = physics::get_shape_build_stats();
+                    ImGui::Text("Cooked Shapes: %u (%.2fms) Built Shapes: %u (%.2fms)", sbs.num_cooked, sbs.cooked_ms,
+                                sbs.num_built, sbs.built_ms);
                 }
                 else if (physics_type == e_physics_type::constraint)
                 {
@@ -1691,7 +1731,7 @@ namespace put
             }
 
             if (sb_count(scene->selection_list) == 1)
-                scene->physics_data[scene->selection_list[0]] = s_physics_preview.params;
+                scene->physics_data.write(scene->selection_list[0]) = s_physics_preview.params;
         }
 
         bool scene_geometry_ui(ecs_scene* scene)
@@ -1717,6 +1757,25 @@ namespace put
                     ImGui::Text("Geometry Name: %s", scene->geometry_names[selected_index].c_str());
 
                     put::dev_ui::set_tooltip("Delete Geometry");
+
+                    // cpu skinned entities get bounds from their animated vertices and can be ray cast against
+                    if (scene->entities[selected_index] & e_cmp::skinned)
+                    {
+                        bool cpu_skin = scene->entities[selected_index] & e_cmp::cpu_skinned;
+                        if (ImGui::Checkbox("Cpu Skin", &cpu_skin))
+                        {
+                            if (cpu_skin)
+                            {
+                                instantiate_cpu_skin(scene, selected_index);
+                            }
+                            else
+                            {
+                                scene->entities[selected_index] &= ~e_cmp::cpu_skinned;
+                                scene->flags |= e_scene_flags::invalidate_queries;
+                            }
+                        }
+                    }
+
                     ImGui::PopID();
 
                     return iv;
@@ -1930,7 +1989,7 @@ namespace put
 
             // master mat
             cmp_material&      mm = scene->materials[selected_index];
-            material_resource& mr = scene->material_resources[selected_index];
+            const material_resource& mr = scene->material_resources[selected_index];
             cmp_material_data  mat = scene->material_data[selected_index];
             cmp_samplers       samp = scene->samplers[selected_index];
             u32                perm = scene->material_permutation[selected_index];
@@ -1943,7 +2002,7 @@ namespace put
             for (u32 i = 1; i < num_selected; ++i)
             {
                 cmp_material&      m2 = scene->materials[scene->selection_list[i]];
-                material_resource& mr2 = scene->material_resources[scene->selection_list[i]];
+                const material_resource& mr2 = scene->material_resources[scene->selection_list[i]];
 
                 if (shader != m2.shader)
                 {
@@ -1993,9 +2052,9 @@ namespace put
                 {
                     u32 si = scene->selection_list[i];
 
-                    scene->material_resources[si].id_technique = id_technique;
-                    scene->material_resources[si].id_shader = id_shader;
-                    scene->material_resources[si].shader_name = shader_list[shader];
+                    scene->material_resources.write(si).id_technique = id_technique;
+                    scene->material_resources.write(si).id_shader = id_shader;
+                    scene->material_resources.write(si).shader_name = shader_list[shader];
                 }
 
                 rebake = true;
@@ -2011,7 +2070,7 @@ namespace put
                 {
                     u32 si = scene->selection_list[i];
 
-                    scene->material_resources[si].id_technique = id_technique;
+                    scene->material_resources.write(si).id_technique = id_technique;
                 }
 
                 rebake = true;
@@ -2181,7 +2240,7 @@ namespace put
 
             if (ImGui::CollapsingHeader("Light"))
             {
-                cmp_light& snl = scene->lights[selected_index];
+                cmp_light& snl = scene->lights.write(selected_index);
 
                 if (scene->entities[selected_index] & e_cmp::light)
                 {
@@ -2232,7 +2291,7 @@ namespace put
                                 instantiate_area_light_ex(scene, selected_index, alr);
                             }
 
-                            area_light_resource& alr = scene->area_light_resources[selected_index];
+                            const area_light_resource& alr = scene->area_light_resources[selected_index];
 
                             u32 shader = 0;
                             u32 technique_list_index = 0;
@@ -2263,7 +2322,7 @@ namespace put
 
                     snl.direction = maths::azimuth_altitude_to_xyz(snl.azimuth, snl.altitude);
 
-                    vec3f& col = scene->lights[selected_index].colour;
+                    vec3f& col = scene->lights.write(selected_index).colour;
                     ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.x, col.y, col.z, 1.0f));
 
                     if (ImGui::Button("Colour"))
@@ -2439,8 +2498,37 @@ namespace put
                     ImGui::Unindent();
 
                     ImGui::Text("Total Entities: %lu", scene->num_entities);
+
+                    size_t cmp_mem, cmp_contiguous_mem;
+                    get_component_memory(scene, cmp_mem, cmp_contiguous_mem);
+                    ImGui::Text("Component Memory: %.2fMB (%.2fMB contiguous)", (f64)cmp_mem / (1024.0 * 1024.0),
+                                (f64)cmp_contiguous_mem / (1024.0 * 1024.0));
                     ImGui::Text("Selected: %i", (s32)sb_count(scene->selection_list));
 
+                    defrag_stats dfs;
+                    get_defrag_stats(scene, dfs);
+                    ImGui::Text("Fragmentation: %.1f%% (%u misplaced, %u holes)", dfs.fragmentation * 100.0f, dfs.misplaced,
+                                dfs.holes);
+
+                    ImGui::Text("Draw Calls: %u, Triangles: %u (%u saved by lods)", scene->draw_stats.draw_calls,
+                                scene->draw_stats.triangles, scene->draw_stats.lod_triangles_saved);
+                    ImGui::InputFloat("Lod Error Threshold", &scene->lod_error_threshold, 0.0001f, 0.001f, 4);
+
+                    ImGui::CheckboxFlags("Cache Shadows", &scene->flags, e_scene_flags::cache_shadows);
+                    if (scene->flags & e_scene_flags::cache_shadows)
+                        ImGui::Text("Shadow Views: %u rendered, %u cached", scene->shadow_view_stats.rendered,
+                                    scene->shadow_view_stats.cached);
+
+                    // measured against drawing the same meshes whole
+                    ImGui::CheckboxFlags("Cull Clusters", &scene->flags, e_scene_flags::cull_clusters);
+                    if (scene->flags & e_scene_flags::cull_clusters)
+                    {
+                        const render_stats& rs = scene->draw_stats;
+                        u32                 whole = rs.triangles + rs.cluster_triangles_culled;
+                        f32                 pc = whole ? (f32)rs.cluster_triangles_culled / (f32)whole * 100.0f : 0.0f;
+                        ImGui::Text("Clusters: %u triangles culled, %.1f%% of whole meshes", rs.cluster_triangles_culled, pc);
+                    }
+
                     for (s32 i = 0; i < PEN_ARRAY_SIZE(dumps); ++i)
                         dumps[i].count = 0;
 
@@ -3066,7 +3154,7 @@ namespace put
                 if (selected_only && !(scene->state_flags[n] & e_state::selected))
                     continue;
 
-                cmp_light& snl = scene->lights[n];
+                const cmp_light& snl = scene->lights[n];
 
                 switch (snl.type)
                 {
@@ -3173,10 +3261,14 @@ namespace put
                     }
                     else
                     {
-                        // from physics instance
+                        // from physics instance, the entity sits at the body minus the physics offset
                         mat4 scale = mat::create_scale(scene->physics_data[n].rigid_body.dimensions);
-                        mat4 rbmat = physics::get_rb_matrix(scene->physics_handles[n]);
-                        dc.world_matrix = rbmat * scale;
+
+                        vec3f p = scene->world_matrices[n].get_translation() + scene->physics_offset[n].translation;
+                        mat4  rot_mat;
+                        scene->transforms[n].rotation.get_matrix(rot_mat);
+
+                        dc.world_matrix = mat::create_translation(p) * rot_mat * scale;
                     }
 
                     dc.v2 = vec4f::white();
@@ -14,6 +14,7 @@
 #include "hash.h"
 #include "pen_string.h"
 #include "str_utilities.h"
+#include "timer.h"
 
 #include "meshoptimizer.h"
 
@@ -33,6 +34,30 @@ namespace
     static const u32 k_matrix_floats = 16;
     static const u32 k_extent_floats = 3;
 
+    // pma files exported from the pipeline are version 1, optimise_pma writes quantised key reduced anims
+    static const u32 k_pma_compressed_version = 2;
+
+    // pmm geometry exported from the pipeline is version 1, optimise_pmm appends simplified index buffers to each submesh
+    static const u32 k_pmm_lod_version = 2;
+    static const u32 k_pmm_max_lods = e_scene_limits::max_geometry_lods - 1;
+    static const f32 k_lod_index_ratio = 0.5f;      // each level targets this fraction of the previous level's indices
+    static const f32 k_lod_min_reduction = 0.8f;    // stop the chain when a level keeps more of the previous than this
+    static const f32 k_lod_target_error[] = {0.01f, 0.03f, 0.08f};
+    static_assert(PEN_ARRAY_SIZE(k_lod_target_error) == k_pmm_max_lods, "mismatched lod error size");
+
+    // version 3 appends meshlets of the full detail mesh, for cluster culling
+    static const u32 k_pmm_cluster_version = 3;
+    static const u32 k_cluster_vertices = 64;
+    static const u32 k_cluster_triangles = 124;
+    static const u32 k_cluster_min_triangles = k_cluster_triangles * 4; // smaller meshes are always drawn whole
+    static_assert(sizeof(geometry_cluster) == 64, "geometry_cluster is written to pmm files as is");
+
+    // collision cooked by optimise_pmm is written alongside the pmm, blobs are 16 byte aligned from the start of the file
+    static const u32 k_pmc_version = 1;
+    static const u32 k_pmc_align = 16;
+    static const f32 k_anim_key_tolerance = 0.001f;
+    static const u32 k_anim_benchmark_samples = 1000;
+
     namespace e_pmm_transform
     {
         enum pmm_transform_t
@@ -69,6 +94,15 @@ namespace
         std::vector<Str> geometry_names;
     };
 
+    struct pmm_lod
+    {
+        f32   error;
+        u32   num_indices;
+        u32   num_pos_indices;
+        void* index_data; // same index size as the submesh
+        void* pos_index_data;
+    };
+
     struct pmm_submesh
     {
         // pmm submesh header
@@ -96,6 +130,34 @@ namespace
         size_t vertex_data_size;
         void*  index_data;
         size_t index_data_size;
+        u32    num_lods;
+        pmm_lod lods[k_pmm_max_lods];
+        u32    num_clusters;
+        void*  cluster_data;
+    };
+
+    struct pmc_entry
+    {
+        hash_id geometry; // hash of the geometry name
+        u32     submesh;
+        u32     mesh_offset;
+        u32     mesh_size;
+        u32     hull_offset;
+        u32     hull_size;
+    };
+
+    struct pmc_file
+    {
+        hash_id file_hash;
+        u8*     data; // aligned, the physics thread uses the blobs in place so files stay loaded
+        u32     size;
+    };
+
+    struct pmc_cooked
+    {
+        pmc_entry entry;
+        void*     mesh;
+        void*     hull;
     };
 
     struct pmm_geometry
@@ -117,6 +179,7 @@ namespace
     std::vector<geometry_resource*> s_geometry_resources;
     std::vector<material_resource*> s_material_resources;
     std::vector<animation_resource> s_animation_resources;
+    std::vector<pmc_file>           s_collision_files;
 
     bool parse_pmm_contents(const c8* filename, pmm_contents& contents)
     {
@@ -239,6 +302,44 @@ namespace
                 memcpy(sm.index_data, p_reader, sm.index_data_size);
                 p_reader = (u32*)((c8*)p_reader + sm.index_data_size);
 
+                // simplified levels, largest first
+                if (og.version >= k_pmm_lod_version)
+                {
+                    sm.num_lods = *p_reader++;
+                    PEN_ASSERT(sm.num_lods <= k_pmm_max_lods);
+                    for (u32 l = 0; l < sm.num_lods; ++l)
+                    {
+                        pmm_lod& lod = sm.lods[l];
+                        memcpy(&lod.error, p_reader++, sizeof(f32));
+                        lod.num_indices = *p_reader++;
+                        lod.num_pos_indices = *p_reader++;
+
+                        size_t ib_size = lod.num_indices * sm.index_size;
+                        lod.index_data = pen::memory_alloc(ib_size);
+                        memcpy(lod.index_data, p_reader, ib_size);
+                        p_reader = (u32*)((c8*)p_reader + ib_size);
+
+                        size_t pos_ib_size = lod.num_pos_indices * sm.pos_index_size;
+                        lod.pos_index_data = pen::memory_alloc(pos_ib_size);
+                        memcpy(lod.pos_index_data, p_reader, pos_ib_size);
+                        p_reader = (u32*)((c8*)p_reader + pos_ib_size);
+                    }
+                }
+
+                // meshlets, offsets index the full detail index buffer
+                if (og.version >= k_pmm_cluster_version)
+                {
+                    sm.num_clusters = *p_reader++;
+
+                    size_t cluster_size = sm.num_clusters * sizeof(geometry_cluster);
+                    if (cluster_size)
+                    {
+                        sm.cluster_data = pen::memory_alloc(cluster_size);
+                        memcpy(sm.cluster_data, p_reader, cluster_size);
+                        p_reader = (u32*)((c8*)p_reader + cluster_size);
+                    }
+                }
+
                 og.submeshes.push_back(sm);
             }
 
@@ -345,6 +446,33 @@ namespace
                     r.index_buffer = pen::renderer_create_buffer(bcp);
                 }
 
+                // lods share the vertex buffers, only the index buffers are needed on the gpu
+                vr.num_lods = sm.num_lods;
+                pr.num_lods = sm.num_lods;
+                for (u32 l = 0; l < sm.num_lods; ++l)
+                {
+                    pmm_lod& lod = sm.lods[l];
+
+                    bcp.usage_flags = PEN_USAGE_DEFAULT;
+                    bcp.bind_flags = PEN_BIND_INDEX_BUFFER;
+                    bcp.cpu_access_flags = 0;
+
+                    bcp.buffer_size = lod.num_indices * sm.index_size;
+                    bcp.data = lod.index_data;
+                    vr.lods[l] = {pen::renderer_create_buffer(bcp), lod.num_indices, lod.error};
+
+                    bcp.buffer_size = lod.num_pos_indices * sm.pos_index_size;
+                    bcp.data = lod.pos_index_data;
+                    pr.lods[l] = {pen::renderer_create_buffer(bcp), lod.num_pos_indices, lod.error};
+
+                    pen::memory_free(lod.index_data);
+                    pen::memory_free(lod.pos_index_data);
+                }
+
+                // clusters are culled on the cpu against the retained index buffer
+                vr.num_clusters = sm.num_clusters;
+                vr.clusters = (geometry_cluster*)sm.cluster_data;
+
                 s_geometry_resources.push_back(p_geometry);
             }
         }
@@ -629,8 +757,8 @@ namespace
             scene->local_matrices[current_node] = (matrix);
 
             // store intial position for physics to hook into later
-            scene->physics_data[current_node].rigid_body.position = translation;
-            scene->physics_data[current_node].rigid_body.rotation = final_rotation;
+            scene->physics_data.write(current_node).rigid_body.position = translation;
+            scene->physics_data.write(current_node).rigid_body.rotation = final_rotation;
 
             // assign geometry, materials and physics
             u32 dest = current_node;
@@ -818,24 +946,90 @@ namespace put
 
         void instantiate_constraint(ecs_scene* scene, u32 node_index)
         {
-            physics::constraint_params& cp = scene->physics_data[node_index].constraint;
+            physics::constraint_params& cp = scene->physics_data.write(node_index).constraint;
 
             // hinge
             s32 rb = cp.rb_indices[0];
             cp.pivot = scene->transforms[node_index].translation - scene->physics_data[rb].rigid_body.position;
 
             scene->physics_handles[node_index] = physics::add_constraint(cp);
-            scene->physics_data[node_index].type = e_physics_type::constraint;
+            scene->physics_data.write(node_index).type = e_physics_type::constraint;
 
             scene->entities[node_index] |= e_cmp::constraint;
         }
 
+        void* get_cooked_collision(ecs_scene* scene, u32 node_index, u32 shape, u32* size_out)
+        {
+            *size_out = 0;
+
+            if (!(scene->entities[node_index] & e_cmp::geometry))
+                return nullptr;
+
+            geometry_resource* gr = get_geometry_resource(scene->id_geometry[node_index]);
+            if (!gr)
+                return nullptr;
+
+            pmc_file* file = nullptr;
+            for (auto& f : s_collision_files)
+                if (f.file_hash == gr->file_hash)
+                    file = &f;
+
+            if (!file)
+            {
+                // missing files are remembered too, so we only try once
+                pmc_file pf = {gr->file_hash, nullptr, 0};
+
+                Str filename = pen::str_remove_ext(gr->filename);
+                filename.append(".pmc");
+
+                void*     data = nullptr;
+                u32       size = 0;
+                pen_error err = pen::filesystem_read_file_to_buffer(filename.c_str(), &data, size);
+                if (err == PEN_ERR_OK && size >= sizeof(u32) * 2 && *(u32*)data == k_pmc_version)
+                {
+                    pf.data = (u8*)pen::memory_alloc_align(size, k_pmc_align);
+                    pf.size = size;
+                    memcpy(pf.data, data, size);
+                }
+                pen::memory_free(data);
+
+                s_collision_files.push_back(pf);
+                file = &s_collision_files.back();
+            }
+
+            if (!file->data)
+                return nullptr;
+
+            u32              num_entries = *((u32*)file->data + 1);
+            const pmc_entry* entries = (const pmc_entry*)(file->data + sizeof(u32) * 2);
+            if (sizeof(u32) * 2 + num_entries * sizeof(pmc_entry) > file->size)
+                return nullptr;
+
+            hash_id geometry = PEN_HASH(gr->geometry_name.c_str());
+            for (u32 i = 0; i < num_entries; ++i)
+            {
+                const pmc_entry& e = entries[i];
+                if (e.geometry != geometry || e.submesh != gr->submesh_index)
+                    continue;
+
+                u32 offset = shape == physics::e_shape::mesh ? e.mesh_offset : e.hull_offset;
+                u32 size = shape == physics::e_shape::mesh ? e.mesh_size : e.hull_size;
+                if (size == 0 || offset + size > file->size)
+                    return nullptr;
+
+                *size_out = size;
+                return file->data + offset;
+            }
+
+            return nullptr;
+        }
+
         void bake_rigid_body_params(ecs_scene* scene, u32 node_index)
         {
             u32 s = node_index;
 
-            physics::rigid_body_params& rb = scene->physics_data[s].rigid_body;
-            cmp_transform&              pt = scene->physics_offset[s];
+            physics::rigid_body_params& rb = scene->physics_data.write(s).rigid_body;
+            const cmp_transform&              pt = scene->physics_offset[s];
 
             vec3f min = scene->bounding_volumes[s].min_extents;
             vec3f max = scene->bounding_volumes[s].max_extents;
@@ -871,6 +1065,13 @@ namespace put
 
             rb.shape_up_axis = physics::e_up_axis::y;
             rb.start_matrix = start_transform;
+
+            // collision cooked offline replaces building meshes and hulls from raw data, pointers saved with the scene
+            // are stale so always look it up again
+            rb.mesh_data.cooked = nullptr;
+            rb.mesh_data.cooked_size = 0;
+            if (rb.shape == physics::e_shape::mesh || rb.shape == physics::e_shape::hull)
+                rb.mesh_data.cooked = get_cooked_collision(scene, s, rb.shape, &rb.mesh_data.cooked_size);
         }
 
         void instantiate_rigid_body(ecs_scene* scene, u32 node_index)
@@ -879,7 +1080,7 @@ namespace put
 
             bake_rigid_body_params(scene, node_index);
 
-            physics::rigid_body_params& rb = scene->physics_data[s].rigid_body;
+            const physics::rigid_body_params& rb = scene->physics_data[s].rigid_body;
 
             if (rb.shape == physics::e_shape::compound)
             {
@@ -896,7 +1097,7 @@ namespace put
                 scene->physics_handles[s] = physics::add_rb(rb);
             }
 
-            scene->physics_data[node_index].type = e_physics_type::rigid_body;
+            scene->physics_data.write(node_index).type = e_physics_type::rigid_body;
             scene->entities[s] |= e_cmp::physics;
         }
 
@@ -914,7 +1115,7 @@ namespace put
                 rbchild[i] = scene->physics_data[ci].rigid_body;
             }
 
-            physics::rigid_body_params& rb = scene->physics_data[parent].rigid_body;
+            const physics::rigid_body_params& rb = scene->physics_data[parent].rigid_body;
 
             physics::compound_rb_params cbpr;
             cbpr.rb = nullptr;
@@ -924,7 +1125,7 @@ namespace put
 
             u32* child_handles = nullptr;
             scene->physics_handles[parent] = physics::add_compound_rb(cbpr, &child_handles);
-            scene->physics_data[parent].type = e_physics_type::rigid_body;
+            scene->physics_data.write(parent).type = e_physics_type::rigid_body;
             scene->entities[parent] |= e_cmp::physics;
 
             // fixup children
@@ -933,7 +1134,7 @@ namespace put
             {
                 u32 ci = children[i];
                 scene->physics_handles[ci] = child_handles[i];
-                scene->physics_data[ci].type = e_physics_type::compound_child;
+                scene->physics_data.write(ci).type = e_physics_type::compound_child;
                 scene->entities[ci] |= e_cmp::physics;
             }
         }
@@ -976,7 +1177,11 @@ namespace put
             scene->entities[node_index] |= e_cmp::geometry;
 
             if (gr->p_skin)
+            {
+                // components are zeroed and 0 is a valid offset, there is no palette until the next update
                 scene->entities[node_index] |= e_cmp::skinned;
+                scene->anim_controller_v2.write(node_index).palette_offset = PEN_INVALID_HANDLE;
+            }
 
             instance->vertex_shader_class = ID_VERTEX_CLASS_BASIC;
             if (scene->entities[node_index] & e_cmp::skinned)
@@ -992,6 +1197,22 @@ namespace put
             pos_instance->num_vertices = pr.num_vertices;
             pos_instance->index_type = pr.index_type;
             pos_instance->vertex_size = pr.vertex_size;
+
+            // lods are selected per entity, shadow passes reuse the level picked for the main view
+            instance->lods = vr.lods;
+            instance->num_lods = vr.num_lods;
+            instance->lod = 0;
+            pos_instance->lods = pr.lods;
+            pos_instance->num_lods = pr.num_lods;
+            pos_instance->lod = 0;
+
+            // clusters are only drawn from the full vertex buffer, shadows and depth draw whole meshes
+            instance->clusters = vr.clusters;
+            instance->num_clusters = vr.num_clusters;
+            instance->cpu_index_buffer = vr.cpu_index_buffer;
+            pos_instance->clusters = nullptr;
+            pos_instance->num_clusters = 0;
+            pos_instance->cpu_index_buffer = pr.cpu_index_buffer;
         }
 
         void destroy_geometry(ecs_scene* scene, u32 node_index)
@@ -1006,7 +1227,9 @@ namespace put
             pen::memory_zero(&scene->geometries[node_index], sizeof(cmp_geometry));
 
             // release cbuffer
-            pen::renderer_release_buffer(scene->cbuffer[node_index]);
+            if (is_valid(scene->cbuffer[node_index]))
+                pen::renderer_release_buffer(scene->cbuffer[node_index]);
+
             scene->cbuffer[node_index] = PEN_INVALID_HANDLE;
             scene->geometry_names[node_index] = "";
 
@@ -1058,7 +1281,7 @@ namespace put
         void instantiate_model_pre_skin(ecs_scene* scene, s32 node_index)
         {
             cmp_geometry& geom = scene->geometries[node_index];
-            cmp_pre_skin& pre_skin = scene->pre_skin[node_index];
+            cmp_pre_skin& pre_skin = scene->pre_skin.write(node_index);
 
             u32 num_verts = geom.num_vertices;
 
@@ -1089,6 +1312,7 @@ namespace put
             // set pre-skinned and unset skinned
             scene->entities[node_index] |= e_cmp::pre_skinned;
             scene->entities[node_index] &= ~e_cmp::skinned;
+            scene->anim_controller_v2.write(node_index).palette_offset = PEN_INVALID_HANDLE;
 
             geom.vertex_shader_class = ID_VERTEX_CLASS_BASIC;
         }
@@ -1099,12 +1323,13 @@ namespace put
 
             if (geom->p_skin)
             {
-                cmp_anim_controller_v2& controller = scene->anim_controller_v2[node_index];
+                cmp_anim_controller_v2& controller = scene->anim_controller_v2.write(node_index);
 
                 std::vector<s32> joint_indices;
                 build_heirarchy_node_list(scene, node_index, joint_indices);
 
                 controller.joints_offset = -1;
+                controller.palette_offset = PEN_INVALID_HANDLE;
                 for (s32 jj = 0; jj < joint_indices.size(); ++jj)
                 {
                     s32 jnode = joint_indices[jj];
@@ -1143,8 +1368,8 @@ namespace put
             }
 
             scene->transforms[node_index].scale = scale;
-            scene->shadows[node_index].texture_handle = volume_texture;
-            scene->shadows[node_index].sampler_state = pmfx::get_render_state(id_cl, pmfx::e_render_state::sampler);
+            scene->shadows.write(node_index).texture_handle = volume_texture;
+            scene->shadows.write(node_index).sampler_state = pmfx::get_render_state(id_cl, pmfx::e_render_state::sampler);
             scene->entities[node_index] |= e_cmp::sdf_shadow;
         }
 
@@ -1166,13 +1391,13 @@ namespace put
             scene->entities[node_index] |= e_cmp::transform;
 
             // basic defaults
-            cmp_light& snl = scene->lights[node_index];
+            cmp_light& snl = scene->lights.write(node_index);
             snl.colour = vec3f::white();
             snl.radius = 1.0f;
             snl.spot_falloff = 0.001f;
             snl.cos_cutoff = 0.1f;
 
-            area_light_resource& alr = scene->area_light_resources[node_index];
+            area_light_resource& alr = scene->area_light_resources.write(node_index);
             alr.sampler_state_name = "";
             alr.texture_name = "";
             alr.shader_name = "";
@@ -1194,8 +1419,8 @@ namespace put
             instantiate_model_cbuffer(scene, node_index);
 
             scene->entities[node_index] |= e_cmp::light;
-            scene->lights[node_index].type = e_light_type::area;
-            scene->area_light[node_index].shader = PEN_INVALID_HANDLE;
+            scene->lights.write(node_index).type = e_light_type::area;
+            scene->area_light.write(node_index).shader = PEN_INVALID_HANDLE;
         }
 
         void instantiate_area_light_ex(ecs_scene* scene, u32 node_index, area_light_resource& alr)
@@ -1213,17 +1438,17 @@ namespace put
             instantiate_model_cbuffer(scene, node_index);
 
             scene->entities[node_index] |= e_cmp::light;
-            scene->lights[node_index].type = e_light_type::area_ex;
+            scene->lights.write(node_index).type = e_light_type::area_ex;
 
             if (!alr.texture_name.empty())
             {
-                scene->area_light[node_index].texture_handle = put::load_texture(alr.texture_name.c_str());
+                scene->area_light.write(node_index).texture_handle = put::load_texture(alr.texture_name.c_str());
             }
 
             if (!alr.shader_name.empty())
             {
-                scene->area_light[node_index].shader = pmfx::load_shader(alr.shader_name.c_str());
-                scene->area_light[node_index].technique = PEN_HASH(alr.technique_name.c_str());
+                scene->area_light.write(node_index).shader = pmfx::load_shader(alr.shader_name.c_str());
+                scene->area_light.write(node_index).technique = PEN_HASH(alr.technique_name.c_str());
             }
             else
             {
@@ -1234,7 +1459,7 @@ namespace put
             }
 
             // store for later for save load.
-            scene->area_light_resources[node_index] = alr;
+            scene->area_light_resources.write(node_index) = alr;
         }
 
         void instantiate_material(material_resource* mr, ecs_scene* scene, u32 node_index)
@@ -1263,7 +1488,7 @@ namespace put
                     mr->id_sampler_state[i] = id_default_sampler_state;
             }
 
-            scene->material_resources[node_index] = *mr;
+            scene->material_resources.write(node_index) = *mr;
 
             bake_material_handles(scene, node_index);
         }
@@ -1282,7 +1507,7 @@ namespace put
 
         void bake_material_handles(ecs_scene* scene, u32 node_index)
         {
-            material_resource* resource = &scene->material_resources[node_index];
+            material_resource* resource = &scene->material_resources.write(node_index);
             cmp_material*      material = &scene->materials[node_index];
             cmp_samplers&      samplers = scene->samplers[node_index];
             u32&               permutation = scene->material_permutation[node_index];
@@ -1364,51 +1589,38 @@ namespace put
             }
         }
 
-        anim_handle load_pma(const c8* filename)
+        void prewarm_scene_shaders(ecs_scene* scene)
         {
-            Str pd = put::dev_ui::get_program_preference_filename("project_dir");
-
-            Str stipped_filename = pen::str_replace_string(filename, pd.c_str(), "");
+            // per pass techniques are selected by material permutation at draw time
+            u32* permutations = nullptr;
+            for (u32 n = 0; n < scene->soa_size; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::material))
+                    continue;
 
-            hash_id filename_hash = PEN_HASH(stipped_filename.c_str());
+                u32 perm = scene->material_permutation[n];
 
-            // search for existing
-            s32 num_anims = s_animation_resources.size();
-            for (s32 i = 0; i < num_anims; ++i)
-            {
-                if (s_animation_resources[i].id_name == filename_hash)
+                bool found = false;
+                u32  num_perms = sb_count(permutations);
+                for (u32 i = 0; i < num_perms; ++i)
                 {
-                    return (anim_handle)i;
+                    if (permutations[i] == perm)
+                    {
+                        found = true;
+                        break;
+                    }
                 }
-            }
 
-            void* anim_file;
-            u32   anim_file_size;
-
-            pen_error err = pen::filesystem_read_file_to_buffer(filename, &anim_file, anim_file_size);
-
-            if (err != PEN_ERR_OK || anim_file_size == 0)
-            {
-                // TODO error dialog
-                return PEN_INVALID_HANDLE;
+                if (!found)
+                    sb_push(permutations, perm);
             }
 
-            const u32* p_u32reader = (u32*)anim_file;
-
-            u32 version = *p_u32reader++;
-
-            if (version < 1)
-            {
-                pen::memory_free(anim_file);
-                return PEN_INVALID_HANDLE;
-            }
-
-            s_animation_resources.push_back(animation_resource());
-            animation_resource& new_animation = s_animation_resources.back();
-
-            new_animation.name = stipped_filename;
-            new_animation.id_name = filename_hash;
+            pmfx::prewarm_view_techniques(permutations, sb_count(permutations));
+            sb_free(permutations);
+        }
 
+        void parse_pma(const u32* p_u32reader, animation_resource& new_animation)
+        {
             u32 num_channels = *p_u32reader++;
 
             new_animation.num_channels = num_channels;
@@ -1427,6 +1639,8 @@ namespace put
                 u32 num_sources = *p_u32reader++;
 
                 // null arrays
+                new_animation.channels[i].times = nullptr;
+                new_animation.channels[i].interpolation = nullptr;
                 new_animation.channels[i].matrices = nullptr;
                 for (u32 o = 0; o < 3; ++o)
                 {
@@ -1589,9 +1803,6 @@ namespace put
                 max_frames = std::max<u32>(new_animation.channels[i].num_frames, max_frames);
             }
 
-            // free file mem
-            pen::memory_free(anim_file);
-
             // bake animations into soa.
 
             // allocate vertical arrays
@@ -1682,6 +1893,125 @@ namespace put
                     sb_push(soa.info[t], ai);
                 }
             }
+        }
+
+        void parse_pma_compressed(const u32* p_u32reader, animation_resource& anim)
+        {
+            u32 num_channels = *p_u32reader++;
+            anim.length = *(f32*)p_u32reader++;
+
+            compressed_anim& ca = anim.compressed;
+            ca.num_channels = num_channels;
+            ca.num_keys = *p_u32reader++;
+
+            anim.num_channels = num_channels;
+            anim.channels = new animation_channel[num_channels];
+
+            ca.channels = (compressed_anim_channel*)pen::memory_alloc(sizeof(compressed_anim_channel) * num_channels);
+            ca.keys = (anim_key_q*)pen::memory_alloc(sizeof(anim_key_q) * ca.num_keys);
+
+            for (u32 i = 0; i < num_channels; ++i)
+            {
+                Str bone_name = read_parsable_string(&p_u32reader);
+                anim.channels[i].target = PEN_HASH(bone_name.c_str());
+                anim.channels[i].target_name = bone_name;
+
+                // key data lives in the compressed anim
+                anim.channels[i].num_frames = 0;
+                anim.channels[i].times = nullptr;
+                anim.channels[i].matrices = nullptr;
+                anim.channels[i].interpolation = nullptr;
+                for (u32 o = 0; o < 3; ++o)
+                {
+                    anim.channels[i].offset[o] = nullptr;
+                    anim.channels[i].scale[o] = nullptr;
+                    anim.channels[i].rotation[o] = nullptr;
+                }
+
+                memcpy(&ca.channels[i], p_u32reader, sizeof(compressed_anim_channel));
+                p_u32reader += sizeof(compressed_anim_channel) / sizeof(u32);
+
+                anim.channels[i].num_frames = ca.channels[i].num_keys;
+            }
+
+            memcpy(ca.keys, p_u32reader, sizeof(anim_key_q) * ca.num_keys);
+        }
+
+        void write_pma_compressed(const c8* filename, const animation_resource& anim)
+        {
+            const compressed_anim& ca = anim.compressed;
+
+            std::ofstream ofs(filename, std::ofstream::binary);
+
+            ofs.write((const c8*)&k_pma_compressed_version, sizeof(u32));
+            ofs.write((const c8*)&ca.num_channels, sizeof(u32));
+            ofs.write((const c8*)&anim.length, sizeof(f32));
+            ofs.write((const c8*)&ca.num_keys, sizeof(u32));
+
+            for (u32 i = 0; i < ca.num_channels; ++i)
+            {
+                write_parsable_string_u32(anim.channels[i].target_name, ofs);
+                ofs.write((const c8*)&ca.channels[i], sizeof(compressed_anim_channel));
+            }
+
+            ofs.write((const c8*)ca.keys, sizeof(anim_key_q) * ca.num_keys);
+
+            ofs.close();
+        }
+
+        anim_handle load_pma(const c8* filename)
+        {
+            Str pd = put::dev_ui::get_program_preference_filename("project_dir");
+
+            Str stipped_filename = pen::str_replace_string(filename, pd.c_str(), "");
+
+            hash_id filename_hash = PEN_HASH(stipped_filename.c_str());
+
+            // search for existing
+            s32 num_anims = s_animation_resources.size();
+            for (s32 i = 0; i < num_anims; ++i)
+            {
+                if (s_animation_resources[i].id_name == filename_hash)
+                {
+                    return (anim_handle)i;
+                }
+            }
+
+            void* anim_file;
+            u32   anim_file_size;
+
+            pen_error err = pen::filesystem_read_file_to_buffer(filename, &anim_file, anim_file_size);
+
+            if (err != PEN_ERR_OK || anim_file_size == 0)
+            {
+                // TODO error dialog
+                return PEN_INVALID_HANDLE;
+            }
+
+            const u32* p_u32reader = (u32*)anim_file;
+
+            u32 version = *p_u32reader++;
+
+            if (version < 1)
+            {
+                pen::memory_free(anim_file);
+                return PEN_INVALID_HANDLE;
+            }
+
+            s_animation_resources.push_back(animation_resource());
+            animation_resource& new_animation = s_animation_resources.back();
+
+            new_animation.name = stipped_filename;
+            new_animation.id_name = filename_hash;
+
+            // compressed files are written by optimise_pma, otherwise we sample the raw soa
+            if (version >= k_pma_compressed_version)
+                parse_pma_compressed(p_u32reader, new_animation);
+            else
+                parse_pma(p_u32reader, new_animation);
+
+            // free file mem
+            pen::memory_free(anim_file);
 
             return (anim_handle)s_animation_resources.size() - 1;
         }
@@ -1695,6 +2025,9 @@ namespace put
             size_t ib_size;
             size_t vertex_count;
             size_t num_indices;
+            u32    num_lods;
+            void*  lod_ib[k_pmm_max_lods];
+            size_t lod_num_indices[k_pmm_max_lods];
         };
 
         mesh_opt optimise_vb(u32* index_data, u32 num_indices, void* vertex_data, u32 num_verts, u32 vertex_size)
@@ -1726,9 +2059,180 @@ namespace put
             // cleanup
             pen::memory_free(remap);
 
+            opt.num_lods = 0;
             return opt;
         }
 
+        void generate_lods(mesh_opt& opt, u32 vertex_size)
+        {
+            // positions are the first 3 floats of both the position only and full vertex formats
+            const u32* src = (const u32*)opt.ib;
+            size_t     src_indices = opt.num_indices;
+
+            opt.num_lods = 0;
+            for (u32 l = 0; l < k_pmm_max_lods; ++l)
+            {
+                size_t target = (size_t)(src_indices * k_lod_index_ratio) / 3 * 3;
+                u32*   lod_ib = (u32*)pen::memory_alloc(src_indices * sizeof(u32));
+
+                size_t num_indices = meshopt_simplify(lod_ib, src, src_indices, (const f32*)opt.vb, opt.vertex_count,
+                                                      vertex_size, target, k_lod_target_error[l]);
+
+                // topology or the error limit stopped the simplifier, further levels would look the same
+                if (num_indices == 0 || num_indices > src_indices * k_lod_min_reduction)
+                {
+                    pen::memory_free(lod_ib);
+                    break;
+                }
+
+                meshopt_optimizeVertexCache(lod_ib, lod_ib, num_indices, opt.vertex_count);
+
+                opt.lod_ib[l] = lod_ib;
+                opt.lod_num_indices[l] = num_indices;
+                opt.num_lods++;
+
+                src = lod_ib;
+                src_indices = num_indices;
+            }
+        }
+
+        u32 generate_clusters(mesh_opt& opt, void** cluster_data)
+        {
+            u32*                ib = (u32*)opt.ib;
+            const vertex_model* vb = (const vertex_model*)opt.vb;
+
+            // normal cones assume triangles face along cross(b - a, c - a), check the winding against the vertex
+            // normals so cones point out of the visible side whichever way the exporter wound the mesh
+            f32 facing = 0.0f;
+            for (size_t i = 0; i < opt.num_indices; i += 3)
+            {
+                const vertex_model& a = vb[ib[i + 0]];
+                const vertex_model& b = vb[ib[i + 1]];
+                const vertex_model& c = vb[ib[i + 2]];
+
+                vec3f n = cross(b.pos.xyz - a.pos.xyz, c.pos.xyz - a.pos.xyz);
+                facing += dot(n, a.normal.xyz + b.normal.xyz + c.normal.xyz);
+            }
+            u32 v1 = facing < 0.0f ? 2 : 1;
+            u32 v2 = 3 - v1;
+
+            size_t max_meshlets = meshopt_buildMeshletsBound(opt.num_indices, k_cluster_vertices, k_cluster_triangles);
+            std::vector<meshopt_Meshlet> meshlets(max_meshlets);
+            size_t num_meshlets = meshopt_buildMeshlets(&meshlets[0], ib, opt.num_indices, opt.vertex_count,
+                                                        k_cluster_vertices, k_cluster_triangles);
+
+            geometry_cluster* clusters = (geometry_cluster*)pen::memory_alloc(num_meshlets * sizeof(geometry_cluster));
+            memset(clusters, 0x0, num_meshlets * sizeof(geometry_cluster));
+
+            // rewrite the index buffer so each meshlet is a contiguous range of triangles
+            u32 bounds_ib[k_cluster_triangles * 3];
+            u32 offset = 0;
+            for (size_t m = 0; m < num_meshlets; ++m)
+            {
+                const meshopt_Meshlet& ml = meshlets[m];
+                u32                    num_indices = ml.triangle_count * 3;
+
+                for (u32 t = 0; t < ml.triangle_count; ++t)
+                {
+                    u32* tri = &ib[offset + t * 3];
+                    for (u32 v = 0; v < 3; ++v)
+                        tri[v] = ml.vertices[ml.indices[t][v]];
+
+                    bounds_ib[t * 3 + 0] = tri[0];
+                    bounds_ib[t * 3 + 1] = tri[v1];
+                    bounds_ib[t * 3 + 2] = tri[v2];
+                }
+
+                meshopt_Bounds b = meshopt_computeClusterBounds(bounds_ib, num_indices, (const f32*)opt.vb,
+                                                                opt.vertex_count, sizeof(vertex_model));
+
+                geometry_cluster& cl = clusters[m];
+                cl.pos_radius = vec4f(b.center[0], b.center[1], b.center[2], b.radius);
+                cl.cone_apex = vec4f(b.cone_apex[0], b.cone_apex[1], b.cone_apex[2], 0.0f);
+                cl.cone_axis_cutoff = vec4f(b.cone_axis[0], b.cone_axis[1], b.cone_axis[2], b.cone_cutoff);
+                cl.index_offset = offset;
+                cl.num_indices = num_indices;
+
+                offset += num_indices;
+            }
+            PEN_ASSERT(offset == opt.num_indices);
+
+            *cluster_data = clusters;
+            return (u32)num_meshlets;
+        }
+
+        void cook_collision(const mesh_opt& opt, hash_id geometry, u32 submesh, std::vector<pmc_cooked>& cooked)
+        {
+            // position stream is vec4
+            const vec4f* pos = (const vec4f*)opt.vb;
+            f32*         vertices = (f32*)pen::memory_alloc(opt.vertex_count * sizeof(f32) * 3);
+            for (size_t v = 0; v < opt.vertex_count; ++v)
+            {
+                vertices[v * 3 + 0] = pos[v].x;
+                vertices[v * 3 + 1] = pos[v].y;
+                vertices[v * 3 + 2] = pos[v].z;
+            }
+
+            physics::collision_mesh_data md;
+            md.vertices = vertices;
+            md.indices = (u32*)opt.ib;
+            md.num_floats = (u32)opt.vertex_count * 3;
+            md.num_indices = (u32)opt.num_indices;
+
+            pmc_cooked pc = {};
+            pc.entry.geometry = geometry;
+            pc.entry.submesh = submesh;
+
+            physics::cook_stats ms, hs;
+            physics::cook_collision_mesh(md, physics::e_shape::mesh, &pc.mesh, &pc.entry.mesh_size, &ms);
+            physics::cook_collision_mesh(md, physics::e_shape::hull, &pc.hull, &pc.entry.hull_size, &hs);
+
+            PEN_LOG("    collision mesh: build %.3fms, cooked %.3fms. hull: build %.3fms, cooked %.3fms", ms.build_ms,
+                    ms.load_ms, hs.build_ms, hs.load_ms);
+
+            cooked.push_back(pc);
+            pen::memory_free(vertices);
+        }
+
+        void write_pmc(const c8* pmm_filename, std::vector<pmc_cooked>& cooked)
+        {
+            Str filename = pen::str_remove_ext(pmm_filename);
+            filename.append(".pmc");
+
+            auto align = [](u32 offset) -> u32 { return (offset + k_pmc_align - 1) & ~(k_pmc_align - 1); };
+
+            u32 num_entries = (u32)cooked.size();
+            u32 offset = align(sizeof(u32) * 2 + num_entries * sizeof(pmc_entry));
+            for (auto& c : cooked)
+            {
+                c.entry.mesh_offset = offset;
+                offset = align(offset + c.entry.mesh_size);
+                c.entry.hull_offset = offset;
+                offset = align(offset + c.entry.hull_size);
+            }
+
+            std::ofstream ofs(filename.c_str(), std::ofstream::binary);
+            ofs.write((const c8*)&k_pmc_version, sizeof(u32));
+            ofs.write((const c8*)&num_entries, sizeof(u32));
+            for (auto& c : cooked)
+                ofs.write((const c8*)&c.entry, sizeof(pmc_entry));
+
+            static const c8 pad[k_pmc_align] = {0};
+            for (auto& c : cooked)
+            {
+                ofs.write(pad, c.entry.mesh_offset - (u32)(std::streamoff)ofs.tellp());
+                ofs.write((const c8*)c.mesh, c.entry.mesh_size);
+                ofs.write(pad, c.entry.hull_offset - (u32)(std::streamoff)ofs.tellp());
+                ofs.write((const c8*)c.hull, c.entry.hull_size);
+
+                pen::memory_free_align(c.mesh);
+                pen::memory_free_align(c.hull);
+            }
+
+            ofs.close();
+            PEN_LOG("    collision: %s, %i submeshes", filename.c_str(), num_entries);
+        }
+
         void optimise_pmm(const c8* input_filename, const c8* output_filename)
         {
             pmm_contents contents;
@@ -1739,11 +2243,16 @@ namespace put
             parse_pmm_geometry(contents, geom);
 
             // perform optimisations on each submesh
-            std::vector<intptr_t> reductions;
-            intptr_t              reduction = 0;
-            u32                   mc = 0;
+            std::vector<intptr_t>   reductions;
+            std::vector<pmc_cooked> collision;
+            intptr_t                reduction = 0;
+            u32                     mc = 0;
+            u32                     gi = 0;
             for (auto& g : geom)
             {
+                hash_id geometry_hash = PEN_HASH(contents.geometry_names[gi].c_str());
+                u32     si = 0;
+
                 // reduction could be negative in theory..
                 // ... especially as index size goes from u16 > u32 so handle it with signed types
 
@@ -1765,15 +2274,74 @@ namespace put
                         optimise_vb((u32*)sm.index_data, sm.num_indices, sm.vertex_data, sm.num_verts, sm.vertex_size),
                         optimise_vb((u32*)sm.index_data, sm.num_pos_indices, sm.pos_data, sm.num_pos_verts, sizeof(vec4f))};
 
+                    // lod chains, both renderables keep the same number of levels so they can share a selection
+                    generate_lods(opt[0], sm.vertex_size);
+                    generate_lods(opt[1], sizeof(vec4f));
+
+                    u32 num_lods = std::min(opt[0].num_lods, opt[1].num_lods);
                     for (auto& o : opt)
                     {
-                        // swap winding..
-                        u32* i32 = (u32*)o.ib;
-                        if (sm.handedness == e_handedness::left)
+                        for (u32 l = num_lods; l < o.num_lods; ++l)
+                            pen::memory_free(o.lod_ib[l]);
+
+                        o.num_lods = num_lods;
+                    }
+
+                    // lods from a previous optimise_pmm are regenerated from the full detail mesh
+                    intptr_t prev_lod_size = 0;
+                    if (g.version >= k_pmm_lod_version)
+                    {
+                        prev_lod_size = sizeof(u32);
+                        for (u32 l = 0; l < sm.num_lods; ++l)
+                        {
+                            prev_lod_size += sizeof(f32) + sizeof(u32) * 2;
+                            prev_lod_size += sm.lods[l].num_indices * sm.index_size;
+                            prev_lod_size += sm.lods[l].num_pos_indices * sm.pos_index_size;
+
+                            pen::memory_free(sm.lods[l].index_data);
+                            pen::memory_free(sm.lods[l].pos_index_data);
+                        }
+                    }
+
+                    // clusters are regenerated too
+                    intptr_t prev_cluster_size = 0;
+                    if (g.version >= k_pmm_cluster_version)
+                    {
+                        prev_cluster_size = sizeof(u32) + sm.num_clusters * sizeof(geometry_cluster);
+                        pen::memory_free(sm.cluster_data);
+                    }
+
+                    // swap winding..
+                    if (sm.handedness == e_handedness::left)
+                    {
+                        for (auto& o : opt)
                         {
+                            u32* i32 = (u32*)o.ib;
                             for (u32 i = 0; i < o.num_indices; i += 3)
                                 std::swap(i32[i], i32[i + 2]);
+
+                            for (u32 l = 0; l < o.num_lods; ++l)
+                            {
+                                u32* li32 = (u32*)o.lod_ib[l];
+                                for (u32 i = 0; i < o.lod_num_indices[l]; i += 3)
+                                    std::swap(li32[i], li32[i + 2]);
+                            }
                         }
+                    }
+
+                    // meshlets of the full detail mesh, skinned meshes move too much for model space bounds
+                    sm.num_clusters = 0;
+                    sm.cluster_data = nullptr;
+                    if (!sm.skinned && opt[0].num_indices >= k_cluster_min_triangles * 3)
+                        sm.num_clusters = generate_clusters(opt[0], &sm.cluster_data);
+
+                    // collision from the position stream with the final winding, for mesh and hull rigid bodies
+                    if (!sm.skinned)
+                        cook_collision(opt[1], geometry_hash, si, collision);
+
+                    for (auto& o : opt)
+                    {
+                        u32* i32 = (u32*)o.ib;
 
                         // reduce index size to u16 if possible
                         o.index_size = 4;
@@ -1787,6 +2355,17 @@ namespace put
                             pen::memory_free(o.ib);
                             o.ib = nni;
                             o.index_size = 2;
+
+                            for (u32 l = 0; l < o.num_lods; ++l)
+                            {
+                                u32* li32 = (u32*)o.lod_ib[l];
+                                u16* lni = (u16*)pen::memory_alloc(o.lod_num_indices[l] * sizeof(u16));
+                                for (u32 i = 0; i < o.lod_num_indices[l]; ++i)
+                                    lni[i] = li32[i];
+
+                                pen::memory_free(o.lod_ib[l]);
+                                o.lod_ib[l] = lni;
+                            }
                         }
                     }
 
@@ -1805,6 +2384,19 @@ namespace put
                     ibr = (intptr_t)opt[1].ib_size - (intptr_t)sm.index_data_size;
                     reduction += vbr + ibr;
 
+                    // lods grow the file
+                    intptr_t lod_size = sizeof(u32);
+                    for (u32 l = 0; l < num_lods; ++l)
+                    {
+                        lod_size += sizeof(f32) + sizeof(u32) * 2;
+                        lod_size += opt[0].lod_num_indices[l] * opt[0].index_size;
+                        lod_size += opt[1].lod_num_indices[l] * opt[1].index_size;
+                    }
+                    reduction += lod_size - prev_lod_size;
+
+                    intptr_t cluster_size = sizeof(u32) + sm.num_clusters * sizeof(geometry_cluster);
+                    reduction += cluster_size - prev_cluster_size;
+
                     // reassign
                     PEN_LOG("    new vertex count: %i, old %i", opt[0].vertex_count, sm.num_verts);
 
@@ -1822,11 +2414,27 @@ namespace put
                     sm.num_pos_verts = (u32)opt[1].vertex_count;
                     sm.pos_index_size = opt[1].index_size;
 
+                    PEN_LOG("    lods: %i, clusters: %i", num_lods, sm.num_clusters);
+
+                    sm.num_lods = num_lods;
+                    for (u32 l = 0; l < num_lods; ++l)
+                    {
+                        sm.lods[l].error = k_lod_target_error[l];
+                        sm.lods[l].num_indices = (u32)opt[0].lod_num_indices[l];
+                        sm.lods[l].index_data = opt[0].lod_ib[l];
+                        sm.lods[l].num_pos_indices = (u32)opt[1].lod_num_indices[l];
+                        sm.lods[l].pos_index_data = opt[1].lod_ib[l];
+                    }
+
                     mc++;
+                    si++;
                 }
                 reductions.push_back(reduction);
+                gi++;
             }
 
+            write_pmc(output_filename, collision);
+
             // work out the offset adjustments, geom is at the end so we dont need to bother with the last one.
             for (u32 g = 1; g < contents.num_geometry; ++g)
             {
@@ -1913,7 +2521,7 @@ namespace put
                     PEN_LOG("[error] geom %u, offset %llu, should be %llu\n", g, pos, base + contents.geometry_offsets[g]);
                 }
 
-                ofs.write((const c8*)&geom[g].version, sizeof(u32));
+                ofs.write((const c8*)&k_pmm_cluster_version, sizeof(u32));
                 ofs.write((const c8*)&geom[g].num_meshes, sizeof(u32));
                 for (auto& mm : geom[g].mat_names)
                     write_parsable_string_u32(mm, ofs);
@@ -1940,6 +2548,22 @@ namespace put
                     ofs.write((const c8*)sm.vertex_data, sm.vertex_data_size);
                     ofs.write((const c8*)sm.pos_index_data, sm.pos_index_data_size);
                     ofs.write((const c8*)sm.index_data, sm.index_data_size);
+
+                    // lods
+                    ofs.write((const c8*)&sm.num_lods, sizeof(u32));
+                    for (u32 l = 0; l < sm.num_lods; ++l)
+                    {
+                        pmm_lod& lod = sm.lods[l];
+                        ofs.write((const c8*)&lod.error, sizeof(f32));
+                        ofs.write((const c8*)&lod.num_indices, sizeof(u32));
+                        ofs.write((const c8*)&lod.num_pos_indices, sizeof(u32));
+                        ofs.write((const c8*)lod.index_data, lod.num_indices * sm.index_size);
+                        ofs.write((const c8*)lod.pos_index_data, lod.num_pos_indices * sm.pos_index_size);
+                    }
+
+                    // clusters
+                    ofs.write((const c8*)&sm.num_clusters, sizeof(u32));
+                    ofs.write((const c8*)sm.cluster_data, sm.num_clusters * sizeof(geometry_cluster));
                 }
             }
 
@@ -1955,15 +2579,146 @@ namespace put
                     pen::memory_free(sm.pos_index_data);
                     pen::memory_free(sm.index_data);
                     pen::memory_free(sm.joint_data);
+
+                    for (u32 l = 0; l < sm.num_lods; ++l)
+                    {
+                        pen::memory_free(sm.lods[l].index_data);
+                        pen::memory_free(sm.lods[l].pos_index_data);
+                    }
+
+                    pen::memory_free(sm.cluster_data);
                 }
             }
             pen::memory_free(contents.file_data);
         }
 
+        void free_animation_resource(animation_resource& anim)
+        {
+            // source channels
+            for (u32 i = 0; i < anim.num_channels; ++i)
+            {
+                animation_channel& channel = anim.channels[i];
+
+                delete[] channel.times;
+                delete[] channel.interpolation;
+                delete[](f32*) channel.matrices;
+
+                for (u32 o = 0; o < 3; ++o)
+                {
+                    delete[] channel.offset[o];
+                    delete[] channel.scale[o];
+                    delete[] channel.rotation[o];
+                }
+            }
+            delete[] anim.channels;
+
+            // soa
+            soa_anim& soa = anim.soa;
+
+            u32 max_frames = 0;
+            for (u32 c = 0; c < soa.num_channels; ++c)
+                max_frames = std::max<u32>(soa.channels[c].num_frames, max_frames);
+
+            for (u32 f = 0; f < max_frames; ++f)
+            {
+                sb_free(soa.data[f]);
+                sb_free(soa.info[f]);
+            }
+
+            delete[] soa.data;
+            delete[] soa.info;
+            delete[] soa.channels;
+
+            free_compressed_anim(anim.compressed);
+        }
+
+        f64 benchmark_anim_sampling(const animation_resource& anim, bool compressed)
+        {
+            // bind every channel to its own target
+            anim_instance instance;
+            instance.soa = anim.soa;
+            if (compressed)
+                instance.compressed = anim.compressed;
+
+            for (u32 c = 0; c < anim.num_channels; ++c)
+            {
+                anim_sampler sampler;
+                sampler.joint = c;
+                sampler.pos = 0;
+                sampler.flags = 0;
+                sampler.cur_t = 0.0f;
+                sampler.prev_t = 0.0f;
+                sb_push(instance.samplers, sampler);
+
+                anim_target at;
+                memset(&at.t[0], 0x0, sizeof(at.t));
+                sb_push(instance.targets, at);
+            }
+
+            pen::timer* timer = pen::timer_create();
+            pen::timer_start(timer);
+
+            for (u32 i = 0; i < k_anim_benchmark_samples; ++i)
+            {
+                for (u32 c = 0; c < anim.num_channels; ++c)
+                    instance.targets[c].q = quat(0.0f, 0.0f, 0.0f);
+
+                f32 t = anim.length * (f32)i / (f32)k_anim_benchmark_samples;
+                sample_anim(instance, t, i == 0);
+            }
+
+            f64 ms = pen::timer_elapsed_ms(timer);
+
+            pen::timer_destroy(timer);
+            sb_free(instance.samplers);
+            sb_free(instance.targets);
+
+            return ms;
+        }
+
         void optimise_pma(const c8* input_filename, const c8* output_filename)
         {
+            void* anim_file;
+            u32   anim_file_size;
+
+            pen_error err = pen::filesystem_read_file_to_buffer(input_filename, &anim_file, anim_file_size);
+            if (err != PEN_ERR_OK || anim_file_size == 0)
+            {
+                PEN_LOG("[error] optimise pma - failed to find file: %s", input_filename);
+                return;
+            }
 
-            // todo
+            const u32* p_u32reader = (u32*)anim_file;
+            u32        version = *p_u32reader++;
+
+            if (version < 1 || version >= k_pma_compressed_version)
+            {
+                PEN_LOG("optimise pma - skipping %s, version %u is already compressed or invalid", input_filename, version);
+                pen::memory_free(anim_file);
+                return;
+            }
+
+            animation_resource anim;
+            parse_pma(p_u32reader, anim);
+            pen::memory_free(anim_file);
+
+            // key reduce and quantise
+            anim_compression_stats stats;
+            compress_anim(anim.soa, anim.compressed, k_anim_key_tolerance, &stats);
+
+            // sample each layout across the clip to compare cost
+            f64 soa_ms = benchmark_anim_sampling(anim, false);
+            f64 compressed_ms = benchmark_anim_sampling(anim, true);
+
+            PEN_LOG("optimise pma - %s, channels %u, length %f", input_filename, anim.num_channels, anim.length);
+            PEN_LOG("    keys: %u -> %u", stats.src_keys, stats.keys);
+            PEN_LOG("    memory: %llu -> %llu bytes (%.1f%%)", (u64)stats.src_size, (u64)stats.size,
+                    stats.src_size ? ((f64)stats.size / (f64)stats.src_size) * 100.0 : 0.0);
+            PEN_LOG("    sample x%u: %f -> %f (ms)", k_anim_benchmark_samples, soa_ms, compressed_ms);
+
+            write_pma_compressed(output_filename, anim);
+
+            free_animation_resource(anim);
         }
 
         s32 load_pmm(const c8* filename, ecs_scene* scene, u32 load_flags)
@@ -2001,7 +2756,7 @@ namespace put
                 // invalidate trees to rebuild
                 if (contents.num_scene > 0)
                     if (scene)
-                        scene->flags |= e_scene_flags::invalidate_scene_tree;
+                        scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
             }
 
             pen::memory_free(contents.file_data);
@@ -2087,6 +2842,31 @@ namespace put
                         ImGui::Text("Renderable: %i", i);
                         ImGui::Text("Vertices: %i", g->renderable[i].num_vertices);
                         ImGui::Text("Indices: %i", g->renderable[i].num_indices);
+
+                        for (u32 l = 0; l < g->renderable[i].num_lods; ++l)
+                            ImGui::Text("Lod %i Indices: %i", l + 1, g->renderable[i].lods[l].num_indices);
+                    }
+
+                    ImGui::Separator();
+                }
+            }
+
+            if (ImGui::CollapsingHeader("Animations"))
+            {
+                for (auto& a : s_animation_resources)
+                {
+                    ImGui::Text("Source: %s", a.name.c_str());
+                    ImGui::Text("Channels: %i", a.num_channels);
+                    ImGui::Text("Length: %f", a.length);
+
+                    if (a.compressed.keys)
+                    {
+                        ImGui::Text("Compressed Keys: %i", a.compressed.num_keys);
+                        ImGui::Text("Size: %i", (u32)compressed_anim_size(a.compressed));
+                    }
+                    else
+                    {
+                        ImGui::Text("Size: %i", (u32)soa_anim_size(a.soa));
                     }
 
                     ImGui::Separator();
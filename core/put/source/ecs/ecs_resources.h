@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "ecs/ecs_anim.h"
 #include "ecs/ecs_scene.h"
 
 namespace put
@@ -160,15 +161,16 @@ namespace put
 
         struct anim_instance
         {
-            u32            flags = 0;
-            soa_anim       soa;
-            f32            time = 0.0f;
-            f32            length = 0.0f; // length in time
-            anim_target*   targets = nullptr;
-            cmp_transform* joints = nullptr;
-            anim_sampler*  samplers = nullptr;
-            vec3f          root_translation;
-            vec3f          root_delta = vec3f::zero();
+            u32             flags = 0;
+            soa_anim        soa;
+            compressed_anim compressed;
+            f32             time = 0.0f;
+            f32             length = 0.0f; // length in time
+            anim_target*    targets = nullptr;
+            cmp_transform*  joints = nullptr;
+            anim_sampler*   samplers = nullptr;
+            vec3f           root_translation;
+            vec3f           root_delta = vec3f::zero();
         };
 
         struct animation_channel
@@ -198,7 +200,8 @@ namespace put
             f32 length;
             Str name;
 
-            soa_anim soa;
+            soa_anim        soa;
+            compressed_anim compressed;
         };
 
         struct pmm_renderable // resouce may contain full vb and position only
@@ -211,6 +214,14 @@ namespace put
             u32   index_type;
             void* cpu_vertex_buffer;
             void* cpu_index_buffer;
+
+            // simplified index buffers written by optimise_pmm
+            u32          num_lods = 0;
+            geometry_lod lods[e_scene_limits::max_geometry_lods - 1];
+
+            // meshlets of the full detail mesh written by optimise_pmm, for cluster culling
+            u32               num_clusters = 0;
+            geometry_cluster* clusters = nullptr;
         };
 
         struct geometry_resource
@@ -267,8 +278,20 @@ namespace put
 
         void save_scene(const c8* filename, ecs_scene* scene);
         void save_sub_scene(ecs_scene* scene, u32 root);
+        void save_sub_scene(const c8* filename, ecs_scene* scene, std::vector<s32>& nodes); // whole hierarchies only
         void load_scene(const c8* filename, ecs_scene* scene, bool merge = false);
 
+        // load_scene in stages. open and read can run on any thread, reading into a scene which is not being updated.
+        // commit creates the geometry, textures and physics the entities reference so must run on the user thread,
+        // it can be spread over frames by returning false once budget_ms has elapsed, budget_ms 0 commits everything.
+        struct scene_file;
+        scene_file* open_scene_file(const c8* filename); // nullptr if the file cannot be read
+        u32         get_scene_file_num_entities(const scene_file* sf);
+        void        read_scene_file(scene_file* sf, ecs_scene* scene, u32 zero_offset);
+        bool        commit_scene_file(scene_file* sf, ecs_scene* scene, u32 zero_offset, f64 budget_ms);
+        bool        get_scene_file_error(const scene_file* sf);
+        void        close_scene_file(scene_file* sf);
+
         s32 load_pmm(const c8* model_scene_name, ecs_scene* scene = nullptr, u32 load_flags = e_pmm_load_flags::all);
         s32 load_pma(const c8* model_scene_name);
         s32 load_pmv(const c8* filename, ecs_scene* scene);
@@ -296,6 +319,7 @@ namespace put
         void bake_rigid_body_params(ecs_scene* scene, u32 node_index);
         void bake_material_handles(ecs_scene* scene, u32 node_index);
         void bake_material_handles();
+        void prewarm_scene_shaders(ecs_scene* scene);
 
         void create_geometry_primitives();
         void create_primitive_resource_faceted(Str name, vertex_model* vertices, u32 nv);
@@ -2,7 +2,9 @@
 // Copyright 2014 - 2019 Alex Dixon.
 // License: https://github.com/polymonster/pmtech/blob/master/license.md
 
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #include <functional>
 
 #include "console.h"
@@ -16,11 +18,14 @@
 #include "pmfx.h"
 #include "str/Str.h"
 #include "str_utilities.h"
+#include "threads.h"
 #include "timer.h"
 
+#include "ecs/ecs_anim.h"
 #include "ecs/ecs_cull.h"
 #include "ecs/ecs_resources.h"
 #include "ecs/ecs_scene.h"
+#include "ecs/ecs_skin.h"
 #include "ecs/ecs_utilities.h"
 
 using namespace put;
@@ -30,6 +35,42 @@ namespace put
     namespace ecs
     {
         static std::vector<ecs_scene_instance> s_scenes;
+        static const u32                       k_anim_batch_size = 32;           // entities per job batch
+        static const u32                       k_anim_controller_batch_size = 4; // controllers per job batch
+
+        struct defrag_state
+        {
+            std::vector<u32> order;       // planned entities in their target order, values are current slots
+            std::vector<u32> block_start; // ranges into order, a block is a whole hierarchy or instance range
+            std::vector<s32> slot_order;  // slot -> index into order, -1 for slots not in the plan
+            std::vector<s32> origin;      // slot -> slot at the start of this defrag_scene call, -1 untouched
+            std::vector<s32> remap;
+            std::vector<u32> touched;
+            u32              cursor = 0; // next block to place
+            u32              moves = 0;
+            bool             planned = false;
+        };
+
+        struct shadow_cache
+        {
+            mat4    view_projection; // shadow_map slices, the light transform static casters were rendered with
+            frustum cull_frustum;
+            vec4f   pos_radius; // omni lights
+            u32     light = -1;
+            u32     valid = 0; // bit per cube face for omni lights, bit 0 for shadow_map slices
+            bool    refreshed = false;
+        };
+
+        struct shadow_caches
+        {
+            std::vector<shadow_cache>   slices; // shadow_map array slices
+            std::vector<shadow_cache>   omni;   // omni lights, all 6 faces are cached or none
+            std::vector<cmp_pos_extent> prev_extents;
+            std::vector<u8>             prev_caster; // 0 = not a caster, 1 = static, 2 = dynamic
+            std::vector<cmp_pos_extent> static_dirty; // old and new bounds of casters which changed this update
+            std::vector<cmp_pos_extent> dynamic_dirty;
+            shadow_stats                frame;
+        };
 
         void register_ecs_extentsions(ecs_scene* scene, const ecs_extension& ext)
         {
@@ -78,39 +119,210 @@ namespace put
                 PEN_ASSERT(0);
         }
 
+        void* alloc_component_page(u32 cmp_size, u32 storage)
+        {
+            u32   page_size = cmp_size << get_component_page_shift(storage);
+            void* page = pen::memory_alloc(page_size);
+            pen::memory_zero(page, page_size);
+            return page;
+        }
+
+        namespace
+        {
+            u32 num_component_pages(u32 storage, u32 num_entities)
+            {
+                u32 shift = get_component_page_shift(storage);
+                return (num_entities + (1 << shift) - 1) >> shift;
+            }
+
+            // returns nullptr for components in pages which have not been allocated
+            void* get_allocated_component(generic_cmp_array& cmp, u32 index)
+            {
+                if (!((void**)cmp.data)[index >> get_component_page_shift(cmp.storage)])
+                    return nullptr;
+
+                return cmp[index];
+            }
+
+            void copy_component(generic_cmp_array& cmp, u32 dst, u32 src)
+            {
+                void* src_cmp = get_allocated_component(cmp, src);
+                if (src_cmp)
+                {
+                    memcpy(cmp[dst], src_cmp, cmp.size);
+                    return;
+                }
+
+                // source page is empty, avoid allocating a page just to write zeros
+                void* dst_cmp = get_allocated_component(cmp, dst);
+                if (dst_cmp)
+                    pen::memory_zero(dst_cmp, cmp.size);
+            }
+
+            // components are written out contiguously so the file format does not depend on storage
+            void write_component_array(std::ofstream& ofs, generic_cmp_array& cmp, u32 count)
+            {
+                u32 page_entities = 1 << get_component_page_shift(cmp.storage);
+
+                void* zero = nullptr;
+                for (u32 n = 0, p = 0; n < count; n += page_entities, ++p)
+                {
+                    u32 num = count - n;
+                    if (num > page_entities)
+                        num = page_entities;
+
+                    void* page = ((void**)cmp.data)[p];
+                    if (!page)
+                    {
+                        if (!zero)
+                            zero = alloc_component_page(cmp.size, cmp.storage);
+
+                        page = zero;
+                    }
+
+                    ofs.write((const c8*)page, cmp.size * num);
+                }
+
+                pen::memory_free(zero);
+            }
+
+            // sequential reads from a scene file which has been mapped or read into memory
+            struct scene_reader
+            {
+                const u8* data;
+                size_t    size;
+                size_t    pos;
+
+                void read(void* dst, size_t num_bytes)
+                {
+                    if (pos + num_bytes > size)
+                    {
+                        // truncated file, zero what we cannot read
+                        pen::memory_zero(dst, num_bytes);
+                        pos = size;
+                        return;
+                    }
+
+                    memcpy(dst, data + pos, num_bytes);
+                    pos += num_bytes;
+                }
+            };
+
+            Str read_parsable_string(scene_reader& r)
+            {
+                u32 len = 0;
+                r.read(&len, sizeof(u32));
+
+                Str name;
+                if (len == 0 || r.pos + len > r.size)
+                    return name;
+
+                const c8* src = (const c8*)r.data + r.pos;
+                name.set(src, src + len);
+                r.pos += len;
+
+                return name;
+            }
+
+            // sparse pages which are entirely zero are not allocated
+            void read_component_array(scene_reader& r, generic_cmp_array& cmp, u32 offset, u32 count)
+            {
+                u32 page_entities = 1 << get_component_page_shift(cmp.storage);
+                u32 mask = page_entities - 1;
+
+                u32 n = 0;
+                while (n < count)
+                {
+                    // read up to the end of the destination page
+                    u32 dst = offset + n;
+                    u32 num = count - n;
+                    if (num > page_entities - (dst & mask))
+                        num = page_entities - (dst & mask);
+
+                    u32 num_bytes = cmp.size * num;
+                    n += num;
+
+                    if (cmp.storage != e_cmp_storage::sparse || r.pos + num_bytes > r.size)
+                    {
+                        r.read(cmp[dst], num_bytes);
+                        continue;
+                    }
+
+                    // test the file data in place so empty chunks never touch the page table
+                    const u8* src = r.data + r.pos;
+                    r.pos += num_bytes;
+
+                    for (u32 b = 0; b < num_bytes; ++b)
+                    {
+                        if (src[b])
+                        {
+                            memcpy(cmp[dst], src, num_bytes);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // links new nodes onto the end of the free list. contiguous allocation and deletes which have not been
+            // relinked yet mean the last node in memory is not necessarily the tail, so walk to it, which only costs
+            // the length of the free list.
+            void extend_free_list(ecs_scene* scene, u32 prev_size, u32 new_size)
+            {
+                free_node_list* tail = scene->free_list_head;
+                while (tail && tail->next)
+                    tail = tail->next;
+
+                for (u32 i = prev_size; i < new_size; ++i)
+                {
+                    free_node_list* l = &scene->free_list[i];
+                    l->node = i;
+                    l->next = nullptr;
+                    l->prev = tail;
+
+                    if (tail)
+                        tail->next = l;
+                    else
+                        scene->free_list_head = l;
+
+                    tail = l;
+                }
+            }
+        } // namespace
+
         void resize_scene_buffers(ecs_scene* scene, s32 size)
         {
-            u32 new_size = scene->soa_size + size;
+            // grow in whole pages, existing pages never move
+            u32 prev_size = scene->soa_size;
+            u32 new_size = (prev_size + size + k_cmp_dense_page_mask) & ~k_cmp_dense_page_mask;
 
             for (u32 i = 0; i < scene->num_components; ++i)
             {
                 generic_cmp_array& cmp = scene->get_component_array(i);
-                u32                alloc_size = cmp.size * new_size;
 
-                if (cmp.data)
-                {
-                    // realloc
-                    cmp.data = pen::memory_realloc(cmp.data, alloc_size);
+                u32 prev_pages = num_component_pages(cmp.storage, prev_size);
+                u32 new_pages = num_component_pages(cmp.storage, new_size);
 
-                    // zero new mem
-                    u32 prev_size = scene->soa_size * cmp.size;
-                    u8* new_offset = (u8*)cmp.data + prev_size;
-                    u32 zero_size = alloc_size - prev_size;
-                    pen::memory_zero(new_offset, zero_size);
+                // only the page table is reallocated
+                cmp.data = pen::memory_realloc(cmp.data, new_pages * sizeof(void*));
 
-                    continue;
+                void** pages = (void**)cmp.data;
+                for (u32 p = prev_pages; p < new_pages; ++p)
+                {
+                    pages[p] = nullptr;
+                    if (cmp.storage == e_cmp_storage::dense)
+                        pages[p] = alloc_component_page(cmp.size, cmp.storage);
                 }
-
-                // alloc and zero
-                cmp.data = pen::memory_alloc(alloc_size);
-                pen::memory_zero(cmp.data, alloc_size);
             }
 
             scene->soa_size = new_size;
-            initialise_free_list(scene);
+
+            if (prev_size == 0)
+                initialise_free_list(scene);
+            else
+                extend_free_list(scene, prev_size, new_size);
         }
 
-        void free_scene_buffers(ecs_scene* scene, bool cmp_mem_only = 0)
+        void free_scene_buffers(ecs_scene* scene, bool cmp_mem_only)
         {
             // Remove entites for sub systems (physics, rendering, etc)
             if (!cmp_mem_only)
@@ -126,10 +338,57 @@ namespace put
             for (u32 i = 0; i < scene->num_components; ++i)
             {
                 generic_cmp_array& cmp = scene->get_component_array(i);
+
+                if (cmp.data)
+                {
+                    u32 num_pages = num_component_pages(cmp.storage, scene->soa_size);
+                    for (u32 p = 0; p < num_pages; ++p)
+                        pen::memory_free(((void**)cmp.data)[p]);
+                }
+
                 pen::memory_free(cmp.data);
                 cmp.data = nullptr;
             }
 
+            u32 num_queries = sb_count(scene->queries);
+            for (u32 q = 0; q < num_queries; ++q)
+                sb_free(scene->queries[q].entities);
+
+            sb_free(scene->queries);
+            scene->queries = nullptr;
+
+            sb_free(scene->bone_palettes);
+            scene->bone_palettes = nullptr;
+
+            delete scene->defrag;
+            scene->defrag = nullptr;
+
+            delete scene->shadow_cache;
+            scene->shadow_cache = nullptr;
+
+            sb_free(scene->culled_indices);
+            scene->culled_indices = nullptr;
+
+            sb_free(scene->physics_entities);
+            scene->physics_entities = nullptr;
+
+            if (scene->clusters)
+                free_light_clusters(*scene->clusters);
+
+            delete scene->clusters;
+            sb_free(scene->cluster_lights);
+            sb_free(scene->cluster_light_data);
+            scene->clusters = nullptr;
+            scene->cluster_lights = nullptr;
+            scene->cluster_light_data = nullptr;
+
+            sb_free(scene->cpu_skin_streams);
+            sb_free(scene->cpu_skinned_positions);
+            sb_free(scene->cpu_skinned_normals);
+            scene->cpu_skin_streams = nullptr;
+            scene->cpu_skinned_positions = nullptr;
+            scene->cpu_skinned_normals = nullptr;
+
             scene->soa_size = 0;
             scene->num_entities = 0;
         }
@@ -139,12 +398,93 @@ namespace put
             for (u32 i = 0; i < scene->num_components; ++i)
             {
                 generic_cmp_array& cmp = scene->get_component_array(i);
-                u8*                offset = (u8*)cmp.data + node_index * cmp.size;
-                pen::memory_zero(offset, cmp.size);
+
+                void* offset = get_allocated_component(cmp, node_index);
+                if (offset)
+                    pen::memory_zero(offset, cmp.size);
             }
 
             // Annoyingly nodeindex == parent is used to determine if a node is not a child
             scene->parents[node_index] = node_index;
+            scene->flags |= e_scene_flags::invalidate_queries;
+        }
+
+        void get_component_memory(ecs_scene* scene, size_t& allocated, size_t& contiguous)
+        {
+            allocated = 0;
+            contiguous = 0;
+
+            for (u32 i = 0; i < scene->num_components; ++i)
+            {
+                generic_cmp_array& cmp = scene->get_component_array(i);
+                contiguous += (size_t)cmp.size * scene->soa_size;
+
+                u32    num_pages = num_component_pages(cmp.storage, scene->soa_size);
+                size_t page_size = (size_t)cmp.size << get_component_page_shift(cmp.storage);
+
+                allocated += num_pages * sizeof(void*);
+                for (u32 p = 0; p < num_pages; ++p)
+                    if (((void**)cmp.data)[p])
+                        allocated += page_size;
+            }
+        }
+
+        void refresh_queries(ecs_scene* scene)
+        {
+            u64 query_mask = 0;
+
+            u32 num_queries = sb_count(scene->queries);
+            for (u32 q = 0; q < num_queries; ++q)
+            {
+                if (scene->queries[q].entities)
+                    stb__sbn(scene->queries[q].entities) = 0;
+
+                query_mask |= scene->queries[q].mask;
+            }
+
+            // one pass over the flags fills every list
+            for (u32 n = 0; query_mask && n < scene->num_entities; ++n)
+            {
+                u64 e = scene->entities[n];
+                if (!(e & query_mask))
+                    continue;
+
+                for (u32 q = 0; q < num_queries; ++q)
+                    if ((e & scene->queries[q].mask) == scene->queries[q].mask)
+                        sb_push(scene->queries[q].entities, n);
+            }
+
+            scene->flags &= ~e_scene_flags::invalidate_queries;
+        }
+
+        const u32* query_entities(ecs_scene* scene, u64 mask, u32& count)
+        {
+            if (scene->flags & e_scene_flags::invalidate_queries)
+                refresh_queries(scene);
+
+            u32 num_queries = sb_count(scene->queries);
+            for (u32 q = 0; q < num_queries; ++q)
+            {
+                if (scene->queries[q].mask != mask)
+                    continue;
+
+                count = sb_count(scene->queries[q].entities);
+                return scene->queries[q].entities;
+            }
+
+            // first use, register the query so it is refreshed with the others from now on
+            ecs_query nq;
+            nq.mask = mask;
+            nq.entities = nullptr;
+
+            for (u32 n = 0; n < scene->num_entities; ++n)
+                if ((scene->entities[n] & mask) == mask)
+                    sb_push(nq.entities, n);
+
+            sb_push(scene->queries, nq);
+
+            count = sb_count(nq.entities);
+            return nq.entities;
         }
 
         void delete_entity(ecs_scene* scene, u32 node_index)
@@ -178,14 +518,17 @@ namespace put
                     pen::renderer_release_buffer(scene->pre_skin[node_index].position_buffer);
             }
 
-            if (scene->master_instances[node_index].instance_buffer)
-                pen::renderer_release_buffer(scene->master_instances[node_index].instance_buffer);
+            if (scene->entities[node_index] & e_cmp::master_instance)
+            {
+                if (scene->master_instances[node_index].instance_buffer)
+                    pen::renderer_release_buffer(scene->master_instances[node_index].instance_buffer);
+            }
         }
 
         void delete_entity_second_pass(ecs_scene* scene, u32 node_index)
         {
             // all constraints must be removed by this point.
-            if (scene->physics_handles[node_index] && (scene->entities[node_index] & e_cmp::physics))
+            if (is_valid(scene->physics_handles[node_index]) && (scene->entities[node_index] & e_cmp::physics))
                 physics::release_entity(scene->physics_handles[node_index]);
 
             zero_entity_components(scene, node_index);
@@ -204,7 +547,7 @@ namespace put
             for (u32 i = 0; i < scene->num_components; ++i)
             {
                 generic_cmp_array& cmp = scene->get_component_array(i);
-                memcpy(cmp[dst], cmp[src], cmp.size);
+                copy_component(cmp, dst, src);
             }
         }
 
@@ -227,113 +570,528 @@ namespace put
             zero_entity_components(scene, temp);
         }
 
-        u32 clone_entity(ecs_scene* scene, u32 src, s32 dst, s32 parent, clone_mode mode, vec3f offset, const c8* suffix)
+        namespace
         {
-            if (dst == -1)
+            namespace e_defrag_class
             {
-                dst = get_new_entity(scene);
+                enum defrag_class_t
+                {
+                    static_renderable,
+                    dynamic_renderable,
+                    light,
+                    other
+                };
             }
-            else
+
+            u32 find_defrag_root(std::vector<u32>& roots, u32 i)
             {
-                if (dst >= scene->num_entities)
-                    scene->num_entities = dst + 1;
+                while (roots[i] != i)
+                {
+                    roots[i] = roots[roots[i]];
+                    i = roots[i];
+                }
+                return i;
             }
 
-            ecs_scene* p_sn = scene;
+            void join_defrag_roots(std::vector<u32>& roots, u32 a, u32 b)
+            {
+                a = find_defrag_root(roots, a);
+                b = find_defrag_root(roots, b);
 
-            // copy components
-            for (u32 i = 0; i < scene->num_components; ++i)
+                // keep the lowest index as the root so blocks are found in index order
+                if (a < b)
+                    roots[b] = a;
+                else
+                    roots[a] = b;
+            }
+
+            bool is_dynamic_entity(u64 e)
             {
-                generic_cmp_array& cmp = p_sn->get_component_array(i);
-                memcpy(cmp[dst], cmp[src], cmp.size);
+                static const u64 dynamic_mask = e_cmp::dynamic | e_cmp::physics | e_cmp::physics_multi |
+                                                e_cmp::anim_controller | e_cmp::skinned | e_cmp::cpu_skinned |
+                                                e_cmp::pre_skinned;
+
+                return e & dynamic_mask;
             }
 
-            // assign
-            Str blank;
-            memcpy(&p_sn->names[dst], &blank, sizeof(Str));
-            memcpy(&p_sn->material_names[dst], &blank, sizeof(Str));
-            memcpy(&p_sn->material_names[dst], &blank, sizeof(Str));
+            u32 get_defrag_class(u64 e)
+            {
+                if (e & e_cmp::geometry)
+                    return is_dynamic_entity(e) ? e_defrag_class::dynamic_renderable : e_defrag_class::static_renderable;
 
-            p_sn->names[dst] = p_sn->names[src].c_str();
-            p_sn->names[dst].append(suffix);
+                if (e & e_cmp::light)
+                    return e_defrag_class::light;
 
-            p_sn->geometry_names[dst] = p_sn->geometry_names[src].c_str();
-            p_sn->material_names[dst] = p_sn->material_names[src].c_str();
+                return e_defrag_class::other;
+            }
 
-            // fixup
-            u32 parent_offset = p_sn->parents[src] - src;
-            if (parent == -1)
+            u32 count_allocated_entities(ecs_scene* scene)
             {
-                p_sn->parents[dst] = dst - parent_offset;
+                u32 count = 0;
+                for (u32 i = 0; i < scene->num_entities; ++i)
+                    if (scene->entities[i] & e_cmp::allocated)
+                        ++count;
+
+                return count;
             }
-            else
+
+            void plan_defrag(ecs_scene* scene, defrag_state* ds)
             {
-                p_sn->parents[dst] = parent;
-            }
+                u32 num = scene->num_entities;
 
-            vec3f translation = p_sn->local_matrices[dst].get_translation();
-            p_sn->local_matrices[dst].set_translation(translation + offset);
+                // hierarchies and instance ranges must stay together, group them into blocks
+                std::vector<u32> roots(num);
+                for (u32 i = 0; i < num; ++i)
+                    roots[i] = i;
 
-            if (mode == e_clone_mode::instantiate)
-            {
-                // todo, clone / instantiate constraint
+                for (u32 i = 0; i < num; ++i)
+                {
+                    if (!(scene->entities[i] & e_cmp::allocated))
+                        continue;
 
-                if (p_sn->physics_handles[src])
-                    instantiate_rigid_body(scene, dst);
+                    u32 p = scene->parents[i];
+                    if (p != i && p < num)
+                        join_defrag_roots(roots, i, p);
 
-                if (p_sn->entities[dst] & e_cmp::geometry)
-                    instantiate_model_cbuffer(scene, dst);
+                    if (scene->entities[i] & e_cmp::master_instance)
+                    {
+                        u32 last = std::min(i + scene->master_instances[i].num_instances, num - 1);
+                        for (u32 j = i + 1; j <= last; ++j)
+                            join_defrag_roots(roots, i, j);
+                    }
+                }
 
-                if (p_sn->entities[dst] & e_cmp::material)
+                // blocks in order of their first entity, take the hottest class of any member
+                std::vector<s32> block_of(num, -1);
+                std::vector<u32> block_class;
+                std::vector<u32> block_size;
+                for (u32 i = 0; i < num; ++i)
                 {
-                    p_sn->materials[dst].material_cbuffer = PEN_INVALID_HANDLE;
-                    instantiate_material_cbuffer(scene, dst, p_sn->materials[dst].material_cbuffer_size);
+                    if (!(scene->entities[i] & e_cmp::allocated))
+                        continue;
+
+                    u32 r = find_defrag_root(roots, i);
+                    if (block_of[r] == -1)
+                    {
+                        block_of[r] = (s32)block_class.size();
+                        block_class.push_back(e_defrag_class::other);
+                        block_size.push_back(0);
+                    }
+
+                    u32 b = block_of[r];
+                    block_of[i] = b;
+                    block_size[b]++;
+                    block_class[b] = std::min(block_class[b], get_defrag_class(scene->entities[i]));
+                }
+
+                u32              num_blocks = (u32)block_class.size();
+                std::vector<u32> sorted(num_blocks);
+                for (u32 b = 0; b < num_blocks; ++b)
+                    sorted[b] = b;
+
+                std::stable_sort(sorted.begin(), sorted.end(),
+                                 [&](u32 a, u32 b) { return block_class[a] < block_class[b]; });
+
+                // members keep their relative order, parents stay before children and joints stay contiguous
+                std::vector<u32> offset(num_blocks);
+                ds->block_start.resize(num_blocks + 1);
+
+                u32 pos = 0;
+                for (u32 s = 0; s < num_blocks; ++s)
+                {
+                    ds->block_start[s] = pos;
+                    offset[sorted[s]] = pos;
+                    pos += block_size[sorted[s]];
+                }
+                ds->block_start[num_blocks] = pos;
+
+                ds->order.resize(pos);
+                ds->slot_order.assign(scene->soa_size, -1);
+                for (u32 i = 0; i < num; ++i)
+                {
+                    if (block_of[i] == -1)
+                        continue;
+
+                    u32 k = offset[block_of[i]]++;
+                    ds->order[k] = i;
+                    ds->slot_order[i] = k;
                 }
+
+                ds->origin.assign(scene->soa_size, -1);
+                ds->remap.assign(scene->soa_size, -1);
+                ds->touched.clear();
+                ds->cursor = 0;
+                ds->moves = 0;
+                ds->planned = true;
             }
-            else if (mode == e_clone_mode::move)
+
+            u32 get_defrag_block(defrag_state* ds, u32 order_index)
             {
-                zero_entity_components(scene, src);
+                auto it = std::upper_bound(ds->block_start.begin(), ds->block_start.end(), order_index);
+                return (u32)(it - ds->block_start.begin()) - 1;
             }
 
-            return dst;
-        }
+            // members must still exist, and reparenting must not have pulled them out of their block
+            bool validate_defrag_block(ecs_scene* scene, defrag_state* ds, u32 b)
+            {
+                for (u32 k = ds->block_start[b]; k < ds->block_start[b + 1]; ++k)
+                {
+                    u32 n = ds->order[k];
+                    if (!(scene->entities[n] & e_cmp::allocated))
+                        return false;
 
-        void init()
-        {
-            // create view renderers
-            put::scene_view_renderer svr_main;
-            svr_main.name = "ecs_render_scene";
-            svr_main.id_name = PEN_HASH(svr_main.name.c_str());
-            svr_main.render_function = &ecs::render_scene_view;
+                    u32 p = scene->parents[n];
+                    if (p == n)
+                        continue;
 
-            put::scene_view_renderer svr_light_volumes;
-            svr_light_volumes.name = "ecs_render_light_volumes";
-            svr_light_volumes.id_name = PEN_HASH(svr_light_volumes.name.c_str());
-            svr_light_volumes.render_function = &ecs::render_light_volumes;
+                    if (p >= scene->num_entities || ds->slot_order[p] == -1)
+                        return false;
 
-            put::scene_view_renderer svr_shadow_maps;
-            svr_shadow_maps.name = "ecs_render_shadow_maps";
-            svr_shadow_maps.id_name = PEN_HASH(svr_shadow_maps.name.c_str());
-            svr_shadow_maps.render_function = &ecs::render_shadow_views;
+                    if (get_defrag_block(ds, ds->slot_order[p]) != b)
+                        return false;
+                }
 
-            put::scene_view_renderer svr_area_light_textures;
-            svr_area_light_textures.name = "ecs_render_area_light_textures";
-            svr_area_light_textures.id_name = PEN_HASH(svr_area_light_textures.name.c_str());
-            svr_area_light_textures.render_function = &ecs::render_area_light_textures;
+                return true;
+            }
 
-            put::scene_view_renderer svr_omni_shadow_maps;
-            svr_omni_shadow_maps.name = "ecs_render_omni_shadow_maps";
-            svr_omni_shadow_maps.id_name = PEN_HASH(svr_omni_shadow_maps.name.c_str());
-            svr_omni_shadow_maps.render_function = &ecs::render_omni_shadow_views;
+            void grow_defrag_state(ecs_scene* scene, defrag_state* ds)
+            {
+                if (ds->slot_order.size() >= scene->soa_size)
+                    return;
 
-            put::scene_view_renderer svr_volume_gi;
-            svr_volume_gi.name = "ecs_compute_volume_gi";
-            svr_volume_gi.id_name = PEN_HASH(svr_volume_gi.name.c_str());
-            svr_volume_gi.render_function = &ecs::compute_volume_gi;
+                ds->slot_order.resize(scene->soa_size, -1);
+                ds->origin.resize(scene->soa_size, -1);
+                ds->remap.resize(scene->soa_size, -1);
+            }
+
+            void move_defrag_entity(ecs_scene* scene, defrag_state* ds, u32 src, u32 dst)
+            {
+                entity_cpy(scene, dst, src);
+                zero_entity_components(scene, src);
+
+                ds->origin[dst] = ds->origin[src] == -1 ? (s32)src : ds->origin[src];
+                if (ds->origin[src] == -1)
+                    ds->touched.push_back(src);
+                ds->origin[src] = (s32)src;
+                ds->touched.push_back(dst);
+
+                s32 k = ds->slot_order[src];
+                ds->slot_order[dst] = k;
+                ds->slot_order[src] = -1;
+                ds->order[k] = dst;
+
+                if (dst >= scene->num_entities)
+                    scene->num_entities = dst + 1;
+
+                ds->moves++;
+            }
+
+            // moves a whole block past the end of the scene keeping its order
+            u32 evict_defrag_block(ecs_scene* scene, defrag_state* ds, u32 b)
+            {
+                u32 count = ds->block_start[b + 1] - ds->block_start[b];
+                if (scene->num_entities + count > scene->soa_size)
+                {
+                    resize_scene_buffers(scene, count);
+                    grow_defrag_state(scene, ds);
+                }
+
+                u32 tail = scene->num_entities;
+                for (u32 k = ds->block_start[b]; k < ds->block_start[b + 1]; ++k)
+                    move_defrag_entity(scene, ds, ds->order[k], tail++);
+
+                return count;
+            }
+
+            // fix up indices stored in components for all entities moved this call
+            void remap_defrag_indices(ecs_scene* scene, defrag_state* ds)
+            {
+                u32 num_touched = (u32)ds->touched.size();
+                if (num_touched == 0)
+                    return;
+
+                for (u32 t = 0; t < num_touched; ++t)
+                {
+                    u32 s = ds->touched[t];
+                    if ((scene->entities[s] & e_cmp::allocated) && ds->origin[s] != (s32)s)
+                        ds->remap[ds->origin[s]] = s;
+                }
+
+                auto remap = [&](u32 i) -> u32 { return (i < ds->remap.size() && ds->remap[i] != -1) ? ds->remap[i] : i; };
+
+                for (u32 n = 0; n < scene->num_entities; ++n)
+                {
+                    if (!(scene->entities[n] & e_cmp::allocated))
+                        continue;
+
+                    scene->parents[n] = remap(scene->parents[n]);
+
+                    if (scene->entities[n] & e_cmp::anim_controller)
+                    {
+                        cmp_anim_controller_v2& controller = scene->anim_controller_v2.write(n);
+
+                        u32 num_joints = sb_count(controller.joint_indices);
+                        for (u32 j = 0; j < num_joints; ++j)
+                            controller.joint_indices[j] = remap(controller.joint_indices[j]);
+
+                        if (is_valid(controller.joints_offset))
+                            controller.joints_offset = remap(controller.joints_offset);
+                    }
+                }
+
+                u32 num_selected = sb_count(scene->selection_list);
+                for (u32 s = 0; s < num_selected; ++s)
+                    scene->selection_list[s] = remap(scene->selection_list[s]);
+
+                if (scene->selected_index >= 0)
+                    scene->selected_index = remap(scene->selected_index);
+
+                for (u32 t = 0; t < num_touched; ++t)
+                {
+                    u32 s = ds->touched[t];
+                    if (ds->origin[s] >= 0)
+                        ds->remap[ds->origin[s]] = -1;
+                    ds->origin[s] = -1;
+                }
+                ds->touched.clear();
+
+                initialise_free_list(scene);
+                scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
+                refresh_queries(scene);
+            }
+        } // namespace
+
+        void defrag_scene(ecs_scene* scene, u32 max_moves)
+        {
+            if (!scene->defrag)
+                scene->defrag = new defrag_state();
+
+            defrag_state* ds = scene->defrag;
+
+            // entities created or deleted since the plan was made
+            if (!ds->planned || ds->order.size() != count_allocated_entities(scene))
+                plan_defrag(scene, ds);
+
+            grow_defrag_state(scene, ds);
+
+            u32 num_blocks = (u32)ds->block_start.size() - 1;
+            u32 moved = 0;
+            u32 replans = 0;
+            while (ds->cursor < num_blocks)
+            {
+                u32 b = ds->cursor;
+                u32 start = ds->block_start[b];
+                u32 end = ds->block_start[b + 1];
+
+                bool in_place = true;
+                for (u32 k = start; k < end && in_place; ++k)
+                    in_place = ds->order[k] == k;
+
+                if (in_place)
+                {
+                    ds->cursor++;
+                    continue;
+                }
+
+                if (!validate_defrag_block(scene, ds, b))
+                {
+                    // the plan is stale, positions already placed are kept and will be found in place
+                    remap_defrag_indices(scene, ds);
+                    if (replans++)
+                        break;
+
+                    plan_defrag(scene, ds);
+                    num_blocks = (u32)ds->block_start.size() - 1;
+                    continue;
+                }
+
+                // the first block is always moved, even if it exceeds the budget on its own
+                u32 count = end - start;
+                if (moved > 0 && moved + count > max_moves)
+                    break;
+
+                // clear the target range, this block included if it overlaps it
+                for (u32 slot = start; slot < end; ++slot)
+                {
+                    if (slot >= scene->num_entities || !(scene->entities[slot] & e_cmp::allocated))
+                        continue;
+
+                    s32 k = ds->slot_order[slot];
+                    if (k == -1)
+                        break; // not planned, the plan will be rebuilt next call
+
+                    moved += evict_defrag_block(scene, ds, get_defrag_block(ds, k));
+                }
+
+                bool clear = true;
+                for (u32 slot = start; slot < end && clear; ++slot)
+                    clear = slot >= scene->num_entities || !(scene->entities[slot] & e_cmp::allocated);
+
+                if (!clear)
+                {
+                    ds->planned = false;
+                    break;
+                }
+
+                for (u32 k = start; k < end; ++k)
+                    move_defrag_entity(scene, ds, ds->order[k], k);
+
+                moved += count;
+                ds->cursor++;
+            }
+
+            // everything is packed, give back the tail
+            if (ds->planned && ds->cursor >= num_blocks)
+            {
+                u32 packed = ds->block_start[num_blocks];
+                if (scene->num_entities > packed)
+                {
+                    remap_defrag_indices(scene, ds);
+                    if (count_allocated_entities(scene) == packed)
+                        scene->num_entities = packed;
+                }
+            }
+
+            remap_defrag_indices(scene, ds);
+        }
+
+        void get_defrag_stats(ecs_scene* scene, defrag_stats& stats)
+        {
+            if (!scene->defrag)
+                scene->defrag = new defrag_state();
+
+            defrag_state* ds = scene->defrag;
+            u32           allocated = count_allocated_entities(scene);
+            if (!ds->planned || ds->order.size() != allocated)
+                plan_defrag(scene, ds);
+
+            stats.misplaced = 0;
+            for (u32 k = 0; k < ds->order.size(); ++k)
+                if (ds->order[k] != k)
+                    stats.misplaced++;
+
+            stats.holes = scene->num_entities - allocated;
+            stats.moves = ds->moves;
+            stats.fragmentation = allocated ? (f32)stats.misplaced / (f32)allocated : 0.0f;
+        }
+
+        u32 clone_entity(ecs_scene* scene, u32 src, s32 dst, s32 parent, clone_mode mode, vec3f offset, const c8* suffix)
+        {
+            if (dst == -1)
+            {
+                dst = get_new_entity(scene);
+            }
+            else
+            {
+                if (dst >= scene->num_entities)
+                    scene->num_entities = dst + 1;
+            }
+
+            ecs_scene* p_sn = scene;
+
+            // copy components
+            for (u32 i = 0; i < scene->num_components; ++i)
+            {
+                generic_cmp_array& cmp = p_sn->get_component_array(i);
+                copy_component(cmp, dst, src);
+            }
+
+            // assign
+            Str blank;
+            memcpy(&p_sn->names[dst], &blank, sizeof(Str));
+            memcpy(&p_sn->material_names[dst], &blank, sizeof(Str));
+            memcpy(&p_sn->material_names[dst], &blank, sizeof(Str));
+
+            p_sn->names[dst] = p_sn->names[src].c_str();
+            p_sn->names[dst].append(suffix);
+
+            p_sn->geometry_names[dst] = p_sn->geometry_names[src].c_str();
+            p_sn->material_names[dst] = p_sn->material_names[src].c_str();
+
+            // fixup
+            u32 parent_offset = p_sn->parents[src] - src;
+            if (parent == -1)
+            {
+                p_sn->parents[dst] = dst - parent_offset;
+            }
+            else
+            {
+                p_sn->parents[dst] = parent;
+            }
+
+            vec3f translation = p_sn->local_matrices[dst].get_translation();
+            p_sn->local_matrices[dst].set_translation(translation + offset);
+
+            // the source palette is not ours, clones get one on the next update
+            if (p_sn->entities[dst] & (e_cmp::skinned | e_cmp::pre_skinned))
+                p_sn->anim_controller_v2.write(dst).palette_offset = PEN_INVALID_HANDLE;
+
+            if (mode == e_clone_mode::instantiate)
+            {
+                // todo, clone / instantiate constraint
+
+                if (p_sn->physics_handles[src])
+                    instantiate_rigid_body(scene, dst);
+
+                if (p_sn->entities[dst] & e_cmp::geometry)
+                    instantiate_model_cbuffer(scene, dst);
+
+                if (p_sn->entities[dst] & e_cmp::material)
+                {
+                    p_sn->materials[dst].material_cbuffer = PEN_INVALID_HANDLE;
+                    instantiate_material_cbuffer(scene, dst, p_sn->materials[dst].material_cbuffer_size);
+                }
+            }
+            else if (mode == e_clone_mode::move)
+            {
+                zero_entity_components(scene, src);
+            }
+
+            return dst;
+        }
+
+        void init()
+        {
+            // create view renderers
+            put::scene_view_renderer svr_main;
+            svr_main.name = "ecs_render_scene";
+            svr_main.id_name = PEN_HASH(svr_main.name.c_str());
+            svr_main.render_function = &ecs::render_scene_view;
+
+            put::scene_view_renderer svr_light_volumes;
+            svr_light_volumes.name = "ecs_render_light_volumes";
+            svr_light_volumes.id_name = PEN_HASH(svr_light_volumes.name.c_str());
+            svr_light_volumes.render_function = &ecs::render_light_volumes;
+
+            put::scene_view_renderer svr_shadow_maps;
+            svr_shadow_maps.name = "ecs_render_shadow_maps";
+            svr_shadow_maps.id_name = PEN_HASH(svr_shadow_maps.name.c_str());
+            svr_shadow_maps.render_function = &ecs::render_shadow_views;
+
+            put::scene_view_renderer svr_static_shadow_maps;
+            svr_static_shadow_maps.name = "ecs_render_static_shadow_maps";
+            svr_static_shadow_maps.id_name = PEN_HASH(svr_static_shadow_maps.name.c_str());
+            svr_static_shadow_maps.render_function = &ecs::render_static_shadow_views;
+
+            put::scene_view_renderer svr_area_light_textures;
+            svr_area_light_textures.name = "ecs_render_area_light_textures";
+            svr_area_light_textures.id_name = PEN_HASH(svr_area_light_textures.name.c_str());
+            svr_area_light_textures.render_function = &ecs::render_area_light_textures;
+
+            put::scene_view_renderer svr_omni_shadow_maps;
+            svr_omni_shadow_maps.name = "ecs_render_omni_shadow_maps";
+            svr_omni_shadow_maps.id_name = PEN_HASH(svr_omni_shadow_maps.name.c_str());
+            svr_omni_shadow_maps.render_function = &ecs::render_omni_shadow_views;
+
+            put::scene_view_renderer svr_volume_gi;
+            svr_volume_gi.name = "ecs_compute_volume_gi";
+            svr_volume_gi.id_name = PEN_HASH(svr_volume_gi.name.c_str());
+            svr_volume_gi.render_function = &ecs::compute_volume_gi;
 
             pmfx::register_scene_view_renderer(svr_main);
             pmfx::register_scene_view_renderer(svr_light_volumes);
             pmfx::register_scene_view_renderer(svr_shadow_maps);
+            pmfx::register_scene_view_renderer(svr_static_shadow_maps);
             pmfx::register_scene_view_renderer(svr_omni_shadow_maps);
             pmfx::register_scene_view_renderer(svr_area_light_textures);
             pmfx::register_scene_view_renderer(svr_volume_gi);
@@ -415,15 +1173,17 @@ namespace put
 
             u32 count = 0;
             u32 area_light = -1;
-            for (u32 i = 0; i < scene->num_entities; ++i)
+
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[i] & e_cmp::light))
-                    continue;
+                u32 i = light_entities[qi];
 
                 if (!(scene->lights[i].type == e_light_type::area_ex))
                     continue;
 
-                cmp_area_light& al = scene->area_light[i];
+                const cmp_area_light& al = scene->area_light[i];
                 if (!is_valid(al.shader))
                     continue;
 
@@ -439,7 +1199,7 @@ namespace put
             if (!is_valid(area_light))
                 return;
 
-            cmp_area_light& al = scene->area_light[area_light];
+            const cmp_area_light& al = scene->area_light[area_light];
 
             pen::renderer_set_constant_buffer(scene->cbuffer[area_light], 1, pen::CBUFFER_BIND_PS);
 
@@ -519,88 +1279,399 @@ namespace put
             }
         }
 
-        void render_shadow_views(const scene_view& view)
+        namespace
         {
-            ecs_scene* scene = view.scene;
-
-            static u32 cb_view = PEN_INVALID_HANDLE;
-            if (!is_valid(cb_view))
-            {
-                pen::buffer_creation_params bcp;
-                bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                bcp.buffer_size = sizeof(camera_cbuffer);
-                bcp.data = nullptr;
-
-                cb_view = pen::renderer_create_buffer(bcp);
-            }
-
-            static mat4 shadow_matrices[e_scene_limits::max_shadow_maps];
-            u32         shadow_index = 0;
-            for (u32 n = 0; n < scene->num_entities; ++n)
+            mat4 get_shadow_view_projection(const camera& cam)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
-
-                if (!(scene->lights[n].flags & (e_light_flags::shadow_map | e_light_flags::global_illumination)))
-                    continue;
-
-                if (shadow_index++ != view.array_index)
-                    continue;
-
-                // create a shadow camera
-                camera cam;
-                shadow_camera_from_entity(cam, scene, n);
-
-                // update view and camera
-                scene_view vv = view;
-                vv.camera = &cam;
-
-                mat4 shadow_vp;
-
                 // handle different clip spaces
                 if (pen::renderer_depth_0_to_1())
                 {
                     // if clip space is 0-1 scale and bias the depth buffer
                     mat4 scale = mat::create_scale(vec3f(1.0f, 1.0f, 0.5f));
                     mat4 bias = mat::create_translation(vec3f(0.0f, 0.0f, 0.5f));
-                    shadow_vp = bias * scale * cam.proj * cam.view;
+                    return bias * scale * cam.proj * cam.view;
                 }
-                else
+
+                // opengl has -1 to 1 z so no need for the scale + bias
+                return cam.proj * cam.view;
+            }
+
+            u32 get_shadow_view_cbuffer()
+            {
+                static u32 cb_view = PEN_INVALID_HANDLE;
+                if (!is_valid(cb_view))
                 {
-                    // opengl has -1 to 1 z so no need for the scale + bias
-                    shadow_vp = cam.proj * cam.view;
+                    pen::buffer_creation_params bcp;
+                    bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                    bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                    bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                    bcp.buffer_size = sizeof(camera_cbuffer);
+                    bcp.data = nullptr;
+
+                    cb_view = pen::renderer_create_buffer(bcp);
                 }
 
-                pen::renderer_update_buffer(cb_view, &shadow_vp, sizeof(mat4));
-                shadow_matrices[shadow_index - 1] = shadow_vp;
-                vv.cb_view = cb_view;
+                return cb_view;
+            }
 
-                // colour shadow maps
-                if (vv.render_flags & pmfx::e_scene_render_flags::forward_lit)
+            void clear_shadow_slice(u32 array_index)
+            {
+                static u32 cs_depth = PEN_INVALID_HANDLE;
+                if (!is_valid(cs_depth))
                 {
-                    // bind single light cbuffer
-                    static u32 cb_light = -1;
-                    if (!is_valid(cb_light))
-                    {
-                        pen::buffer_creation_params bcp;
-                        bcp.usage_flags = PEN_USAGE_DYNAMIC;
-                        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
-                        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
-                        bcp.buffer_size = sizeof(light_data);
-                        bcp.data = nullptr;
+                    pen::clear_state cs = {};
+                    cs.depth = 1.0f;
+                    cs.flags = PEN_CLEAR_DEPTH_BUFFER;
 
-                        cb_light = pen::renderer_create_buffer(bcp);
-                    }
-
-                    light_data ld;
-                    single_light_from_entity(ld, scene, n);
-                    pen::renderer_update_buffer(cb_light, &ld, sizeof(light_data));
-                    pen::renderer_set_constant_buffer(cb_light, 10, pen::CBUFFER_BIND_PS);
+                    cs_depth = pen::renderer_create_clear_state(cs);
                 }
 
-                render_scene_view(vv);
+                pen::renderer_clear(cs_depth, array_index);
+            }
+
+            bool shadow_cache_matches(const shadow_cache& c, u32 light, const mat4& view_projection)
+            {
+                return c.valid && c.light == light && memcmp(&c.view_projection, &view_projection, sizeof(mat4)) == 0;
+            }
+
+            bool aabb_inside_frustum(const frustum& frust, const cmp_pos_extent& pe)
+            {
+                vec3f pos = pe.pos.xyz;
+                vec3f extent = pe.extent.xyz;
+
+                for (s32 p = 0; p < 6; ++p)
+                {
+                    vec3f sign_flip = sgn(frust.n[p]) * -1.0f;
+                    f32   pd = maths::plane_distance(frust.p[p], frust.n[p]);
+                    f32   d2 = dot(pos + extent * sign_flip, frust.n[p]);
+
+                    if (d2 > -pd)
+                        return false;
+                }
+
+                return true;
+            }
+
+            bool aabb_inside_sphere(const vec4f& pos_radius, const cmp_pos_extent& pe)
+            {
+                f32 d2 = 0.0f;
+                for (u32 i = 0; i < 3; ++i)
+                {
+                    f32 d = fabs(pos_radius[i] - pe.pos[i]) - pe.extent[i];
+                    if (d > 0.0f)
+                        d2 += d * d;
+                }
+
+                return d2 <= pos_radius.w * pos_radius.w;
+            }
+
+            void invalidate_shadow_caches(ecs_scene* scene)
+            {
+                if (!scene->shadow_cache)
+                    return;
+
+                for (auto& c : scene->shadow_cache->slices)
+                    c.valid = 0;
+
+                for (auto& c : scene->shadow_cache->omni)
+                    c.valid = 0;
+            }
+
+            void push_shadow_dirty_region(shadow_caches* sc, u8 caster, const cmp_pos_extent& pe)
+            {
+                if (caster == 1)
+                    sc->static_dirty.push_back(pe);
+                else if (caster == 2)
+                    sc->dynamic_dirty.push_back(pe);
+            }
+
+            void update_shadow_caches(ecs_scene* scene)
+            {
+                if (!(scene->flags & e_scene_flags::cache_shadows))
+                {
+                    delete scene->shadow_cache;
+                    scene->shadow_cache = nullptr;
+                    return;
+                }
+
+                if (!scene->shadow_cache)
+                    scene->shadow_cache = new shadow_caches();
+
+                shadow_caches* sc = scene->shadow_cache;
+
+                // counts from the views rendered since the last update
+                scene->shadow_view_stats = sc->frame;
+                sc->frame = shadow_stats();
+
+                if (sc->prev_extents.size() < scene->num_entities)
+                {
+                    sc->prev_extents.resize(scene->num_entities);
+                    sc->prev_caster.resize(scene->num_entities, 0);
+                }
+
+                // entities which were created, deleted or moved dirty both their old and new bounds
+                sc->static_dirty.clear();
+                sc->dynamic_dirty.clear();
+
+                static const u64 caster_mask = e_cmp::allocated | e_cmp::geometry | e_cmp::material;
+                for (u32 n = 0; n < scene->num_entities; ++n)
+                {
+                    u64 e = scene->entities[n];
+
+                    u8 caster = 0;
+                    if ((e & caster_mask) == caster_mask)
+                        caster = is_dynamic_entity(e) ? 2 : 1;
+
+                    u8&                   prev = sc->prev_caster[n];
+                    cmp_pos_extent&       prev_pe = sc->prev_extents[n];
+                    const cmp_pos_extent& pe = scene->pos_extent[n];
+
+                    if (caster == prev && (!caster || memcmp(&pe, &prev_pe, sizeof(cmp_pos_extent)) == 0))
+                        continue;
+
+                    push_shadow_dirty_region(sc, prev, prev_pe);
+                    push_shadow_dirty_region(sc, caster, pe);
+
+                    prev = caster;
+                    prev_pe = pe;
+                }
+
+                // shadow_map slices only cache static casters, omni lights cache everything
+                for (auto& c : sc->slices)
+                {
+                    if (!c.valid)
+                        continue;
+
+                    for (auto& pe : sc->static_dirty)
+                    {
+                        if (aabb_inside_frustum(c.cull_frustum, pe))
+                        {
+                            c.valid = 0;
+                            break;
+                        }
+                    }
+                }
+
+                for (auto& c : sc->omni)
+                {
+                    if (!c.valid)
+                        continue;
+
+                    for (auto* dirty : {&sc->static_dirty, &sc->dynamic_dirty})
+                    {
+                        for (auto& pe : *dirty)
+                        {
+                            if (aabb_inside_sphere(c.pos_radius, pe))
+                            {
+                                c.valid = 0;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            void copy_static_shadow_slice(const scene_view& view, u32 static_shadow_map)
+            {
+                static u32 shader = pmfx::load_shader("forward_render");
+                static u32 cb_draw = PEN_INVALID_HANDLE;
+                if (!is_valid(cb_draw))
+                {
+                    pen::buffer_creation_params bcp;
+                    bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                    bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                    bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                    bcp.buffer_size = sizeof(cmp_draw_call);
+                    bcp.data = nullptr;
+
+                    cb_draw = pen::renderer_create_buffer(bcp);
+                }
+
+                static hash_id id_technique = PEN_HASH("copy_shadow_layer");
+                if (!pmfx::set_technique_perm(shader, id_technique, 0))
+                    return;
+
+                static hash_id id_no_cull = PEN_HASH("no_cull");
+                static hash_id id_depth_always = PEN_HASH("depth_always");
+                static hash_id id_clamp_point = PEN_HASH("clamp_point");
+                u32 no_cull = pmfx::get_render_state(id_no_cull, pmfx::e_render_state::rasterizer);
+                u32 depth_always = pmfx::get_render_state(id_depth_always, pmfx::e_render_state::depth_stencil);
+                u32 clamp_point = pmfx::get_render_state(id_clamp_point, pmfx::e_render_state::sampler);
+
+                static hash_id     id_quad = PEN_HASH("full_screen_quad");
+                geometry_resource* quad = get_geometry_resource(id_quad);
+                pmm_renderable&    r = quad->renderable[e_pmm_renderable::full_vertex_buffer];
+
+                cmp_draw_call dc;
+                dc.world_matrix = mat4::create_identity();
+                dc.v1 = vec4f((f32)view.array_index, 0.0f, 0.0f, 0.0f);
+                pen::renderer_update_buffer(cb_draw, &dc, sizeof(cmp_draw_call));
+
+                pen::renderer_set_raster_state(no_cull);
+                pen::renderer_set_depth_stencil_state(depth_always);
+                pen::renderer_set_texture(static_shadow_map, clamp_point, 4, pen::TEXTURE_BIND_PS);
+                pen::renderer_set_constant_buffer(cb_draw, 1, pen::CBUFFER_BIND_PS | pen::CBUFFER_BIND_VS);
+                pen::renderer_set_vertex_buffer(r.vertex_buffer, 0, r.vertex_size, 0);
+                pen::renderer_set_index_buffer(r.index_buffer, r.index_type, 0);
+                pen::renderer_draw_indexed(r.num_indices, 0, 0, PEN_PT_TRIANGLELIST);
+
+                // back to the view state for the dynamic casters
+                pen::renderer_set_raster_state(view.raster_state);
+                pen::renderer_set_depth_stencil_state(view.depth_stencil_state);
+                pen::renderer_set_texture(0, 0, 4, pen::TEXTURE_BIND_PS);
+            }
+        } // namespace
+
+        void render_static_shadow_views(const scene_view& view)
+        {
+            ecs_scene*     scene = view.scene;
+            shadow_caches* sc = scene->shadow_cache;
+            if (!sc)
+                return;
+
+            u32 cb_view = get_shadow_view_cbuffer();
+            u32 shadow_index = 0;
+
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
+            {
+                u32 n = light_entities[qi];
+
+                if (!(scene->lights[n].flags & (e_light_flags::shadow_map | e_light_flags::global_illumination)))
+                    continue;
+
+                if (shadow_index++ != view.array_index)
+                    continue;
+
+                camera cam;
+                shadow_camera_from_entity(cam, scene, n);
+                mat4 shadow_vp = get_shadow_view_projection(cam);
+
+                if (sc->slices.size() <= view.array_index)
+                    sc->slices.resize(view.array_index + 1);
+
+                shadow_cache& c = sc->slices[view.array_index];
+                c.refreshed = false;
+
+                if (shadow_cache_matches(c, n, shadow_vp))
+                    return;
+
+                // the view does not clear so untouched slices keep their casters
+                clear_shadow_slice(view.array_index);
+
+                pen::renderer_update_buffer(cb_view, &shadow_vp, sizeof(mat4));
+
+                scene_view vv = view;
+                vv.camera = &cam;
+                vv.cb_view = cb_view;
+                render_scene_view(vv);
+
+                c.view_projection = shadow_vp;
+                c.cull_frustum = cam.camera_frustum;
+                c.light = n;
+                c.valid = 1;
+                c.refreshed = true;
+                return;
+            }
+        }
+
+        void render_shadow_views(const scene_view& view)
+        {
+            ecs_scene* scene = view.scene;
+
+            u32 cb_view = get_shadow_view_cbuffer();
+
+            static mat4 shadow_matrices[e_scene_limits::max_shadow_maps];
+            u32         shadow_index = 0;
+
+            // depth only views can reuse static casters from render_static_shadow_views
+            shadow_caches* sc = nullptr;
+            u32            static_shadow_map = PEN_INVALID_HANDLE;
+            if (scene->shadow_cache && !(view.render_flags & pmfx::e_scene_render_flags::forward_lit))
+            {
+                sc = scene->shadow_cache;
+
+                static hash_id             id_static_shadow_map = PEN_HASH("shadow_map_static");
+                const pmfx::render_target* rt = pmfx::get_render_target(id_static_shadow_map);
+                if (rt && rt->num_arrays > view.array_index)
+                    static_shadow_map = rt->handle;
+            }
+
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
+            {
+                u32 n = light_entities[qi];
+
+                if (!(scene->lights[n].flags & (e_light_flags::shadow_map | e_light_flags::global_illumination)))
+                    continue;
+
+                if (shadow_index++ != view.array_index)
+                    continue;
+
+                // create a shadow camera
+                camera cam;
+                shadow_camera_from_entity(cam, scene, n);
+
+                // update view and camera
+                scene_view vv = view;
+                vv.camera = &cam;
+
+                mat4 shadow_vp = get_shadow_view_projection(cam);
+
+                pen::renderer_update_buffer(cb_view, &shadow_vp, sizeof(mat4));
+                shadow_matrices[shadow_index - 1] = shadow_vp;
+                vv.cb_view = cb_view;
+
+                // copy the cached static casters into the slice and draw only dynamic casters on top
+                if (sc)
+                {
+                    shadow_cache* cache = nullptr;
+                    if (is_valid(static_shadow_map) && view.array_index < sc->slices.size())
+                        if (shadow_cache_matches(sc->slices[view.array_index], n, shadow_vp))
+                            cache = &sc->slices[view.array_index];
+
+                    if (cache)
+                    {
+                        copy_static_shadow_slice(view, static_shadow_map);
+                        vv.render_flags |= pmfx::e_scene_render_flags::dynamic_casters;
+
+                        if (cache->refreshed)
+                            sc->frame.rendered++;
+                        else
+                            sc->frame.cached++;
+                    }
+                    else
+                    {
+                        sc->frame.rendered++;
+                    }
+                }
+
+                // colour shadow maps
+                if (vv.render_flags & pmfx::e_scene_render_flags::forward_lit)
+                {
+                    // bind single light cbuffer
+                    static u32 cb_light = -1;
+                    if (!is_valid(cb_light))
+                    {
+                        pen::buffer_creation_params bcp;
+                        bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                        bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                        bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                        bcp.buffer_size = sizeof(light_data);
+                        bcp.data = nullptr;
+
+                        cb_light = pen::renderer_create_buffer(bcp);
+                    }
+
+                    light_data ld;
+                    single_light_from_entity(ld, scene, n);
+                    pen::renderer_update_buffer(cb_light, &ld, sizeof(light_data));
+                    pen::renderer_set_constant_buffer(cb_light, 10, pen::CBUFFER_BIND_PS);
+                }
+
+                render_scene_view(vv);
             }
 
             // update cbuffer
@@ -634,10 +1705,12 @@ namespace put
             u32 target_omni_light_index = view.array_index / 6;
             u32 array_face = view.array_index % 6;
             u32 omni_light_index = 0;
-            for (u32 n = 0; n < scene->num_entities; ++n)
+
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
                 if (!(scene->lights[n].flags & e_light_flags::omni_shadow_map))
                     continue;
@@ -645,6 +1718,35 @@ namespace put
                 if (omni_light_index++ != target_omni_light_index)
                     continue;
 
+                // cached faces are left untouched until the light or a caster within its radius moves
+                if (scene->shadow_cache)
+                {
+                    shadow_caches* sc = scene->shadow_cache;
+                    if (sc->omni.size() <= target_omni_light_index)
+                        sc->omni.resize(target_omni_light_index + 1);
+
+                    shadow_cache& c = sc->omni[target_omni_light_index];
+                    vec4f         pos_radius = vec4f(scene->transforms[n].translation, scene->lights[n].radius);
+                    if (c.light != n || memcmp(&c.pos_radius, &pos_radius, sizeof(vec4f)) != 0)
+                    {
+                        c.light = n;
+                        c.pos_radius = pos_radius;
+                        c.valid = 0;
+                    }
+
+                    if (c.valid & (1 << array_face))
+                    {
+                        sc->frame.cached++;
+                        return;
+                    }
+
+                    c.valid |= 1 << array_face;
+                    sc->frame.rendered++;
+                }
+
+                // the view does not clear so cached faces survive
+                clear_shadow_slice(view.array_index);
+
                 cam_omni_shadow.pos = scene->transforms[n].translation;
                 put::camera_create_cubemap(&cam_omni_shadow, 0.1f, scene->lights[n].radius * 2.0f);
                 put::camera_set_cubemap_face(&cam_omni_shadow, array_face);
@@ -688,10 +1790,11 @@ namespace put
             static hash_id id_disable_depth = PEN_HASH("disabled");
             u32            depth_disabled = pmfx::get_render_state(id_disable_depth, pmfx::e_render_state::depth_stencil);
 
-            for (u32 n = 0; n < scene->num_entities; ++n)
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
                 if (!scene->cbuffer[n])
                     continue;
@@ -811,10 +1914,12 @@ namespace put
 
             // get inv shadow matrices
             u32 i = 0;
-            for (u32 n = 0; n < scene->num_entities; ++n)
+
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
                 if (!(scene->lights[n].flags & e_light_flags::global_illumination))
                     continue;
@@ -847,6 +1952,88 @@ namespace put
             pen::renderer_set_texture(0, 0, 2, pen::TEXTURE_BIND_CS);
         }
 
+        namespace
+        {
+            u32 create_cluster_buffer(u32 size, u32 stride)
+            {
+                pen::buffer_creation_params bcp;
+                bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                bcp.bind_flags = PEN_BIND_SHADER_RESOURCE;
+                bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                bcp.buffer_size = size;
+                bcp.stride = stride;
+                bcp.data = nullptr;
+
+                return pen::renderer_create_buffer(bcp);
+            }
+
+            // assigns the scenes cluster lights for this view and binds the buffers, returns false if the view
+            // should use the regular forward light loops instead. needs structured buffer support in the renderer.
+            bool bind_light_clusters(ecs_scene* scene, const camera* cam)
+            {
+                if (!(scene->flags & e_scene_flags::clustered_lights))
+                    return false;
+
+                u32 num_lights = sb_count(scene->cluster_lights);
+                if (num_lights == 0 || (cam->flags & e_camera_flags::orthographic))
+                    return false;
+
+                if (!scene->clusters)
+                    scene->clusters = new light_clusters();
+
+                light_clusters& lc = *scene->clusters;
+                assign_light_clusters(lc, cam, scene->cluster_lights, num_lights);
+
+                u32 num_clusters = lc.dims[0] * lc.dims[1] * lc.dims[2];
+                u32 num_indices = std::max<u32>(sb_count(lc.indices), 1);
+
+                if (!is_valid(scene->cluster_info_buffer))
+                {
+                    pen::buffer_creation_params bcp;
+                    bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                    bcp.bind_flags = PEN_BIND_CONSTANT_BUFFER;
+                    bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                    bcp.buffer_size = sizeof(light_cluster_buffer);
+                    bcp.data = nullptr;
+
+                    scene->cluster_info_buffer = pen::renderer_create_buffer(bcp);
+                    scene->cluster_light_buffer =
+                        create_cluster_buffer(sizeof(light_data) * e_scene_limits::max_clustered_lights, sizeof(light_data));
+                    scene->cluster_offset_buffer = create_cluster_buffer(sizeof(u32) * 2 * num_clusters, sizeof(u32));
+                }
+
+                // index count varies with the view, grow by doubling
+                if (num_indices > scene->cluster_index_capacity)
+                {
+                    if (is_valid(scene->cluster_index_buffer))
+                        pen::renderer_release_buffer(scene->cluster_index_buffer);
+
+                    scene->cluster_index_capacity = std::max<u32>(scene->cluster_index_capacity * 2, num_indices);
+                    scene->cluster_index_buffer =
+                        create_cluster_buffer(sizeof(u32) * scene->cluster_index_capacity, sizeof(u32));
+                }
+
+                light_cluster_buffer info;
+                info.dims = vec4f((f32)lc.dims[0], (f32)lc.dims[1], (f32)lc.dims[2], (f32)num_lights);
+                info.params = vec4f(lc.near_plane, lc.slice_scale, cam->proj.m[0], cam->proj.m[5]);
+
+                pen::renderer_update_buffer(scene->cluster_info_buffer, &info, sizeof(info));
+                pen::renderer_update_buffer(scene->cluster_light_buffer, scene->cluster_light_data,
+                                            sizeof(light_data) * num_lights);
+                pen::renderer_update_buffer(scene->cluster_offset_buffer, lc.offsets, sizeof(u32) * 2 * num_clusters);
+                if (sb_count(lc.indices))
+                    pen::renderer_update_buffer(scene->cluster_index_buffer, lc.indices, sizeof(u32) * sb_count(lc.indices));
+
+                u32 sbf = pen::SBUFFER_BIND_PS | pen::SBUFFER_BIND_READ;
+                pen::renderer_set_constant_buffer(scene->cluster_info_buffer, 12, pen::CBUFFER_BIND_PS);
+                pen::renderer_set_structured_buffer(scene->cluster_light_buffer, 16, sbf);
+                pen::renderer_set_structured_buffer(scene->cluster_offset_buffer, 17, sbf);
+                pen::renderer_set_structured_buffer(scene->cluster_index_buffer, 18, sbf);
+
+                return true;
+            }
+        } // namespace
+
         void render_scene_view(const scene_view& view)
         {
             // PEN_PERF_SCOPE_PRINT(render_scene_view);
@@ -859,6 +2046,7 @@ namespace put
             pen::renderer_set_constant_buffer(view.cb_view, 0, pen::CBUFFER_BIND_PS | pen::CBUFFER_BIND_VS);
 
             // fwd lights
+            u32 view_permutation = 0;
             if (view.render_flags & pmfx::e_scene_render_flags::forward_lit)
             {
                 pen::renderer_set_constant_buffer(scene->forward_light_buffer, 3, pen::CBUFFER_BIND_PS);
@@ -874,16 +2062,21 @@ namespace put
 
                 pen::renderer_set_texture(ltc_mat, clamp_linear, 13, pen::TEXTURE_BIND_PS);
                 pen::renderer_set_texture(ltc_mag, clamp_linear, 12, pen::TEXTURE_BIND_PS);
+
+                if (bind_light_clusters(scene, view.camera))
+                    view_permutation |= e_shader_permutation::clustered_lights;
             }
 
             // sdf shadows
             pen::renderer_set_constant_buffer(scene->sdf_shadow_buffer, 5, pen::CBUFFER_BIND_PS);
-            for (u32 n = 0; n < scene->num_entities; ++n)
+
+            u32        num_sdf_entities = 0;
+            const u32* sdf_entities = query_entities(scene, e_cmp::sdf_shadow, num_sdf_entities);
+            for (u32 qi = 0; qi < num_sdf_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::sdf_shadow))
-                    continue;
+                u32 n = sdf_entities[qi];
 
-                cmp_shadow& shadow = scene->shadows[n];
+                const cmp_shadow& shadow = scene->shadows[n];
 
                 if (is_valid(shadow.texture_handle))
                     pen::renderer_set_texture(shadow.texture_handle, shadow.sampler_state, e_global_textures::sdf_shadow,
@@ -906,8 +2099,68 @@ namespace put
             u32* filtered_entities = nullptr;
             u32* culled_entities = nullptr;
             filter_entities_scalar(scene, &filtered_entities);
+
+            // cached shadow maps draw static and dynamic casters in separate passes
+            if (view.render_flags & (pmfx::e_scene_render_flags::static_casters | pmfx::e_scene_render_flags::dynamic_casters))
+            {
+                bool dynamic = view.render_flags & pmfx::e_scene_render_flags::dynamic_casters;
+                u32  num_filtered = sb_count(filtered_entities);
+                u32  num_kept = 0;
+                for (u32 i = 0; i < num_filtered; ++i)
+                    if (is_dynamic_entity(scene->entities[filtered_entities[i]]) == dynamic)
+                        filtered_entities[num_kept++] = filtered_entities[i];
+
+                if (filtered_entities)
+                    stb__sbn(filtered_entities) = num_kept;
+            }
+
             frustum_cull_aabb_scalar(scene, view.camera, filtered_entities, &culled_entities);
 
+            // lods are kept per entity so they are picked once per frame for everything, views would otherwise
+            // overwrite each others choice and break the hysteresis. shadow passes reuse them
+            if (!(view.render_flags & pmfx::e_scene_render_flags::shadow_map) && !(scene->flags & e_scene_flags::lods_selected))
+            {
+                const camera* lod_cam = scene->lod_camera ? scene->lod_camera : view.camera;
+                select_geometry_lods(scene, lod_cam, filtered_entities, sb_count(filtered_entities));
+                scene->flags |= e_scene_flags::lods_selected;
+            }
+
+            // surviving clusters of full detail meshes are compacted into one index buffer for the view
+            cluster_range* cluster_ranges = nullptr;
+            if (scene->flags & e_scene_flags::cull_clusters && !(view.render_flags & pmfx::e_scene_render_flags::shadow_map))
+            {
+                u32 num_culled = sb_count(culled_entities);
+                cluster_ranges = (cluster_range*)pen::memory_alloc(sizeof(cluster_range) * std::max<u32>(num_culled, 1));
+
+                if (scene->culled_indices)
+                    stb__sbn(scene->culled_indices) = 0;
+
+                cull_geometry_clusters(scene, view.camera, culled_entities, num_culled, cluster_ranges,
+                                       &scene->culled_indices);
+
+                // index count varies with the view, grow by doubling
+                u32 num_indices = sb_count(scene->culled_indices);
+                if (num_indices > scene->culled_index_capacity)
+                {
+                    if (is_valid(scene->culled_index_buffer))
+                        pen::renderer_release_buffer(scene->culled_index_buffer);
+
+                    scene->culled_index_capacity = std::max<u32>(scene->culled_index_capacity * 2, num_indices);
+
+                    pen::buffer_creation_params bcp;
+                    bcp.usage_flags = PEN_USAGE_DYNAMIC;
+                    bcp.bind_flags = PEN_BIND_INDEX_BUFFER;
+                    bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
+                    bcp.buffer_size = sizeof(u32) * scene->culled_index_capacity;
+                    bcp.data = nullptr;
+
+                    scene->culled_index_buffer = pen::renderer_create_buffer(bcp);
+                }
+
+                if (num_indices)
+                    pen::renderer_update_buffer(scene->culled_index_buffer, scene->culled_indices, sizeof(u32) * num_indices);
+            }
+
             // track to prevent redundant state changes.
             u32 cur_shader = -1;
             u32 cur_technique = -1;
@@ -926,16 +2179,28 @@ namespace put
                     if (view.render_flags & pmfx::e_scene_render_flags::shadow_map)
                         p_geom = &scene->position_geometries[n];
 
+                // skinned entities added since the last update have no palette yet, skip them for a frame
+                mat4* palette = nullptr;
+                bool  skin = (scene->entities[n] & e_cmp::skinned) && !(scene->entities[n] & e_cmp::sub_geometry);
+                if (skin || (scene->entities[n] & e_cmp::pre_skinned))
+                {
+                    palette = get_bone_palette(scene, n);
+                    if (!palette)
+                        continue;
+                }
+
                 cmp_material* p_mat = &scene->materials[n];
-                u32           permutation = scene->material_permutation[n];
+                u32           permutation = scene->material_permutation[n] | view_permutation;
 
                 // set shader / technique only if we need to change
                 if (p_mat->shader != cur_shader || p_mat->technique_index != cur_technique || permutation != cur_permutation)
                 {
                     if (!is_valid(view.pmfx_shader))
                     {
-                        // per entity material
-                        pmfx::set_technique(p_mat->shader, p_mat->technique_index);
+                        // per entity material, techniques without the view permutation mask it off
+                        if (!view_permutation ||
+                            !pmfx::set_technique_perm(p_mat->shader, scene->material_resources[n].id_technique, permutation))
+                            pmfx::set_technique(p_mat->shader, p_mat->technique_index);
                         cur_shader = p_mat->shader;
                         cur_technique = p_mat->technique_index;
                         cur_permutation = permutation;
@@ -955,9 +2220,8 @@ namespace put
                 }
 
                 // update skin
-                if (scene->entities[n] & e_cmp::skinned && !(scene->entities[n] & e_cmp::sub_geometry))
+                if (skin)
                 {
-                    static mat4 bb[85];
                     if (p_geom->p_skin->bone_cbuffer == PEN_INVALID_HANDLE)
                     {
                         pen::buffer_creation_params bcp;
@@ -970,11 +2234,8 @@ namespace put
                         p_geom->p_skin->bone_cbuffer = pen::renderer_create_buffer(bcp);
                     }
 
-                    s32 joints_offset = scene->anim_controller_v2[n].joints_offset;
-                    for (s32 i = 0; i < p_geom->p_skin->num_joints; ++i)
-                        bb[i] = scene->world_matrices[joints_offset + i] * p_geom->p_skin->joint_bind_matrices[i];
-
-                    pen::renderer_update_buffer(p_geom->p_skin->bone_cbuffer, bb, sizeof(bb));
+                    pen::renderer_update_buffer(p_geom->p_skin->bone_cbuffer, palette,
+                                                sizeof(mat4) * p_geom->p_skin->num_joints);
                     pen::renderer_set_constant_buffer(p_geom->p_skin->bone_cbuffer, 2, pen::CBUFFER_BIND_VS);
                 }
 
@@ -1020,28 +2281,66 @@ namespace put
                     }
                 }
 
+                // lods index the same vertex buffer, position only geometry has matching levels
+                u32 index_buffer = p_geom->index_buffer;
+                u32 index_type = p_geom->index_type;
+                u32 num_indices = p_geom->num_indices;
+                u32 start_index = 0;
+                u32 lod = scene->geometries[n].lod;
+                if (lod > 0 && lod <= p_geom->num_lods)
+                {
+                    index_buffer = p_geom->lods[lod - 1].index_buffer;
+                    num_indices = p_geom->lods[lod - 1].num_indices;
+                }
+
+                // clusters which survived culling
+                u32 cluster_culled = 0;
+                if (cluster_ranges && cluster_ranges[i].start != k_cluster_range_whole)
+                {
+                    cluster_culled = (num_indices - cluster_ranges[i].count) / 3;
+                    scene->draw_stats_frame.cluster_triangles_culled += cluster_culled;
+
+                    if (cluster_ranges[i].count == 0)
+                        continue;
+
+                    index_buffer = scene->culled_index_buffer;
+                    index_type = PEN_FORMAT_R32_UINT;
+                    num_indices = cluster_ranges[i].count;
+                    start_index = cluster_ranges[i].start;
+                }
+
                 // set index buffer
-                if (cur_ib != p_geom->index_buffer)
+                if (cur_ib != index_buffer)
                 {
-                    pen::renderer_set_index_buffer(p_geom->index_buffer, p_geom->index_type, 0);
-                    cur_ib = p_geom->index_buffer;
+                    pen::renderer_set_index_buffer(index_buffer, index_type, 0);
+                    cur_ib = index_buffer;
                 }
 
+                u32 num_instances = 1;
+                if (scene->entities[n] & e_cmp::master_instance)
+                    num_instances = scene->master_instances[n].num_instances;
+
+                render_stats& stats = scene->draw_stats_frame;
+                stats.draw_calls++;
+                stats.triangles += num_instances * (num_indices / 3);
+                stats.lod_triangles_saved += num_instances * ((p_geom->num_indices - num_indices) / 3 - cluster_culled);
+
                 // draw
 
                 // instances
                 if (scene->entities[n] & e_cmp::master_instance)
                 {
-                    u32 num_instances = scene->master_instances[n].num_instances;
-                    pen::renderer_draw_indexed_instanced(num_instances, 0, p_geom->num_indices, 0, 0, PEN_PT_TRIANGLELIST);
+                    pen::renderer_draw_indexed_instanced(num_instances, 0, num_indices, 0, 0, PEN_PT_TRIANGLELIST);
                     n += num_instances;
                     continue;
                 }
 
                 // single
-                pen::renderer_draw_indexed(p_geom->num_indices, 0, 0, PEN_PT_TRIANGLELIST);
+                pen::renderer_draw_indexed(num_indices, start_index, 0, PEN_PT_TRIANGLELIST);
             }
 
+            pen::memory_free(cluster_ranges);
+
             if (filtered_entities)
             {
                 sb_free(filtered_entities);
@@ -1053,207 +2352,219 @@ namespace put
             }
         }
 
-        void update_animations(ecs_scene* scene, f32 dt)
+        struct anim_job
         {
-            for (u32 n = 0; n < scene->num_entities; ++n)
+            ecs_scene* scene;
+            const u32* controllers;
+            f32        dt;
+        };
+
+        void update_anim_controller(ecs_scene* scene, u32 n, f32 dt)
+        {
+            cmp_anim_controller_v2 controller = scene->anim_controller_v2[n];
+
+            u32 num_anims = sb_count(controller.anim_instances);
+            for (u32 ai = 0; ai < num_anims; ++ai)
             {
-                if (!(scene->entities[n] & e_cmp::anim_controller))
-                    continue;
+                anim_instance& instance = controller.anim_instances[ai];
 
-                cmp_anim_controller_v2 controller = scene->anim_controller_v2[n];
+                if (instance.flags & e_anim_flags::paused)
+                    continue;
 
-                u32 num_anims = sb_count(controller.anim_instances);
-                for (u32 ai = 0; ai < num_anims; ++ai)
-                {
-                    anim_instance& instance = controller.anim_instances[ai];
+                f32 anim_t = instance.time;
 
-                    if (instance.flags & e_anim_flags::paused)
-                        continue;
+                bool looped = false;
 
-                    soa_anim& soa = instance.soa;
-                    u32       num_channels = soa.num_channels;
-                    f32       anim_t = instance.time;
+                // roll on time
+                instance.time += dt;
+                if (instance.time >= instance.length)
+                {
+                    instance.time = 0.0f;
+                    looped = true;
+                }
 
-                    bool looped = false;
+                if (instance.flags & e_anim_flags::looped)
+                {
+                    instance.flags &= ~e_anim_flags::looped;
+                    looped = true;
+                }
 
-                    // roll on time
-                    instance.time += dt;
-                    if (instance.time >= instance.length)
-                    {
-                        instance.time = 0.0f;
-                        looped = true;
-                    }
+                u32 num_joints = sb_count(instance.joints);
 
-                    if (instance.flags & e_anim_flags::looped)
-                    {
-                        instance.flags &= ~e_anim_flags::looped;
-                        looped = true;
-                    }
+                // reset rotations
+                for (u32 j = 0; j < num_joints; ++j)
+                    instance.targets[j].q = quat(0.0f, 0.0f, 0.0f);
 
-                    u32 num_joints = sb_count(instance.joints);
+                // sample channels into targets
+                sample_anim(instance, anim_t, looped);
 
-                    // reset rotations
-                    for (u32 j = 0; j < num_joints; ++j)
-                        instance.targets[j].q = quat(0.0f, 0.0f, 0.0f);
+                // bake anim target into a cmp transform for joint
+                u32 tj = PEN_INVALID_HANDLE;
+                for (u32 j = 0; j < num_joints; ++j)
+                {
+                    u32 jnode = controller.joint_indices[j];
 
-                    for (s32 c = 0; c < num_channels; ++c)
+                    if (scene->entities[jnode] & e_cmp::anim_trajectory)
                     {
-                        anim_sampler& sampler = instance.samplers[c];
-                        anim_channel& channel = soa.channels[c];
-
-                        if (sampler.joint == PEN_INVALID_HANDLE)
-                            continue;
+                        tj = j;
+                        continue;
+                    }
 
-                        // find the frame we are on..
-                        for (; sampler.pos < channel.num_frames; sampler.pos++)
-                            if (anim_t <= soa.info[sampler.pos][c].time)
-                            {
-                                sampler.pos -= 1;
-                                break;
-                            }
+                    f32* f = &instance.targets[j].t[0];
 
-                        //reset flag
-                        sampler.flags &= ~e_anim_flags::looped;
+                    instance.joints[j].translation = vec3f(f[e_anim_output::translate_x], f[e_anim_output::translate_y],
+                                                           f[e_anim_output::translate_z]);
 
-                        if (sampler.pos >= channel.num_frames || looped)
-                        {
-                            sampler.pos = 0;
-                            sampler.flags = e_anim_flags::looped;
-                        }
+                    instance.joints[j].scale =
+                        vec3f(f[e_anim_output::scale_x], f[e_anim_output::scale_y], f[e_anim_output::scale_z]);
 
-                        u32 next = (sampler.pos + 1) % channel.num_frames;
+                    if (instance.targets[j].flags & e_anim_flags::baked_quaternion)
+                        instance.joints[j].rotation = instance.targets[j].q;
+                    else
+                        instance.joints[j].rotation = scene->initial_transform[jnode].rotation * instance.targets[j].q;
+                }
 
-                        // get anim data
-                        anim_info& info1 = soa.info[sampler.pos][c];
-                        anim_info& info2 = soa.info[next][c];
+                // root motion.. todo rotation
+                if (tj != PEN_INVALID_HANDLE)
+                {
+                    f32*  f = &instance.targets[tj].t[0];
+                    vec3f tt = vec3f(f[0], f[1], f[2]);
 
-                        f32* d1 = &soa.data[sampler.pos][info1.offset];
-                        f32* d2 = &soa.data[next][info2.offset];
+                    if (instance.samplers[0].flags & e_anim_flags::looped)
+                    {
+                        // inherit prev root motion
+                        instance.root_translation = tt;
+                    }
+                    else
+                    {
+                        instance.root_delta = tt - instance.root_translation;
+                        instance.root_translation = tt;
+                    }
+                }
+            }
 
-                        f32 a = (anim_t - info1.time);
-                        f32 b = (info2.time - info1.time);
+            // for active controller.anim_instances, make trans, quat, scale
+            //      blend tree
+            if (num_anims > 0)
+            {
+                anim_instance& a = controller.anim_instances[controller.blend.anim_a];
+                anim_instance& b = controller.anim_instances[controller.blend.anim_b];
+                f32            t = controller.blend.ratio;
 
-                        f32 it = min(max(a / b, 0.0f), 1.0f);
+                u32 num_joints = sb_count(a.joints);
+                for (u32 j = 0; j < num_joints; ++j)
+                {
+                    u32 jnode = controller.joint_indices[j];
 
-                        sampler.prev_t = sampler.cur_t;
-                        sampler.cur_t = it;
+                    cmp_transform& tc = scene->transforms[jnode];
+                    cmp_transform& ta = a.joints[j];
+                    cmp_transform& tb = b.joints[j];
 
-                        for (u32 e = 0; e < channel.element_count; ++e)
-                        {
-                            u32 eo = channel.element_offset[e];
+                    if (scene->entities[jnode] & e_cmp::anim_trajectory)
+                    {
+                        vec3f lerp_delta = lerp(a.root_delta, b.root_delta, t);
 
-                            // slerp quats
-                            if (eo == e_anim_output::quaternion)
-                            {
-                                quat q1;
-                                quat q2;
+                        mat4 rot_mat;
+                        quat q = scene->initial_transform[jnode].rotation;
+                        q.get_matrix(rot_mat);
 
-                                memcpy(&q1.v[0], &d1[e], 16);
-                                memcpy(&q2.v[0], &d2[e], 16);
+                        vec3f transform_translation = rot_mat.transform_vector(lerp_delta);
 
-                                quat ql = slerp(q1, q2, it);
+                        // apply root motion to the root controller, so we bring along the meshes
+                        scene->transforms[n].rotation = q;
+                        scene->transforms[n].translation += transform_translation;
+                        scene->entities[n] |= e_cmp::transform;
 
-                                instance.targets[sampler.joint].q = ql * instance.targets[sampler.joint].q;
-                                instance.targets[sampler.joint].flags |= channel.flags;
-                                e += 3;
-                            }
-                            else
-                            {
-                                // lerp translation / scale
-                                f32 lf = (1 - it) * d1[e] + it * d2[e];
-                                instance.targets[sampler.joint].t[eo] = lf;
-                            }
-                        }
+                        continue;
                     }
 
-                    // bake anim target into a cmp transform for joint
-                    u32 tj = PEN_INVALID_HANDLE;
-                    for (u32 j = 0; j < num_joints; ++j)
-                    {
-                        u32 jnode = controller.joint_indices[j];
+                    tc.translation = lerp(ta.translation, tb.translation, t);
+                    tc.rotation = slerp2(ta.rotation, tb.rotation, t);
+                    tc.scale = lerp(ta.scale, tb.scale, t);
 
-                        if (scene->entities[jnode] & e_cmp::anim_trajectory)
-                        {
-                            tj = j;
-                            continue;
-                        }
+                    scene->entities[jnode] |= e_cmp::transform;
+                }
+            }
+        }
 
-                        f32* f = &instance.targets[j].t[0];
+        void update_anim_controllers_job(void* user_data, u32 begin, u32 end)
+        {
+            anim_job* job = (anim_job*)user_data;
+            for (u32 i = begin; i < end; ++i)
+                update_anim_controller(job->scene, job->controllers[i], job->dt);
+        }
 
-                        instance.joints[j].translation = vec3f(f[e_anim_output::translate_x], f[e_anim_output::translate_y],
-                                                               f[e_anim_output::translate_z]);
+        void update_animations(ecs_scene* scene, f32 dt)
+        {
+            u32        num_controllers = 0;
+            const u32* controllers = query_entities(scene, e_cmp::anim_controller, num_controllers);
 
-                        instance.joints[j].scale =
-                            vec3f(f[e_anim_output::scale_x], f[e_anim_output::scale_y], f[e_anim_output::scale_z]);
+            // controllers only write to their own joints and root, so each one can be updated independently
+            anim_job job = {scene, controllers, dt};
+            pen::jobs_parallel_for(num_controllers, k_anim_controller_batch_size, update_anim_controllers_job, &job);
+        }
 
-                        if (instance.targets[j].flags & e_anim_flags::baked_quaternion)
-                            instance.joints[j].rotation = instance.targets[j].q;
-                        else
-                            instance.joints[j].rotation = scene->initial_transform[jnode].rotation * instance.targets[j].q;
-                    }
+        mat4* get_bone_palette(ecs_scene* scene, u32 node_index)
+        {
+            // entities added since the last update have no palette yet
+            if (!(scene->entities[node_index] & (e_cmp::skinned | e_cmp::pre_skinned)))
+                return nullptr;
 
-                    // root motion.. todo rotation
-                    if (tj != PEN_INVALID_HANDLE)
-                    {
-                        f32*  f = &instance.targets[tj].t[0];
-                        vec3f tt = vec3f(f[0], f[1], f[2]);
+            u32       po = scene->anim_controller_v2[node_index].palette_offset;
+            cmp_skin* p_skin = scene->geometries[node_index].p_skin;
+            if (!is_valid(po) || !p_skin || po + p_skin->num_joints > sb_count(scene->bone_palettes))
+                return nullptr;
 
-                        if (instance.samplers[0].flags & e_anim_flags::looped)
-                        {
-                            // inherit prev root motion
-                            instance.root_translation = tt;
-                        }
-                        else
-                        {
-                            instance.root_delta = tt - instance.root_translation;
-                            instance.root_translation = tt;
-                        }
-                    }
-                }
+            return &scene->bone_palettes[po];
+        }
 
-                // for active controller.anim_instances, make trans, quat, scale
-                //      blend tree
-                if (num_anims > 0)
-                {
-                    anim_instance& a = controller.anim_instances[controller.blend.anim_a];
-                    anim_instance& b = controller.anim_instances[controller.blend.anim_b];
-                    f32            t = controller.blend.ratio;
+        void update_bone_palettes_job(void* user_data, u32 begin, u32 end)
+        {
+            ecs_scene* scene = (ecs_scene*)user_data;
+            for (u32 n = begin; n < end; ++n)
+            {
+                if (!(scene->entities[n] & (e_cmp::skinned | e_cmp::pre_skinned)))
+                    continue;
 
-                    u32 num_joints = sb_count(a.joints);
-                    for (u32 j = 0; j < num_joints; ++j)
-                    {
-                        u32 jnode = controller.joint_indices[j];
+                u32 po = scene->anim_controller_v2[n].palette_offset;
+                if (!is_valid(po))
+                    continue;
 
-                        cmp_transform& tc = scene->transforms[jnode];
-                        cmp_transform& ta = a.joints[j];
-                        cmp_transform& tb = b.joints[j];
+                cmp_skin* p_skin = scene->geometries[n].p_skin;
+                mat4*     palette = &scene->bone_palettes[po];
+                s32       joints_offset = scene->anim_controller_v2[n].joints_offset;
 
-                        if (scene->entities[jnode] & e_cmp::anim_trajectory)
-                        {
-                            vec3f lerp_delta = lerp(a.root_delta, b.root_delta, t);
+                for (s32 i = 0; i < p_skin->num_joints; ++i)
+                    palette[i] = scene->world_matrices[joints_offset + i] * p_skin->joint_bind_matrices[i];
+            }
+        }
+
+        void update_bone_palettes(ecs_scene* scene)
+        {
+            // allocate space for each skinned entity, shared by all render paths for this frame
+            u32 num_palette = 0;
+            for (u32 n = 0; n < scene->num_entities; ++n)
+            {
+                if (!(scene->entities[n] & (e_cmp::skinned | e_cmp::pre_skinned)))
+                    continue;
 
-                            mat4 rot_mat;
-                            quat q = scene->initial_transform[jnode].rotation;
-                            q.get_matrix(rot_mat);
+                scene->anim_controller_v2.write(n).palette_offset = PEN_INVALID_HANDLE;
 
-                            vec3f transform_translation = rot_mat.transform_vector(lerp_delta);
+                cmp_skin* p_skin = scene->geometries[n].p_skin;
+                if (!p_skin || !is_valid(scene->anim_controller_v2[n].joints_offset))
+                    continue;
 
-                            // apply root motion to the root controller, so we bring along the meshes
-                            scene->transforms[n].rotation = q;
-                            scene->transforms[n].translation += transform_translation;
-                            scene->entities[n] |= e_cmp::transform;
+                scene->anim_controller_v2.write(n).palette_offset = num_palette;
+                num_palette += p_skin->num_joints;
+            }
 
-                            continue;
-                        }
+            if (num_palette > sb_count(scene->bone_palettes))
+                sb_add(scene->bone_palettes, num_palette - sb_count(scene->bone_palettes));
 
-                        tc.translation = lerp(ta.translation, tb.translation, t);
-                        tc.rotation = slerp2(ta.rotation, tb.rotation, t);
-                        tc.scale = lerp(ta.scale, tb.scale, t);
+            if (num_palette == 0)
+                return;
 
-                        scene->entities[jnode] |= e_cmp::transform;
-                    }
-                }
-            }
+            pen::jobs_parallel_for((u32)scene->num_entities, k_anim_batch_size, update_bone_palettes_job, scene);
         }
 
         void update(f32 dt)
@@ -1280,6 +2591,95 @@ namespace put
             return &s_scenes;
         }
 
+        namespace
+        {
+            void rebuild_physics_entities(ecs_scene* scene)
+            {
+                if (scene->physics_entities)
+                    stb__sbn(scene->physics_entities) = 0;
+
+                for (u32 n = 0; n < scene->num_entities; ++n)
+                {
+                    if (!(scene->entities[n] & e_cmp::physics))
+                        continue;
+
+                    u32 h = scene->physics_handles[n];
+                    if (!is_valid(h))
+                        continue;
+
+                    while (sb_count(scene->physics_entities) <= h)
+                        sb_push(scene->physics_entities, (u32)-1);
+
+                    scene->physics_entities[h] = n;
+                }
+            }
+
+            // entities are moved by defrag and deleted without telling the table, so check each lookup and rebuild
+            // at most once per update when one is stale
+            u32 get_physics_entity(ecs_scene* scene, u32 handle, bool& rebuilt)
+            {
+                for (;;)
+                {
+                    if (handle < sb_count(scene->physics_entities))
+                    {
+                        u32 n = scene->physics_entities[handle];
+                        if (n < scene->num_entities && (scene->entities[n] & e_cmp::physics) &&
+                            scene->physics_handles[n] == handle)
+                            return n;
+                    }
+
+                    if (rebuilt)
+                        return (u32)-1;
+
+                    rebuild_physics_entities(scene);
+                    rebuilt = true;
+                }
+            }
+
+            // bodies which moved in the last physics step, sleeping bodies keep the local matrix they last had
+            void apply_physics_transforms(ecs_scene* scene)
+            {
+                const physics::rb_transforms& moved = physics::get_moved_rb_transforms();
+
+                // fixed rate physics is drawn one tick behind, between the last two states
+                f32 alpha = 1.0f;
+                if (moved.tick_us)
+                {
+                    f64 since_state = pen::get_time_us() - moved.time_us;
+                    alpha = (f32)std::min<f64>(std::max<f64>(since_state / (f64)moved.tick_us, 0.0), 1.0);
+                }
+
+                bool rebuilt = false;
+                for (u32 i = 0; i < moved.count; ++i)
+                {
+                    u32 n = get_physics_entity(scene, moved.handles[i], rebuilt);
+                    if (!is_valid(n))
+                        continue;
+
+                    // controlled transforms are pushed into physics instead
+                    if ((scene->entities[n] & e_cmp::transform) &&
+                        !(scene->state_flags[n] & e_state::sync_physics_transform))
+                        continue;
+
+                    cmp_transform& t = scene->transforms[n];
+                    const cmp_transform& pt = scene->physics_offset[n];
+
+                    t.translation = lerp(moved.prev_positions[i], moved.positions[i], alpha);
+                    t.rotation = slerp2(moved.prev_rotations[i], moved.rotations[i], alpha);
+
+                    mat4 rot_mat;
+                    t.rotation.get_matrix(rot_mat);
+
+                    mat4 translation_mat = mat::create_translation(t.translation - pt.translation);
+                    mat4 scale_mat = mat::create_scale(t.scale);
+
+                    scene->local_matrices[n] = translation_mat * rot_mat * scale_mat;
+                }
+
+                physics::acknowledge_rb_transforms(moved);
+            }
+        } // namespace
+
         void update_scene(ecs_scene* scene, f32 dt)
         {
             // static anim time to pass into draw calls etc..
@@ -1288,11 +2688,23 @@ namespace put
             u32 num_controllers = sb_count(scene->controllers);
             u32 num_extensions = sb_count(scene->extensions);
 
+            // draw counts from the views rendered since the last update
+            scene->draw_stats = scene->draw_stats_frame;
+            scene->draw_stats_frame = render_stats();
+            scene->flags &= ~e_scene_flags::lods_selected;
+
             // pre update controllers
             for (u32 c = 0; c < num_controllers; ++c)
                 if (scene->controllers[c].update_func)
                     scene->controllers[c].update_func(scene->controllers[c], scene, dt);
 
+            // a few moves each frame keep hot entities together, queries are refreshed after
+            if (scene->defrag_moves_per_frame)
+                defrag_scene(scene, scene->defrag_moves_per_frame);
+
+            // entity lists for this frame, systems below iterate these instead of scanning every entity
+            refresh_queries(scene);
+
             if (scene->flags & e_scene_flags::pause_update)
             {
                 physics::set_paused(1);
@@ -1311,6 +2723,8 @@ namespace put
             static pen::timer* timer = pen::timer_create();
             pen::timer_start(timer);
 
+            apply_physics_transforms(scene);
+
             // scene node transform
             for (size_t n = 0; n < scene->num_entities; ++n)
             {
@@ -1340,37 +2754,16 @@ namespace put
                     {
                         if (scene->physics_data[n].type == e_physics_type::rigid_body)
                         {
-                            cmp_transform& pt = scene->physics_offset[n];
-                            physics::set_transform(scene->physics_handles[n], t.translation + pt.translation, t.rotation);
-                            physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_angular_velocity);
-                            physics::set_v3(scene->physics_handles[n], vec3f::zero(), physics::e_cmd::set_linear_velocity);
+                            // coalesced into one bulk command each for transforms and velocities
+                            const cmp_transform& pt = scene->physics_offset[n];
+                            physics::queue_transform(scene->physics_handles[n], t.translation + pt.translation, t.rotation);
+                            physics::queue_velocity(scene->physics_handles[n], vec3f::zero(), vec3f::zero());
                         }
                     }
 
                     // local matrix will be baked
                     scene->entities[n] &= ~e_cmp::transform;
                 }
-                else if (scene->entities[n] & e_cmp::physics)
-                {
-                    if (!physics::has_rb_matrix(n))
-                        continue;
-
-                    cmp_transform& t = scene->transforms[n];
-                    cmp_transform& pt = scene->physics_offset[n];
-
-                    mat4 scale_mat = mat::create_scale(t.scale);
-
-                    vec3f os = t.scale;
-                    t = physics::get_rb_transform(scene->physics_handles[n]);
-                    t.scale = os;
-
-                    mat4 rot_mat;
-                    t.rotation.get_matrix(rot_mat);
-
-                    mat4 translation_mat = mat::create_translation(t.translation - pt.translation);
-
-                    scene->local_matrices[n] = translation_mat * rot_mat * scale_mat;
-                }
 
                 // heirarchical scene transform
                 u32 parent = scene->parents[n];
@@ -1380,6 +2773,10 @@ namespace put
                     scene->world_matrices[n] = scene->world_matrices[parent] * scene->local_matrices[n];
             }
 
+            // skinning matrices
+            update_bone_palettes(scene);
+            update_cpu_skinning(scene);
+
             // bounding volume transform
             static vec3f corners[] = {vec3f(0.0f, 0.0f, 0.0f),
 
@@ -1410,12 +2807,25 @@ namespace put
                 tmax = -vec3f::flt_max();
                 tmin = vec3f::flt_max();
 
-                for (s32 c = 0; c < 8; ++c)
+                // cpu skinned vertices are already in world space
+                const cpu_skin_stream* skin_stream = nullptr;
+                if (scene->entities[n] & e_cmp::cpu_skinned)
+                    skin_stream = get_cpu_skin_stream(scene, n);
+
+                if (skin_stream)
+                {
+                    tmin = skin_stream->min_extents;
+                    tmax = skin_stream->max_extents;
+                }
+                else
                 {
-                    vec3f p = scene->world_matrices[n].transform_vector(min + max * corners[c]);
+                    for (s32 c = 0; c < 8; ++c)
+                    {
+                        vec3f p = scene->world_matrices[n].transform_vector(min + max * corners[c]);
 
-                    tmax = max_union(tmax, p);
-                    tmin = min_union(tmin, p);
+                        tmax = max_union(tmax, p);
+                        tmin = min_union(tmin, p);
+                    }
                 }
 
                 f32& trad = scene->bounding_volumes[n].radius;
@@ -1465,6 +2875,9 @@ namespace put
                 }
             }
 
+            // invalidate cached shadow maps where casters have changed
+            update_shadow_caches(scene);
+
             // Forward light buffer
             static forward_light_buffer light_buffer;
             s32                         pos = 0;
@@ -1472,14 +2885,24 @@ namespace put
 
             memset(&light_buffer, 0x0, sizeof(forward_light_buffer));
 
+            u32        num_light_entities = 0;
+            const u32* light_entities = query_entities(scene, e_cmp::light, num_light_entities);
+
+            // lights without shadows go to clusters, they are assigned per view in render_scene_view
+            bool clustered = scene->flags & e_scene_flags::clustered_lights;
+            if (scene->cluster_lights)
+            {
+                stb__sbn(scene->cluster_lights) = 0;
+                stb__sbn(scene->cluster_light_data) = 0;
+            }
+
             // directional lights
             s32 num_directions_lights = 0;
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
                 if (l.type != e_light_type::dir)
                     continue;
 
@@ -1504,12 +2927,11 @@ namespace put
 
             // point lights
             s32 num_point_lights = 0;
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
                 if (l.type != e_light_type::point)
                     continue;
 
@@ -1521,12 +2943,32 @@ namespace put
                 scene->transforms[n].scale = vec3f(rad, rad, rad);
                 scene->entities[n] |= e_cmp::transform;
 
-                if (num_lights >= e_scene_limits::max_forward_lights)
-                    break;
-
                 cmp_transform& t = scene->transforms[n];
 
                 bool sm = l.flags & e_light_flags::omni_shadow_map;
+                if (clustered && !sm)
+                {
+                    if (sb_count(scene->cluster_lights) < e_scene_limits::max_clustered_lights)
+                    {
+                        light_data ld;
+                        ld.pos_radius = vec4f(t.translation, l.radius);
+                        ld.dir_cutoff = vec4f::zero();
+                        ld.colour = vec4f(l.colour, 0.0f);
+                        ld.data = vec4f::zero();
+
+                        cluster_light cl;
+                        cl.pos_radius = ld.pos_radius;
+                        cl.dir_angle = vec4f::zero();
+
+                        sb_push(scene->cluster_light_data, ld);
+                        sb_push(scene->cluster_lights, cl);
+                    }
+                    continue;
+                }
+
+                if (num_lights >= e_scene_limits::max_forward_lights)
+                    continue;
+
                 light_buffer.lights[pos].pos_radius = vec4f(t.translation, l.radius);
                 light_buffer.lights[pos].colour = vec4f(l.colour, sm ? 1.0 : 0.0);
 
@@ -1537,15 +2979,11 @@ namespace put
 
             // spot lights
             s32 num_spot_lights = 0;
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (num_lights >= e_scene_limits::max_forward_lights)
-                    break;
+                u32 n = light_entities[qi];
 
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
-
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
 
                 if (l.type != e_light_type::spot)
                     continue;
@@ -1566,6 +3004,29 @@ namespace put
                 vec3f dir = normalized(-scene->world_matrices[n].get_column(1).xyz);
 
                 bool sm = l.flags & e_light_flags::shadow_map;
+                if (clustered && !sm)
+                {
+                    if (sb_count(scene->cluster_lights) < e_scene_limits::max_clustered_lights)
+                    {
+                        light_data ld;
+                        ld.pos_radius = vec4f(t.translation, l.radius);
+                        ld.dir_cutoff = vec4f(dir, l.cos_cutoff);
+                        ld.colour = vec4f(l.colour, 0.0f);
+                        ld.data = vec4f(l.spot_falloff, 1.0f, 0.0f, 0.0f); // y = 1 marks a spot light
+
+                        cluster_light cl;
+                        cl.pos_radius = ld.pos_radius;
+                        cl.dir_angle = vec4f(dir, angle);
+
+                        sb_push(scene->cluster_light_data, ld);
+                        sb_push(scene->cluster_lights, cl);
+                    }
+                    continue;
+                }
+
+                if (num_lights >= e_scene_limits::max_forward_lights)
+                    continue;
+
                 light_buffer.lights[pos].pos_radius = vec4f(t.translation, l.radius);
                 light_buffer.lights[pos].dir_cutoff = vec4f(dir, l.cos_cutoff);
                 light_buffer.lights[pos].colour = vec4f(l.colour, sm ? 1.0 : 0.0);
@@ -1591,15 +3052,14 @@ namespace put
             u32 num_constant_colour_area_lights = 0;
             u32 num_textured_area_lights = 0;
             // constant colour area light
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
                 if (num_lights >= e_scene_limits::max_forward_lights)
                     break;
 
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
                 if (l.type != e_light_type::area)
                     continue;
 
@@ -1613,15 +3073,14 @@ namespace put
                 ++num_area_lights;
             }
             // textured / shader / animated area light
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
                 if (num_lights >= e_scene_limits::max_forward_lights)
                     break;
 
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
                 if (l.type != e_light_type::area_ex)
                     continue;
 
@@ -1659,10 +3118,11 @@ namespace put
             }
 
             // Distance field shadows
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            u32        num_sdf_entities = 0;
+            const u32* sdf_entities = query_entities(scene, e_cmp::sdf_shadow, num_sdf_entities);
+            for (u32 qi = 0; qi < num_sdf_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::sdf_shadow))
-                    continue;
+                u32 n = sdf_entities[qi];
 
                 static distance_field_shadow_buffer sdf_buffer;
 
@@ -1678,12 +3138,11 @@ namespace put
             u32 num_shadow_maps = 0;
             u32 num_omni_shadow_maps = 0;
             u32 num_gi_maps = 0;
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            for (u32 qi = 0; qi < num_light_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 n = light_entities[qi];
 
-                cmp_light& l = scene->lights[n];
+                const cmp_light& l = scene->lights[n];
 
                 if (l.flags & e_light_flags::global_illumination)
                     num_gi_maps++;
@@ -1712,6 +3171,24 @@ namespace put
                 }
             }
 
+            // cached static casters, resizing loses the contents of every slice
+            const pmfx::render_target* ssm = pmfx::get_render_target(PEN_HASH("shadow_map_static"));
+            if (ssm)
+            {
+                if (ssm->num_arrays < num_shadow_maps)
+                {
+                    pmfx::rt_resize_params rrp;
+                    rrp.width = ssm->width;
+                    rrp.height = ssm->height;
+                    rrp.format = nullptr;
+                    rrp.num_arrays = num_shadow_maps;
+                    rrp.num_mips = 1;
+                    rrp.collection = pen::TEXTURE_COLLECTION_ARRAY;
+                    pmfx::resize_render_target(PEN_HASH("shadow_map_static"), rrp);
+                    invalidate_shadow_caches(scene);
+                }
+            }
+
             // resize omni directional
             const pmfx::render_target* osm = pmfx::get_render_target(PEN_HASH("omni_shadow_map"));
             if (osm)
@@ -1726,6 +3203,7 @@ namespace put
                     rrp.num_mips = 1;
                     rrp.collection = pen::TEXTURE_COLLECTION_CUBE_ARRAY;
                     pmfx::resize_render_target(PEN_HASH("omni_shadow_map"), rrp);
+                    invalidate_shadow_caches(scene);
                 }
             }
 
@@ -1752,9 +3230,15 @@ namespace put
             static u32     shader = pmfx::load_shader("forward_render");
             if (pmfx::set_technique_perm(shader, id_pre_skin_technique))
             {
-                for (size_t n = 0; n < scene->num_entities; ++n)
+
+                u32        num_pre_skinned_entities = 0;
+                const u32* pre_skinned_entities = query_entities(scene, e_cmp::pre_skinned, num_pre_skinned_entities);
+                for (u32 qi = 0; qi < num_pre_skinned_entities; ++qi)
                 {
-                    if (!(scene->entities[n] & e_cmp::pre_skinned))
+                    u32 n = pre_skinned_entities[qi];
+
+                    mat4* palette = get_bone_palette(scene, n);
+                    if (!palette)
                         continue;
 
                     // update bone cbuffer
@@ -1771,15 +3255,10 @@ namespace put
                         geom.p_skin->bone_cbuffer = pen::renderer_create_buffer(bcp);
                     }
 
-                    static mat4 bb[85];
-                    s32         joints_offset = scene->anim_controller_v2[n].joints_offset;
-                    for (s32 i = 0; i < geom.p_skin->num_joints; ++i)
-                        bb[i] = scene->world_matrices[joints_offset + i] * geom.p_skin->joint_bind_matrices[i];
-
-                    pen::renderer_update_buffer(geom.p_skin->bone_cbuffer, bb, sizeof(bb));
+                    pen::renderer_update_buffer(geom.p_skin->bone_cbuffer, palette, sizeof(mat4) * geom.p_skin->num_joints);
 
                     // bind stream out targets
-                    cmp_pre_skin& pre_skin = scene->pre_skin[n];
+                    const cmp_pre_skin& pre_skin = scene->pre_skin[n];
                     pen::renderer_set_stream_out_target(geom.vertex_buffer);
                     pen::renderer_set_vertex_buffer(pre_skin.vertex_buffer, 0, pre_skin.vertex_size, 0);
                     pen::renderer_set_constant_buffer(geom.p_skin->bone_cbuffer, 2, pen::CBUFFER_BIND_VS);
@@ -1829,21 +3308,39 @@ namespace put
             }
 
             // update instance buffers
-            for (size_t n = 0; n < scene->num_entities; ++n)
+            u32        num_master_entities = 0;
+            const u32* master_entities = query_entities(scene, e_cmp::master_instance, num_master_entities);
+            for (u32 qi = 0; qi < num_master_entities; ++qi)
             {
-                if (!(scene->entities[n] & e_cmp::master_instance))
-                    continue;
+                u32 n = master_entities[qi];
 
-                cmp_master_instance& master = scene->master_instances[n];
+                const cmp_master_instance& master = scene->master_instances[n];
 
                 u32 instance_data_size = master.num_instances * master.instance_stride;
-                pen::renderer_update_buffer(master.instance_buffer, &scene->draw_call_data[n + 1], instance_data_size);
 
-                // stride over sub instances
-                n += scene->master_instances[n].num_instances;
+                // instances are contiguous entities, but may straddle a component page
+                u32 first = (u32)n + 1;
+                u32 last = first + master.num_instances - 1;
+                if ((first >> k_cmp_dense_page_shift) == (last >> k_cmp_dense_page_shift))
+                {
+                    pen::renderer_update_buffer(master.instance_buffer, &scene->draw_call_data[first], instance_data_size);
+                }
+                else
+                {
+                    static u8* instance_data = nullptr;
+                    if (sb_count(instance_data) < instance_data_size)
+                        sb_add(instance_data, instance_data_size - sb_count(instance_data));
+
+                    for (u32 i = 0; i < master.num_instances; ++i)
+                        memcpy(&instance_data[i * master.instance_stride], &scene->draw_call_data[first + i],
+                               master.instance_stride);
+
+                    pen::renderer_update_buffer(master.instance_buffer, instance_data, instance_data_size);
+                }
             }
 
-            // update physics running 1 frame behind to allow the sets to take effect
+            // update physics running 1 frame behind to allow the sets to take effect,
+            // fixed rate physics ignores the step and picks up the committed commands on its own tick
             physics::step(dt);
             physics::physics_consume_command_buffer();
 
@@ -1866,24 +3363,145 @@ namespace put
             s32 num_lookup_strings = 0;
             s32 num_extensions = 0;
             s32 num_base_components = 0;
-            s32 reserved_1[25] = {0};
+            u32 toc_offset = 0;             // version 10: file offset of the scene_component_blob table
+            u32 specialisations_offset = 0; // version 10: file offset of the lookup string ids and resource info
+            s32 reserved_1[23] = {0};
             u32 view_flags = 0;
             s32 selected_index = 0;
             s32 reserved_2[30] = {0};
         };
 
-        struct lookup_string
+        // version 10 stores each component array as an aligned blob so it can be copied straight out of the file
+        struct scene_component_blob
         {
-            Str     name;
-            hash_id id;
+            u32 size;
+            u32 count;
+            u32 offset;
+            u32 reserved;
         };
-        static lookup_string* s_lookup_strings = nullptr;
+        static const u32 k_scene_blob_align = 16;
 
-        void write_lookup_string(const char* string, std::ofstream& ofs, const c8* strip_project_dir = nullptr)
+        u32 align_scene_offset(u32 offset, u32 align)
         {
-            hash_id id = 0;
+            return (offset + align - 1) & ~(align - 1);
+        }
 
-            Str stripped = string;
+        void write_scene_padding(std::ofstream& ofs, u32 align)
+        {
+            static const c8 zero[k_scene_blob_align] = {0};
+
+            u32 pos = (u32)ofs.tellp();
+            ofs.write(zero, align_scene_offset(pos, align) - pos);
+        }
+
+        struct scene_blob_read
+        {
+            generic_cmp_array* cmp;
+            size_t             offset;
+        };
+
+        struct scene_blob_job
+        {
+            scene_blob_read* reads;
+            const u8*        data;
+            size_t           size;
+            u32              zero_offset;
+            u32              num_nodes;
+        };
+
+        void read_component_blobs_job(void* user_data, u32 begin, u32 end)
+        {
+            scene_blob_job* job = (scene_blob_job*)user_data;
+
+            for (u32 i = begin; i < end; ++i)
+            {
+                scene_reader br = {job->data, job->size, job->reads[i].offset};
+                read_component_array(br, *job->reads[i].cmp, job->zero_offset, job->num_nodes);
+            }
+        }
+
+        struct lookup_string
+        {
+            Str     name;
+            hash_id id;
+        };
+
+        struct lookup_string_table
+        {
+            lookup_string* strings = nullptr;
+            u32*           table = nullptr; // open addressed, stores index + 1 into strings
+            u32            table_size = 0;
+        };
+        static lookup_string_table s_lookup_strings; // filled while saving
+
+        void clear_lookup_strings(lookup_string_table& lt)
+        {
+            sb_free(lt.strings);
+            lt.strings = nullptr;
+
+            pen::memory_free(lt.table);
+            lt.table = nullptr;
+            lt.table_size = 0;
+        }
+
+        u32 find_lookup_string(const lookup_string_table& lt, hash_id id)
+        {
+            if (!lt.table)
+                return -1;
+
+            u32 mask = lt.table_size - 1;
+            for (u32 i = id & mask;; i = (i + 1) & mask)
+            {
+                u32 li = lt.table[i];
+                if (li == 0)
+                    return -1;
+
+                if (lt.strings[li - 1].id == id)
+                    return li - 1;
+            }
+        }
+
+        void insert_lookup_index(lookup_string_table& lt, u32 index)
+        {
+            u32 mask = lt.table_size - 1;
+            u32 i = lt.strings[index].id & mask;
+            while (lt.table[i])
+                i = (i + 1) & mask;
+
+            lt.table[i] = index + 1;
+        }
+
+        void add_lookup_string(lookup_string_table& lt, const Str& name, hash_id id)
+        {
+            lookup_string ls = {name, id};
+            sb_push(lt.strings, ls);
+
+            u32 num_strings = sb_count(lt.strings);
+
+            // keep the table under half full
+            if (num_strings * 2 > lt.table_size)
+            {
+                u32 table_size = lt.table_size ? lt.table_size * 2 : 256;
+
+                pen::memory_free(lt.table);
+                lt.table = (u32*)pen::memory_alloc(table_size * sizeof(u32));
+                pen::memory_zero(lt.table, table_size * sizeof(u32));
+                lt.table_size = table_size;
+
+                for (u32 i = 0; i < num_strings; ++i)
+                    insert_lookup_index(lt, i);
+
+                return;
+            }
+
+            insert_lookup_index(lt, num_strings - 1);
+        }
+
+        void write_lookup_string(const char* string, std::ostream& ofs, const c8* strip_project_dir = nullptr)
+        {
+            hash_id id = 0;
+
+            Str stripped = string;
             if (strip_project_dir)
             {
                 stripped = pen::str_replace_string(stripped, strip_project_dir, "");
@@ -1899,54 +3517,37 @@ namespace put
             id = PEN_HASH(string);
             ofs.write((const c8*)&id, sizeof(hash_id));
 
-            u32 num_strings = sb_count(s_lookup_strings);
-            for (u32 i = 0; i < num_strings; ++i)
-            {
-                if (id == s_lookup_strings[i].id)
-                {
-                    return;
-                }
-            }
-
-            lookup_string ls = {string, id};
-            sb_push(s_lookup_strings, ls);
+            if (find_lookup_string(s_lookup_strings, id) == -1)
+                add_lookup_string(s_lookup_strings, string, id);
         }
 
-        Str read_lookup_string(std::ifstream& ifs)
+        Str read_lookup_string(const lookup_string_table& lt, scene_reader& r)
         {
             hash_id id;
-            ifs.read((c8*)&id, sizeof(hash_id));
+            r.read(&id, sizeof(hash_id));
 
-            u32 num_strings = sb_count(s_lookup_strings);
-            for (u32 i = 0; i < num_strings; ++i)
-            {
-                if (s_lookup_strings[i].id == id)
-                {
-                    return s_lookup_strings[i].name;
-                }
-            }
+            u32 li = find_lookup_string(lt, id);
+            if (li == -1)
+                return "";
 
-            return "";
+            return lt.strings[li].name;
         }
 
-        hash_id rehash_lookup_string(hash_id id)
+        hash_id rehash_lookup_string(const lookup_string_table& lt, hash_id id)
         {
-            u32 num_strings = sb_count(s_lookup_strings);
-            for (u32 i = 0; i < num_strings; ++i)
-            {
-                if (s_lookup_strings[i].id == id)
-                {
-                    return PEN_HASH(s_lookup_strings[i].name);
-                }
-            }
+            u32 li = find_lookup_string(lt, id);
+            if (li == -1)
+                return 0;
 
-            return 0;
+            return PEN_HASH(lt.strings[li].name);
         }
 
-        void save_sub_scene(ecs_scene* scene, u32 root)
+        void save_sub_scene(const c8* filename, ecs_scene* scene, std::vector<s32>& nodes)
         {
-            std::vector<s32> nodes;
-            build_heirarchy_node_list(scene, root, nodes);
+            // keep scene order so parents still come before their children, drop invalid entries
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+            nodes.erase(nodes.begin(), std::lower_bound(nodes.begin(), nodes.end(), 0));
 
             u32 num = nodes.size();
 
@@ -1961,10 +3562,7 @@ namespace put
 
             for (u32 i = 0; i < num; ++i)
             {
-                u32 ii = nodes[i];
-                if (ii == PEN_INVALID_HANDLE)
-                    continue;
-
+                s32 ii = nodes[i];
                 u32 ni = sub_scene.num_entities;
 
                 for (u32 c = 0; c < scene->num_components; ++c)
@@ -1972,47 +3570,55 @@ namespace put
                     generic_cmp_array& src = scene->get_component_array(c);
                     generic_cmp_array& dst = sub_scene.get_component_array(c);
 
-                    memcpy(dst[ni], src[ii], src.size);
+                    void* src_cmp = get_allocated_component(src, ii);
+                    if (src_cmp)
+                        memcpy(dst[ni], src_cmp, src.size);
                 }
 
-                sub_scene.parents[ni] -= root;
+                // parents outside of the sub scene become roots
+                auto parent = std::lower_bound(nodes.begin(), nodes.end(), (s32)scene->parents[ii]);
+                if (parent != nodes.end() && *parent == (s32)scene->parents[ii])
+                    sub_scene.parents[ni] = (u32)(parent - nodes.begin());
+                else
+                    sub_scene.parents[ni] = ni;
+
                 sub_scene.num_entities++;
             }
 
-            Str fn = "";
-            fn.appendf("../../assets/scene/%s.pms", sub_scene.names[0].c_str());
-
-            save_scene(fn.c_str(), &sub_scene);
+            save_scene(filename, &sub_scene);
 
             free_scene_buffers(&sub_scene, true);
             unregister_ecs_extensions(&sub_scene);
         }
 
+        void save_sub_scene(ecs_scene* scene, u32 root)
+        {
+            std::vector<s32> nodes;
+            build_heirarchy_node_list(scene, root, nodes);
+
+            Str fn = "";
+            fn.appendf("../../assets/scene/%s.pms", scene->names[root].c_str());
+
+            save_sub_scene(fn.c_str(), scene, nodes);
+        }
+
         void save_scene(const c8* filename, ecs_scene* scene)
         {
             const c8* wd = pen::os_get_user_info().working_directory;
             Str       project_dir = dev_ui::get_program_preference_filename("project_dir", wd);
 
-            std::ofstream ofs(filename, std::ofstream::binary);
-
-            sb_free(s_lookup_strings);
-            s_lookup_strings = nullptr;
-
-            // write basic components
-            for (u32 i = 0; i < scene->num_components; ++i)
-            {
-                generic_cmp_array& cmp = scene->get_component_array(i);
-                ofs.write((const c8*)cmp.data, cmp.size * scene->num_entities);
-            }
+            clear_lookup_strings(s_lookup_strings);
 
             // specialisations ------------------------------------------------------------------------------
+            // written to memory first because they fill the lookup string table which precedes them in the file
+            std::ostringstream sos(std::ios::binary);
 
             // names
             for (s32 n = 0; n < scene->num_entities; ++n)
             {
-                write_lookup_string(scene->names[n].c_str(), ofs);
-                write_lookup_string(scene->geometry_names[n].c_str(), ofs);
-                write_lookup_string(scene->material_names[n].c_str(), ofs);
+                write_lookup_string(scene->names[n].c_str(), sos);
+                write_lookup_string(scene->geometry_names[n].c_str(), sos);
+                write_lookup_string(scene->material_names[n].c_str(), sos);
             }
 
             // geometry
@@ -2023,10 +3629,10 @@ namespace put
 
                 geometry_resource* gr = get_geometry_resource(scene->id_geometry[n]);
 
-                ofs.write((const c8*)&gr->submesh_index, sizeof(u32));
+                sos.write((const c8*)&gr->submesh_index, sizeof(u32));
 
-                write_lookup_string(gr->filename.c_str(), ofs, project_dir.c_str());
-                write_lookup_string(gr->geometry_name.c_str(), ofs, project_dir.c_str());
+                write_lookup_string(gr->filename.c_str(), sos, project_dir.c_str());
+                write_lookup_string(gr->geometry_name.c_str(), sos, project_dir.c_str());
             }
 
             // animations
@@ -2037,13 +3643,13 @@ namespace put
                 if (scene->anim_controller_v2[n].anim_instances)
                     size = sb_count(scene->anim_controller_v2[n].anim_instances);
 
-                ofs.write((const c8*)&size, sizeof(s32));
+                sos.write((const c8*)&size, sizeof(s32));
 
                 for (s32 i = 0; i < size; ++i)
                 {
                     // todo with anim controller v2
                     // auto* anim = get_animation_resource(scene->anim_controller_v2[n].anim_instances[i].);
-                    write_lookup_string("placeholder", ofs, project_dir.c_str());
+                    write_lookup_string("placeholder", sos, project_dir.c_str());
                 }
             }
 
@@ -2054,14 +3660,14 @@ namespace put
                     continue;
 
                 cmp_material&      mat = scene->materials[n];
-                material_resource& mat_res = scene->material_resources[n];
+                const material_resource& mat_res = scene->material_resources[n];
 
                 const char* shader_name = pmfx::get_shader_name(mat.shader);
                 const char* technique_name = pmfx::get_technique_name(mat.shader, mat_res.id_technique);
 
-                write_lookup_string(mat_res.material_name.c_str(), ofs);
-                write_lookup_string(shader_name, ofs);
-                write_lookup_string(technique_name, ofs);
+                write_lookup_string(mat_res.material_name.c_str(), sos);
+                write_lookup_string(shader_name, sos);
+                write_lookup_string(technique_name, sos);
             }
 
             // shadow
@@ -2070,9 +3676,9 @@ namespace put
                 if (!(scene->entities[n] & e_cmp::sdf_shadow))
                     continue;
 
-                cmp_shadow& shadow = scene->shadows[n];
+                const cmp_shadow& shadow = scene->shadows[n];
 
-                write_lookup_string(put::get_texture_filename(shadow.texture_handle).c_str(), ofs, project_dir.c_str());
+                write_lookup_string(put::get_texture_filename(shadow.texture_handle).c_str(), sos, project_dir.c_str());
             }
 
             // sampler bindings
@@ -2085,8 +3691,8 @@ namespace put
 
                 for (u32 i = 0; i < e_pmfx_constants::max_technique_sampler_bindings; ++i)
                 {
-                    write_lookup_string(put::get_texture_filename(samplers.sb[i].handle).c_str(), ofs, project_dir.c_str());
-                    write_lookup_string(pmfx::get_render_state_name(samplers.sb[i].sampler_state).c_str(), ofs,
+                    write_lookup_string(put::get_texture_filename(samplers.sb[i].handle).c_str(), sos, project_dir.c_str());
+                    write_lookup_string(pmfx::get_render_state_name(samplers.sb[i].sampler_state).c_str(), sos,
                                         project_dir.c_str());
                 }
             }
@@ -2096,7 +3702,7 @@ namespace put
             u32      num_cams = sb_count(cams);
             for (u32 i = 0; i < num_cams; ++i)
             {
-                write_lookup_string(cams[i]->name.c_str(), ofs);
+                write_lookup_string(cams[i]->name.c_str(), sos);
             }
 
             // call extensions specific save
@@ -2105,130 +3711,214 @@ namespace put
                 if (scene->extensions[i].save_func)
                     scene->extensions[i].save_func(scene->extensions[i], scene);
 
-            ofs.close();
-
-            std::ifstream infile(filename, std::ifstream::binary);
-
-            // get size of file
-            infile.seekg(0, infile.end);
-            u32 scene_data_size = (u32)infile.tellg();
-            infile.seekg(0);
-
-            // allocate memory for file content
-            c8* scene_data = new c8[scene_data_size];
+            std::ofstream out(filename, std::ofstream::binary);
 
-            // read content of infile
-            infile.read(scene_data, scene_data_size);
-
-            ofs = std::ofstream(filename, std::ofstream::binary);
-
-            // header
+            // header is written again once the offsets are known
             scene_header sh;
             sh.num_nodes = scene->num_entities;
             sh.view_flags = scene->view_flags;
             sh.selected_index = scene->selected_index;
             sh.num_components = scene->num_components;
             sh.num_base_components = scene->num_base_components;
-            sh.num_lookup_strings = sb_count(s_lookup_strings);
             sh.num_extensions = sb_count(scene->extensions);
-            ofs.write((const c8*)&sh, sizeof(scene_header));
+            out.write((const c8*)&sh, sizeof(scene_header));
 
             // component sizes
             for (u32 c = 0; c < sh.num_components; ++c)
             {
-                ofs.write((const c8*)&scene->get_component_array(c).size, sizeof(u32));
+                out.write((const c8*)&scene->get_component_array(c).size, sizeof(u32));
             }
 
             // extensions
             for (u32 i = 0; i < sh.num_extensions; ++i)
             {
                 u32 co = get_extension_component_offset(scene, i);
-                write_lookup_string(scene->extensions[i].name.c_str(), ofs);
-                ofs.write((const c8*)&co, sizeof(u32));
-                ofs.write((const c8*)&scene->extensions[i].num_components, sizeof(u32));
+                write_lookup_string(scene->extensions[i].name.c_str(), out);
+                out.write((const c8*)&co, sizeof(u32));
+                out.write((const c8*)&scene->extensions[i].num_components, sizeof(u32));
             }
 
             // string lookups
+            sh.num_lookup_strings = sb_count(s_lookup_strings.strings);
             for (u32 l = 0; l < sh.num_lookup_strings; ++l)
             {
-                write_parsable_string(s_lookup_strings[l].name.c_str(), ofs);
-                ofs.write((const c8*)&s_lookup_strings[l].id, sizeof(hash_id));
+                write_parsable_string(s_lookup_strings.strings[l].name.c_str(), out);
+                out.write((const c8*)&s_lookup_strings.strings[l].id, sizeof(hash_id));
             }
 
             // write camera info
-            ofs.write((const c8*)&num_cams, sizeof(u32));
+            out.write((const c8*)&num_cams, sizeof(u32));
             for (u32 i = 0; i < num_cams; ++i)
             {
                 hash_id id_cam = PEN_HASH(cams[i]->name);
-                ofs.write((const c8*)&id_cam, sizeof(hash_id));
-                ofs.write((const c8*)&cams[i]->pos, sizeof(vec3f));
-                ofs.write((const c8*)&cams[i]->focus, sizeof(vec3f));
-                ofs.write((const c8*)&cams[i]->rot, sizeof(vec2f));
-                ofs.write((const c8*)&cams[i]->fov, sizeof(f32));
-                ofs.write((const c8*)&cams[i]->aspect, sizeof(f32));
-                ofs.write((const c8*)&cams[i]->near_plane, sizeof(f32));
-                ofs.write((const c8*)&cams[i]->far_plane, sizeof(f32));
-                ofs.write((const c8*)&cams[i]->zoom, sizeof(f32));
-            }
-
-            // write scene data
-            ofs.write(scene_data, scene_data_size);
-            ofs.close();
-        }
+                out.write((const c8*)&id_cam, sizeof(hash_id));
+                out.write((const c8*)&cams[i]->pos, sizeof(vec3f));
+                out.write((const c8*)&cams[i]->focus, sizeof(vec3f));
+                out.write((const c8*)&cams[i]->rot, sizeof(vec2f));
+                out.write((const c8*)&cams[i]->fov, sizeof(f32));
+                out.write((const c8*)&cams[i]->aspect, sizeof(f32));
+                out.write((const c8*)&cams[i]->near_plane, sizeof(f32));
+                out.write((const c8*)&cams[i]->far_plane, sizeof(f32));
+                out.write((const c8*)&cams[i]->zoom, sizeof(f32));
+            }
 
-        void load_scene(const c8* filename, ecs_scene* scene, bool merge)
-        {
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
-            bool      error = false;
-            const c8* wd = pen::os_get_user_info().working_directory;
-            Str       project_dir = dev_ui::get_program_preference_filename("project_dir", wd);
+            // table of contents, then each component array as an aligned blob
+            write_scene_padding(out, k_scene_blob_align);
+            sh.toc_offset = (u32)out.tellp();
 
-            std::ifstream ifs(pen::os_path_for_resource(filename).c_str(), std::ofstream::binary);
+            u32 blob_offset = sh.toc_offset + sizeof(scene_component_blob) * sh.num_components;
+            for (u32 c = 0; c < sh.num_components; ++c)
+            {
+                generic_cmp_array& cmp = scene->get_component_array(c);
 
-            // header
-            scene_header sh;
-            ifs.read((c8*)&sh, sizeof(scene_header));
+                scene_component_blob blob = {0};
+                blob.size = cmp.size;
+                blob.count = scene->num_entities;
+                blob.offset = align_scene_offset(blob_offset, k_scene_blob_align);
+                out.write((const c8*)&blob, sizeof(scene_component_blob));
 
-            if (!merge)
+                blob_offset = blob.offset + blob.size * blob.count;
+            }
+
+            for (u32 c = 0; c < sh.num_components; ++c)
             {
-                scene->version = sh.version;
-                scene->filename = filename;
+                write_scene_padding(out, k_scene_blob_align);
+                write_component_array(out, scene->get_component_array(c), scene->num_entities);
             }
 
-            // version 9 adds extensions
-            if (sh.version < 9)
-                sh.num_base_components = sh.num_components;
+            // specialisations
+            sh.specialisations_offset = (u32)out.tellp();
+            const std::string& specialisations = sos.str();
+            out.write(specialisations.c_str(), specialisations.size());
 
-            // unpack header
-            s32 num_nodes = sh.num_nodes;
+            out.seekp(0);
+            out.write((const c8*)&sh, sizeof(scene_header));
+            out.close();
+        }
 
-            scene->selected_index = sh.selected_index;
-            s32 scene_view_flags = sh.view_flags;
+        struct scene_camera
+        {
+            hash_id id;
+            vec3f   pos;
+            vec3f   focus;
+            vec2f   rot;
+            f32     fov;
+            f32     aspect;
+            f32     near_plane;
+            f32     far_plane;
+            f32     zoom;
+        };
 
-            u32 zero_offset = 0;
-            s32 new_num_nodes = num_nodes;
+        // resource names for one entity, read from the specialisations so they can be created later
+        struct scene_entity_resources
+        {
+            u32              submesh = 0;
+            Str              geometry_file;
+            Str              geometry_name;
+            std::vector<Str> anims;
+            Str              sdf_shadow;
+            Str              textures[e_pmfx_constants::max_technique_sampler_bindings];
+            Str              sampler_states[e_pmfx_constants::max_technique_sampler_bindings];
+        };
 
-            if (merge)
+        // resources are created in phases over all entities, so anything an entity depends on
+        // (rigid bodies for constraints) exists before it is needed
+        namespace e_scene_commit
+        {
+            enum scene_commit_t
             {
-                zero_offset = scene->num_entities;
-                new_num_nodes = scene->num_entities + num_nodes;
+                geometry,
+                physics,
+                constraints,
+                animations,
+                sdf_shadows,
+                samplers,
+                lights,
+                COUNT
+            };
+        }
+
+        struct scene_file
+        {
+            const void*             data = nullptr;
+            size_t                  size = 0;
+            bool                    mapped = false;
+            scene_header            header;
+            lookup_string_table     lookup_strings;
+            scene_camera*           cameras = nullptr;
+            scene_entity_resources* resources = nullptr;
+            u32                     commit_phase = 0;
+            u32                     commit_entity = 0;
+            bool                    error = false;
+        };
+
+        scene_file* open_scene_file(const c8* filename)
+        {
+            scene_file* sf = new scene_file();
+
+            // map the file so component blobs can be copied straight out of it, fallback to reading it in
+            sf->mapped = pen::filesystem_map_file(filename, &sf->data, sf->size) == PEN_ERR_OK;
+
+            if (!sf->mapped)
+            {
+                void* buffer = nullptr;
+                u32   buffer_size = 0;
+                if (pen::filesystem_read_file_to_buffer(filename, &buffer, buffer_size) == PEN_ERR_OK)
+                {
+                    sf->data = buffer;
+                    sf->size = buffer_size;
+                }
             }
-            else
+
+            if (sf->size < sizeof(scene_header))
             {
-                clear_scene(scene);
+                close_scene_file(sf);
+                return nullptr;
             }
 
-            if (new_num_nodes > scene->soa_size)
-                resize_scene_buffers(scene, num_nodes);
+            memcpy(&sf->header, sf->data, sizeof(scene_header));
 
-            scene->num_entities = new_num_nodes;
+            // version 9 adds extensions, version 10 adds the component blob table of contents
+            if (sf->header.version < 9)
+                sf->header.num_base_components = sf->header.num_components;
+
+            return sf;
+        }
+
+        u32 get_scene_file_num_entities(const scene_file* sf)
+        {
+            return sf->header.num_nodes;
+        }
+
+        void close_scene_file(scene_file* sf)
+        {
+            if (!sf)
+                return;
+
+            if (sf->mapped)
+                pen::filesystem_unmap_file(sf->data, sf->size);
+            else
+                pen::memory_free((void*)sf->data);
+
+            clear_lookup_strings(sf->lookup_strings);
+            sb_free(sf->cameras);
+            delete[] sf->resources;
+            delete sf;
+        }
+
+        void read_scene_file(scene_file* sf, ecs_scene* scene, u32 zero_offset)
+        {
+            scene_header& sh = sf->header;
+            u32           num_nodes = sh.num_nodes;
+
+            scene_reader r = {(const u8*)sf->data, sf->size, sizeof(scene_header)};
 
             // read component sizes
             u32* component_sizes = nullptr;
             for (u32 i = 0; i < sh.num_components; ++i)
             {
                 u32 size;
-                ifs.read((c8*)&size, sizeof(u32));
+                r.read(&size, sizeof(u32));
                 sb_push(component_sizes, size);
             }
 
@@ -2244,67 +3934,67 @@ namespace put
             for (u32 i = 0; i < sh.num_extensions; ++i)
             {
                 ext_components ext;
-                ifs.read((c8*)&ext.id, sizeof(hash_id));
-                ifs.read((c8*)&ext.start_cmp, sizeof(u32));
-                ifs.read((c8*)&ext.num_cmp, sizeof(u32));
+                r.read(&ext.id, sizeof(hash_id));
+                r.read(&ext.start_cmp, sizeof(u32));
+                r.read(&ext.num_cmp, sizeof(u32));
 
                 sb_push(exts, ext);
             }
 
             // read string lookups
-            sb_free(s_lookup_strings);
-            s_lookup_strings = nullptr;
+            lookup_string_table& lt = sf->lookup_strings;
+            clear_lookup_strings(lt);
 
             for (u32 n = 0; n < sh.num_lookup_strings; ++n)
             {
-                lookup_string ls;
-                ls.name = read_parsable_string(ifs);
-                ifs.read((c8*)&ls.id, sizeof(hash_id));
+                Str     name = read_parsable_string(r);
+                hash_id id;
+                r.read(&id, sizeof(hash_id));
 
-                sb_push(s_lookup_strings, ls);
+                add_lookup_string(lt, name, id);
             }
 
             // rehash extension ids
             for (u32 i = 0; i < sh.num_extensions; ++i)
             {
-                exts[i].id = rehash_lookup_string(exts[i].id);
+                exts[i].id = rehash_lookup_string(lt, exts[i].id);
             }
 
             // read cameras
             u32 num_cams;
-            ifs.read((c8*)&num_cams, sizeof(u32));
+            r.read(&num_cams, sizeof(u32));
 
             for (u32 i = 0; i < num_cams; ++i)
             {
-                camera  cam;
-                hash_id id_cam;
-
-                ifs.read((c8*)&id_cam, sizeof(hash_id));
-                ifs.read((c8*)&cam.pos, sizeof(vec3f));
-                ifs.read((c8*)&cam.focus, sizeof(vec3f));
-                ifs.read((c8*)&cam.rot, sizeof(vec2f));
-                ifs.read((c8*)&cam.fov, sizeof(f32));
-                ifs.read((c8*)&cam.aspect, sizeof(f32));
-                ifs.read((c8*)&cam.near_plane, sizeof(f32));
-                ifs.read((c8*)&cam.far_plane, sizeof(f32));
-                ifs.read((c8*)&cam.zoom, sizeof(f32));
+                scene_camera cam;
+                r.read(&cam.id, sizeof(hash_id));
+                r.read(&cam.pos, sizeof(vec3f));
+                r.read(&cam.focus, sizeof(vec3f));
+                r.read(&cam.rot, sizeof(vec2f));
+                r.read(&cam.fov, sizeof(f32));
+                r.read(&cam.aspect, sizeof(f32));
+                r.read(&cam.near_plane, sizeof(f32));
+                r.read(&cam.far_plane, sizeof(f32));
+                r.read(&cam.zoom, sizeof(f32));
+
+                sb_push(sf->cameras, cam);
+            }
 
-                // find camera and set
-                camera* _cam = pmfx::get_camera(id_cam);
-                if (_cam && !merge)
+            // read all components
+            scene_component_blob* toc = nullptr;
+            if (sh.version >= 10)
+            {
+                r.pos = sh.toc_offset;
+                for (u32 i = 0; i < sh.num_components; ++i)
                 {
-                    _cam->pos = cam.pos;
-                    _cam->focus = cam.focus;
-                    _cam->rot = cam.rot;
-                    _cam->fov = cam.fov;
-                    _cam->aspect = cam.aspect;
-                    _cam->near_plane = cam.near_plane;
-                    _cam->far_plane = cam.far_plane;
-                    _cam->zoom = cam.zoom;
+                    scene_component_blob blob;
+                    r.read(&blob, sizeof(scene_component_blob));
+                    sb_push(toc, blob);
                 }
             }
 
-            // read all components
+            scene_blob_read* blob_reads = nullptr;
+
             for (u32 i = 0; i < sh.num_components; ++i)
             {
                 u32 ri = i; // remap i.. if we have extensions
@@ -2326,34 +4016,53 @@ namespace put
                     }
                 }
 
-                bool read = false;
-
-                if (ri != -1)
+                generic_cmp_array* cmp = nullptr;
+                if (ri < scene->num_components)
                 {
-                    generic_cmp_array& cmp = scene->get_component_array(ri);
+                    cmp = &scene->get_component_array(ri);
+                    if (cmp->size != component_sizes[i])
+                        cmp = nullptr;
+                }
 
-                    if (cmp.size == component_sizes[i])
+                if (toc)
+                {
+                    // blobs are copied out of the file on the workers once they are all located
+                    size_t blob_end = (size_t)toc[i].offset + (size_t)toc[i].size * toc[i].count;
+                    if (cmp && toc[i].count == num_nodes && blob_end <= sf->size)
                     {
-                        // read whole array
-                        c8* data_offset = (c8*)cmp.data + zero_offset * cmp.size;
-                        ifs.read(data_offset, cmp.size * num_nodes);
-                        read = true;
+                        scene_blob_read br = {cmp, toc[i].offset};
+                        sb_push(blob_reads, br);
                     }
+
+                    // here any fixup can be applied from the old size blob into cmp
+                    continue;
                 }
 
-                if (!read)
+                if (cmp)
                 {
-                    // read the old size
-                    u32 array_size = component_sizes[i] * num_nodes;
-                    c8* old = (c8*)pen::memory_alloc(array_size);
-                    ifs.read(old, array_size);
+                    // read whole array
+                    read_component_array(r, *cmp, zero_offset, num_nodes);
+                    continue;
+                }
 
-                    // here any fuxup can be applied old into cmp.data
+                // skip the old size, here any fixup can be applied from the file into cmp
+                r.pos += component_sizes[i] * num_nodes;
+            }
 
-                    pen::memory_free(old);
-                }
+            if (toc)
+            {
+                scene_blob_job job = {blob_reads, r.data, r.size, zero_offset, num_nodes};
+
+                u32 num_reads = sb_count(blob_reads);
+                if (num_reads)
+                    pen::jobs_parallel_for(num_reads, 1, read_component_blobs_job, &job);
+
+                r.pos = sh.specialisations_offset;
             }
 
+            sb_free(toc);
+            sb_free(blob_reads);
+
             // fixup parents for scene import / merge
             for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
                 scene->parents[n] += zero_offset;
@@ -2365,22 +4074,124 @@ namespace put
                 memset(&scene->geometry_names[n], 0x0, sizeof(Str));
                 memset(&scene->material_names[n], 0x0, sizeof(Str));
 
-                scene->names[n] = read_lookup_string(ifs);
-                scene->geometry_names[n] = read_lookup_string(ifs);
-                scene->material_names[n] = read_lookup_string(ifs);
+                scene->names[n] = read_lookup_string(lt, r);
+                scene->geometry_names[n] = read_lookup_string(lt, r);
+                scene->material_names[n] = read_lookup_string(lt, r);
             }
 
+            sf->resources = new scene_entity_resources[num_nodes];
+
             // geometry
             for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
             {
-                if (scene->entities[n] & e_cmp::geometry)
+                if (!(scene->entities[n] & e_cmp::geometry))
+                    continue;
+
+                scene_entity_resources& res = sf->resources[n - zero_offset];
+                r.read(&res.submesh, sizeof(u32));
+                res.geometry_file = read_lookup_string(lt, r);
+                res.geometry_name = read_lookup_string(lt, r);
+            }
+
+            // animations
+            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            {
+                s32 size;
+                r.read(&size, sizeof(s32));
+
+                for (s32 i = 0; i < size; ++i)
+                    sf->resources[n - zero_offset].anims.push_back(read_lookup_string(lt, r));
+            }
+
+            // materials
+            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::material))
+                    continue;
+
+                cmp_material&      mat = scene->materials[n];
+                material_resource& mat_res = scene->material_resources.write(n);
+
+                // Invalidate stuff we need to recreate
+                memset(&mat_res.material_name, 0x0, sizeof(Str));
+                memset(&mat_res.shader_name, 0x0, sizeof(Str));
+                mat.material_cbuffer = PEN_INVALID_HANDLE;
+
+                Str material_name = read_lookup_string(lt, r);
+                Str shader = read_lookup_string(lt, r);
+                Str technique = read_lookup_string(lt, r);
+
+                mat_res.material_name = material_name;
+                mat_res.id_shader = PEN_HASH(shader.c_str());
+                mat_res.id_technique = PEN_HASH(technique.c_str());
+                mat_res.shader_name = shader;
+            }
+
+            // sdf shadow
+            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::sdf_shadow))
+                    continue;
+
+                Str sdf_shadow_volume_file = read_lookup_string(lt, r);
+                sf->resources[n - zero_offset].sdf_shadow = pen::str_replace_string(sdf_shadow_volume_file, ".dds", ".pmv");
+            }
+
+            // sampler binding textures
+            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::samplers))
+                    continue;
+
+                scene_entity_resources& res = sf->resources[n - zero_offset];
+                for (u32 i = 0; i < e_pmfx_constants::max_technique_sampler_bindings; ++i)
+                {
+                    res.textures[i] = read_lookup_string(lt, r);
+                    res.sampler_states[i] = read_lookup_string(lt, r);
+                }
+            }
+
+            // invalidate runtime handles saved with the file, the commit recreates them and deleting an entity which
+            // has not been committed must not release handles now owned by other resources
+            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            {
+                scene->cbuffer[n] = PEN_INVALID_HANDLE;
+                scene->physics_handles[n] = PEN_INVALID_HANDLE;
+                scene->physics_debug_cbuffer[n] = PEN_INVALID_HANDLE;
+
+                if (scene->entities[n] & e_cmp::pre_skinned)
                 {
-                    u32 submesh;
-                    ifs.read((c8*)&submesh, sizeof(u32));
+                    cmp_pre_skin& pre_skin = scene->pre_skin.write(n);
+                    pre_skin.vertex_buffer = 0;
+                    pre_skin.position_buffer = 0;
+                }
+
+                if (scene->entities[n] & e_cmp::master_instance)
+                    scene->master_instances.write(n).instance_buffer = 0;
+            }
+
+            sf->commit_phase = 0;
+            sf->commit_entity = 0;
+
+            // cleanup
+            sb_free(component_sizes);
+            sb_free(exts);
+        }
+
+        void commit_entity_resources(scene_file* sf, ecs_scene* scene, u32 n, const Str& project_dir)
+        {
+            scene_entity_resources& res = sf->resources[sf->commit_entity];
+
+            switch (sf->commit_phase)
+            {
+                case e_scene_commit::geometry:
+                {
+                    if (!(scene->entities[n] & e_cmp::geometry))
+                        break;
 
                     Str filename = project_dir;
-                    Str name = read_lookup_string(ifs).c_str();
-                    Str geometry_name = read_lookup_string(ifs);
+                    Str name = res.geometry_file;
+                    Str geometry_name = res.geometry_name;
 
                     hash_id        name_hash = PEN_HASH(name.c_str());
                     static hash_id primitive_id = PEN_HASH("primitive");
@@ -2398,7 +4209,7 @@ namespace put
                         hm.begin(0);
                         hm.add(filename.c_str(), filename.length());
                         hm.add(geometry_name.c_str(), geometry_name.length());
-                        hm.add(submesh);
+                        hm.add(res.submesh);
                         hash_id geom_hash = hm.end();
 
                         gr = get_geometry_resource(geom_hash);
@@ -2425,150 +4236,217 @@ namespace put
                                           filename.c_str());
 
                         scene->entities[n] &= ~e_cmp::geometry;
-                        error = true;
+                        sf->error = true;
                     }
                 }
-            }
+                break;
 
-            // instantiate physics
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-                if (scene->entities[n] & e_cmp::physics)
-                    instantiate_rigid_body(scene, n);
-
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-                if (scene->entities[n] & e_cmp::constraint)
-                    instantiate_constraint(scene, n);
+                case e_scene_commit::physics:
+                    if (scene->entities[n] & e_cmp::physics)
+                        instantiate_rigid_body(scene, n);
+                    break;
 
-            // animations
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-            {
-                s32 size;
-                ifs.read((c8*)&size, sizeof(s32));
+                case e_scene_commit::constraints:
+                    if (scene->entities[n] & e_cmp::constraint)
+                        instantiate_constraint(scene, n);
+                    break;
 
-                for (s32 i = 0; i < size; ++i)
+                case e_scene_commit::animations:
                 {
-                    Str anim_name = project_dir;
-                    anim_name.append(read_lookup_string(ifs).c_str());
+                    u32 num_anims = res.anims.size();
+                    for (u32 i = 0; i < num_anims; ++i)
+                    {
+                        Str anim_name = project_dir;
+                        anim_name.append(res.anims[i].c_str());
 
-                    anim_handle h = load_pma(anim_name.c_str());
+                        anim_handle h = load_pma(anim_name.c_str());
 
-                    if (!is_valid(h))
+                        if (!is_valid(h))
+                        {
+                            dev_ui::log_level(dev_ui::console_level::error, "[error] animation - cannot find pma file: %s",
+                                              anim_name.c_str());
+                            sf->error = true;
+                        }
+
+                        bind_animation_to_rig(scene, h, n);
+                    }
+                }
+                break;
+
+                case e_scene_commit::sdf_shadows:
+                    if (scene->entities[n] & e_cmp::sdf_shadow)
                     {
-                        dev_ui::log_level(dev_ui::console_level::error, "[error] animation - cannot find pma file: %s",
-                                          anim_name.c_str());
-                        error = true;
+                        dev_console_log("[scene load] %s", res.sdf_shadow.c_str());
+                        instantiate_sdf_shadow(res.sdf_shadow.c_str(), scene, n);
                     }
+                    break;
+
+                case e_scene_commit::samplers:
+                {
+                    if (!(scene->entities[n] & e_cmp::samplers))
+                        break;
+
+                    cmp_samplers& samplers = scene->samplers[n];
+
+                    for (u32 i = 0; i < e_pmfx_constants::max_technique_sampler_bindings; ++i)
+                    {
+                        if (!res.textures[i].empty())
+                        {
+                            samplers.sb[i].handle = put::load_texture(res.textures[i].c_str());
+                            samplers.sb[i].sampler_state =
+                                pmfx::get_render_state(PEN_HASH("wrap_linear"), pmfx::e_render_state::sampler);
+                        }
 
-                    bind_animation_to_rig(scene, h, n);
+                        if (!res.sampler_states[i].empty())
+                        {
+                            samplers.sb[i].sampler_state =
+                                pmfx::get_render_state(PEN_HASH(res.sampler_states[i]), pmfx::e_render_state::sampler);
+                        }
+                    }
                 }
+                break;
+
+                case e_scene_commit::lights:
+                    if (scene->entities[n] & e_cmp::light)
+                        instantiate_model_cbuffer(scene, n);
+                    break;
             }
+        }
 
-            // materials
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-            {
-                if (!(scene->entities[n] & e_cmp::material))
-                    continue;
+        bool commit_scene_file(scene_file* sf, ecs_scene* scene, u32 zero_offset, f64 budget_ms)
+        {
+            static pen::timer* timer = pen::timer_create();
+            pen::timer_start(timer);
 
-                cmp_material&      mat = scene->materials[n];
-                material_resource& mat_res = scene->material_resources[n];
+            const c8* wd = pen::os_get_user_info().working_directory;
+            Str       project_dir = dev_ui::get_program_preference_filename("project_dir", wd);
 
-                // Invalidate stuff we need to recreate
-                memset(&mat_res.material_name, 0x0, sizeof(Str));
-                memset(&mat_res.shader_name, 0x0, sizeof(Str));
-                mat.material_cbuffer = PEN_INVALID_HANDLE;
+            u32 num_nodes = sf->header.num_nodes;
 
-                Str material_name = read_lookup_string(ifs);
-                Str shader = read_lookup_string(ifs);
-                Str technique = read_lookup_string(ifs);
+            while (sf->commit_phase < e_scene_commit::COUNT)
+            {
+                while (sf->commit_entity < num_nodes)
+                {
+                    if (budget_ms > 0.0 && pen::timer_elapsed_ms(timer) > budget_ms)
+                        return false;
 
-                mat_res.material_name = material_name;
-                mat_res.id_shader = PEN_HASH(shader.c_str());
-                mat_res.id_technique = PEN_HASH(technique.c_str());
-                mat_res.shader_name = shader;
+                    commit_entity_resources(sf, scene, zero_offset + sf->commit_entity, project_dir);
+                    sf->commit_entity++;
+                }
+
+                sf->commit_phase++;
+                sf->commit_entity = 0;
             }
 
-            // sdf shadow
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-            {
-                if (!(scene->entities[n] & e_cmp::sdf_shadow))
-                    continue;
+            bake_material_handles();
+            prewarm_scene_shaders(scene);
+            return true;
+        }
 
-                Str sdf_shadow_volume_file = read_lookup_string(ifs);
-                sdf_shadow_volume_file = pen::str_replace_string(sdf_shadow_volume_file, ".dds", ".pmv");
+        bool get_scene_file_error(const scene_file* sf)
+        {
+            return sf->error;
+        }
 
-                dev_console_log("[scene load] %s", sdf_shadow_volume_file.c_str());
-                instantiate_sdf_shadow(sdf_shadow_volume_file.c_str(), scene, n);
-            }
+        void load_scene(const c8* filename, ecs_scene* scene, bool merge)
+        {
+            pen::timer* load_timer = pen::timer_create();
+            pen::timer_start(load_timer);
 
-            // sampler binding textures
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            scene_file* sf = open_scene_file(filename);
+            if (!sf)
             {
-                if (!(scene->entities[n] & e_cmp::samplers))
-                    continue;
+                dev_ui::log_level(dev_ui::console_level::error, "[error] scene - cannot load file: %s", filename);
+                pen::timer_destroy(load_timer);
+                return;
+            }
 
-                cmp_samplers& samplers = scene->samplers[n];
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
 
-                for (u32 i = 0; i < e_pmfx_constants::max_technique_sampler_bindings; ++i)
-                {
-                    Str texture_name = read_lookup_string(ifs);
+            // header
+            const scene_header& sh = sf->header;
 
-                    if (!texture_name.empty())
-                    {
-                        samplers.sb[i].handle = put::load_texture(texture_name.c_str());
-                        samplers.sb[i].sampler_state =
-                            pmfx::get_render_state(PEN_HASH("wrap_linear"), pmfx::e_render_state::sampler);
-                    }
+            if (!merge)
+            {
+                scene->version = sh.version;
+                scene->filename = filename;
+            }
 
-                    Str sampler_state_name = read_lookup_string(ifs);
+            // unpack header
+            s32 num_nodes = sh.num_nodes;
 
-                    if (!sampler_state_name.empty())
-                    {
-                        samplers.sb[i].sampler_state =
-                            pmfx::get_render_state(PEN_HASH(sampler_state_name), pmfx::e_render_state::sampler);
-                    }
-                }
+            scene->selected_index = sh.selected_index;
+            s32 scene_view_flags = sh.view_flags;
+
+            u32 zero_offset = 0;
+            s32 new_num_nodes = num_nodes;
+
+            if (merge)
+            {
+                zero_offset = scene->num_entities;
+                new_num_nodes = scene->num_entities + num_nodes;
+            }
+            else
+            {
+                clear_scene(scene);
             }
 
-            // read cams strings
-            for (u32 i = 0; i < num_cams; ++i)
-                read_lookup_string(ifs);
+            if (new_num_nodes > scene->soa_size)
+                resize_scene_buffers(scene, num_nodes);
 
-            // read extensions
-            for (u32 i = 0; i < sh.num_extensions; ++i)
-                if (scene->extensions[i].load_func)
-                    scene->extensions[i].load_func(scene->extensions[i], scene);
+            scene->num_entities = new_num_nodes;
 
-            bake_material_handles();
+            read_scene_file(sf, scene, zero_offset);
 
-            // light geom
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
+            // find cameras and set
+            if (!merge)
             {
-                if (!(scene->entities[n] & e_cmp::light))
-                    continue;
+                u32 num_cams = sb_count(sf->cameras);
+                for (u32 i = 0; i < num_cams; ++i)
+                {
+                    const scene_camera& cam = sf->cameras[i];
+
+                    camera* _cam = pmfx::get_camera(cam.id);
+                    if (!_cam)
+                        continue;
 
-                instantiate_model_cbuffer(scene, n);
+                    _cam->pos = cam.pos;
+                    _cam->focus = cam.focus;
+                    _cam->rot = cam.rot;
+                    _cam->fov = cam.fov;
+                    _cam->aspect = cam.aspect;
+                    _cam->near_plane = cam.near_plane;
+                    _cam->far_plane = cam.far_plane;
+                    _cam->zoom = cam.zoom;
+                }
             }
 
-            // invalidate physics debug cbuffer.. will recreate on demand
-            for (s32 n = zero_offset; n < zero_offset + num_nodes; ++n)
-                scene->physics_debug_cbuffer[n] = PEN_INVALID_HANDLE;
+            // create all resources at once
+            commit_scene_file(sf, scene, zero_offset, 0.0);
+
+            // read extensions
+            u32 num_extensions = sb_count(scene->extensions);
+            for (u32 i = 0; i < sh.num_extensions && i < num_extensions; ++i)
+                if (scene->extensions[i].load_func)
+                    scene->extensions[i].load_func(scene->extensions[i], scene);
 
             if (!merge)
             {
                 scene->view_flags = scene_view_flags;
 
                 // show bones and mats if we have an error, to aid deugging
-                if (error)
+                if (sf->error)
                     scene->view_flags |= (e_scene_view_flags::matrix | e_scene_view_flags::bones);
             }
 
-            ifs.close();
-
             initialise_free_list(scene);
 
-            // cleanup
-            sb_free(component_sizes);
-            sb_free(exts);
+            // compare formats by loading the same scene before and after re-saving it
+            dev_console_log("[scene load] %s version %i, %i entities in %.2f(ms)", filename, sh.version, num_nodes,
+                            pen::timer_elapsed_ms(load_timer));
+            pen::timer_destroy(load_timer);
+
+            close_scene_file(sf);
         }
     } // namespace ecs
 } // namespace put
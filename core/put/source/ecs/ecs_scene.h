@@ -27,7 +27,12 @@ namespace put
     namespace ecs
     {
         struct anim_instance;
+        struct cluster_light;
+        struct cpu_skin_stream;
+        struct defrag_state;
         struct ecs_scene;
+        struct light_clusters;
+        struct shadow_caches;
 
         namespace e_scene_view_flags
         {
@@ -59,7 +64,12 @@ namespace put
             {
                 none = 0,
                 invalidate_scene_tree = 1 << 1,
-                pause_update = 1 << 2
+                pause_update = 1 << 2,
+                invalidate_queries = 1 << 3,
+                clustered_lights = 1 << 4, // unshadowed point and spot lights are binned into clusters per view
+                cache_shadows = 1 << 5,    // static casters are rendered once into shadow_map_static and reused
+                cull_clusters = 1 << 6,    // back facing and off screen clusters of full detail meshes are not drawn
+                lods_selected = 1 << 7     // geometry lods have been picked since the last update_scene
             };
         }
         typedef u32 scene_flags;
@@ -135,7 +145,9 @@ namespace put
                 max_area_lights = 10,
                 max_shadow_maps = 100,
                 max_sdf_shadows = 1,
-                max_omni_shadow_maps = 100
+                max_omni_shadow_maps = 100,
+                max_clustered_lights = 4096,
+                max_geometry_lods = 4 // including the full detail mesh
             };
         }
 
@@ -163,7 +175,8 @@ namespace put
                 sub_geometry = (1 << 17),
                 sdf_shadow = (1 << 18),
                 volume = (1 << 19),
-                samplers = (1 << 20)
+                samplers = (1 << 20),
+                cpu_skinned = (1 << 21)
             };
         }
 
@@ -262,17 +275,40 @@ namespace put
             vec3f max;
         };
 
+        struct geometry_lod
+        {
+            u32 index_buffer; // indexes the same vertex buffer as the full detail mesh
+            u32 num_indices;
+            f32 error; // simplification error relative to the mesh extents
+        };
+
+        struct geometry_cluster
+        {
+            vec4f pos_radius;       // bounding sphere in model space
+            vec4f cone_apex;        // normal cone in model space, w is unused
+            vec4f cone_axis_cutoff; // w is the cosine of the cone half angle, 1 when the cone can never be culled
+            u32   index_offset;     // triangles of a cluster are contiguous in the full detail index buffer
+            u32   num_indices;
+            u32   pad[2];
+        };
+
         struct cmp_geometry
         {
-            u32       position_buffer;
-            u32       vertex_buffer;
-            u32       index_buffer;
-            u32       num_indices;
-            u32       num_vertices;
-            u32       index_type;
-            u32       vertex_size;
-            cmp_skin* p_skin;
-            hash_id   vertex_shader_class;
+            u32                     position_buffer;
+            u32                     vertex_buffer;
+            u32                     index_buffer;
+            u32                     num_indices;
+            u32                     num_vertices;
+            u32                     index_type;
+            u32                     vertex_size;
+            cmp_skin*               p_skin;
+            hash_id                 vertex_shader_class;
+            const geometry_lod*     lods;     // owned by the geometry resource
+            u32                     num_lods; // simplified levels after the full detail mesh
+            u32                     lod;      // level selected by the last view, 0 is full detail
+            const geometry_cluster* clusters; // owned by the geometry resource, full vertex buffer geometry only
+            u32                     num_clusters;
+            const void*             cpu_index_buffer; // full detail indices surviving clusters are copied from
         };
 
         struct cmp_pre_skin
@@ -304,6 +340,7 @@ namespace put
             u8*            joint_flags = nullptr;
             anim_blend     blend;
             u32            joints_offset;
+            u32            palette_offset; // into scene->bone_palettes, invalid until the next update
         };
 
         struct cmp_light
@@ -359,6 +396,26 @@ namespace put
             light_data lights[e_scene_limits::max_forward_lights];
         };
 
+        struct light_cluster_buffer
+        {
+            vec4f dims;   // clusters in x, y and z
+            vec4f params; // x = near, y = z slices per log depth, zw = projection x and y scale
+        };
+
+        struct shadow_stats
+        {
+            u32 rendered = 0; // shadow views with static casters re-rendered, or not cached at all
+            u32 cached = 0;   // shadow views which reused their cached static casters
+        };
+
+        struct render_stats
+        {
+            u32 draw_calls = 0;
+            u32 triangles = 0;
+            u32 lod_triangles_saved = 0;     // triangles lod selection removed from the full detail meshes
+            u32 cluster_triangles_culled = 0; // triangles in clusters rejected by cull_clusters
+        };
+
         struct distance_field_shadow
         {
             mat4 world_matrix;
@@ -395,19 +452,58 @@ namespace put
             free_node_list* prev;
         };
 
-        template <typename T>
+        namespace e_cmp_storage
+        {
+            enum cmp_storage_t
+            {
+                dense, // all pages allocated when the scene grows
+                sparse // pages allocated on first write, for rarely used components
+            };
+        }
+
+        // components live in fixed size pages so growing a scene never moves existing components
+        static const u32 k_cmp_dense_page_shift = 10;
+        static const u32 k_cmp_dense_page_entities = 1 << k_cmp_dense_page_shift;
+        static const u32 k_cmp_dense_page_mask = k_cmp_dense_page_entities - 1;
+
+        static const u32 k_cmp_sparse_page_shift = 6;
+        static const u32 k_cmp_sparse_page_entities = 1 << k_cmp_sparse_page_shift;
+        static const u32 k_cmp_sparse_page_mask = k_cmp_sparse_page_entities - 1;
+
+        void* alloc_component_page(u32 cmp_size, u32 storage);
+
+        template <typename T, u32 S = e_cmp_storage::dense>
         struct cmp_array
         {
             u32 size = sizeof(T);
-            T*  data = nullptr;
+            u32 storage = S;
+            T** pages = nullptr;
 
             T&       operator[](size_t index);
             const T& operator[](size_t index) const;
         };
 
+        // reads never allocate, a missing page returns a zeroed component. write allocates the page and must be
+        // called on the user thread, jobs should only touch entities which have the component.
+        template <typename T>
+        struct cmp_array<T, e_cmp_storage::sparse>
+        {
+            u32 size = sizeof(T);
+            u32 storage = e_cmp_storage::sparse;
+            T** pages = nullptr;
+
+            T&       write(size_t index);
+            const T& operator[](size_t index) const;
+        };
+
+        template <typename T>
+        using sparse_cmp_array = cmp_array<T, e_cmp_storage::sparse>;
+
+        // type erased view of any cmp_array, data is the page table
         struct generic_cmp_array
         {
             u32   size;
+            u32   storage;
             void* data;
 
             void* operator[](size_t index);
@@ -429,6 +525,13 @@ namespace put
             void (*update_func)(ecs_extension&, ecs_scene*, f32) = nullptr; // update with dt
         };
 
+        // packed list of entities which have all the components in mask
+        struct ecs_query
+        {
+            u64  mask;
+            u32* entities;
+        };
+
         struct ecs_controller
         {
             Str          name;
@@ -442,7 +545,7 @@ namespace put
 
         struct ecs_scene
         {
-            static const u32 k_version = 9;
+            static const u32 k_version = 10;
 
             ecs_scene()
             {
@@ -451,45 +554,45 @@ namespace put
             };
 
             // Components version 4
-            cmp_array<u64>                      entities;
-            cmp_array<u64>                      state_flags;
-            cmp_array<hash_id>                  id_name;
-            cmp_array<hash_id>                  id_geometry;
-            cmp_array<hash_id>                  id_material;
-            cmp_array<Str>                      names;
-            cmp_array<Str>                      geometry_names;
-            cmp_array<Str>                      material_names;
-            cmp_array<u32>                      parents;
-            cmp_array<cmp_transform>            transforms;
-            cmp_array<mat4>                     local_matrices;
-            cmp_array<mat4>                     world_matrices;
-            cmp_array<mat4>                     offset_matrices;
-            cmp_array<mat4>                     physics_matrices;
-            cmp_array<cmp_bounding_volume>      bounding_volumes;
-            cmp_array<cmp_light>                lights;
-            cmp_array<u32>                      physics_handles;
-            cmp_array<cmp_master_instance>      master_instances;
-            cmp_array<cmp_geometry>             geometries;
-            cmp_array<cmp_pre_skin>             pre_skin;
-            cmp_array<cmp_physics>              physics_data;
-            cmp_array<cmp_geometry>             position_geometries;
-            cmp_array<u32>                      cbuffer;
-            cmp_array<cmp_draw_call>            draw_call_data;
-            cmp_array<free_node_list>           free_list;
-            cmp_array<cmp_material>             materials;
-            cmp_array<cmp_material_data>        material_data;
-            cmp_array<material_resource>        material_resources;
-            cmp_array<cmp_shadow>               shadows;
-            cmp_array<cmp_samplers>             samplers;             // version 5
-            cmp_array<u32>                      material_permutation; // version 8
-            cmp_array<cmp_transform>            initial_transform;    // version 9
-            cmp_array<cmp_anim_controller_v2>   anim_controller_v2;
-            cmp_array<cmp_transform>            physics_offset;
-            cmp_array<u32>                      physics_debug_cbuffer;
-            cmp_array<cmp_area_light>           area_light;
-            cmp_array<area_light_resource>      area_light_resources;
-            cmp_array<pmfx::scene_render_flags> render_flags;
-            cmp_array<cmp_pos_extent>           pos_extent;
+            cmp_array<u64>                           entities;
+            cmp_array<u64>                           state_flags;
+            cmp_array<hash_id>                       id_name;
+            cmp_array<hash_id>                       id_geometry;
+            cmp_array<hash_id>                       id_material;
+            cmp_array<Str>                           names;
+            cmp_array<Str>                           geometry_names;
+            cmp_array<Str>                           material_names;
+            cmp_array<u32>                           parents;
+            cmp_array<cmp_transform>                 transforms;
+            cmp_array<mat4>                          local_matrices;
+            cmp_array<mat4>                          world_matrices;
+            cmp_array<mat4>                          offset_matrices;
+            cmp_array<mat4>                          physics_matrices;
+            cmp_array<cmp_bounding_volume>           bounding_volumes;
+            sparse_cmp_array<cmp_light>              lights;
+            cmp_array<u32>                           physics_handles;
+            sparse_cmp_array<cmp_master_instance>    master_instances;
+            cmp_array<cmp_geometry>                  geometries;
+            sparse_cmp_array<cmp_pre_skin>           pre_skin;
+            sparse_cmp_array<cmp_physics>            physics_data;
+            cmp_array<cmp_geometry>                  position_geometries;
+            cmp_array<u32>                           cbuffer;
+            cmp_array<cmp_draw_call>                 draw_call_data;
+            cmp_array<free_node_list>                free_list;
+            cmp_array<cmp_material>                  materials;
+            cmp_array<cmp_material_data>             material_data;
+            sparse_cmp_array<material_resource>      material_resources;
+            sparse_cmp_array<cmp_shadow>             shadows;
+            cmp_array<cmp_samplers>                  samplers;             // version 5
+            cmp_array<u32>                           material_permutation; // version 8
+            cmp_array<cmp_transform>                 initial_transform;    // version 9
+            sparse_cmp_array<cmp_anim_controller_v2> anim_controller_v2;
+            sparse_cmp_array<cmp_transform>          physics_offset;
+            cmp_array<u32>                           physics_debug_cbuffer;
+            sparse_cmp_array<cmp_area_light>         area_light;
+            sparse_cmp_array<area_light_resource>    area_light_resources;
+            cmp_array<pmfx::scene_render_flags>      render_flags;
+            cmp_array<cmp_pos_extent>                pos_extent;
 
             // num base components calculates value based on its address - entities address.
             u32 num_base_components;
@@ -508,12 +611,37 @@ namespace put
             u32              area_light_buffer = PEN_INVALID_HANDLE;
             u32              shadow_map_buffer = PEN_INVALID_HANDLE;
             u32              gi_volume_buffer = PEN_INVALID_HANDLE;
+            u32              cluster_info_buffer = PEN_INVALID_HANDLE;
+            u32              cluster_light_buffer = PEN_INVALID_HANDLE;
+            u32              cluster_offset_buffer = PEN_INVALID_HANDLE;
+            u32              cluster_index_buffer = PEN_INVALID_HANDLE;
+            u32              cluster_index_capacity = 0;
+            u32              culled_index_buffer = PEN_INVALID_HANDLE; // surviving cluster indices of all views
+            u32              culled_index_capacity = 0;
+            u32*             culled_indices = nullptr;
+            u32*             physics_entities = nullptr; // physics handle to entity, rebuilt when it goes stale
             s32              selected_index = -1;
             scene_flags      flags = 0;
             scene_view_flags view_flags = 0;
             extents          renderable_extents;
             extents          shadow_extent_constraints = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
             u32*             selection_list = nullptr;
+            ecs_query*       queries = nullptr;
+            mat4*            bone_palettes = nullptr; // skinning matrices for all skinned entities this frame
+            cpu_skin_stream* cpu_skin_streams = nullptr;
+            vec4f*           cpu_skinned_positions = nullptr;
+            vec4f*           cpu_skinned_normals = nullptr;
+            defrag_state*    defrag = nullptr;
+            cluster_light*   cluster_lights = nullptr; // rebuilt each update when clustered_lights is set
+            light_data*      cluster_light_data = nullptr;
+            light_clusters*  clusters = nullptr;
+            shadow_caches*   shadow_cache = nullptr;
+            shadow_stats     shadow_view_stats; // counts from the last rendered frame when cache_shadows is set
+            render_stats     draw_stats;        // counts from the last rendered frame
+            render_stats     draw_stats_frame;  // accumulated by render_scene_view
+            f32              lod_error_threshold = 0.001f; // in screen heights, 0 draws the full detail meshes
+            const camera*    lod_camera = nullptr; // picks lods once per frame, null uses the first camera view rendered
+            u32              defrag_moves_per_frame = 0; // entities update_scene may move to defragment, 0 disables
             u32              version = k_version;
             Str              filename = "";
 
@@ -536,9 +664,19 @@ namespace put
         void update(f32 dt);
         void update_scene(ecs_scene* scene, f32 dt);
 
+        // entities with all components in mask, in ascending order. all lists are refreshed together in a single pass
+        // by update_scene, or on the next query after entities are allocated or deleted.
+        // the returned list is valid until the next refresh.
+        const u32* query_entities(ecs_scene* scene, u64 mask, u32& count);
+        void       refresh_queries(ecs_scene* scene);
+
+        // skinning matrices built by update_scene, nullptr if the entity has no palette this frame
+        mat4* get_bone_palette(ecs_scene* scene, u32 node_index);
+
         void render_scene_view(const scene_view& view);
         void render_light_volumes(const scene_view& view);
         void render_shadow_views(const scene_view& view);
+        void render_static_shadow_views(const scene_view& view);
         void render_omni_shadow_views(const scene_view& view);
         void render_area_light_textures(const scene_view& view);
         void compute_volume_gi(const scene_view& view);
@@ -547,6 +685,7 @@ namespace put
         void default_scene(ecs_scene* scene);
 
         void resize_scene_buffers(ecs_scene* scene, s32 size = 1024);
+        void free_scene_buffers(ecs_scene* scene, bool cmp_mem_only = false); // cmp_mem_only skips sub system cleanup
         void zero_entity_components(ecs_scene* scene, u32 node_index);
 
         void delete_entity(ecs_scene* scene, u32 node_index);
@@ -555,28 +694,65 @@ namespace put
 
         void initialise_free_list(ecs_scene* scene);
 
+        // bytes held by component pages, and what the same components would take as contiguous arrays
+        void get_component_memory(ecs_scene* scene, size_t& allocated, size_t& contiguous);
+
         void register_ecs_extentsions(ecs_scene* scene, const ecs_extension& ext);
         void unregister_ecs_extensions(ecs_scene* scene);
 
         void register_ecs_controller(ecs_scene* scene, const ecs_controller& controller);
 
         // separate implementations to make clang always inline
+        template <typename T, u32 S>
+        pen_inline T& cmp_array<T, S>::operator[](size_t index)
+        {
+            return pages[index >> k_cmp_dense_page_shift][index & k_cmp_dense_page_mask];
+        }
+
+        template <typename T, u32 S>
+        pen_inline const T& cmp_array<T, S>::operator[](size_t index) const
+        {
+            return pages[index >> k_cmp_dense_page_shift][index & k_cmp_dense_page_mask];
+        }
+
         template <typename T>
-        pen_inline T& cmp_array<T>::operator[](size_t index)
+        pen_inline T& cmp_array<T, e_cmp_storage::sparse>::write(size_t index)
         {
-            return data[index];
+            T*& page = pages[index >> k_cmp_sparse_page_shift];
+            if (!page)
+                page = (T*)alloc_component_page(size, storage);
+
+            return page[index & k_cmp_sparse_page_mask];
         }
 
         template <typename T>
-        pen_inline const T& cmp_array<T>::operator[](size_t index) const
+        pen_inline const T& cmp_array<T, e_cmp_storage::sparse>::operator[](size_t index) const
         {
-            return data[index];
+            alignas(T) static const u8 zero[sizeof(T)] = {0};
+
+            const T* page = pages[index >> k_cmp_sparse_page_shift];
+            if (!page)
+                return *(const T*)zero;
+
+            return page[index & k_cmp_sparse_page_mask];
+        }
+
+        pen_inline u32 get_component_page_shift(u32 storage)
+        {
+            return storage == e_cmp_storage::sparse ? k_cmp_sparse_page_shift : k_cmp_dense_page_shift;
         }
 
         pen_inline void* generic_cmp_array::operator[](size_t index)
         {
-            u8* d = (u8*)data;
-            u8* di = &d[index * size];
+            u32 shift = get_component_page_shift(storage);
+            u32 mask = (1 << shift) - 1;
+
+            void*& page = ((void**)data)[index >> shift];
+            if (!page)
+                page = alloc_component_page(size, storage);
+
+            u8* d = (u8*)page;
+            u8* di = &d[(index & mask) * size];
             return (void*)(di);
         }
 
@@ -0,0 +1,364 @@
+// ecs_skin.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include "ecs/ecs_skin.h"
+#include "ecs/ecs_resources.h"
+#include "ecs/ecs_scene.h"
+
+#include "data_struct.h"
+#include "renderer_definitions.h"
+#include "threads.h"
+
+#include <algorithm>
+#include <math.h>
+
+#if __SSE2__ || __AVX2__ || __AVX__
+#include <immintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    const f32 k_ray_epsilon = 0.0000001f;
+} // namespace
+
+namespace put
+{
+    namespace ecs
+    {
+        // matches skin_pos in shaders/libs/skinning.pmfx, weights which do not sum to 1 have the remainder applied to the
+        // first bone. blend indices are stored as floats in the vertex buffer.
+        pen_inline void get_blend(const vertex_model_skinned& v, u32* indices, f32* weights)
+        {
+            const f32* bi = (const f32*)&v.blend_indices;
+            const f32* bw = (const f32*)&v.blend_weights;
+
+            f32 sum = 0.0f;
+            for (u32 i = 0; i < 4; ++i)
+            {
+                indices[i] = (u32)bi[i];
+                weights[i] = bw[i];
+                sum += bw[i];
+            }
+
+            weights[0] += 1.0f - sum;
+        }
+
+        //
+        // scalar implementation
+        //
+
+        void skin_vertices_scalar(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                  vec4f* normals)
+        {
+            for (u32 v = 0; v < count; ++v)
+            {
+                u32 indices[4];
+                f32 weights[4];
+                get_blend(src[v], indices, weights);
+
+                // blend the matrices once then transform position and normal
+                mat4 bm;
+                f32* m = &bm.m[0];
+                for (u32 k = 0; k < 16; ++k)
+                    m[k] = 0.0f;
+
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    if (weights[i] == 0.0f)
+                        continue;
+
+                    const f32* pm = &palette[indices[i]].m[0];
+                    for (u32 k = 0; k < 16; ++k)
+                        m[k] += pm[k] * weights[i];
+                }
+
+                positions[v] = bm.transform_vector(vec4f(src[v].pos.xyz, 1.0f));
+                normals[v] = bm.transform_vector(vec4f(src[v].normal.xyz, 0.0f));
+            }
+        }
+
+        //
+        // sse 128 implementation
+        //
+
+#if __SSE__ || __AVX__
+        // r0-r3 are the rows of the blended matrix
+        pen_inline void transform_blended(__m128 r0, __m128 r1, __m128 r2, __m128 r3, const vertex_model_skinned& v,
+                                          vec4f* position, vec4f* normal)
+        {
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            __m128 p = _mm_add_ps(_mm_mul_ps(r0, _mm_set1_ps(v.pos.x)), r3);
+            p = _mm_add_ps(_mm_mul_ps(r1, _mm_set1_ps(v.pos.y)), p);
+            p = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(v.pos.z)), p);
+
+            __m128 n = _mm_mul_ps(r0, _mm_set1_ps(v.normal.x));
+            n = _mm_add_ps(_mm_mul_ps(r1, _mm_set1_ps(v.normal.y)), n);
+            n = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(v.normal.z)), n);
+
+            _mm_storeu_ps((f32*)position, p);
+            _mm_storeu_ps((f32*)normal, n);
+        }
+
+        void skin_vertices_simd128(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals)
+        {
+            for (u32 v = 0; v < count; ++v)
+            {
+                u32 indices[4];
+                f32 weights[4];
+                get_blend(src[v], indices, weights);
+
+                __m128 r0 = _mm_setzero_ps();
+                __m128 r1 = _mm_setzero_ps();
+                __m128 r2 = _mm_setzero_ps();
+                __m128 r3 = _mm_setzero_ps();
+
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    if (weights[i] == 0.0f)
+                        continue;
+
+                    const f32* pm = &palette[indices[i]].m[0];
+                    __m128     w = _mm_set1_ps(weights[i]);
+
+                    r0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pm + 0), w), r0);
+                    r1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pm + 4), w), r1);
+                    r2 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pm + 8), w), r2);
+                    r3 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pm + 12), w), r3);
+                }
+
+                // translation only applies to positions, the normal path ignores r3 after transpose
+                transform_blended(r0, r1, r2, r3, src[v], &positions[v], &normals[v]);
+            }
+        }
+#else
+        void skin_vertices_simd128(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals)
+        {
+            skin_vertices_scalar(palette, src, count, positions, normals);
+        }
+#endif
+
+        //
+        // avx 256 implementation
+        //
+
+#if __AVX2__
+        void skin_vertices_simd256(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals)
+        {
+            for (u32 v = 0; v < count; ++v)
+            {
+                u32 indices[4];
+                f32 weights[4];
+                get_blend(src[v], indices, weights);
+
+                // two rows per register halves the blend cost
+                __m256 r01 = _mm256_setzero_ps();
+                __m256 r23 = _mm256_setzero_ps();
+
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    if (weights[i] == 0.0f)
+                        continue;
+
+                    const f32* pm = &palette[indices[i]].m[0];
+                    __m256     w = _mm256_set1_ps(weights[i]);
+
+                    r01 = _mm256_fmadd_ps(_mm256_loadu_ps(pm + 0), w, r01);
+                    r23 = _mm256_fmadd_ps(_mm256_loadu_ps(pm + 8), w, r23);
+                }
+
+                __m128 r0 = _mm256_castps256_ps128(r01);
+                __m128 r1 = _mm256_extractf128_ps(r01, 1);
+                __m128 r2 = _mm256_castps256_ps128(r23);
+                __m128 r3 = _mm256_extractf128_ps(r23, 1);
+
+                transform_blended(r0, r1, r2, r3, src[v], &positions[v], &normals[v]);
+            }
+        }
+#else
+        void skin_vertices_simd256(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals)
+        {
+            skin_vertices_simd128(palette, src, count, positions, normals);
+        }
+#endif
+
+        void skin_vertices(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                           vec4f* normals)
+        {
+            skin_vertices_simd256(palette, src, count, positions, normals);
+        }
+
+        //
+        // scene integration
+        //
+
+        bool instantiate_cpu_skin(ecs_scene* scene, u32 node_index)
+        {
+            geometry_resource* gr = get_geometry_resource(scene->id_geometry[node_index]);
+            if (!gr || !gr->p_skin)
+                return false;
+
+            pmm_renderable& r = gr->renderable[e_pmm_renderable::full_vertex_buffer];
+            if (!r.cpu_vertex_buffer || r.vertex_size != sizeof(vertex_model_skinned))
+                return false;
+
+            scene->entities[node_index] |= e_cmp::cpu_skinned;
+            scene->flags |= e_scene_flags::invalidate_queries;
+            return true;
+        }
+
+        void update_cpu_skin_job(void* user_data, u32 begin, u32 end)
+        {
+            ecs_scene* scene = (ecs_scene*)user_data;
+
+            for (u32 i = begin; i < end; ++i)
+            {
+                cpu_skin_stream& s = scene->cpu_skin_streams[i];
+
+                vec4f* pos = &scene->cpu_skinned_positions[s.offset];
+                vec4f* nrm = &scene->cpu_skinned_normals[s.offset];
+
+                skin_vertices(get_bone_palette(scene, s.node_index), s.vertices, s.num_vertices, pos, nrm);
+
+                s.min_extents = vec3f::flt_max();
+                s.max_extents = -vec3f::flt_max();
+                for (u32 v = 0; v < s.num_vertices; ++v)
+                {
+                    s.min_extents = min_union(s.min_extents, pos[v].xyz);
+                    s.max_extents = max_union(s.max_extents, pos[v].xyz);
+                }
+            }
+        }
+
+        void update_cpu_skinning(ecs_scene* scene)
+        {
+            if (scene->cpu_skin_streams)
+                stb__sbn(scene->cpu_skin_streams) = 0;
+
+            // only entities opted in with instantiate_cpu_skin are skinned, the query is in entity order so lookups can
+            // binary search the streams
+            u32        num_cpu_skinned = 0;
+            const u32* cpu_skinned = query_entities(scene, e_cmp::cpu_skinned, num_cpu_skinned);
+
+            u32 num_verts = 0;
+            for (u32 qi = 0; qi < num_cpu_skinned; ++qi)
+            {
+                u32 n = cpu_skinned[qi];
+                if (!get_bone_palette(scene, n))
+                    continue;
+
+                geometry_resource* gr = get_geometry_resource(scene->id_geometry[n]);
+                if (!gr)
+                    continue;
+
+                pmm_renderable& r = gr->renderable[e_pmm_renderable::full_vertex_buffer];
+                if (!r.cpu_vertex_buffer)
+                    continue;
+
+                cpu_skin_stream s;
+                s.node_index = n;
+                s.offset = num_verts;
+                s.num_vertices = r.num_vertices;
+                s.num_indices = r.num_indices;
+                s.index_type = r.index_type;
+                s.vertices = (const vertex_model_skinned*)r.cpu_vertex_buffer;
+                s.indices = r.cpu_index_buffer;
+
+                sb_push(scene->cpu_skin_streams, s);
+                num_verts += r.num_vertices;
+            }
+
+            u32 num_streams = sb_count(scene->cpu_skin_streams);
+            if (num_streams == 0)
+                return;
+
+            u32 cur = sb_count(scene->cpu_skinned_positions);
+            if (num_verts > cur)
+            {
+                sb_add(scene->cpu_skinned_positions, num_verts - cur);
+                sb_add(scene->cpu_skinned_normals, num_verts - cur);
+            }
+
+            pen::jobs_parallel_for(num_streams, 1, update_cpu_skin_job, scene);
+        }
+
+        const cpu_skin_stream* get_cpu_skin_stream(const ecs_scene* scene, u32 node_index)
+        {
+            u32 count = sb_count(scene->cpu_skin_streams);
+
+            const cpu_skin_stream* begin = scene->cpu_skin_streams;
+            const cpu_skin_stream* end = begin + count;
+
+            const cpu_skin_stream* s = std::lower_bound(
+                begin, end, node_index, [](const cpu_skin_stream& a, u32 n) { return a.node_index < n; });
+
+            if (s == end || s->node_index != node_index)
+                return nullptr;
+
+            return s;
+        }
+
+        bool cast_ray_cpu_skinned(const ecs_scene* scene, u32 node_index, const vec3f& r0, const vec3f& r1, vec3f& hit_pos)
+        {
+            const cpu_skin_stream* s = get_cpu_skin_stream(scene, node_index);
+            if (!s || !s->indices)
+                return false;
+
+            const vec4f* pos = &scene->cpu_skinned_positions[s->offset];
+            const u16*   i16 = (const u16*)s->indices;
+            const u32*   i32 = (const u32*)s->indices;
+            bool         short_indices = s->index_type == PEN_FORMAT_R16_UINT;
+
+            vec3f rv = r1 - r0;
+            f32   closest = 1.0f;
+            bool  hit = false;
+
+            // moller trumbore, t is the fraction along r0 -> r1
+            for (u32 i = 0; i + 2 < s->num_indices; i += 3)
+            {
+                u32 t0 = short_indices ? i16[i + 0] : i32[i + 0];
+                u32 t1 = short_indices ? i16[i + 1] : i32[i + 1];
+                u32 t2 = short_indices ? i16[i + 2] : i32[i + 2];
+
+                vec3f v0 = pos[t0].xyz;
+                vec3f e1 = pos[t1].xyz - v0;
+                vec3f e2 = pos[t2].xyz - v0;
+
+                vec3f p = cross(rv, e2);
+                f32   det = dot(e1, p);
+                if (fabs(det) < k_ray_epsilon)
+                    continue;
+
+                f32   inv_det = 1.0f / det;
+                vec3f sv = r0 - v0;
+
+                f32 u = dot(sv, p) * inv_det;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+
+                vec3f q = cross(sv, e1);
+                f32   v = dot(rv, q) * inv_det;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+
+                f32 t = dot(e2, q) * inv_det;
+                if (t >= 0.0f && t < closest)
+                {
+                    closest = t;
+                    hit = true;
+                }
+            }
+
+            if (hit)
+                hit_pos = r0 + rv * closest;
+
+            return hit;
+        }
+    } // namespace ecs
+} // namespace put
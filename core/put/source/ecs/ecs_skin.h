@@ -0,0 +1,55 @@
+// ecs_skin.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#pragma once
+
+#include "maths/maths.h"
+#include "types.h"
+
+namespace put
+{
+    namespace ecs
+    {
+        struct ecs_scene;
+        struct vertex_model_skinned;
+
+        // cpu skinned output for one entity, positions and normals are in world space.
+        struct cpu_skin_stream
+        {
+            u32                         node_index;
+            u32                         offset; // into scene->cpu_skinned_positions and scene->cpu_skinned_normals
+            u32                         num_vertices;
+            u32                         num_indices;
+            u32                         index_type;
+            const vertex_model_skinned* vertices;
+            const void*                 indices;
+            vec3f                       min_extents;
+            vec3f                       max_extents;
+        };
+
+        // flags the entity as e_cmp::cpu_skinned, requires skinned geometry with cpu vertex data
+        bool instantiate_cpu_skin(ecs_scene* scene, u32 node_index);
+
+        // skin count vertices with the bone palette, positions have w = 1 and normals w = 0.
+        void skin_vertices_scalar(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                  vec4f* normals);
+        void skin_vertices_simd128(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals);
+        void skin_vertices_simd256(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                                   vec4f* normals);
+
+        // picks the widest simd available
+        void skin_vertices(const mat4* palette, const vertex_model_skinned* src, u32 count, vec4f* positions,
+                           vec4f* normals);
+
+        // skins all cpu_skinned entities on the worker threads, called by update_scene once bone palettes are built
+        void update_cpu_skinning(ecs_scene* scene);
+
+        // nullptr if the entity was not cpu skinned this frame
+        const cpu_skin_stream* get_cpu_skin_stream(const ecs_scene* scene, u32 node_index);
+
+        // closest hit on the skinned triangles of an entity along the segment r0 -> r1
+        bool cast_ray_cpu_skinned(const ecs_scene* scene, u32 node_index, const vec3f& r0, const vec3f& r1, vec3f& hit_pos);
+    } // namespace ecs
+} // namespace put
@@ -0,0 +1,645 @@
+// ecs_stream.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "console.h"
+#include "data_struct.h"
+#include "dev_ui.h"
+#include "file_system.h"
+#include "memory.h"
+#include "os.h"
+#include "pen_string.h"
+#include "str/Str.h"
+#include "threads.h"
+#include "timer.h"
+
+#include "ecs/ecs_resources.h"
+#include "ecs/ecs_scene.h"
+#include "ecs/ecs_stream.h"
+#include "ecs/ecs_utilities.h"
+
+using namespace put;
+using namespace ecs;
+
+namespace
+{
+    const u32 k_stream_version = 1;
+    const u32 k_stream_queue_size = 64;
+    const u32 k_max_stream_path = 256;
+
+    namespace e_cell_state
+    {
+        enum cell_state_t
+        {
+            unloaded,
+            requested,  // waiting on the loader thread
+            staged,     // parsed into a staging scene, waiting to be committed
+            committing, // entities are in the scene, resources are being created
+            loaded,
+            unloading,
+            missing // file could not be read
+        };
+    }
+
+    struct stream_index_header
+    {
+        u32 version = k_stream_version;
+        f32 cell_size = 0.0f;
+        u32 num_cells = 0;
+        u32 reserved[5] = {0};
+    };
+
+    struct stream_index_cell
+    {
+        s32 x;
+        s32 z;
+        u32 num_entities;
+        u32 reserved;
+    };
+
+    struct stream_cell
+    {
+        stream_index_cell info;
+        u32               state = e_cell_state::unloaded;
+        scene_file*       sf = nullptr;
+        ecs_scene*        staging = nullptr;
+        s32               start = -1;
+        u32               unload_cursor = 0;
+        f32               distance = 0.0f;
+    };
+
+    struct stream_request
+    {
+        stream_world* world;
+        u32           cell;
+        c8            filename[k_max_stream_path];
+    };
+
+    struct stream_result
+    {
+        stream_world* world;
+        u32           cell;
+        scene_file*   sf;
+        ecs_scene*    staging;
+    };
+
+    pen::ring_buffer<stream_request> s_stream_requests;
+    pen::ring_buffer<stream_result>  s_stream_results;
+    pen::job*                        s_stream_job = nullptr;
+
+    void get_cell_filename(c8* buf, const Str& directory, s32 x, s32 z)
+    {
+        pen::string_format(buf, k_max_stream_path, "%s/cell_%i_%i.pms", directory.c_str(), x, z);
+    }
+
+    // reads and parses a cell into a staging scene, no resources are created
+    stream_result load_cell(const stream_request& req)
+    {
+        stream_result result;
+        result.world = req.world;
+        result.cell = req.cell;
+        result.staging = nullptr;
+        result.sf = open_scene_file(req.filename);
+
+        if (result.sf)
+        {
+            u32 num_entities = get_scene_file_num_entities(result.sf);
+
+            result.staging = new ecs_scene();
+            resize_scene_buffers(result.staging, num_entities);
+            result.staging->num_entities = num_entities;
+
+            read_scene_file(result.sf, result.staging, 0);
+        }
+
+        return result;
+    }
+
+    void* stream_loader_thread(void* params)
+    {
+        pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+        pen::job*               p_thread_info = job_params->job_info;
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+        for (;;)
+        {
+            stream_request* req = s_stream_requests.get();
+            while (req)
+            {
+                stream_result result = load_cell(*req);
+
+                while (!s_stream_results.try_put(result))
+                    pen::thread_sleep_ms(1);
+
+                req = s_stream_requests.get();
+            }
+
+            if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+                break;
+
+            pen::thread_sleep_ms(4);
+        }
+
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+        pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+        return PEN_THREAD_OK;
+    }
+
+    void free_staging(stream_cell& cell)
+    {
+        if (cell.staging)
+        {
+            free_scene_buffers(cell.staging, true);
+            delete cell.staging;
+            cell.staging = nullptr;
+        }
+
+        close_scene_file(cell.sf);
+        cell.sf = nullptr;
+    }
+} // namespace
+
+namespace put
+{
+    namespace ecs
+    {
+        struct stream_world
+        {
+            ecs_scene*    scene;
+            Str           directory;
+            stream_params params;
+            f32           cell_size;
+            stream_cell*  cells = nullptr;
+            u32*          order = nullptr; // cells sorted by distance to the focus
+            size_t        entity_memory; // bytes of base components per entity
+            u32           num_in_flight = 0;
+        };
+
+        namespace
+        {
+            f32 cell_distance(const stream_world* world, const stream_cell& cell, const vec3f& focus)
+            {
+                // distance on the xz plane to the cell rect
+                f32 min_x = cell.info.x * world->cell_size;
+                f32 min_z = cell.info.z * world->cell_size;
+
+                f32 dx = std::max(std::max(min_x - focus.x, focus.x - (min_x + world->cell_size)), 0.0f);
+                f32 dz = std::max(std::max(min_z - focus.z, focus.z - (min_z + world->cell_size)), 0.0f);
+
+                return sqrt(dx * dx + dz * dz);
+            }
+
+            size_t cell_memory(const stream_world* world, const stream_cell& cell)
+            {
+                return (size_t)cell.info.num_entities * world->entity_memory;
+            }
+
+            void receive_cell(stream_result& result)
+            {
+                stream_world* world = result.world;
+                stream_cell&  cell = world->cells[result.cell];
+
+                world->num_in_flight--;
+
+                cell.sf = result.sf;
+                cell.staging = result.staging;
+                cell.state = e_cell_state::staged;
+
+                if (!cell.sf)
+                {
+                    Str fn = "";
+                    fn.appendf("cell_%i_%i.pms", cell.info.x, cell.info.z);
+                    dev_console_log_level(dev_ui::console_level::warning, "[stream] cannot read %s", fn.c_str());
+                    cell.state = e_cell_state::missing;
+                }
+            }
+
+            void receive_cells()
+            {
+                stream_result* result = s_stream_results.get();
+                while (result)
+                {
+                    receive_cell(*result);
+                    result = s_stream_results.get();
+                }
+            }
+
+            bool request_cell(stream_world* world, u32 c)
+            {
+                stream_cell& cell = world->cells[c];
+
+                stream_request req;
+                req.world = world;
+                req.cell = c;
+                get_cell_filename(req.filename, world->directory, cell.info.x, cell.info.z);
+
+#if PEN_SINGLE_THREADED
+                world->num_in_flight++;
+                stream_result result = load_cell(req);
+                receive_cell(result);
+                return true;
+#else
+                if (!s_stream_job)
+                {
+                    s_stream_requests.create(k_stream_queue_size);
+                    s_stream_results.create(k_stream_queue_size);
+                    s_stream_job =
+                        pen::jobs_create_job(stream_loader_thread, 1024 * 1024, nullptr, pen::e_thread_start_flags::detached);
+                }
+
+                // loader is busy, try again next frame
+                if (!s_stream_requests.try_put(req))
+                    return false;
+
+                world->num_in_flight++;
+                cell.state = e_cell_state::requested;
+                return true;
+#endif
+            }
+
+            // moves the staging components into a contiguous range of the scene
+            void place_cell(stream_world* world, stream_cell& cell)
+            {
+                ecs_scene* scene = world->scene;
+                ecs_scene* staging = cell.staging;
+                s32        num = cell.info.num_entities;
+
+                s32 start = -1;
+                s32 end = -1;
+                get_new_entities_contiguous(scene, num, start, end);
+                if (start < 0)
+                    get_new_entities_append(scene, num, start, end);
+
+                for (u32 c = 0; c < staging->num_base_components; ++c)
+                {
+                    generic_cmp_array& src = staging->get_component_array(c);
+                    generic_cmp_array& dst = scene->get_component_array(c);
+
+                    if (&dst == (generic_cmp_array*)&scene->free_list)
+                        continue;
+
+                    u32 shift = get_component_page_shift(src.storage);
+                    u32 mask = (1 << shift) - 1;
+
+                    for (s32 i = 0; i < num; ++i)
+                    {
+                        u8* page = (u8*)((void**)src.data)[i >> shift];
+                        if (page)
+                            memcpy(dst[start + i], page + (i & mask) * src.size, src.size);
+                    }
+                }
+
+                for (s32 i = start; i < start + num; ++i)
+                {
+                    scene->entities[i] |= e_cmp::allocated;
+                    scene->parents[i] += start;
+                }
+
+                // names and resources now belong to the scene, only the staging pages are freed
+                free_scene_buffers(staging, true);
+                delete staging;
+                cell.staging = nullptr;
+
+                initialise_free_list(scene);
+                scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
+
+                cell.start = start;
+                cell.state = e_cell_state::committing;
+            }
+
+            // returns true once all entities of the cell have been deleted
+            bool unload_cell(stream_world* world, stream_cell& cell, pen::timer* timer, f64 budget_ms)
+            {
+                ecs_scene* scene = world->scene;
+                u32        num = cell.info.num_entities;
+
+                // constraints must be released before rigid bodies, so all first passes happen before second passes
+                while (cell.unload_cursor < num * 2)
+                {
+                    if (budget_ms > 0.0 && pen::timer_elapsed_ms(timer) > budget_ms)
+                        return false;
+
+                    u32 n = cell.start + (cell.unload_cursor % num);
+                    if (scene->entities[n] & e_cmp::allocated)
+                    {
+                        if (cell.unload_cursor < num)
+                            delete_entity_first_pass(scene, n);
+                        else
+                            delete_entity_second_pass(scene, n);
+                    }
+
+                    cell.unload_cursor++;
+                }
+
+                initialise_free_list(scene);
+                scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
+
+                cell.start = -1;
+                cell.unload_cursor = 0;
+                cell.state = e_cell_state::unloaded;
+                return true;
+            }
+
+            void unload_all(stream_world* world)
+            {
+                u32 num_cells = sb_count(world->cells);
+                for (u32 i = 0; i < num_cells; ++i)
+                {
+                    stream_cell& cell = world->cells[i];
+                    switch (cell.state)
+                    {
+                        case e_cell_state::staged:
+                            free_staging(cell);
+                            break;
+                        case e_cell_state::committing:
+                        case e_cell_state::loaded:
+                        case e_cell_state::unloading:
+                            close_scene_file(cell.sf);
+                            cell.sf = nullptr;
+                            unload_cell(world, cell, nullptr, 0.0);
+                            break;
+                        default:
+                            break;
+                    }
+
+                    cell.state = e_cell_state::unloaded;
+                }
+            }
+        } // namespace
+
+        void save_stream_cells(ecs_scene* scene, f32 cell_size, const c8* directory)
+        {
+            struct cell_nodes
+            {
+                stream_index_cell info;
+                std::vector<s32>  nodes;
+            };
+            std::vector<cell_nodes> cells;
+
+            for (u32 n = 0; n < scene->num_entities; ++n)
+            {
+                if (!(scene->entities[n] & e_cmp::allocated) || scene->parents[n] != n)
+                    continue;
+
+                const vec3f& t = scene->transforms[n].translation;
+                s32          x = (s32)floor(t.x / cell_size);
+                s32          z = (s32)floor(t.z / cell_size);
+
+                u32 c = 0;
+                u32 num_cells = cells.size();
+                for (; c < num_cells; ++c)
+                    if (cells[c].info.x == x && cells[c].info.z == z)
+                        break;
+
+                if (c == num_cells)
+                {
+                    cell_nodes cn;
+                    cn.info.x = x;
+                    cn.info.z = z;
+                    cn.info.num_entities = 0;
+                    cn.info.reserved = 0;
+                    cells.push_back(cn);
+                }
+
+                build_heirarchy_node_list(scene, n, cells[c].nodes);
+            }
+
+            stream_index_header sh;
+            sh.cell_size = cell_size;
+            sh.num_cells = cells.size();
+
+            Str index_filename = directory;
+            index_filename.append("/world.pmw");
+
+            std::ofstream ofs(index_filename.c_str(), std::ofstream::binary);
+            ofs.write((const c8*)&sh, sizeof(stream_index_header));
+
+            for (auto& cell : cells)
+            {
+                c8 filename[k_max_stream_path];
+                get_cell_filename(filename, directory, cell.info.x, cell.info.z);
+
+                save_sub_scene(filename, scene, cell.nodes);
+
+                // save_sub_scene removes duplicates and invalid entries
+                cell.info.num_entities = cell.nodes.size();
+                ofs.write((const c8*)&cell.info, sizeof(stream_index_cell));
+            }
+
+            ofs.close();
+
+            dev_console_log("[stream] saved %i cells to %s", sh.num_cells, directory);
+        }
+
+        stream_world* create_stream_world(ecs_scene* scene, const c8* directory, const stream_params& params)
+        {
+            Str index_filename = directory;
+            index_filename.append("/world.pmw");
+
+            void* data = nullptr;
+            u32   data_size = 0;
+            if (pen::filesystem_read_file_to_buffer(index_filename.c_str(), &data, data_size) != PEN_ERR_OK)
+            {
+                dev_console_log_level(dev_ui::console_level::error, "[stream] cannot find %s", index_filename.c_str());
+                pen::memory_free(data);
+                return nullptr;
+            }
+
+            const stream_index_header* sh = (const stream_index_header*)data;
+            if (data_size < sizeof(stream_index_header) ||
+                data_size < sizeof(stream_index_header) + sh->num_cells * sizeof(stream_index_cell))
+            {
+                dev_console_log_level(dev_ui::console_level::error, "[stream] invalid index %s", index_filename.c_str());
+                pen::memory_free(data);
+                return nullptr;
+            }
+
+            stream_world* world = new stream_world();
+            world->scene = scene;
+            world->directory = directory;
+            world->params = params;
+            world->cell_size = sh->cell_size;
+
+            const stream_index_cell* cells = (const stream_index_cell*)(sh + 1);
+            for (u32 i = 0; i < sh->num_cells; ++i)
+            {
+                stream_cell cell;
+                cell.info = cells[i];
+                sb_push(world->cells, cell);
+                sb_push(world->order, i);
+            }
+
+            world->entity_memory = 0;
+            for (u32 c = 0; c < scene->num_base_components; ++c)
+                world->entity_memory += scene->get_component_array(c).size;
+
+            pen::memory_free(data);
+            return world;
+        }
+
+        void destroy_stream_world(stream_world* world)
+        {
+            if (!world)
+                return;
+
+            // wait for cells still on the loader thread
+            while (world->num_in_flight > 0)
+            {
+                receive_cells();
+                pen::thread_sleep_ms(1);
+            }
+
+            unload_all(world);
+
+            sb_free(world->cells);
+            sb_free(world->order);
+            delete world;
+        }
+
+        void set_stream_params(stream_world* world, const stream_params& params)
+        {
+            world->params = params;
+        }
+
+        void update_stream_world(stream_world* world, const vec3f& focus)
+        {
+            static pen::timer* timer = pen::timer_create();
+            pen::timer_start(timer);
+
+            const stream_params& params = world->params;
+
+            receive_cells();
+
+            u32    num_cells = sb_count(world->cells);
+            size_t memory = 0;
+
+            for (u32 i = 0; i < num_cells; ++i)
+            {
+                stream_cell& cell = world->cells[i];
+                cell.distance = cell_distance(world, cell, focus);
+
+                bool far = cell.distance > params.unload_radius;
+
+                switch (cell.state)
+                {
+                    case e_cell_state::staged:
+                        if (far)
+                        {
+                            free_staging(cell);
+                            cell.state = e_cell_state::unloaded;
+                        }
+                        break;
+                    case e_cell_state::committing:
+                    case e_cell_state::loaded:
+                        if (far)
+                        {
+                            close_scene_file(cell.sf);
+                            cell.sf = nullptr;
+                            cell.state = e_cell_state::unloading;
+                        }
+                        break;
+                    case e_cell_state::missing:
+                        // allow the file to appear again once we have moved away
+                        if (far)
+                            cell.state = e_cell_state::unloaded;
+                        break;
+                    default:
+                        break;
+                }
+
+                if (cell.state != e_cell_state::unloaded && cell.state != e_cell_state::missing)
+                    memory += cell_memory(world, cell);
+            }
+
+            // nearest first, so the memory budget is spent on the cells closest to the focus
+            stream_cell* cells = world->cells;
+            std::sort(world->order, world->order + num_cells,
+                      [cells](u32 a, u32 b) { return cells[a].distance < cells[b].distance; });
+
+            size_t memory_budget = (size_t)params.memory_budget_mb * 1024 * 1024;
+
+            for (u32 i = 0; i < num_cells; ++i)
+            {
+                u32          c = world->order[i];
+                stream_cell& cell = world->cells[c];
+
+                if (cell.distance > params.load_radius)
+                    break;
+
+                if (cell.state != e_cell_state::unloaded)
+                    continue;
+
+                size_t cm = cell_memory(world, cell);
+                if (memory + cm > memory_budget)
+                    break;
+
+                if (!request_cell(world, c))
+                    break;
+
+                memory += cm;
+            }
+
+            // unloading first frees memory for the cells waiting behind the budget
+            for (u32 i = 0; i < num_cells; ++i)
+            {
+                u32          c = world->order[num_cells - 1 - i];
+                stream_cell& cell = world->cells[c];
+
+                if (cell.state != e_cell_state::unloading)
+                    continue;
+
+                if (!unload_cell(world, cell, timer, params.commit_budget_ms))
+                    return;
+            }
+
+            for (u32 i = 0; i < num_cells; ++i)
+            {
+                u32          c = world->order[i];
+                stream_cell& cell = world->cells[c];
+
+                if (cell.state == e_cell_state::staged)
+                    place_cell(world, cell);
+
+                if (cell.state != e_cell_state::committing)
+                    continue;
+
+                f64 remaining = params.commit_budget_ms - pen::timer_elapsed_ms(timer);
+                if (remaining <= 0.0)
+                    return;
+
+                if (!commit_scene_file(cell.sf, world->scene, cell.start, remaining))
+                    return;
+
+                if (get_scene_file_error(cell.sf))
+                    dev_console_log_level(dev_ui::console_level::warning, "[stream] cell %i, %i has missing resources",
+                                          cell.info.x, cell.info.z);
+
+                close_scene_file(cell.sf);
+                cell.sf = nullptr;
+                cell.state = e_cell_state::loaded;
+            }
+        }
+
+        void get_stream_stats(const stream_world* world, u32& loaded_cells, size_t& memory)
+        {
+            loaded_cells = 0;
+            memory = 0;
+
+            u32 num_cells = sb_count(world->cells);
+            for (u32 i = 0; i < num_cells; ++i)
+            {
+                const stream_cell& cell = world->cells[i];
+
+                if (cell.state == e_cell_state::loaded)
+                    loaded_cells++;
+
+                if (cell.state != e_cell_state::unloaded && cell.state != e_cell_state::missing)
+                    memory += cell_memory(world, cell);
+            }
+        }
+    } // namespace ecs
+} // namespace put
@@ -0,0 +1,45 @@
+// ecs_stream.h
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Streams large worlds into an ecs_scene as a grid of cells on the xz plane, each cell is a sub scene file.
+// Cells near the focus are read and parsed on a background thread, then committed into the scene on the user thread
+// in slices bounded by a per frame time budget. Cells which move out of range are deleted and their entities go back
+// to the free list. Only base components are streamed, extension components in cell files are skipped.
+
+#pragma once
+
+#include "maths/maths.h"
+#include "types.h"
+
+namespace put
+{
+    namespace ecs
+    {
+        struct ecs_scene;
+        struct stream_world;
+
+        struct stream_params
+        {
+            f32 load_radius = 200.0f;   // cells closer than this to the focus are loaded
+            f32 unload_radius = 300.0f; // cells further than this are unloaded, keep it larger than load_radius
+            f64 commit_budget_ms = 2.0; // user thread time per frame spent creating and deleting cell entities
+            u32 memory_budget_mb = 256; // estimated component memory of cells which are loaded or in flight
+        };
+
+        // groups root entities and their hierarchies into cells by position, saves each cell as a sub scene
+        // along with a world.pmw index into directory
+        void save_stream_cells(ecs_scene* scene, f32 cell_size, const c8* directory);
+
+        // reads directory/world.pmw, nullptr if it cannot be found
+        stream_world* create_stream_world(ecs_scene* scene, const c8* directory, const stream_params& params);
+        void          destroy_stream_world(stream_world* world); // deletes all streamed entities
+        void          set_stream_params(stream_world* world, const stream_params& params);
+
+        // call once per frame on the user thread
+        void update_stream_world(stream_world* world, const vec3f& focus);
+
+        // number of cells which are fully committed, and the estimated memory of all cells which are not unloaded
+        void get_stream_stats(const stream_world* world, u32& loaded_cells, size_t& memory);
+    } // namespace ecs
+} // namespace put
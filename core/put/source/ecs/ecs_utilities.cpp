@@ -116,6 +116,7 @@ namespace put
             }
 
             scene->num_entities = end;
+            scene->flags |= e_scene_flags::invalidate_queries;
         }
 
         void get_new_entities_contiguous(ecs_scene* scene, s32 num, s32& start, s32& end)
@@ -170,6 +171,7 @@ namespace put
                 }
 
                 scene->num_entities = std::max<u32>(end, scene->num_entities);
+                scene->flags |= e_scene_flags::invalidate_queries;
             }
         }
 
@@ -185,8 +187,9 @@ namespace put
         {
             // o(1) using free list
 
+            // grows by a single page, existing components are not moved
             if (!scene->free_list_head)
-                resize_scene_buffers(scene, scene->soa_size * 2);
+                resize_scene_buffers(scene, k_cmp_dense_page_entities);
 
             u32 ii = 0;
             ii = scene->free_list_head->node;
@@ -194,7 +197,7 @@ namespace put
 
             u32 i = ii;
 
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
 
             scene->num_entities = std::max<u32>(i + 1, scene->num_entities);
 
@@ -432,7 +435,7 @@ namespace put
                 // pen::renderer_consume_cmd_buffer();
             }
 
-            scene->flags |= e_scene_flags::invalidate_scene_tree;
+            scene->flags |= (e_scene_flags::invalidate_scene_tree | e_scene_flags::invalidate_queries);
         }
 
         void instance_entity_range(ecs_scene* scene, u32 master_node, u32 num_nodes)
@@ -444,8 +447,8 @@ namespace put
 
             scene->entities[master] |= e_cmp::master_instance;
 
-            scene->master_instances[master].num_instances = num_nodes;
-            scene->master_instances[master].instance_stride = sizeof(cmp_draw_call);
+            scene->master_instances.write(master).num_instances = num_nodes;
+            scene->master_instances.write(master).instance_stride = sizeof(cmp_draw_call);
 
             pen::buffer_creation_params bcp;
             bcp.usage_flags = PEN_USAGE_DYNAMIC;
@@ -454,7 +457,7 @@ namespace put
             bcp.data = nullptr;
             bcp.cpu_access_flags = PEN_CPU_ACCESS_WRITE;
 
-            scene->master_instances[master].instance_buffer = pen::renderer_create_buffer(bcp);
+            scene->master_instances.write(master).instance_buffer = pen::renderer_create_buffer(bcp);
             scene->geometries[master].vertex_shader_class = ID_VERTEX_CLASS_INSTANCED;
 
             // vertex class has changed which changes shader technique
@@ -616,6 +619,12 @@ namespace put
             scene->geometries[nn].vertex_size = vertex_size;
             scene->geometries[nn].vertex_shader_class = 0;
             scene->geometries[nn].p_skin = nullptr;
+            scene->geometries[nn].lods = nullptr;
+            scene->geometries[nn].num_lods = 0;
+            scene->geometries[nn].lod = 0;
+            scene->geometries[nn].clusters = nullptr;
+            scene->geometries[nn].num_clusters = 0;
+            scene->geometries[nn].cpu_index_buffer = nullptr;
 
             scene->transforms[nn].scale = vec3f::one();
             scene->transforms[nn].translation = vec3f::zero();
@@ -637,9 +646,10 @@ namespace put
             animation_resource* anim = get_animation_resource(anim_handle);
             anim_instance       anim_instance;
             anim_instance.soa = anim->soa;
+            anim_instance.compressed = anim->compressed;
             anim_instance.length = anim->length;
 
-            cmp_anim_controller_v2& controller = scene->anim_controller_v2[node_index];
+            const cmp_anim_controller_v2& controller = scene->anim_controller_v2[node_index];
 
             // initialise anim with starting transform
             u32 num_joints = sb_count(controller.joint_indices);
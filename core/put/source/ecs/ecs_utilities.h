@@ -29,6 +29,14 @@ namespace put
         }
         typedef e_clone_mode::clone_mode_t clone_mode;
 
+        struct defrag_stats
+        {
+            f32 fragmentation; // fraction of allocated entities which are not in their defragmented slot
+            u32 misplaced;     // entities still to move
+            u32 holes;         // free slots below num_entities
+            u32 moves;         // entities moved since the current plan was made
+        };
+
         u32  get_next_entity(ecs_scene* scene); // gets next entity index
         u32  get_new_entity(ecs_scene* scene);  // allocates a new entity at the next index o(1)
         void get_new_entities_contiguous(ecs_scene* scene, s32 num, s32& start, s32& end); // finds contiguous space o(n)
@@ -37,6 +45,13 @@ namespace put
                           clone_mode mode = e_clone_mode::instantiate, vec3f offset = vec3f::zero(),
                           const c8* suffix = "_cloned");
         void swap_entities(ecs_scene* scene, u32 a, s32 b);
+
+        // compacts entities so whole hierarchies are contiguous and parent first, grouped as static renderables,
+        // dynamic renderables, lights and then everything else. moves at most max_moves entities per call, a
+        // hierarchy is always moved in one go so a large one may exceed it. parents, joints, selection and instance
+        // ranges are fixed up, entity indices held outside of the scene are not, so do not use it with a stream_world.
+        void defrag_scene(ecs_scene* scene, u32 max_moves);
+        void get_defrag_stats(ecs_scene* scene, defrag_stats& stats);
         void clone_selection_hierarchical(ecs_scene* scene, u32** selection_list, const c8* suffix);
         void instance_entity_range(ecs_scene* scene, u32 master_node, u32 num_nodes);
         void bake_entities_to_vb(ecs_scene* scene, u32 parent, u32* node_list);
@@ -142,21 +142,36 @@ namespace
         pen::texture_creation_params tcp;
     };
 
+    struct file_watch_input
+    {
+        hash_id id_name;
+        hash_id id_data_file;
+        Str     name;
+    };
+
     struct file_watch
     {
-        hash_id              id_name;
-        Str                  filename;
-        pen::json            dependencies;
-        bool                 invalidated = false;
-        std::vector<hash_id> changes;
-        u32                  rebuild_ts = 0;
+        hash_id                       id_name;
+        hash_id                       id_dependencies; // hash of the resource path to the dependencies file
+        Str                           filename;
+        pen::json                     dependencies;
+        bool                          invalidated = false;
+        std::vector<hash_id>          changes;
+        std::vector<file_watch_input> inputs;
 
         void (*build_callback)();
         void (*hotload_callback)(std::vector<hash_id>& dirty);
     };
 
+    struct file_listener
+    {
+        hash_id id_filename;
+        void (*changed_callback)(hash_id id_filename);
+    };
+
     // static vars
     std::vector<file_watch*>       k_file_watches;
+    std::vector<file_listener>     k_file_listeners;
     std::vector<texture_reference> k_texture_references;
 
     u32 calc_level_size(u32 width, u32 height, bool compressed, u32 block_size)
@@ -494,6 +509,68 @@ namespace
             }
         }
     }
+
+    void watch_dependencies(file_watch* fw)
+    {
+        // the dependencies file is rewritten by the build when it completes
+        Str dep_fn = pen::os_path_for_resource(fw->filename.c_str());
+        fw->id_dependencies = PEN_HASH(dep_fn.c_str());
+        pen::filesystem_watch_file(dep_fn.c_str());
+
+        fw->inputs.clear();
+
+        pen::json files = fw->dependencies["files"];
+        s32       num_files = files.size();
+        for (s32 i = 0; i < num_files; ++i)
+        {
+            pen::json outputs = files[i];
+            s32       num_inputs = outputs.size();
+            for (s32 j = 0; j < num_inputs; ++j)
+            {
+                file_watch_input input;
+                input.name = outputs[j]["name"].as_str();
+                input.id_name = PEN_HASH(input.name.c_str());
+                input.id_data_file = PEN_HASH(outputs[j]["data_file"].as_str().c_str());
+
+                pen::filesystem_watch_file(input.name.c_str());
+                fw->inputs.push_back(input);
+            }
+        }
+    }
+
+    void file_watch_changed(file_watch* fw, hash_id id_changed)
+    {
+        if (fw->invalidated)
+        {
+            if (id_changed != fw->id_dependencies)
+                return;
+
+            fw->dependencies = pen::json::load_from_file(fw->filename.c_str());
+
+            // rebuild has succeeded
+            dev_console_log("[file watcher] rebuild for %s complete", fw->filename.c_str());
+            fw->hotload_callback(fw->changes);
+            fw->changes.clear();
+            fw->invalidated = false;
+
+            // inputs may have changed with the rebuild
+            watch_dependencies(fw);
+            return;
+        }
+
+        for (auto& input : fw->inputs)
+        {
+            if (input.id_name != id_changed)
+                continue;
+
+            dev_console_log("[file watcher] input file %s has changed", input.name.c_str());
+
+            fw->changes.push_back(input.id_data_file);
+            fw->build_callback();
+            fw->invalidated = true;
+            return;
+        }
+    }
 } // namespace
 
 namespace put
@@ -647,6 +724,8 @@ namespace put
 
     void add_file_watcher(const c8* filename, void (*build_callback)(), void (*hotload_callback)(std::vector<hash_id>& dirty))
     {
+        PEN_HOTLOADING_ENABLED;
+
         Str     fn = filename;
         hash_id id_name = PEN_HASH(fn.c_str());
 
@@ -671,9 +750,24 @@ namespace put
         fw->hotload_callback = hotload_callback;
         fw->build_callback = build_callback;
 
+        watch_dependencies(fw);
+
         k_file_watches.push_back(fw);
     }
 
+    void watch_file(const c8* filename, void (*changed_callback)(hash_id id_filename))
+    {
+        PEN_HOTLOADING_ENABLED;
+
+        hash_id id_filename = PEN_HASH(filename);
+        for (auto& fl : k_file_listeners)
+            if (fl.id_filename == id_filename && fl.changed_callback == changed_callback)
+                return;
+
+        pen::filesystem_watch_file(filename);
+        k_file_listeners.push_back({id_filename, changed_callback});
+    }
+
     void poll_hot_loader()
     {
         PEN_HOTLOADING_ENABLED;
@@ -681,64 +775,16 @@ namespace put
         // print build cmd to console first time init
         get_build_cmd();
 
-        for (auto* fw : k_file_watches)
+        // changes are detected by the os on the file watcher thread, nothing is checked here unless notified
+        hash_id id_changed;
+        while (pen::filesystem_watch_next(id_changed))
         {
-            if (fw->invalidated)
-            {
-                u32 dep_ts;
-                Str fn = pen::os_path_for_resource(fw->filename.c_str());
-                if (pen::filesystem_getmtime(fn.c_str(), dep_ts) == PEN_ERR_OK)
-                {
-                    if (dep_ts >= fw->rebuild_ts)
-                    {
-                        fw->dependencies = pen::json::load_from_file(fw->filename.c_str());
+            for (auto& fl : k_file_listeners)
+                if (fl.id_filename == id_changed)
+                    fl.changed_callback(id_changed);
 
-                        // rebuild has succeeded
-                        dev_console_log("[file watcher] rebuild for %s complete", fw->filename.c_str());
-                        fw->hotload_callback(fw->changes);
-                        fw->changes.clear();
-                        fw->invalidated = false;
-                    }
-                }
-            }
-            else
-            {
-                pen::json files = fw->dependencies["files"];
-                s32       num_files = files.size();
-                for (s32 i = 0; i < num_files; ++i)
-                {
-                    pen::json outputs = files[i];
-                    s32       num_inputs = outputs.size();
-                    u32       current_ts = 0;
-
-                    Str fn = pen::os_path_for_resource(fw->filename.c_str());
-                    if (pen::filesystem_getmtime(fn.c_str(), current_ts) == PEN_ERR_OK)
-                    {
-                        for (s32 j = 0; j < num_inputs; ++j)
-                        {
-                            Str ifn = outputs[j]["name"].as_str();
-                            u32 input_ts = 0;
-                            if (pen::filesystem_getmtime(ifn.c_str(), input_ts) == PEN_ERR_OK)
-                            {
-                                if (!fw->invalidated)
-                                {
-                                    if (input_ts > current_ts)
-                                    {
-                                        dev_console_log("[file watcher] input file %s has changed", ifn.c_str());
-
-                                        Str data_file = outputs[j]["data_file"].as_str();
-                                        fw->changes.push_back(PEN_HASH(data_file.c_str()));
-                                        fw->rebuild_ts = input_ts;
-
-                                        fw->build_callback();
-                                        fw->invalidated = true;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            for (auto* fw : k_file_watches)
+                file_watch_changed(fw, id_changed);
         }
     }
 } // namespace put
@@ -27,4 +27,7 @@ namespace put
     Str  get_build_cmd();
     void add_file_watcher(const c8* filename, void (*build_callback)(),
                           void (*hotload_callback)(std::vector<hash_id>& dirty));
+
+    // changed_callback is called from poll_hot_loader with PEN_HASH(filename) when the os reports a change
+    void watch_file(const c8* filename, void (*changed_callback)(hash_id id_filename));
 } // namespace put
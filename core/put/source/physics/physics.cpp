@@ -22,7 +22,7 @@
 #if PEN_SINGLE_THREADED
 #define add_cmd(cmd) exec_cmd(cmd)
 #else
-#define add_cmd(cmd) s_cmd_buffer.put(cmd)
+#define add_cmd(cmd) put_cmd(cmd)
 #endif
 
 namespace physics
@@ -31,6 +31,8 @@ namespace physics
     static pen::slot_resources           s_physics_slot_resources;
     static pen::slot_resources           s_p2p_slot_resources;
 
+    static void put_cmd(const physics_cmd& cmd);
+
     void exec_cmd(const physics_cmd& cmd)
     {
         switch (cmd.command_index)
@@ -169,6 +171,15 @@ namespace physics
             case e_cmd::contact_test:
                 contact_test_internal(cmd.contact_test);
                 break;
+            case e_cmd::cast_batch:
+                cast_batch_internal(cmd.batch);
+                break;
+            case e_cmd::set_transforms:
+                set_transforms_internal(cmd.set_transforms);
+                break;
+            case e_cmd::set_velocities:
+                set_velocities_internal(cmd.set_velocities);
+                break;
             case e_cmd::step:
                 physics_update(cmd.dt);
                 break;
@@ -178,26 +189,185 @@ namespace physics
         }
     }
 
+    // user thread sets coalesced per frame, slot maps a handle to its entry while handles[slot] agrees
+    struct queued_sets
+    {
+        u32*   slot = nullptr;
+        u32*   handles = nullptr;
+        vec3f* v0 = nullptr; // position or linear velocity
+        vec3f* v1 = nullptr; // angular velocity
+        quat*  rotations = nullptr;
+    };
+    static queued_sets s_queued_transforms;
+    static queued_sets s_queued_velocities;
+
+    static bool is_queued(const queued_sets& qs, u32 handle)
+    {
+        if (handle >= sb_count(qs.slot))
+            return false;
+
+        u32 s = qs.slot[handle];
+        return s < sb_count(qs.handles) && qs.handles[s] == handle;
+    }
+
+    static u32 get_queued_slot(queued_sets& qs, u32 handle)
+    {
+        while (sb_count(qs.slot) <= handle)
+            sb_push(qs.slot, 0);
+
+        if (is_queued(qs, handle))
+            return qs.slot[handle];
+
+        u32 s = sb_count(qs.handles);
+        qs.slot[handle] = s;
+        sb_push(qs.handles, handle);
+        sb_push(qs.v0, vec3f::zero());
+        sb_push(qs.v1, vec3f::zero());
+        sb_push(qs.rotations, quat());
+        return s;
+    }
+
+    // swaps the last entry into the erased one, the order of entries does not matter
+    static void erase_queued_set(queued_sets& qs, u32 handle)
+    {
+        if (!is_queued(qs, handle))
+            return;
+
+        u32 s = qs.slot[handle];
+        u32 last = sb_count(qs.handles) - 1;
+
+        qs.handles[s] = qs.handles[last];
+        qs.v0[s] = qs.v0[last];
+        qs.v1[s] = qs.v1[last];
+        qs.rotations[s] = qs.rotations[last];
+        qs.slot[qs.handles[s]] = s;
+
+        stb__sbn(qs.handles) = last;
+        stb__sbn(qs.v0) = last;
+        stb__sbn(qs.v1) = last;
+        stb__sbn(qs.rotations) = last;
+    }
+
+    static void clear_queued_sets(queued_sets& qs)
+    {
+        if (!qs.handles)
+            return;
+
+        stb__sbn(qs.handles) = 0;
+        stb__sbn(qs.v0) = 0;
+        stb__sbn(qs.v1) = 0;
+        stb__sbn(qs.rotations) = 0;
+    }
+
+    static void flush_queued_sets()
+    {
+        u32 num_transforms = sb_count(s_queued_transforms.handles);
+        if (num_transforms)
+        {
+            set_transforms(s_queued_transforms.handles, s_queued_transforms.v0, s_queued_transforms.rotations,
+                           num_transforms);
+            clear_queued_sets(s_queued_transforms);
+        }
+
+        u32 num_velocities = sb_count(s_queued_velocities.handles);
+        if (num_velocities)
+        {
+            set_velocities(s_queued_velocities.handles, s_queued_velocities.v0, s_queued_velocities.v1, num_velocities);
+            clear_queued_sets(s_queued_velocities);
+        }
+    }
+
+    // commands which target a handle with queued sets must execute after them to keep command order
+    static void flush_queued_sets(u32 handle)
+    {
+        if (is_queued(s_queued_transforms, handle) || is_queued(s_queued_velocities, handle))
+            flush_queued_sets();
+    }
+
+    // slots are reused as soon as they are released, so sets queued for a released body must never reach the next one
+    static void erase_queued_sets(u32 handle)
+    {
+        erase_queued_set(s_queued_transforms, handle);
+        erase_queued_set(s_queued_velocities, handle);
+    }
+
+    static u32 get_next_slot()
+    {
+        u32 slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        erase_queued_sets(slot);
+        return slot;
+    }
+
     // thread sync
     pen::job* p_physics_job_thread_info;
 
+    // fixed rate, written before the physics thread lets the user thread continue
+    static u32   s_fixed_tick_us = 0;
+    static a_u32 s_cmd_commit = {0}; // put position after the last frame of commands the user thread committed
+
     void physics_consume_command_buffer()
     {
+        flush_queued_sets();
+
+        // fixed rate physics picks up committed commands on its next tick, nothing waits
+        if (s_fixed_tick_us)
+        {
+            s_cmd_commit = (u32)s_cmd_buffer.put_pos;
+            return;
+        }
+
         pen::semaphore_post(p_physics_job_thread_info->p_sem_consume, 1);
         pen::semaphore_wait(p_physics_job_thread_info->p_sem_continue);
     }
 
+    // never overwrites commands which have not executed yet. when a burst fills the buffer, the queued commands are
+    // handed to the physics thread and this waits for space. in fixed rate mode the burst is split across ticks.
+    static void put_cmd(const physics_cmd& cmd)
+    {
+        while (!s_cmd_buffer.try_put(cmd))
+        {
+            if (s_fixed_tick_us)
+            {
+                s_cmd_commit = (u32)s_cmd_buffer.put_pos;
+            }
+            else
+            {
+                pen::semaphore_post(p_physics_job_thread_info->p_sem_consume, 1);
+                pen::semaphore_wait(p_physics_job_thread_info->p_sem_continue);
+            }
+
+            pen::thread_sleep_us(100);
+        }
+    }
+
     loop_t physics_thread_update()
     {
-        if (pen::semaphore_try_wait(p_physics_job_thread_info->p_sem_consume))
+        if (s_fixed_tick_us)
+        {
+            // whole frames of commands only, so a tick never sees half of the sets made in one update
+            u32 commit = s_cmd_commit;
+            // commands are released after they execute so put_cmd cannot write over one in use
+            while (s_cmd_buffer.get_pos != commit)
+            {
+                exec_cmd(*s_cmd_buffer.check());
+                s_cmd_buffer.get();
+            }
+
+            u32 wait_us = physics_fixed_update(s_fixed_tick_us);
+#if !PEN_SINGLE_THREADED
+            pen::thread_sleep_us(wait_us);
+#endif
+        }
+        else if (pen::semaphore_try_wait(p_physics_job_thread_info->p_sem_consume))
         {
             pen::semaphore_post(p_physics_job_thread_info->p_sem_continue, 1);
 
-            physics_cmd* cmd = s_cmd_buffer.get();
+            physics_cmd* cmd = s_cmd_buffer.check();
             while (cmd)
             {
                 exec_cmd(*cmd);
-                cmd = s_cmd_buffer.get();
+                s_cmd_buffer.get();
+                cmd = s_cmd_buffer.check();
             }
         }
 
@@ -216,17 +386,26 @@ namespace physics
     {
         pen::job_thread_params* job_params = (pen::job_thread_params*)params;
         pen::job*               p_thread_info = job_params->job_info;
-        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+        physics_thread_params thread_params;
+        if (job_params->user_data)
+            thread_params = *(physics_thread_params*)job_params->user_data;
+
+        if (thread_params.fixed_rate_hz)
+            s_fixed_tick_us = 1000000 / thread_params.fixed_rate_hz;
 
         p_physics_job_thread_info = p_thread_info;
 
         pen::slot_resources_init(&s_physics_slot_resources, 1024);
         pen::slot_resources_init(&s_p2p_slot_resources, 16);
 
-        physics_initialise();
+        physics_initialise(thread_params);
 
         s_cmd_buffer.create(1024);
 
+        // continue once the command buffer exists, so commands can be issued as soon as the job is created
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
         pen_main_loop(physics_thread_update);
         return PEN_THREAD_OK;
     }
@@ -238,6 +417,7 @@ namespace physics
         memcpy(&pc.set_v3.data, &v3, sizeof(vec3f));
         pc.set_v3.object_index = entity_index;
 
+        flush_queued_sets(entity_index);
         add_cmd(pc);
     }
 
@@ -248,43 +428,86 @@ namespace physics
         memcpy(&pc.set_float.data, &fval, sizeof(f32));
         pc.set_float.object_index = entity_index;
 
+        flush_queued_sets(entity_index);
         add_cmd(pc);
     }
 
-    void set_transform(const u32& entity_index, const vec3f& position, const quat& quaternion)
+    void set_transforms(const u32* handles, const vec3f* positions, const quat* rotations, u32 count)
     {
+        // handles first, so the physics thread frees the block through it
+        size_t hs = sizeof(u32) * count;
+        size_t ps = sizeof(vec3f) * count;
+        u8*    block = (u8*)pen::memory_alloc(hs + ps + sizeof(quat) * count);
+
         physics_cmd pc;
-        pc.command_index = e_cmd::set_transform;
-        memcpy(&pc.set_transform.position, &position, sizeof(vec3f));
-        memcpy(&pc.set_transform.rotation, &quaternion, sizeof(quat));
-        pc.set_transform.object_index = entity_index;
+        pc.command_index = e_cmd::set_transforms;
+        pc.set_transforms.handles = (u32*)block;
+        pc.set_transforms.positions = (vec3f*)(block + hs);
+        pc.set_transforms.rotations = (quat*)(block + hs + ps);
+        pc.set_transforms.count = count;
+
+        memcpy(pc.set_transforms.handles, handles, hs);
+        memcpy(pc.set_transforms.positions, positions, ps);
+        memcpy(pc.set_transforms.rotations, rotations, sizeof(quat) * count);
 
         add_cmd(pc);
     }
 
-    mat4 get_rb_matrix(const u32& entity_index)
+    void set_velocities(const u32* handles, const vec3f* linear, const vec3f* angular, u32 count)
     {
-        if (!g_readable_data.output_matrices._data[0])
-            return mat4::create_identity();
+        size_t hs = sizeof(u32) * count;
+        size_t vs = sizeof(vec3f) * count;
+        u8*    block = (u8*)pen::memory_alloc(hs + vs * 2);
+
+        physics_cmd pc;
+        pc.command_index = e_cmd::set_velocities;
+        pc.set_velocities.handles = (u32*)block;
+        pc.set_velocities.linear = (vec3f*)(block + hs);
+        pc.set_velocities.angular = (vec3f*)(block + hs + vs);
+        pc.set_velocities.count = count;
+
+        memcpy(pc.set_velocities.handles, handles, hs);
+        memcpy(pc.set_velocities.linear, linear, vs);
+        memcpy(pc.set_velocities.angular, angular, vs);
 
-        mat4* const& fb = g_readable_data.output_matrices.frontbuffer();
-        return fb[entity_index];
+        add_cmd(pc);
     }
 
-    maths::transform get_rb_transform(const u32& entity_index)
+    void queue_transform(u32 entity_index, const vec3f& position, const quat& quaternion)
     {
-        maths::transform* const& fb = g_readable_data.output_transforms.frontbuffer();
-        return fb[entity_index];
+        u32 s = get_queued_slot(s_queued_transforms, entity_index);
+        s_queued_transforms.v0[s] = position;
+        s_queued_transforms.rotations[s] = quaternion;
     }
 
-    bool has_rb_matrix(const u32& entity_index)
+    void queue_velocity(u32 entity_index, const vec3f& linear, const vec3f& angular)
     {
-        auto&        om = g_readable_data.output_matrices;
-        mat4* const& fb = om._data[om._fb];
-        if (entity_index >= sb_count(fb))
-            return false;
+        u32 s = get_queued_slot(s_queued_velocities, entity_index);
+        s_queued_velocities.v0[s] = linear;
+        s_queued_velocities.v1[s] = angular;
+    }
+
+    void set_transform(const u32& entity_index, const vec3f& position, const quat& quaternion)
+    {
+        physics_cmd pc;
+        pc.command_index = e_cmd::set_transform;
+        memcpy(&pc.set_transform.position, &position, sizeof(vec3f));
+        memcpy(&pc.set_transform.rotation, &quaternion, sizeof(quat));
+        pc.set_transform.object_index = entity_index;
 
-        return true;
+        flush_queued_sets(entity_index);
+        add_cmd(pc);
+    }
+
+    const rb_transforms& get_moved_rb_transforms()
+    {
+        return g_readable_data.moved_transforms.frontbuffer();
+    }
+
+    void acknowledge_rb_transforms(const rb_transforms& moved)
+    {
+        if (moved.step > g_readable_data.acknowledged_step)
+            g_readable_data.acknowledged_step = moved.step;
     }
 
     u32 add_rb(const rigid_body_params& rbp)
@@ -294,7 +517,7 @@ namespace physics
         pc.command_index = e_cmd::add_rigid_body;
         pc.add_rb = rbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         add_cmd(pc);
@@ -309,7 +532,7 @@ namespace physics
         pc.command_index = e_cmd::add_ghost_rigid_body;
         pc.add_rb = rbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         add_cmd(pc);
@@ -324,7 +547,7 @@ namespace physics
         pc.command_index = e_cmd::add_multi_body;
         pc.add_multi = mbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         add_cmd(pc);
@@ -337,6 +560,31 @@ namespace physics
         g_readable_data.b_paused = val;
     }
 
+    void set_solver_threads(u32 num_threads)
+    {
+        g_readable_data.requested_solver_threads = num_threads;
+    }
+
+    u32 get_solver_threads()
+    {
+        return g_readable_data.solver_threads;
+    }
+
+    f64 get_step_ms()
+    {
+        return (f64)g_readable_data.step_us / 1000.0;
+    }
+
+    shape_build_stats get_shape_build_stats()
+    {
+        shape_build_stats stats;
+        stats.num_cooked = g_readable_data.num_cooked_shapes;
+        stats.num_built = g_readable_data.num_built_shapes;
+        stats.cooked_ms = (f64)g_readable_data.cooked_shape_us / 1000.0;
+        stats.built_ms = (f64)g_readable_data.built_shape_us / 1000.0;
+        return stats;
+    }
+
     void set_multi_v3(const u32& object_index, const u32& link_index, const vec3f& v3_data, const u32& cmd)
     {
         physics_cmd pc;
@@ -347,6 +595,7 @@ namespace physics
         pc.set_multi_v3.multi_index = object_index;
         pc.set_multi_v3.link_index = link_index;
 
+        flush_queued_sets(object_index);
         add_cmd(pc);
     }
 
@@ -357,14 +606,14 @@ namespace physics
         pc.command_index = e_cmd::add_compound_rb;
         pc.add_compound_rb.params = crbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         pc.add_compound_rb.children_handles = nullptr;
         *child_handles_out = nullptr;
         for (u32 i = 0; i < crbp.num_shapes; ++i)
         {
-            u32 cs = pen::slot_resources_get_next(&s_physics_slot_resources);
+            u32 cs = get_next_slot();
             sb_push(pc.add_compound_rb.children_handles, cs);
             sb_push(*child_handles_out, cs);
         }
@@ -383,6 +632,8 @@ namespace physics
         pc.sync_compound.compound_index = compound_index;
         pc.sync_compound.multi_index = multi_index;
 
+        flush_queued_sets(compound_index);
+        flush_queued_sets(multi_index);
         add_cmd(pc);
     }
 
@@ -396,6 +647,8 @@ namespace physics
         pc.sync_rb.slave = slave;
         pc.sync_rb.link_index = link_index;
 
+        flush_queued_sets(master);
+        flush_queued_sets(slave);
         add_cmd(pc);
     }
 
@@ -406,7 +659,11 @@ namespace physics
         pc.command_index = e_cmd::add_constraint;
         pc.add_constraint_params = crbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        // constraints are built from the current body transforms
+        flush_queued_sets((u32)crbp.rb_indices[0]);
+        flush_queued_sets((u32)crbp.rb_indices[1]);
+
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         add_cmd(pc);
@@ -422,6 +679,7 @@ namespace physics
         pc.set_group.group = group;
         pc.set_group.mask = mask;
 
+        flush_queued_sets(object_index);
         add_cmd(pc);
     }
 
@@ -432,7 +690,7 @@ namespace physics
         pc.command_index = e_cmd::add_compound_shape;
         pc.add_compound_rb.params = crbp;
 
-        u32 resource_slot = pen::slot_resources_get_next(&s_physics_slot_resources);
+        u32 resource_slot = get_next_slot();
         pc.resource_slot = resource_slot;
 
         add_cmd(pc);
@@ -447,6 +705,8 @@ namespace physics
         pc.command_index = e_cmd::attach_rb_to_compound;
         pc.attach_compound = params;
 
+        flush_queued_sets(params.rb);
+        flush_queued_sets(params.compound);
         add_cmd(pc);
 
         return 0;
@@ -459,6 +719,7 @@ namespace physics
         pc.command_index = e_cmd::remove_from_world;
         pc.entity_index = entity_index;
 
+        flush_queued_sets(entity_index);
         add_cmd(pc);
     }
 
@@ -469,6 +730,7 @@ namespace physics
         pc.command_index = e_cmd::add_to_world;
         pc.entity_index = entity_index;
 
+        flush_queued_sets(entity_index);
         add_cmd(pc);
     }
 
@@ -477,6 +739,8 @@ namespace physics
         if (!pen::slot_resources_free(&s_physics_slot_resources, entity_index))
             return;
 
+        erase_queued_sets(entity_index);
+
         physics_cmd pc;
 
         pc.command_index = e_cmd::release_entity;
@@ -507,6 +771,16 @@ namespace physics
         add_cmd(pc);
     }
 
+    void cast_batch(batch_cast* batch)
+    {
+        batch->complete = 0;
+
+        physics_cmd pc;
+        pc.command_index = e_cmd::cast_batch;
+        pc.batch = batch;
+        add_cmd(pc);
+    }
+
     cast_result cast_ray_immediate(const ray_cast_params& rcp)
     {
         return cast_ray_internal(rcp);
@@ -527,6 +801,12 @@ namespace physics
 
     void step(f32 dt)
     {
+        // queued sets take effect in this step
+        flush_queued_sets();
+
+        if (s_fixed_tick_us)
+            return;
+
         physics_cmd pc;
         pc.command_index = e_cmd::step;
         pc.dt = dt;
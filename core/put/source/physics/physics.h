@@ -7,6 +7,13 @@
 
 namespace physics
 {
+    struct physics_thread_params
+    {
+        u32 solver_threads = 0; // 0 steps a single threaded world, otherwise the mt world runs on pen's workers
+        u32 fixed_rate_hz = 0;  // steps on the physics thread's own clock, 0 steps once per physics::step
+    };
+
+    // pass physics_thread_params as the job user data, or nullptr for the defaults
     void* physics_thread_main(void* params);
 
     namespace e_cmd
@@ -48,6 +55,9 @@ namespace physics
             add_central_force,
             add_central_impulse,
             contact_test,
+            cast_batch,
+            set_transforms,
+            set_velocities,
             step
         };
     }
@@ -121,6 +131,11 @@ namespace physics
         u32* indices;
         u32  num_floats;
         u32  num_indices;
+
+        // blob from cook_collision_mesh, used instead of the raw data when set. it must stay alive while shapes use it
+        // and is patched in place the first time a mesh shape is created from it, so only pass it to one world.
+        void* cooked = nullptr;
+        u32   cooked_size = 0;
     };
 
     struct rigid_body_params
@@ -246,6 +261,23 @@ namespace physics
         quat  rotation;
     };
 
+    // arrays are packed into one allocation starting at handles, the physics thread frees it once applied
+    struct set_transforms_params
+    {
+        u32*   handles;
+        vec3f* positions;
+        quat*  rotations;
+        u32    count;
+    };
+
+    struct set_velocities_params
+    {
+        u32*   handles;
+        vec3f* linear;
+        vec3f* angular;
+        u32    count;
+    };
+
     struct sync_compound_multi_params
     {
         u32 compound_index;
@@ -306,6 +338,44 @@ namespace physics
         void (*callback)(const cast_result& result) = nullptr;
     };
 
+    struct batch_cast
+    {
+        const ray_cast_params*    rays = nullptr; // either rays or spheres, their callbacks are not called
+        const sphere_cast_params* spheres = nullptr;
+        u32                       num_casts = 0;
+        cast_result*              results = nullptr; // num_casts results written by the physics thread
+        bool                      single_threaded = false; // runs on the physics thread only, for comparison
+        f64                       cast_ms = 0.0;           // physics thread time spent on the batch
+        a_u32                     complete = {0};          // set once the results are written
+    };
+
+    struct cook_stats
+    {
+        f64 build_ms = 0.0; // creating the shape from the raw data, as the physics thread would
+        f64 load_ms = 0.0;  // creating the shape from the cooked blob
+    };
+
+    struct shape_build_stats
+    {
+        u32 num_cooked;
+        u32 num_built;
+        f64 cooked_ms;
+        f64 built_ms;
+    };
+
+    struct rb_transforms
+    {
+        u32*   handles = nullptr; // compound children are included with their world transform
+        vec3f* positions = nullptr;
+        quat*  rotations = nullptr;
+        vec3f* prev_positions = nullptr; // pose one step earlier, equal to the current one when the body stopped
+        quat*  prev_rotations = nullptr;
+        u32    count = 0;
+        u32    step = 0;
+        f64    time_us = 0.0; // time the state represents on the pen::get_time_us clock, for fixed rate physics
+        u32    tick_us = 0;   // fixed tick length, 0 when physics steps once per physics::step
+    };
+
     struct contact
     {
         vec3f normal;
@@ -359,6 +429,9 @@ namespace physics
             ray_cast_params            ray_cast;
             sphere_cast_params         sphere_cast;
             contact_test_params        contact_test;
+            batch_cast*                batch;
+            set_transforms_params      set_transforms;
+            set_velocities_params      set_velocities;
             f32                        dt;
         };
 
@@ -369,6 +442,21 @@ namespace physics
     void set_paused(bool val);
     void physics_consume_command_buffer();
 
+    // threads used by the mt world, clamped to the workers plus the physics thread, applied on the next step.
+    // get returns the count in use, 0 when the single threaded world was created.
+    void set_solver_threads(u32 num_threads);
+    u32  get_solver_threads();
+    f64  get_step_ms(); // time spent in the last step
+
+    // mesh and hull shapes instantiated from cooked blobs and from raw data, totals since startup
+    shape_build_stats get_shape_build_stats();
+
+    // offline cooking for the asset pipeline, does not need the physics thread. mesh shapes store their quantised bvh,
+    // hulls are simplified and store faces with their planes. blob is allocated with pen::memory_alloc_align and must
+    // be loaded into 16 byte aligned memory at runtime.
+    bool cook_collision_mesh(const collision_mesh_data& mesh_data, shape_type shape, void** blob_out, u32* size_out,
+                             cook_stats* stats = nullptr);
+
     u32 add_rb(const rigid_body_params& rbp);
     u32 add_ghost_rb(const rigid_body_params& rbp);
     u32 add_constraint(const constraint_params& crbp);
@@ -385,25 +473,41 @@ namespace physics
     void cast_sphere(const sphere_cast_params& rcp);
     void contact_test(const contact_test_params& ctp);
 
+    // all casts in a batch run on the worker threads after the next step, against the same broadphase state.
+    // batch and its arrays must stay alive until complete is set, poll it from the user thread.
+    void cast_batch(batch_cast* batch);
+
     // these casts will give you the result immediately, but might not be thread safe, so far they seem ok though.
     // the contact test is not thread safe at all.
     cast_result cast_ray_immediate(const ray_cast_params& rcp);
     cast_result cast_sphere_immediate(const sphere_cast_params& scp);
 
-    void step(f32 dt);
+    void step(f32 dt); // ignored when the physics thread runs at a fixed rate
     void set_v3(const u32& entity_index, const vec3f& v3, u32 cmd);
     void set_float(const u32& entity_index, const f32& fval, u32 cmd);
     void set_transform(const u32& entity_index, const vec3f& position, const quat& quaternion);
+
+    // one command for count bodies, the arrays are copied
+    void set_transforms(const u32* handles, const vec3f* positions, const quat* rotations, u32 count);
+    void set_velocities(const u32* handles, const vec3f* linear, const vec3f* angular, u32 count);
+
+    // coalesced on the user thread so the last set to a body in a frame wins, sent as one set_transforms and one
+    // set_velocities before the next step. transforms are applied before velocities
+    void queue_transform(u32 entity_index, const vec3f& position, const quat& quaternion);
+    void queue_velocity(u32 entity_index, const vec3f& linear, const vec3f& angular);
     void set_multi_v3(const u32& entity_index, const u32& link_index, const vec3f& v3_data, const u32& cmd);
     void set_collision_group(const u32& entity_index, const u32& group, const u32& mask);
 
     void sync_compound_multi(const u32& compound_index, const u32& multi_index);
     void sync_rigid_bodies(const u32& master, const u32& slave, const s32& link_index, u32 cmd);
 
-    bool             has_rb_matrix(const u32& entity_index);
-    mat4             get_rb_matrix(const u32& entity_index);
-    maths::transform get_rb_transform(const u32& entity_index);
-    void             release_entity(const u32& entity_index);
+    // bodies which moved since the last acknowledged step, each once with its latest transform. apply them and then
+    // acknowledge, sleeping bodies are not published again until they are woken. the result stays valid while physics
+    // keeps stepping, until the next call. call from a single thread.
+    const rb_transforms& get_moved_rb_transforms();
+    void                 acknowledge_rb_transforms(const rb_transforms& moved);
+
+    void release_entity(const u32& entity_index);
 
 } // namespace physics
 #endif
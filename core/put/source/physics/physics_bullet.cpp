@@ -43,6 +43,7 @@ namespace physics
     readable_data                 g_readable_data;
     static bullet_systems         s_bullet_systems;
     pen::res_pool<physics_entity> s_entities;
+    static batch_cast**           s_cast_batches = nullptr; // executed after the next step
 
     btTransform get_bttransform(const vec3f& p, const quat& q)
     {
@@ -70,6 +71,186 @@ namespace physics
         return trans;
     }
 
+    namespace
+    {
+        // cooked collision blobs, each section is 16 byte aligned from the start of the blob
+        const u32 k_cooked_magic = 0x6b6f6f63; // "cook"
+        const u32 k_cooked_version = 1;
+        const u32 k_cooked_align = 16;
+
+        struct cooked_header
+        {
+            u32 magic;
+            u32 version;
+            u32 shape;
+            u32 num_vertices; // f32 x 3
+            u32 num_indices;  // triangle indices for meshes, face indices for hulls
+            u32 num_faces;
+            u32 vertices_offset;
+            u32 indices_offset;
+            u32 faces_offset;
+            u32 bvh_offset;
+            u32 bvh_size;
+            u32 pad;
+            f32 aabb_min[4];
+            f32 aabb_max[4];
+        };
+        static_assert(sizeof(cooked_header) % k_cooked_align == 0, "cooked sections must stay aligned");
+        static_assert(sizeof(btScalar) == sizeof(f32), "cooked vertices are f32");
+
+        struct cooked_face
+        {
+            u32 first_index;
+            u32 num_indices;
+            f32 plane[4];
+        };
+
+        struct cooked_bvh
+        {
+            const void*     blob;
+            btOptimizedBvh* bvh;
+        };
+        cooked_bvh* s_cooked_bvhs = nullptr; // bvhs are deserialized in place so only once per blob
+
+        u32 cooked_align(u32 offset)
+        {
+            return (offset + k_cooked_align - 1) & ~(k_cooked_align - 1);
+        }
+
+        // hull with the polyhedron read from the blob, initializePolyhedralFeatures would rebuild it from the points
+        class cooked_hull_shape : public btConvexHullShape
+        {
+          public:
+            cooked_hull_shape(const f32* points, u32 num_points, const cooked_face* faces, u32 num_faces, const u32* indices)
+                : btConvexHullShape(points, num_points, sizeof(f32) * 3)
+            {
+                void* mem = btAlignedAlloc(sizeof(btConvexPolyhedron), 16);
+                m_polyhedron = new (mem) btConvexPolyhedron;
+
+                m_polyhedron->m_vertices.resize(num_points);
+                for (u32 i = 0; i < num_points; ++i)
+                    m_polyhedron->m_vertices[i] = btVector3(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+
+                m_polyhedron->m_faces.resize(num_faces);
+                for (u32 f = 0; f < num_faces; ++f)
+                {
+                    btFace& face = m_polyhedron->m_faces[f];
+                    face.m_indices.resize(faces[f].num_indices);
+                    for (u32 i = 0; i < faces[f].num_indices; ++i)
+                        face.m_indices[i] = indices[faces[f].first_index + i];
+
+                    for (u32 i = 0; i < 4; ++i)
+                        face.m_plane[i] = faces[f].plane[i];
+                }
+
+                m_polyhedron->initialize();
+            }
+        };
+
+        btCollisionShape* build_mesh_shape(const collision_mesh_data& mesh_data, u32 shape)
+        {
+            if (shape == e_shape::hull)
+                return new btConvexHullShape(mesh_data.vertices, mesh_data.num_floats / 3, 12);
+
+            u32 num_tris = mesh_data.num_indices / 3;
+
+            btTriangleIndexVertexArray* mesh =
+                new btTriangleIndexVertexArray(num_tris, (s32*)mesh_data.indices, sizeof(u32) * 3, mesh_data.num_floats / 3,
+                                               mesh_data.vertices, sizeof(f32) * 3);
+
+            return new btBvhTriangleMeshShape(mesh, true);
+        }
+
+        // bvh is deserialized from the blob when null, which modifies the blob
+        btCollisionShape* load_cooked_shape(u8* blob, u32 size, u32 shape, btOptimizedBvh** bvh)
+        {
+            cooked_header* header = (cooked_header*)blob;
+            if (size < sizeof(cooked_header) || header->magic != k_cooked_magic || header->version != k_cooked_version ||
+                header->shape != shape)
+                return nullptr;
+
+            PEN_ASSERT(((uintptr_t)blob & (k_cooked_align - 1)) == 0);
+
+            const f32* vertices = (const f32*)(blob + header->vertices_offset);
+            u32*       indices = (u32*)(blob + header->indices_offset);
+
+            if (shape == e_shape::hull)
+            {
+                const cooked_face* faces = (const cooked_face*)(blob + header->faces_offset);
+                return new cooked_hull_shape(vertices, header->num_vertices, faces, header->num_faces, indices);
+            }
+
+            if (!*bvh)
+                *bvh = (btOptimizedBvh*)btOptimizedBvh::deSerializeInPlace(blob + header->bvh_offset, header->bvh_size, false);
+
+            btTriangleIndexVertexArray* mesh =
+                new btTriangleIndexVertexArray(header->num_indices / 3, (s32*)indices, sizeof(u32) * 3, header->num_vertices,
+                                               (btScalar*)vertices, sizeof(f32) * 3);
+
+            mesh->setPremadeAabb(btVector3(header->aabb_min[0], header->aabb_min[1], header->aabb_min[2]),
+                                 btVector3(header->aabb_max[0], header->aabb_max[1], header->aabb_max[2]));
+
+            btBvhTriangleMeshShape* concave_mesh = new btBvhTriangleMeshShape(mesh, true, false);
+            concave_mesh->setOptimizedBvh(*bvh);
+            return concave_mesh;
+        }
+
+        void delete_mesh_shape(btCollisionShape* shape)
+        {
+            if (shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE)
+            {
+                btStridingMeshInterface* mesh = ((btBvhTriangleMeshShape*)shape)->getMeshInterface();
+                delete shape;
+                delete mesh;
+                return;
+            }
+
+            delete shape;
+        }
+
+        btCollisionShape* create_mesh_shape(const rigid_body_params& params)
+        {
+            f64 start = pen::get_time_us();
+
+            btCollisionShape* shape = nullptr;
+            if (params.mesh_data.cooked)
+            {
+                btOptimizedBvh** bvh = nullptr;
+                u32              num_bvhs = sb_count(s_cooked_bvhs);
+                for (u32 i = 0; i < num_bvhs; ++i)
+                    if (s_cooked_bvhs[i].blob == params.mesh_data.cooked)
+                        bvh = &s_cooked_bvhs[i].bvh;
+
+                if (!bvh)
+                {
+                    cooked_bvh cb = {params.mesh_data.cooked, nullptr};
+                    sb_push(s_cooked_bvhs, cb);
+                    bvh = &s_cooked_bvhs[num_bvhs].bvh;
+                }
+
+                shape = load_cooked_shape((u8*)params.mesh_data.cooked, params.mesh_data.cooked_size, params.shape, bvh);
+
+                if (shape)
+                {
+                    g_readable_data.num_cooked_shapes++;
+                    g_readable_data.cooked_shape_us += (u64)(pen::get_time_us() - start);
+                    return shape;
+                }
+
+                PEN_LOG("[physics] invalid cooked collision data, building the shape from mesh data\n");
+            }
+
+            if (!params.mesh_data.vertices)
+                return nullptr;
+
+            shape = build_mesh_shape(params.mesh_data, params.shape);
+
+            g_readable_data.num_built_shapes++;
+            g_readable_data.built_shape_us += (u64)(pen::get_time_us() - start);
+            return shape;
+        }
+    } // namespace
+
     btCollisionShape* create_collision_shape(physics_entity& entity, const rigid_body_params& params,
                                              const compound_rb_params* p_compound = NULL)
     {
@@ -127,20 +308,9 @@ namespace physics
                 }
                 break;
             case physics::e_shape::hull:
-                shape = new btConvexHullShape(params.mesh_data.vertices, params.mesh_data.num_floats / 3, 12);
-                break;
             case physics::e_shape::mesh:
-            {
-                u32 num_tris = params.mesh_data.num_indices / 3;
-
-                btTriangleIndexVertexArray* mesh = new btTriangleIndexVertexArray(
-                    num_tris, (s32*)params.mesh_data.indices, sizeof(u32) * 3, params.mesh_data.num_floats / 3,
-                    params.mesh_data.vertices, sizeof(f32) * 3);
-
-                btBvhTriangleMeshShape* concave_mesh = new btBvhTriangleMeshShape(mesh, true);
-                shape = concave_mesh;
-            }
-            break;
+                shape = create_mesh_shape(params);
+                break;
             case physics::e_shape::compound:
             {
                 if (p_compound)
@@ -216,21 +386,22 @@ namespace physics
         }
 
         // using motion state is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-        btDefaultMotionState* motion_state = new btDefaultMotionState(shape_transform);
+        sync_motion_state* motion_state = new sync_motion_state(shape_transform);
         entity.default_motion_state = motion_state;
 
         btRigidBody::btRigidBodyConstructionInfo rb_info(mass, motion_state, shape, local_inertia);
 
         btRigidBody* body = new btRigidBody(rb_info);
 
+        body->setContactProcessingThreshold(BT_LARGE_FLOAT);
+
+        // kinematic bodies are driven by set_transform and stay awake, dynamic ones may sleep and stop publishing
         if (params.create_flags & e_create_flags::kinematic)
         {
             body->setCollisionFlags(btCollisionObject::CF_KINEMATIC_OBJECT);
+            body->setActivationState(DISABLE_DEACTIVATION);
         }
 
-        body->setContactProcessingThreshold(BT_LARGE_FLOAT);
-        body->setActivationState(DISABLE_DEACTIVATION);
-
         if (!ghost)
         {
             s_bullet_systems.dynamics_world->addRigidBody(body, params.group, params.mask);
@@ -239,22 +410,310 @@ namespace physics
         return body;
     }
 
-    void physics_initialise()
+    namespace
     {
-        s_entities.init(1024);
+        // btAxisSweep3 keeps a dbvt to accelerate ray tests but traverses it with one shared stack, batched casts
+        // walk the same trees from the worker threads with a stack each
+        class axis_sweep_broadphase : public btAxisSweep3
+        {
+          public:
+            axis_sweep_broadphase(const btVector3& world_min, const btVector3& world_max) : btAxisSweep3(world_min, world_max)
+            {
+            }
+
+            btDbvtBroadphase* get_raycast_accelerator()
+            {
+                return m_raycastAccelerator;
+            }
+        };
+
+        struct parallel_for_body
+        {
+            const btIParallelForBody* body;
+            int                       begin;
+        };
+
+        void run_parallel_for_body(void* user_data, u32 begin, u32 end)
+        {
+            parallel_for_body* pfb = (parallel_for_body*)user_data;
+            pfb->body->forLoop(pfb->begin + (int)begin, pfb->begin + (int)end);
+        }
+
+        // runs bullet's parallel loops on pen's workers, the physics thread takes batches too. the range is split into
+        // at most one batch per thread so no more than num_threads work on a loop at once
+        class pen_task_scheduler : public btITaskScheduler
+        {
+          public:
+            pen_task_scheduler() : btITaskScheduler("pen_jobs")
+            {
+            }
+
+            int getMaxNumThreads() const override
+            {
+                return (int)std::min<u32>(pen::jobs_get_num_workers() + 1, BT_MAX_THREAD_COUNT);
+            }
+
+            int getNumThreads() const override
+            {
+                return m_num_threads;
+            }
+
+            void setNumThreads(int num_threads) override
+            {
+                m_num_threads = std::max<int>(1, std::min<int>(num_threads, getMaxNumThreads()));
+            }
+
+            void parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body) override
+            {
+                int count = end - begin;
+                if (m_num_threads <= 1 || count <= grain_size)
+                {
+                    body.forLoop(begin, end);
+                    return;
+                }
+
+                u32 batch_size = (u32)std::max<int>(grain_size, (count + m_num_threads - 1) / m_num_threads);
+
+                parallel_for_body pfb = {&body, begin};
+                pen::jobs_parallel_for((u32)count, batch_size, run_parallel_for_body, &pfb);
+            }
+
+          private:
+            int m_num_threads = 1;
+        };
+        pen_task_scheduler* s_task_scheduler = nullptr;
+
+        struct batch_cast_tester : btDbvt::ICollide
+        {
+            btCollisionWorld::RayResultCallback*    ray_result = nullptr;
+            btCollisionWorld::ConvexResultCallback* convex_result = nullptr;
+            const btConvexShape*                    shape = nullptr;
+            btTransform                             from;
+            btTransform                             to;
+
+            void Process(const btDbvtNode* leaf)
+            {
+                btBroadphaseProxy* proxy = (btBroadphaseProxy*)leaf->data;
+                btCollisionObject* obj = (btCollisionObject*)proxy->m_clientObject;
+
+                if (ray_result)
+                {
+                    if (ray_result->needsCollision(obj->getBroadphaseHandle()))
+                        btCollisionWorld::rayTestSingle(from, to, obj, obj->getCollisionShape(), obj->getWorldTransform(),
+                                                        *ray_result);
+                }
+                else if (convex_result->needsCollision(obj->getBroadphaseHandle()))
+                {
+                    btCollisionWorld::objectQuerySingle(shape, from, to, obj, obj->getCollisionShape(),
+                                                        obj->getWorldTransform(), *convex_result, 0.0f);
+                }
+            }
+        };
+
+        struct batch_cast_job
+        {
+            batch_cast*       batch;
+            btDbvtBroadphase* broadphase;
+        };
+
+        void traverse_broadphase(btDbvtBroadphase* broadphase, const btVector3& from, const btVector3& to,
+                                 const btVector3& aabb_min, const btVector3& aabb_max,
+                                 btAlignedObjectArray<const btDbvtNode*>& stack, batch_cast_tester& tester)
+        {
+            btVector3 dir = to - from;
+            btScalar  lambda_max = dir.length();
+            dir /= lambda_max;
+
+            btVector3 inv;
+            u32       signs[3];
+            for (u32 i = 0; i < 3; ++i)
+            {
+                inv[i] = dir[i] == 0.0f ? BT_LARGE_FLOAT : 1.0f / dir[i];
+                signs[i] = inv[i] < 0.0f;
+            }
+
+            // dynamic and static sets
+            for (u32 s = 0; s < 2; ++s)
+            {
+                btDbvt& set = broadphase->m_sets[s];
+                set.rayTestInternal(set.m_root, from, to, inv, signs, lambda_max, aabb_min, aabb_max, stack, tester);
+            }
+        }
+
+        void cast_batch_range(void* user_data, u32 begin, u32 end)
+        {
+            batch_cast_job* job = (batch_cast_job*)user_data;
+            batch_cast*     batch = job->batch;
+
+            btAlignedObjectArray<const btDbvtNode*> stack;
+            stack.reserve(128);
+
+            for (u32 i = begin; i < end; ++i)
+            {
+                cast_result& cr = batch->results[i];
+                cr = cast_result();
+                cr.physics_handle = -1;
+
+                batch_cast_tester tester;
+                if (batch->rays)
+                {
+                    const ray_cast_params& rcp = batch->rays[i];
+                    cr.user_data = rcp.user_data;
+
+                    btVector3 from = from_vec3(rcp.start);
+                    btVector3 to = from_vec3(rcp.end);
+                    if ((to - from).length2() < 0.0001f * 0.0001f)
+                        continue;
+
+                    btCollisionWorld::ClosestRayResultCallback ray_callback(from, to);
+                    ray_callback.m_collisionFilterMask = rcp.mask;
+                    ray_callback.m_collisionFilterGroup = rcp.group;
+
+                    tester.ray_result = &ray_callback;
+                    tester.from.setIdentity();
+                    tester.from.setOrigin(from);
+                    tester.to.setIdentity();
+                    tester.to.setOrigin(to);
+                    traverse_broadphase(job->broadphase, from, to, btVector3(0, 0, 0), btVector3(0, 0, 0), stack, tester);
+
+                    if (ray_callback.hasHit())
+                    {
+                        cr.point = from_btvector(ray_callback.m_hitPointWorld);
+                        cr.normal = from_btvector(ray_callback.m_hitNormalWorld);
+
+                        const btRigidBody* body = btRigidBody::upcast(ray_callback.m_collisionObject);
+                        if (body)
+                        {
+                            cr.physics_handle = body->getUserIndex();
+                            cr.set = true;
+                        }
+                    }
+                }
+                else
+                {
+                    const sphere_cast_params& scp = batch->spheres[i];
+                    cr.user_data = scp.user_data;
+
+                    btVector3 from = from_vec3(scp.from);
+                    btVector3 to = from_vec3(scp.to);
+                    if ((to - from).length2() < 0.0001f * 0.0001f)
+                        continue;
+
+                    btSphereShape shape = btSphereShape(btScalar(scp.dimension.x));
+
+                    btCollisionWorld::ClosestConvexResultCallback cast_callback(from, to);
+                    cast_callback.m_collisionFilterMask = scp.mask;
+                    cast_callback.m_collisionFilterGroup = scp.group;
+
+                    tester.convex_result = &cast_callback;
+                    tester.shape = &shape;
+                    tester.from = get_bttransform(scp.from, quat());
+                    tester.to = get_bttransform(scp.to, quat());
+
+                    // nodes are expanded by the sphere to find everything the sweep can touch
+                    btVector3 extent = btVector3(scp.dimension.x, scp.dimension.x, scp.dimension.x);
+                    traverse_broadphase(job->broadphase, from, to, -extent, extent, stack, tester);
+
+                    if (cast_callback.hasHit())
+                    {
+                        const btRigidBody* body = btRigidBody::upcast(cast_callback.m_hitCollisionObject);
+                        if (body)
+                        {
+                            cr.physics_handle = body->getUserIndex();
+                            cr.set = true;
+                        }
+
+                        cr.point = from_btvector(cast_callback.m_hitPointWorld);
+                        cr.normal = from_btvector(cast_callback.m_hitNormalWorld);
+                    }
+                }
+            }
+        }
+
+        void execute_cast_batches()
+        {
+            static const u32 k_casts_per_job = 256;
+
+            axis_sweep_broadphase* axis_sweep = (axis_sweep_broadphase*)s_bullet_systems.olp_cache;
+            btDbvtBroadphase*      broadphase = axis_sweep->get_raycast_accelerator();
+
+            u32 num_batches = sb_count(s_cast_batches);
+            for (u32 b = 0; b < num_batches; ++b)
+            {
+                batch_cast* batch = s_cast_batches[b];
+                f64         start = pen::get_time_us();
+
+                if (broadphase)
+                {
+                    batch_cast_job job = {batch, broadphase};
+                    if (batch->single_threaded)
+                        cast_batch_range(&job, 0, batch->num_casts);
+                    else
+                        pen::jobs_parallel_for(batch->num_casts, k_casts_per_job, &cast_batch_range, &job);
+                }
+                else
+                {
+                    // no accelerator to walk, fall back to the world queries one at a time
+                    for (u32 i = 0; i < batch->num_casts; ++i)
+                    {
+                        if (batch->rays)
+                        {
+                            ray_cast_params rcp = batch->rays[i];
+                            rcp.callback = nullptr;
+                            batch->results[i] = cast_ray_internal(rcp);
+                        }
+                        else
+                        {
+                            sphere_cast_params scp = batch->spheres[i];
+                            scp.callback = nullptr;
+                            batch->results[i] = cast_sphere_internal(scp);
+                        }
+                    }
+                }
+
+                batch->cast_ms = (pen::get_time_us() - start) / 1000.0;
+                batch->complete = 1;
+            }
+
+            if (s_cast_batches)
+                stb__sbn(s_cast_batches) = 0;
+        }
+    } // namespace
 
-        g_readable_data.output_matrices._data[0] = nullptr;
-        g_readable_data.output_matrices._data[1] = nullptr;
-        g_readable_data.output_transforms._data[0] = nullptr;
-        g_readable_data.output_transforms._data[1] = nullptr;
+    void physics_initialise(const physics_thread_params& params)
+    {
+        s_entities.init(1024);
 
         s_bullet_systems.collision_config = new btDefaultCollisionConfiguration();
-        s_bullet_systems.dispatcher = new btCollisionDispatcher(s_bullet_systems.collision_config);
-        s_bullet_systems.olp_cache = new btAxisSweep3(btVector3(-50.0f, -50.0f, -50.0f), btVector3(50.0f, 50.0f, 50.0f));
-        s_bullet_systems.solver = new btSequentialImpulseConstraintSolver;
-        s_bullet_systems.dynamics_world =
-            new btDiscreteDynamicsWorld(s_bullet_systems.dispatcher, s_bullet_systems.olp_cache, s_bullet_systems.solver,
-                                        s_bullet_systems.collision_config);
+        s_bullet_systems.olp_cache =
+            new axis_sweep_broadphase(btVector3(-50.0f, -50.0f, -50.0f), btVector3(50.0f, 50.0f, 50.0f));
+
+        if (params.solver_threads)
+        {
+            // the scheduler must be set before any of the mt classes are created
+            s_task_scheduler = new pen_task_scheduler();
+            btSetTaskScheduler(s_task_scheduler);
+            s_task_scheduler->setNumThreads(params.solver_threads);
+
+            g_readable_data.requested_solver_threads = s_task_scheduler->getNumThreads();
+            g_readable_data.solver_threads = s_task_scheduler->getNumThreads();
+
+            // a solver per thread which can run, islands are solved in parallel
+            btConstraintSolverPoolMt* solver_pool = new btConstraintSolverPoolMt(s_task_scheduler->getMaxNumThreads());
+
+            s_bullet_systems.dispatcher = new btCollisionDispatcherMt(s_bullet_systems.collision_config);
+            s_bullet_systems.solver = solver_pool;
+            s_bullet_systems.dynamics_world = new btDiscreteDynamicsWorldMt(
+                s_bullet_systems.dispatcher, s_bullet_systems.olp_cache, solver_pool, s_bullet_systems.collision_config);
+        }
+        else
+        {
+            s_bullet_systems.dispatcher = new btCollisionDispatcher(s_bullet_systems.collision_config);
+            s_bullet_systems.solver = new btSequentialImpulseConstraintSolver;
+            s_bullet_systems.dynamics_world =
+                new btDiscreteDynamicsWorld(s_bullet_systems.dispatcher, s_bullet_systems.olp_cache,
+                                            s_bullet_systems.solver, s_bullet_systems.collision_config);
+        }
 
         s_bullet_systems.dynamics_world->setGravity(btVector3(0, -10, 0));
     }
@@ -277,113 +736,225 @@ namespace physics
         }
     }
 
-    void update_output_matrices()
+    namespace
     {
-        mat4*&             bb_mats = g_readable_data.output_matrices.backbuffer();
-        maths::transform*& bb_transforms = g_readable_data.output_transforms.backbuffer();
+        // handles moved since the step the user thread last acknowledged, each appears once. a body is published once
+        // more after it stops moving so an interpolating reader settles on its final pose
+        struct moved_bodies
+        {
+            u32*   pending = nullptr;
+            u32*   moved_step = nullptr;     // per handle, the last step the body moved in, 0 for never
+            u32*   published_step = nullptr; // per handle, the last step last_pos and last_rot were written
+            vec3f* last_pos = nullptr;
+            quat*  last_rot = nullptr;
+            u32    step = 1;
+            u32    acknowledged = 0;
+        };
+        moved_bodies s_moved;
+
+        // fixed rate stepping on the physics thread's own clock
+        struct fixed_clock
+        {
+            f64 sim_time_us = 0.0; // time of the last state, in the pen::get_time_us timeline
+            u32 tick_us = 0;
+        };
+        fixed_clock s_fixed;
 
-        u32 num = sb_count(bb_mats);
+        const u32 k_max_fixed_steps = 4; // steps per update before dropping time when a step is slower than a tick
 
-        for (u32 i = 0; i < s_entities._capacity; i++)
+        void grow_moved_handles(u32 handle)
         {
-            if (i >= num)
+            while (sb_count(s_moved.moved_step) <= handle)
             {
-                ++num;
-                sb_push(bb_mats, mat4::create_identity());
-                sb_push(bb_transforms, maths::transform());
+                sb_push(s_moved.moved_step, 0);
+                sb_push(s_moved.published_step, 0);
+                sb_push(s_moved.last_pos, vec3f::zero());
+                sb_push(s_moved.last_rot, quat());
             }
+        }
 
-            physics_entity& entity = s_entities.get(i);
+        bool is_pending(u32 handle)
+        {
+            u32 ms = s_moved.moved_step[handle];
+            return ms && ms >= s_moved.acknowledged;
+        }
+
+        void mark_moved(u32 handle)
+        {
+            if (!is_valid(handle))
+                return;
 
-            switch (entity.type)
+            grow_moved_handles(handle);
+
+            if (!is_pending(handle))
+                sb_push(s_moved.pending, handle);
+
+            s_moved.moved_step[handle] = s_moved.step;
+        }
+
+        void drop_acknowledged_bodies()
+        {
+            s_moved.acknowledged = g_readable_data.acknowledged_step;
+
+            u32 num = sb_count(s_moved.pending);
+            u32 keep = 0;
+            for (u32 i = 0; i < num; ++i)
             {
-                case ENTITY_RIGID_BODY:
-                {
-                    btRigidBody* p_rb = entity.rb.rigid_body;
-                    if (!p_rb)
-                        continue;
+                u32 h = s_moved.pending[i];
+                if (is_pending(h))
+                    s_moved.pending[keep++] = h;
+            }
 
-                    btTransform rb_transform = p_rb->getWorldTransform();
+            if (s_moved.pending)
+                stb__sbn(s_moved.pending) = keep;
+        }
 
-                    btScalar _mm[16];
+        void push_moved_transform(rb_transforms& out, u32 handle, const btTransform& trans, bool moved)
+        {
+            grow_moved_handles(handle);
 
-                    rb_transform.getOpenGLMatrix(_mm);
+            vec3f pos = from_btvector(trans.getOrigin());
+            quat  rot = from_btquat(trans.getRotation());
 
-                    for (s32 m = 0; m < 16; ++m)
-                        bb_mats[i].m[m] = _mm[m];
+            // previous pose is the one published last step, a body which did not move this step holds still
+            bool has_prev = moved && s_moved.published_step[handle] == s_moved.step - 1;
 
-                    bb_mats[i].transpose();
-                    bb_transforms[i] = from_bttransform(rb_transform);
-                }
-                break;
+            sb_push(out.handles, handle);
+            sb_push(out.positions, pos);
+            sb_push(out.rotations, rot);
+            sb_push(out.prev_positions, has_prev ? s_moved.last_pos[handle] : pos);
+            sb_push(out.prev_rotations, has_prev ? s_moved.last_rot[handle] : rot);
 
-                case ENTITY_COMPOUND_RIGID_BODY:
-                {
-                    btCompoundShape* p_compound = entity.compound_shape;
-                    btRigidBody*     p_rb = entity.rb.rigid_body;
+            s_moved.published_step[handle] = s_moved.step;
+            s_moved.last_pos[handle] = pos;
+            s_moved.last_rot[handle] = rot;
+        }
 
-                    btTransform rb_transform = p_rb->getWorldTransform();
+        void publish_moved_transforms()
+        {
+            rb_transforms& bb = g_readable_data.moved_transforms.backbuffer();
 
-                    btScalar _mm[16];
+            if (bb.handles)
+            {
+                stb__sbn(bb.handles) = 0;
+                stb__sbn(bb.positions) = 0;
+                stb__sbn(bb.rotations) = 0;
+                stb__sbn(bb.prev_positions) = 0;
+                stb__sbn(bb.prev_rotations) = 0;
+            }
 
-                    rb_transform.getOpenGLMatrix(_mm);
+            u32 num = sb_count(s_moved.pending);
+            for (u32 i = 0; i < num; ++i)
+            {
+                u32 h = s_moved.pending[i];
+                if (h >= s_entities._capacity)
+                    continue;
 
-                    for (s32 m = 0; m < 16; ++m)
-                        bb_mats[i].m[m] = _mm[m];
+                physics_entity& entity = s_entities.get(h);
+                if (entity.type != ENTITY_RIGID_BODY && entity.type != ENTITY_COMPOUND_RIGID_BODY)
+                    continue;
 
-                    bb_mats[i].transpose();
+                btRigidBody* p_rb = entity.rb.rigid_body;
+                if (!p_rb)
+                    continue;
 
-                    if (p_compound)
-                    {
-                        u32 num_shapes = p_compound->getNumChildShapes();
-                        for (u32 j = 0; j < num_shapes; ++j)
-                        {
-                            if (p_rb)
-                            {
-                                btTransform       base = p_rb->getWorldTransform();
-                                btTransform       child = p_compound->getChildTransform(j);
-                                btCollisionShape* shape = p_compound->getChildShape(j);
-                                u32               ph = shape->getUserIndex();
+                // kinematic bodies only pick up set_transform in the motion state during a step
+                btTransform rb_transform = p_rb->getWorldTransform();
+                if (p_rb->isKinematicObject())
+                    entity.default_motion_state->getWorldTransform(rb_transform);
 
-                                if (!is_valid(ph))
-                                    continue;
+                bool moved = s_moved.moved_step[h] == s_moved.step;
+                push_moved_transform(bb, h, rb_transform, moved);
 
-                                btTransform child_world = base * child;
+                btCompoundShape* p_compound = entity.compound_shape;
+                if (entity.type != ENTITY_COMPOUND_RIGID_BODY || !p_compound)
+                    continue;
 
-                                btScalar _mm[16];
+                u32 num_shapes = p_compound->getNumChildShapes();
+                for (u32 j = 0; j < num_shapes; ++j)
+                {
+                    u32 ph = p_compound->getChildShape(j)->getUserIndex();
+                    if (!is_valid(ph))
+                        continue;
 
-                                child_world.getOpenGLMatrix(_mm);
+                    push_moved_transform(bb, ph, rb_transform * p_compound->getChildTransform(j), moved);
+                }
+            }
 
-                                for (s32 m = 0; m < 16; ++m)
-                                    bb_mats[ph].m[m] = _mm[m];
+            bb.count = sb_count(bb.handles);
+            bb.step = s_moved.step++;
+            bb.time_us = s_fixed.sim_time_us;
+            bb.tick_us = s_fixed.tick_us;
 
-                                bb_mats[ph].transpose();
-                                bb_transforms[ph] = from_bttransform(child_world);
-                            }
-                        }
-                    }
+            g_readable_data.moved_transforms.swap_buffers();
+        }
+
+        void step_world(f32 dt, s32 max_sub_steps, f32 fixed_time_step)
+        {
+            drop_acknowledged_bodies();
+
+            if (s_task_scheduler)
+            {
+                u32 requested = g_readable_data.requested_solver_threads;
+                if (requested != (u32)s_task_scheduler->getNumThreads())
+                {
+                    s_task_scheduler->setNumThreads(requested);
+                    g_readable_data.solver_threads = s_task_scheduler->getNumThreads();
                 }
-                break;
+            }
 
-                default:
-                    break;
+            // step, bullet only synchronises the motion states of active bodies
+            if (!g_readable_data.b_paused)
+            {
+                f64 start = pen::get_time_us();
+                s_bullet_systems.dynamics_world->stepSimulation(dt, max_sub_steps, fixed_time_step);
+                g_readable_data.step_us = (u64)(pen::get_time_us() - start);
             }
+
+            // publish bodies which moved
+            publish_moved_transforms();
+
+            // batched casts see the world after the step
+            execute_cast_batches();
         }
+    } // namespace
 
-        g_readable_data.output_matrices.swap_buffers();
-        g_readable_data.output_transforms.swap_buffers();
+    void sync_motion_state::setWorldTransform(const btTransform& world_trans)
+    {
+        btDefaultMotionState::setWorldTransform(world_trans);
+        mark_moved(handle);
     }
 
     void physics_update(f32 dt)
     {
-        // step
-        if (!g_readable_data.b_paused)
+        step_world(dt, 1, 1.0f / 60.0f);
+    }
+
+    u32 physics_fixed_update(u32 tick_us)
+    {
+        f64 now = pen::get_time_us();
+
+        if (s_fixed.tick_us != tick_us)
         {
-            s_bullet_systems.dynamics_world->stepSimulation(dt);
+            s_fixed.tick_us = tick_us;
+            s_fixed.sim_time_us = now;
+        }
+
+        // one bullet step per tick, so the world advances exactly as far as the clock
+        f32 tick = (f32)tick_us / 1000000.0f;
+        for (u32 i = 0; s_fixed.sim_time_us + tick_us <= now; ++i)
+        {
+            if (i == k_max_fixed_steps)
+            {
+                s_fixed.sim_time_us = now;
+                break;
+            }
+
+            s_fixed.sim_time_us += tick_us;
+            step_world(tick, 1, tick);
         }
 
-        // update mats
-        update_output_matrices();
+        return (u32)(s_fixed.sim_time_us + tick_us - now);
     }
 
     void add_rb_internal(const rigid_body_params& params, u32 resource_slot, bool ghost)
@@ -395,6 +966,9 @@ namespace physics
         btRigidBody* rb = create_rb_internal(entity, params, ghost);
         rb->setUserIndex(resource_slot);
 
+        entity.default_motion_state->handle = resource_slot;
+        mark_moved(resource_slot);
+
         entity.rb.rigid_body = rb;
         entity.rb.rigid_body_in_world = !ghost;
 
@@ -428,6 +1002,9 @@ namespace physics
         entity.rb.rigid_body = create_rb_internal(entity, cmd.params.base, 0, compound);
         entity.rb.rigid_body->setUserIndex(resource_slot);
 
+        entity.default_motion_state->handle = resource_slot;
+        mark_moved(resource_slot);
+
         entity.rb.rigid_body_in_world = 1;
         entity.group = cmd.params.base.group;
         entity.mask = cmd.params.base.mask;
@@ -594,22 +1171,20 @@ namespace physics
         s_entities.get(cmd.object_index).rb.rigid_body->activate(ACTIVE_TAG);
     }
 
-    void set_transform_internal(const set_transform_params& cmd)
+    namespace
     {
-        btVector3    bt_v3;
-        btQuaternion bt_quat;
-
-        memcpy(&bt_v3, &cmd.position, sizeof(vec3f));
-        memcpy(&bt_quat, &cmd.rotation, sizeof(quat));
+        void set_rb_transform(btRigidBody* rb, const vec3f& position, const quat& rotation)
+        {
+            btVector3    bt_v3;
+            btQuaternion bt_quat;
 
-        btTransform bt_trans;
-        bt_trans.setOrigin(bt_v3);
-        bt_trans.setRotation(bt_quat);
+            memcpy(&bt_v3, &position, sizeof(vec3f));
+            memcpy(&bt_quat, &rotation, sizeof(quat));
 
-        btRigidBody* rb = s_entities.get(cmd.object_index).rb.rigid_body;
+            btTransform bt_trans;
+            bt_trans.setOrigin(bt_v3);
+            bt_trans.setRotation(bt_quat);
 
-        if (rb)
-        {
             if (rb->getCollisionFlags() & btCollisionObject::CF_KINEMATIC_OBJECT)
             {
                 rb->getMotionState()->setWorldTransform(bt_trans);
@@ -618,8 +1193,58 @@ namespace physics
             {
                 rb->getMotionState()->setWorldTransform(bt_trans);
                 rb->setCenterOfMassTransform(bt_trans);
+                rb->activate(true);
             }
         }
+
+        // bulk sets are sent after the frame's other commands, so a body may have been released since
+        btRigidBody* get_bulk_rb(u32 handle)
+        {
+            if (handle >= s_entities._capacity)
+                return nullptr;
+
+            physics_entity& entity = s_entities.get(handle);
+            if (entity.type != ENTITY_RIGID_BODY && entity.type != ENTITY_COMPOUND_RIGID_BODY)
+                return nullptr;
+
+            return entity.rb.rigid_body;
+        }
+    } // namespace
+
+    void set_transform_internal(const set_transform_params& cmd)
+    {
+        btRigidBody* rb = s_entities.get(cmd.object_index).rb.rigid_body;
+
+        if (rb)
+            set_rb_transform(rb, cmd.position, cmd.rotation);
+    }
+
+    void set_transforms_internal(const set_transforms_params& cmd)
+    {
+        for (u32 i = 0; i < cmd.count; ++i)
+        {
+            btRigidBody* rb = get_bulk_rb(cmd.handles[i]);
+            if (rb)
+                set_rb_transform(rb, cmd.positions[i], cmd.rotations[i]);
+        }
+
+        pen::memory_free(cmd.handles);
+    }
+
+    void set_velocities_internal(const set_velocities_params& cmd)
+    {
+        for (u32 i = 0; i < cmd.count; ++i)
+        {
+            btRigidBody* rb = get_bulk_rb(cmd.handles[i]);
+            if (!rb)
+                continue;
+
+            rb->setLinearVelocity(btVector3(cmd.linear[i].x, cmd.linear[i].y, cmd.linear[i].z));
+            rb->setAngularVelocity(btVector3(cmd.angular[i].x, cmd.angular[i].y, cmd.angular[i].z));
+            rb->activate(ACTIVE_TAG);
+        }
+
+        pen::memory_free(cmd.handles);
     }
 
     void set_gravity_internal(const set_v3_params& cmd)
@@ -703,6 +1328,7 @@ namespace physics
 
             btTransform master = p_rb->getWorldTransform();
             p_rb_slave->setWorldTransform(master);
+            mark_moved(cmd.slave);
         }
 
         if (s_entities.get(cmd.master).type == ENTITY_MULTI_BODY && cmd.link_index != -1)
@@ -712,6 +1338,7 @@ namespace physics
 
             btTransform master = p_mb->getLink(cmd.link_index).m_collider->getWorldTransform();
             p_rb_slave->setWorldTransform(master);
+            mark_moved(cmd.slave);
         }
     }
 
@@ -885,6 +1512,8 @@ namespace physics
                 pe.type = ENTITY_RIGID_BODY;
 
                 rb.rigid_body->setWorldTransform(base * compound_child);
+                rb.rigid_body->activate(true);
+                mark_moved(params.rb);
             }
             else
             {
@@ -922,13 +1551,17 @@ namespace physics
 
                 pe.type = ENTITY_COMPOUND_RIGID_BODY_CHILD;
                 s_bullet_systems.dynamics_world->removeRigidBody(rb.rigid_body);
+
+                // publish the compound so the new child picks up its transform
+                mark_moved(params.compound);
             }
         }
     }
 
     void release_entity_internal(u32 entity_index)
     {
-        if (s_entities.get(entity_index).type == ENTITY_RIGID_BODY)
+        e_entity_type type = s_entities.get(entity_index).type;
+        if (type == ENTITY_RIGID_BODY || type == ENTITY_COMPOUND_RIGID_BODY)
         {
             remove_from_world_internal(entity_index);
             delete s_entities.get(entity_index).rb.rigid_body;
@@ -1034,6 +1667,17 @@ namespace physics
         return sr;
     }
 
+    void cast_batch_internal(batch_cast* batch)
+    {
+        if (batch->num_casts == 0)
+        {
+            batch->complete = 1;
+            return;
+        }
+
+        sb_push(s_cast_batches, batch);
+    }
+
     class contact_processor : public btCollisionWorld::ContactResultCallback
     {
       public:
@@ -1086,6 +1730,155 @@ namespace physics
 
         ctp.callback(cb.ctr);
     }
+
+    bool cook_collision_mesh(const collision_mesh_data& mesh_data, shape_type shape, void** blob_out, u32* size_out,
+                             cook_stats* stats)
+    {
+        *blob_out = nullptr;
+        *size_out = 0;
+
+        if (!mesh_data.vertices || (shape != e_shape::mesh && shape != e_shape::hull))
+            return false;
+
+        if (shape == e_shape::mesh && (!mesh_data.indices || mesh_data.num_indices < 3))
+            return false;
+
+        // time to build the shape from raw data on the physics thread, what loading the cooked data replaces
+        f64 build_us = 0.0;
+        f64 start = pen::get_time_us();
+
+        cooked_header header = {};
+        header.magic = k_cooked_magic;
+        header.version = k_cooked_version;
+        header.shape = shape;
+
+        // sources for the sections
+        const f32*   vertices = mesh_data.vertices;
+        const u32*   indices = mesh_data.indices;
+        cooked_face* faces = nullptr;
+        u32*         face_indices = nullptr;
+
+        btTriangleIndexVertexArray* mesh = nullptr;
+        btBvhTriangleMeshShape*     bvh_shape = nullptr;
+        btConvexHullShape*          simplified = nullptr;
+        f32*                        hull_vertices = nullptr;
+
+        if (shape == e_shape::mesh)
+        {
+            // the same build the physics thread does from raw data
+            mesh = new btTriangleIndexVertexArray(mesh_data.num_indices / 3, (s32*)mesh_data.indices, sizeof(u32) * 3,
+                                                  mesh_data.num_floats / 3, mesh_data.vertices, sizeof(f32) * 3);
+
+            bvh_shape = new btBvhTriangleMeshShape(mesh, true);
+            build_us = pen::get_time_us() - start;
+
+            header.num_vertices = mesh_data.num_floats / 3;
+            header.num_indices = (mesh_data.num_indices / 3) * 3;
+            header.bvh_size = bvh_shape->getOptimizedBvh()->calculateSerializeBufferSize();
+
+            const btVector3& aabb_min = bvh_shape->getLocalAabbMin();
+            const btVector3& aabb_max = bvh_shape->getLocalAabbMax();
+            for (u32 i = 0; i < 3; ++i)
+            {
+                header.aabb_min[i] = aabb_min[i];
+                header.aabb_max[i] = aabb_max[i];
+            }
+        }
+        else
+        {
+            btConvexHullShape source(mesh_data.vertices, mesh_data.num_floats / 3, sizeof(f32) * 3);
+            build_us = pen::get_time_us() - start;
+
+            // simplify without the margin, the runtime shape adds it back
+            source.setMargin(0.0f);
+            btShapeHull reduced(&source);
+            if (reduced.buildHull(0.0f))
+                simplified = new btConvexHullShape((const btScalar*)reduced.getVertexPointer(), reduced.numVertices());
+            else
+                simplified = new btConvexHullShape(mesh_data.vertices, mesh_data.num_floats / 3, sizeof(f32) * 3);
+
+            simplified->initializePolyhedralFeatures();
+            const btConvexPolyhedron* poly = simplified->getConvexPolyhedron();
+
+            u32 num_vertices = (u32)poly->m_vertices.size();
+            hull_vertices = (f32*)pen::memory_alloc(num_vertices * sizeof(f32) * 3);
+            for (u32 i = 0; i < num_vertices; ++i)
+                for (u32 j = 0; j < 3; ++j)
+                    hull_vertices[i * 3 + j] = poly->m_vertices[i][j];
+
+            for (s32 f = 0; f < poly->m_faces.size(); ++f)
+            {
+                const btFace& face = poly->m_faces[f];
+
+                cooked_face cf;
+                cf.first_index = sb_count(face_indices);
+                cf.num_indices = (u32)face.m_indices.size();
+                for (u32 i = 0; i < 4; ++i)
+                    cf.plane[i] = face.m_plane[i];
+
+                for (s32 i = 0; i < face.m_indices.size(); ++i)
+                    sb_push(face_indices, (u32)face.m_indices[i]);
+
+                sb_push(faces, cf);
+            }
+
+            header.num_vertices = num_vertices;
+            header.num_indices = sb_count(face_indices);
+            header.num_faces = sb_count(faces);
+
+            vertices = hull_vertices;
+            indices = face_indices;
+        }
+
+        // layout
+        header.vertices_offset = sizeof(cooked_header);
+        header.indices_offset = cooked_align(header.vertices_offset + header.num_vertices * sizeof(f32) * 3);
+        header.faces_offset = cooked_align(header.indices_offset + header.num_indices * sizeof(u32));
+        header.bvh_offset = cooked_align(header.faces_offset + header.num_faces * sizeof(cooked_face));
+        u32 size = cooked_align(header.bvh_offset + header.bvh_size);
+
+        u8* blob = (u8*)pen::memory_alloc_align(size, k_cooked_align);
+        memset(blob, 0x0, size);
+        memcpy(blob, &header, sizeof(cooked_header));
+        memcpy(blob + header.vertices_offset, vertices, header.num_vertices * sizeof(f32) * 3);
+        memcpy(blob + header.indices_offset, indices, header.num_indices * sizeof(u32));
+
+        if (faces)
+            memcpy(blob + header.faces_offset, faces, header.num_faces * sizeof(cooked_face));
+
+        if (bvh_shape)
+            bvh_shape->getOptimizedBvh()->serializeInPlace(blob + header.bvh_offset, header.bvh_size, false);
+
+        // cleanup
+        delete_mesh_shape(bvh_shape ? (btCollisionShape*)bvh_shape : (btCollisionShape*)simplified);
+        pen::memory_free(hull_vertices);
+        sb_free(faces);
+        sb_free(face_indices);
+
+        if (stats)
+        {
+            // load a copy, deserializing the bvh patches the blob
+            u8* copy = (u8*)pen::memory_alloc_align(size, k_cooked_align);
+            memcpy(copy, blob, size);
+
+            f64 load_start = pen::get_time_us();
+
+            btOptimizedBvh*   bvh = nullptr;
+            btCollisionShape* loaded = load_cooked_shape(copy, size, shape, &bvh);
+
+            stats->load_ms = (pen::get_time_us() - load_start) / 1000.0;
+            stats->build_ms = build_us / 1000.0;
+
+            if (loaded)
+                delete_mesh_shape(loaded);
+
+            pen::memory_free_align(copy);
+        }
+
+        *blob_out = blob;
+        *size_out = size;
+        return true;
+    }
 } // namespace physics
 
 #if PICKING_REFERENCE // reference
@@ -17,6 +17,14 @@
 #include "BulletDynamics/Featherstone/btMultiBodyPoint2Point.h"
 #include "btBulletDynamicsCommon.h"
 
+// for the multi threaded world
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+
+// for cooked collision shapes
+#include "BulletCollision/CollisionShapes/btConvexPolyhedron.h"
+#include "BulletCollision/CollisionShapes/btShapeHull.h"
+
 namespace physics
 {
     enum e_entity_type
@@ -66,6 +74,19 @@ namespace physics
         };
     };
 
+    // records the body as moved whenever bullet synchronises an active body, or a transform is set on it
+    class sync_motion_state : public btDefaultMotionState
+    {
+      public:
+        sync_motion_state(const btTransform& start_trans) : btDefaultMotionState(start_trans)
+        {
+        }
+
+        void setWorldTransform(const btTransform& world_trans) override;
+
+        u32 handle = (u32)-1;
+    };
+
     struct physics_entity
     {
         e_entity_type type = ENTITY_NULL;
@@ -76,7 +97,7 @@ namespace physics
             constraint_entity constraint;
         };
 
-        btDefaultMotionState* default_motion_state;
+        sync_motion_state*    default_motion_state;
         btCollisionShape*     collision_shape;
         btCompoundShape*      compound_shape;
         u32                   num_base_compound_shapes;
@@ -116,17 +137,33 @@ namespace physics
         readable_data()
         {
             b_paused = 0;
+            acknowledged_step = 0;
+            requested_solver_threads = 0;
+            solver_threads = 0;
+            step_us = 0;
+            num_cooked_shapes = 0;
+            num_built_shapes = 0;
+            cooked_shape_us = 0;
+            built_shape_us = 0;
         }
 
-        a_u32                                   b_paused;
-        pen::multi_buffer<mat4*, 2>             output_matrices;
-        pen::multi_buffer<maths::transform*, 2> output_transforms;
+        a_u32                               b_paused;
+        a_u32                               acknowledged_step;
+        a_u32                               requested_solver_threads;
+        a_u32                               solver_threads;
+        a_u64                               step_us;
+        a_u32                               num_cooked_shapes;
+        a_u32                               num_built_shapes;
+        a_u64                               cooked_shape_us;
+        a_u64                               built_shape_us;
+        pen::triple_buffer<rb_transforms>   moved_transforms;
     };
 
     extern readable_data g_readable_data;
 
     void physics_update(f32 dt);
-    void physics_initialise();
+    u32  physics_fixed_update(u32 tick_us); // steps until caught up with the clock, returns us until the next tick
+    void physics_initialise(const physics_thread_params& params);
     void physics_shutdown();
 
     btRigidBody* create_rb_internal(physics_entity& entity, const rigid_body_params& params, u32 ghost,
@@ -145,6 +182,8 @@ namespace physics
     void set_linear_factor_internal(const set_v3_params& cmd);
     void set_angular_factor_internal(const set_v3_params& cmd);
     void set_transform_internal(const set_transform_params& cmd);
+    void set_transforms_internal(const set_transforms_params& cmd);
+    void set_velocities_internal(const set_velocities_params& cmd);
     void set_gravity_internal(const set_v3_params& cmd);
     void set_friction_internal(const set_float_params& cmd);
     void set_hinge_motor_internal(const set_v3_params& cmd);
@@ -172,6 +211,7 @@ namespace physics
     cast_result cast_ray_internal(const ray_cast_params& rcp);
     cast_result cast_sphere_internal(const sphere_cast_params& ccp);
     void        contact_test_internal(const contact_test_params& ctp);
+    void        cast_batch_internal(batch_cast* batch);
 
     void add_central_force(const set_v3_params& cmd);
     void add_central_impulse(const set_v3_params& cmd);
@@ -53,7 +53,8 @@ namespace put
         enum shader_permutation_t
         {
             skinned = 1 << 31,
-            instanced = 1 << 30
+            instanced = 1 << 30,
+            clustered_lights = 1 << 5
         };
     }
     typedef u32 shader_permutation;
@@ -193,6 +194,8 @@ namespace put
                 forward_lit = 1,
                 shadow_map = 1 << 1,
                 alpha_blended = 1 << 2,
+                static_casters = 1 << 3,  // only entities which do not move by physics or animation
+                dynamic_casters = 1 << 4, // only entities which do
                 COUNT
             };
         }
@@ -237,6 +240,7 @@ namespace put
             hash_id   id_sub_type;
             Str       name;
             bool      loaded = false;
+            bool      prewarming = false;
             pen::json info;
 
             u32 vertex_shader;
@@ -350,6 +354,14 @@ namespace put
         bool has_technique_samplers(u32 shader, u32 technique_index);
         bool has_technique_params(u32 shader, u32 technique_index);
 
+        // techniques are created on first use, pre-warming reads the byte code on a loader thread ahead of time
+        // so first use does not hitch. create_prewarmed_techniques is called by render each frame.
+        void prewarm_technique(u32 shader, hash_id id_technique, u32 permutation = 0);
+        void prewarm_technique_index(u32 shader, u32 technique_index);
+        void prewarm_view_techniques(const u32* permutations, u32 num_permutations);
+        void create_prewarmed_techniques();
+        u32  get_lazy_load_count(); // techniques which had to be loaded synchronously last frame
+
         void poll_for_changes();
     } // namespace pmfx
 } // namespace put
@@ -193,6 +193,8 @@ namespace
         "forward_lit", e_scene_render_flags::forward_lit,
         "shadow_map", e_scene_render_flags::shadow_map,
         "alpha_blended", e_scene_render_flags::alpha_blended,
+        "static_casters", e_scene_render_flags::static_casters,
+        "dynamic_casters", e_scene_render_flags::dynamic_casters,
         nullptr, 0
     };
     
@@ -3064,10 +3066,33 @@ namespace put
             }
         }
 
+        void prewarm_view_techniques(const u32* permutations, u32 num_permutations)
+        {
+            for (auto& v : s_views)
+            {
+                if (v.view_flags & e_view_flags::template_view)
+                    continue;
+
+                if (is_valid(v.pmfx_shader) && v.id_technique)
+                {
+                    prewarm_technique(v.pmfx_shader, v.id_technique, v.technique_permutation);
+
+                    for (u32 i = 0; i < num_permutations; ++i)
+                        prewarm_technique(v.pmfx_shader, v.id_technique, permutations[i]);
+                }
+
+                for (auto& pv : v.post_process_views)
+                    if (is_valid(pv.pmfx_shader) && pv.id_technique)
+                        prewarm_technique(pv.pmfx_shader, pv.id_technique, pv.technique_permutation);
+            }
+        }
+
         void render()
         {
             reload();
 
+            create_prewarmed_techniques();
+
             for (auto& v : s_views)
             {
                 if (v.view_flags & e_view_flags::template_view)
@@ -20,6 +20,7 @@
 #include "pen_json.h"
 #include "pen_string.h"
 #include "renderer.h"
+#include "threads.h"
 
 using namespace put;
 using namespace pmfx;
@@ -38,12 +39,13 @@ namespace
     struct pmfx_shader
     {
         hash_id         id_filename = 0;
+        hash_id         id_info = 0; // hash of the resource path to info.json, rewritten when a build completes
         Str             filename = nullptr;
         bool            invalidated = false;
+        bool            info_changed = false;
         pen::json       info;
         u32             info_timestamp = 0;
         shader_program* techniques = nullptr;
-        u32             rebuild_ts = 0;
     };
 
     pmfx_shader*  s_pmfx_list = nullptr;
@@ -51,6 +53,123 @@ namespace
     const char*** s_technique_names = nullptr;
     hash_id**     s_technique_id_names = nullptr;
     u32           s_num_shader_names = 0;
+
+    // pre-warming
+    const u32 k_prewarm_queue_size = 256;
+    const u32 k_max_shader_path = 256;
+
+    namespace e_shader_file
+    {
+        enum shader_file_t
+        {
+            vs,
+            ps,
+            cs,
+            COUNT
+        };
+    }
+
+    struct shader_byte_code
+    {
+        void* data;
+        u32   size;
+    };
+
+    struct prewarm_request
+    {
+        u32     shader;
+        u32     technique_index;
+        hash_id id_filename;
+        c8      filenames[e_shader_file::COUNT][k_max_shader_path];
+    };
+
+    struct prewarm_result
+    {
+        u32              shader;
+        u32              technique_index;
+        hash_id          id_filename;
+        shader_byte_code byte_code[e_shader_file::COUNT];
+    };
+
+    pen::ring_buffer<prewarm_request> s_prewarm_requests;
+    pen::ring_buffer<prewarm_result>  s_prewarm_results;
+    pen::job*                         s_prewarm_job = nullptr;
+    u32                               s_lazy_loads = 0;
+    u32                               s_lazy_loads_last_frame = 0;
+
+    void* prewarm_loader_thread(void* params)
+    {
+        pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+        pen::job*               p_thread_info = job_params->job_info;
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+        for (;;)
+        {
+            prewarm_request* req = s_prewarm_requests.get();
+            while (req)
+            {
+                prewarm_result result;
+                result.shader = req->shader;
+                result.technique_index = req->technique_index;
+                result.id_filename = req->id_filename;
+
+                for (u32 i = 0; i < e_shader_file::COUNT; ++i)
+                {
+                    result.byte_code[i].data = nullptr;
+                    result.byte_code[i].size = 0;
+
+                    if (req->filenames[i][0] == '\0')
+                        continue;
+
+                    pen_error err = pen::filesystem_read_file_to_buffer(req->filenames[i], &result.byte_code[i].data,
+                                                                        result.byte_code[i].size);
+                    if (err != PEN_ERR_OK)
+                    {
+                        pen::memory_free(result.byte_code[i].data);
+                        result.byte_code[i].data = nullptr;
+                    }
+                }
+
+                while (!s_prewarm_results.try_put(result))
+                    pen::thread_sleep_ms(1);
+
+                req = s_prewarm_requests.get();
+            }
+
+            if (pen::semaphore_try_wait(p_thread_info->p_sem_exit))
+                break;
+
+            pen::thread_sleep_ms(4);
+        }
+
+        pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+        pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+        return PEN_THREAD_OK;
+    }
+
+    void get_shader_filename(c8* buf, const c8* fx_filename, const Str& file)
+    {
+        buf[0] = '\0';
+        if (file.empty())
+            return;
+
+        const c8* sfp = pen::renderer_get_shader_platform();
+        pen::string_format(buf, k_max_shader_path, "data/pmfx/%s/%s/%s", sfp, fx_filename, file.c_str());
+    }
+
+    // takes byte code read on the loader thread if there is any, otherwise reads from disk
+    pen_error read_byte_code(const c8* filename, shader_byte_code* prewarmed, void** byte_code, u32& byte_code_size)
+    {
+        if (prewarmed && prewarmed->data)
+        {
+            *byte_code = prewarmed->data;
+            byte_code_size = prewarmed->size;
+            prewarmed->data = nullptr;
+            return PEN_ERR_OK;
+        }
+
+        return pen::filesystem_read_file_to_buffer(filename, byte_code, byte_code_size);
+    }
 } // namespace
 
 namespace put
@@ -293,7 +412,8 @@ namespace put
             return program;
         }
 
-        shader_program load_shader_technique(const c8* fx_filename, pen::json& j_technique, pen::json& j_info)
+        shader_program load_shader_technique(const c8* fx_filename, pen::json& j_technique, pen::json& j_info,
+                                             shader_byte_code* prewarmed = nullptr)
         {
             shader_program program = {};
 
@@ -319,7 +439,8 @@ namespace put
                 pen::shader_load_params cs_slp;
                 cs_slp.type = PEN_SHADER_TYPE_CS;
 
-                pen_error err = pen::filesystem_read_file_to_buffer(cs_file_buf, &cs_slp.byte_code, cs_slp.byte_code_size);
+                shader_byte_code* cs_prewarmed = prewarmed ? &prewarmed[e_shader_file::cs] : nullptr;
+                pen_error err = read_byte_code(cs_file_buf, cs_prewarmed, &cs_slp.byte_code, cs_slp.byte_code_size);
 
                 pen::memory_free(cs_file_buf);
 
@@ -342,7 +463,8 @@ namespace put
             pen::shader_load_params vs_slp;
             vs_slp.type = PEN_SHADER_TYPE_VS;
 
-            pen_error err = pen::filesystem_read_file_to_buffer(vs_file_buf, &vs_slp.byte_code, vs_slp.byte_code_size);
+            shader_byte_code* vs_prewarmed = prewarmed ? &prewarmed[e_shader_file::vs] : nullptr;
+            pen_error err = read_byte_code(vs_file_buf, vs_prewarmed, &vs_slp.byte_code, vs_slp.byte_code_size);
 
             pen::memory_free(vs_file_buf);
 
@@ -434,7 +556,8 @@ namespace put
             pen::shader_load_params ps_slp;
             ps_slp.type = PEN_SHADER_TYPE_PS;
 
-            err = pen::filesystem_read_file_to_buffer(ps_file_buf, &ps_slp.byte_code, ps_slp.byte_code_size);
+            shader_byte_code* ps_prewarmed = prewarmed ? &prewarmed[e_shader_file::ps] : nullptr;
+            err = read_byte_code(ps_file_buf, ps_prewarmed, &ps_slp.byte_code, ps_slp.byte_code_size);
 
             pen::memory_free(ps_file_buf);
 
@@ -581,16 +704,107 @@ namespace put
             return program;
         }
 
+        u32 find_technique_index_perm(u32 shader, hash_id id_technique, u32 permutation);
+
         void lazy_load_shader_technique(shader_program& t, u32 shader)
         {
             auto& s = s_pmfx_list[shader];
             if (!t.loaded)
             {
+                // report so the technique can be added to a pre-warm
+                const c8* reason = t.prewarming ? "pre-warm still in flight" : "not pre-warmed";
+                dev_console_log_level(dev_ui::console_level::warning, "[pmfx] lazy loading %s:%s (%s)", s.filename.c_str(),
+                                      t.name.c_str(), reason);
+                s_lazy_loads++;
+
                 t = load_shader_technique(s.filename.c_str(), t.info, s.info);
                 t.loaded = true;
             }
         }
 
+        void prewarm_technique_index(u32 shader, u32 technique_index)
+        {
+#if PEN_SINGLE_THREADED
+            return;
+#endif
+            if (shader >= sb_count(s_pmfx_list))
+                return;
+
+            auto& s = s_pmfx_list[shader];
+            if (technique_index >= sb_count(s.techniques))
+                return;
+
+            auto& t = s.techniques[technique_index];
+            if (t.loaded || t.prewarming)
+                return;
+
+            if (!s_prewarm_job)
+            {
+                s_prewarm_requests.create(k_prewarm_queue_size);
+                s_prewarm_results.create(k_prewarm_queue_size);
+                s_prewarm_job =
+                    pen::jobs_create_job(prewarm_loader_thread, 1024 * 1024, nullptr, pen::e_thread_start_flags::detached);
+            }
+
+            prewarm_request req;
+            req.shader = shader;
+            req.technique_index = technique_index;
+            req.id_filename = s.id_filename;
+
+            get_shader_filename(req.filenames[e_shader_file::vs], s.filename.c_str(), t.info["vs_file"].as_str());
+            get_shader_filename(req.filenames[e_shader_file::ps], s.filename.c_str(), t.info["ps_file"].as_str());
+            get_shader_filename(req.filenames[e_shader_file::cs], s.filename.c_str(), t.info["cs_file"].as_str());
+
+            // loader is busy, the technique will be created on first use instead
+            if (!s_prewarm_requests.try_put(req))
+                return;
+
+            t.prewarming = true;
+        }
+
+        void prewarm_technique(u32 shader, hash_id id_technique, u32 permutation)
+        {
+            u32 technique_index = find_technique_index_perm(shader, id_technique, permutation);
+            if (is_valid(technique_index))
+                prewarm_technique_index(shader, technique_index);
+        }
+
+        void create_prewarmed_techniques()
+        {
+            s_lazy_loads_last_frame = s_lazy_loads;
+            s_lazy_loads = 0;
+
+            prewarm_result* r = s_prewarm_results.get();
+            while (r)
+            {
+                // shaders may have been hot reloaded while loading
+                if (r->shader < sb_count(s_pmfx_list))
+                {
+                    auto& s = s_pmfx_list[r->shader];
+                    if (s.id_filename == r->id_filename && r->technique_index < sb_count(s.techniques))
+                    {
+                        auto& t = s.techniques[r->technique_index];
+                        if (t.prewarming && !t.loaded)
+                        {
+                            t = load_shader_technique(s.filename.c_str(), t.info, s.info, r->byte_code);
+                            t.loaded = true;
+                        }
+                    }
+                }
+
+                // free anything which was not consumed
+                for (u32 i = 0; i < e_shader_file::COUNT; ++i)
+                    pen::memory_free(r->byte_code[i].data);
+
+                r = s_prewarm_results.get();
+            }
+        }
+
+        u32 get_lazy_load_count()
+        {
+            return s_lazy_loads_last_frame;
+        }
+
         void initialise_constant_defaults(u32 shader, u32 technique_index, f32* data)
         {
             if (shader >= sb_count(s_pmfx_list))
@@ -747,8 +961,11 @@ namespace put
             return true;
         }
 
-        u32 get_technique_index_perm(u32 shader, hash_id id_technique, u32 permutation)
+        u32 find_technique_index_perm(u32 shader, hash_id id_technique, u32 permutation)
         {
+            if (shader >= sb_count(s_pmfx_list))
+                return PEN_INVALID_HANDLE;
+
             u32 num_techniques = sb_count(s_pmfx_list[shader].techniques);
             for (u32 i = 0; i < num_techniques; ++i)
             {
@@ -762,14 +979,22 @@ namespace put
                 if (t.permutation_id != masked_permutation)
                     continue;
 
-                lazy_load_shader_technique(t, shader);
-
                 return i;
             }
 
             return PEN_INVALID_HANDLE;
         }
 
+        u32 get_technique_index_perm(u32 shader, hash_id id_technique, u32 permutation)
+        {
+            u32 i = find_technique_index_perm(shader, id_technique, permutation);
+
+            if (is_valid(i))
+                lazy_load_shader_technique(s_pmfx_list[shader].techniques[i], shader);
+
+            return i;
+        }
+
         Str get_pmfx_info_filename(const c8* pmfx_filename)
         {
             Str fn = "data/pmfx/";
@@ -806,6 +1031,40 @@ namespace put
             return true;
         }
 
+        void pmfx_file_changed(hash_id id_filename)
+        {
+            u32 num_pmfx = sb_count(s_pmfx_list);
+            for (u32 i = 0; i < num_pmfx; ++i)
+            {
+                auto& pmfx_set = s_pmfx_list[i];
+
+                // wait until info is re-written to know compilation is completed.
+                if (pmfx_set.invalidated)
+                {
+                    if (id_filename == pmfx_set.id_info)
+                        pmfx_set.info_changed = true;
+
+                    continue;
+                }
+
+                pen::json files = pmfx_set.info["files"];
+
+                s32 num_files = files.size();
+                for (s32 f = 0; f < num_files; ++f)
+                {
+                    if (PEN_HASH(files[f]["name"].as_str().c_str()) != id_filename)
+                        continue;
+
+                    Str shader_compiler_str = put::get_build_cmd();
+                    shader_compiler_str.append("-pmfx");
+
+                    put::trigger_hot_loader(shader_compiler_str);
+                    pmfx_set.invalidated = true;
+                    break;
+                }
+            }
+        }
+
         pmfx_shader load_internal(const c8* filename)
         {
             // load info file for description
@@ -826,6 +1085,15 @@ namespace put
                 new_pmfx.info_timestamp = ts;
             }
 
+            // watch the info and all source files, changes are dispatched from put::poll_hot_loader
+            Str info_fn = pen::os_path_for_resource(fn.c_str());
+            new_pmfx.id_info = PEN_HASH(info_fn.c_str());
+            put::watch_file(info_fn.c_str(), pmfx_file_changed);
+
+            pen::json files = new_pmfx.info["files"];
+            for (s32 i = 0; i < files.size(); ++i)
+                put::watch_file(files[i]["name"].as_str().c_str(), pmfx_file_changed);
+
             pen::json _techniques = new_pmfx.info["techniques"];
 
             for (s32 i = 0; i < _techniques.size(); ++i)
@@ -900,63 +1168,24 @@ namespace put
         {
             PEN_HOTLOADING_ENABLED;
 
-            Str shader_compiler_str = put::get_build_cmd();
-            shader_compiler_str.append("-pmfx");
-
             u32 current_counter = 0;
 
             u32  num_pmfx = sb_count(s_pmfx_list);
             u32* reload_list = nullptr;
 
+            // sets are invalidated and info changes flagged by pmfx_file_changed, no files are checked here
             for (u32 i = 0; i < num_pmfx; ++i)
             {
                 auto& pmfx_set = s_pmfx_list[i];
 
-                if (pmfx_set.invalidated)
+                if (pmfx_set.invalidated && pmfx_set.info_changed)
                 {
-                    Str fn = pen::os_path_for_resource(get_pmfx_info_filename(pmfx_set.filename.c_str()).c_str());
-
-                    u32       current_ts;
-                    pen_error err = pen::filesystem_getmtime(fn.c_str(), current_ts);
-
-                    // wait until info is newer than the current info file,
-                    // to know compilation is completed.
-                    if (err == PEN_ERR_OK && current_ts > pmfx_set.rebuild_ts)
-                    {
-                        bool complete = pmfx_ready(pmfx_set.filename.c_str());
-                        if (complete)
-                        {
-                            sb_push(reload_list, i);
-                            pmfx_set.invalidated = false;
-                        }
-                    }
-                }
-                else
-                {
-                    pen::json files = pmfx_set.info["files"];
-
-                    s32 num_files = files.size();
-                    for (s32 i = 0; i < num_files; ++i)
+                    bool complete = pmfx_ready(pmfx_set.filename.c_str());
+                    if (complete)
                     {
-                        pen::json file = files[i];
-                        Str       fn = file["name"].as_str();
-
-                        u32 dep_ts = 0;
-                        Str fn2 = pen::os_path_for_resource(get_pmfx_info_filename(pmfx_set.filename.c_str()).c_str());
-
-                        if (pen::filesystem_getmtime(fn2.c_str(), dep_ts) == PEN_ERR_OK)
-                        {
-                            u32 input_ts = 0;
-                            if (pen::filesystem_getmtime(fn.c_str(), input_ts) == PEN_ERR_OK)
-                            {
-                                if (input_ts > dep_ts)
-                                {
-                                    put::trigger_hot_loader(shader_compiler_str);
-                                    pmfx_set.invalidated = true;
-                                    pmfx_set.rebuild_ts = dep_ts;
-                                }
-                            }
-                        }
+                        sb_push(reload_list, i);
+                        pmfx_set.invalidated = false;
+                        pmfx_set.info_changed = false;
                     }
                 }
 
@@ -640,7 +640,7 @@ class playback_deck
     spectrum_analyser sa;
 
     // audio states
-    put::audio_channel_state   channel_state;
+    put::audio_voice_state     channel_state;
     put::audio_fft_spectrum    spectrum;
     put::audio_group_state     group_state;
     put::audio_sound_file_info file_info;
@@ -713,8 +713,8 @@ class playback_deck
         ImGui::SameLine();
         ImGui::Text("%s", file);
 
-        // update states
-        pen_error err = put::audio_channel_get_state(channel_index, &channel_state);
+        // update states, the voice state is kept after the channel stops or finishes
+        pen_error err = put::audio_channel_get_voice_state(channel_index, &channel_state);
 
         if (err == PEN_ERR_OK)
         {
@@ -1,3 +1,6 @@
+// mt world so the stress pile can compare solver thread counts, stepping at 120hz apart from rendering
+#define EXAMPLE_PHYSICS_SOLVER_THREADS 8
+#define EXAMPLE_PHYSICS_FIXED_RATE_HZ 120
 #include "../example_common.h"
 
 using namespace put;
@@ -21,6 +24,127 @@ namespace pen
 u32 convex;
 u32 concave;
 
+// batched ray cast benchmark
+static const u32 k_num_bench_rays = 10000;
+
+struct ray_bench
+{
+    physics::batch_cast       batch;
+    physics::ray_cast_params* rays = nullptr;
+    physics::cast_result*     results = nullptr;
+    bool                      submitted = false;
+    bool                      single_threaded = false;
+    u32                       hits = 0;
+};
+ray_bench s_ray_bench;
+
+void update_ray_bench()
+{
+    ray_bench& rb = s_ray_bench;
+
+    if (!rb.rays)
+    {
+        rb.rays = new physics::ray_cast_params[k_num_bench_rays];
+        rb.results = new physics::cast_result[k_num_bench_rays];
+    }
+
+    // results are written by the physics thread, wait for them before reusing the arrays
+    if (rb.submitted)
+    {
+        if (!rb.batch.complete)
+            return;
+
+        rb.hits = 0;
+        for (u32 i = 0; i < k_num_bench_rays; ++i)
+            if (rb.results[i].set)
+                rb.hits++;
+
+        // show a sample of the hits
+        for (u32 i = 0; i < k_num_bench_rays; i += 100)
+            if (rb.results[i].set)
+                dbg::add_point(rb.results[i].point, 0.1f, vec4f::magenta());
+    }
+
+    // vertical rays over the scene, inside the broadphase extents
+    for (u32 i = 0; i < k_num_bench_rays; ++i)
+    {
+        f32 x = (f32)(rand() % 9000) / 100.0f - 45.0f;
+        f32 z = (f32)(rand() % 9000) / 100.0f - 45.0f;
+        rb.rays[i].start = vec3f(x, 40.0f, z);
+        rb.rays[i].end = vec3f(x, -10.0f, z);
+    }
+
+    rb.batch.rays = rb.rays;
+    rb.batch.num_casts = k_num_bench_rays;
+    rb.batch.results = rb.results;
+    rb.batch.single_threaded = rb.single_threaded;
+    physics::cast_batch(&rb.batch);
+    rb.submitted = true;
+}
+
+// solver thread benchmark, a pile of boxes dropped into the valley
+static const u32 k_stress_pile_size = 5000;
+static const u32 k_solver_thread_counts[] = {1, 2, 4, 8};
+
+struct solver_bench
+{
+    bool stress_pile = false;
+    s32  thread_count_index = 3;
+    f64  avg_step_ms = 0.0;
+};
+solver_bench s_solver_bench;
+
+void add_stress_pile(ecs_scene* scene)
+{
+    material_resource* default_material = get_material_resource(PEN_HASH("default_material"));
+    geometry_resource* box = get_geometry_resource(PEN_HASH("cube"));
+
+    // 20x20 columns inside the broadphase extents
+    for (u32 i = 0; i < k_stress_pile_size; ++i)
+    {
+        u32 x = i % 20;
+        u32 z = (i / 20) % 20;
+        u32 y = i / 400;
+
+        u32 bb = get_new_entity(scene);
+        scene->names[bb].setf("stress_%i", i);
+        scene->transforms[bb].translation = vec3f(x * 1.2f - 12.0f, 22.0f + y * 1.2f, z * 1.2f - 12.0f);
+        scene->transforms[bb].rotation = quat();
+        scene->transforms[bb].scale = vec3f(0.5f, 0.5f, 0.5f);
+        scene->entities[bb] |= e_cmp::transform;
+        scene->parents[bb] = bb;
+        scene->physics_data.write(bb).rigid_body.shape = physics::e_shape::box;
+        scene->physics_data.write(bb).rigid_body.mass = 1.0f;
+        instantiate_geometry(box, scene, bb);
+        instantiate_material(default_material, scene, bb);
+        instantiate_model_cbuffer(scene, bb);
+        instantiate_rigid_body(scene, bb);
+    }
+}
+
+void update_solver_bench(ecs_scene* scene)
+{
+    solver_bench& sb = s_solver_bench;
+
+    bool opened = true;
+    ImGui::Begin("Solver Threads", &opened, ImGuiWindowFlags_AlwaysAutoResize);
+
+    if (!sb.stress_pile && ImGui::Button("Add Stress Pile"))
+    {
+        add_stress_pile(scene);
+        sb.stress_pile = true;
+    }
+
+    if (ImGui::Combo("Threads", &sb.thread_count_index, "1\0""2\0""4\0""8\0"))
+        physics::set_solver_threads(k_solver_thread_counts[sb.thread_count_index]);
+
+    sb.avg_step_ms = sb.avg_step_ms * 0.95 + physics::get_step_ms() * 0.05;
+
+    ImGui::Text("Threads In Use: %u", physics::get_solver_threads());
+    ImGui::Text("Step Time: %.3f (ms)", sb.avg_step_ms);
+    ImGui::End();
+}
+
 void gen_convex_shape(physics::collision_mesh_data& cmd)
 {
     // pentagon corners
@@ -144,6 +268,7 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->view_flags &= ~e_scene_view_flags::hide_debug;
     scene->view_flags |= e_scene_view_flags::physics;
     editor_set_transform_mode(e_transform_mode::physics);
+    put::dev_ui::enable(true);
 
     clear_scene(scene);
 
@@ -155,9 +280,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -175,8 +300,8 @@ void example_setup(ecs_scene* scene, camera& cam)
         scene->transforms[bb].scale = vec3f(0.5f, 0.5f, 0.5f);
         scene->entities[bb] |= e_cmp::transform;
         scene->parents[bb] = bb;
-        scene->physics_data[bb].rigid_body.shape = physics::e_shape::box;
-        scene->physics_data[bb].rigid_body.mass = 1.0f;
+        scene->physics_data.write(bb).rigid_body.shape = physics::e_shape::box;
+        scene->physics_data.write(bb).rigid_body.mass = 1.0f;
         instantiate_geometry(box, scene, bb);
         instantiate_material(default_material, scene, bb);
         instantiate_model_cbuffer(scene, bb);
@@ -193,10 +318,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[convex].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[convex] |= e_cmp::transform;
     scene->parents[convex] = convex;
-    scene->physics_data[convex].rigid_body.shape = physics::e_shape::hull;
-    scene->physics_data[convex].rigid_body.mass = 1.0f;
+    scene->physics_data.write(convex).rigid_body.shape = physics::e_shape::hull;
+    scene->physics_data.write(convex).rigid_body.mass = 1.0f;
 
-    gen_convex_shape(scene->physics_data[convex].rigid_body.mesh_data);
+    gen_convex_shape(scene->physics_data.write(convex).rigid_body.mesh_data);
 
     instantiate_rigid_body(scene, convex);
 
@@ -208,10 +333,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[concave].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[concave] |= e_cmp::transform;
     scene->parents[concave] = concave;
-    scene->physics_data[concave].rigid_body.shape = physics::e_shape::mesh;
-    scene->physics_data[concave].rigid_body.mass = 0.0f;
+    scene->physics_data.write(concave).rigid_body.shape = physics::e_shape::mesh;
+    scene->physics_data.write(concave).rigid_body.mass = 0.0f;
 
-    gen_concave_shape(scene->physics_data[concave].rigid_body.mesh_data);
+    gen_concave_shape(scene->physics_data.write(concave).rigid_body.mesh_data);
 
     instantiate_rigid_body(scene, concave);
 
@@ -223,8 +348,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[compound].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[compound] |= e_cmp::transform;
     scene->parents[compound] = compound;
-    scene->physics_data[compound].rigid_body.shape = physics::e_shape::compound;
-    scene->physics_data[compound].rigid_body.mass = 1.0f;
+    scene->physics_data.write(compound).rigid_body.shape = physics::e_shape::compound;
+    scene->physics_data.write(compound).rigid_body.mass = 1.0f;
 
     //instantiate_rigid_body(scene, compound);
 
@@ -235,8 +360,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[cc].scale = vec3f(0.5f, 2.0f, 0.5f);
     scene->entities[cc] |= e_cmp::transform;
     scene->parents[cc] = cc;
-    scene->physics_data[cc].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[cc].rigid_body.mass = 1.0f;
+    scene->physics_data.write(cc).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(cc).rigid_body.mass = 1.0f;
     instantiate_geometry(box, scene, cc);
     instantiate_material(default_material, scene, cc);
     instantiate_model_cbuffer(scene, cc);
@@ -251,8 +376,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[cc].scale = vec3f(2.0f, 0.5f, 0.5f);
     scene->entities[cc] |= e_cmp::transform;
     scene->parents[cc] = cc;
-    scene->physics_data[cc].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[cc].rigid_body.mass = 1.0f;
+    scene->physics_data.write(cc).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(cc).rigid_body.mass = 1.0f;
     instantiate_geometry(box, scene, cc);
     instantiate_material(default_material, scene, cc);
     instantiate_model_cbuffer(scene, cc);
@@ -269,7 +394,7 @@ void example_setup(ecs_scene* scene, camera& cam)
 void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
 {
     // debug draw shape
-    physics::collision_mesh_data& convex_cmd = scene->physics_data[convex].rigid_body.mesh_data;
+    const physics::collision_mesh_data& convex_cmd = scene->physics_data[convex].rigid_body.mesh_data;
     mat4&                         convex_mat = scene->world_matrices[convex];
 
     for (u32 i = 0; i < convex_cmd.num_floats; i += 9)
@@ -296,4 +421,16 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
     vec3f w2 = vec3f(-50.0f, 20.0f, 50.0f);
 
     dbg::add_triangle_with_normal(w0, w1, w2);
+
+    // ray cast benchmark
+    update_ray_bench();
+
+    bool opened = true;
+    ImGui::Begin("Batched Ray Casts", &opened, ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Checkbox("Single Threaded", &s_ray_bench.single_threaded);
+    ImGui::Text("%u rays, %u hits", k_num_bench_rays, s_ray_bench.hits);
+    ImGui::Text("Cast Time: %.3f (ms)", s_ray_bench.batch.cast_ms);
+    ImGui::End();
+
+    update_solver_bench(scene);
 }
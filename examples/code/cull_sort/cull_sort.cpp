@@ -33,9 +33,9 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -94,10 +94,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags = e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags = e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -108,9 +108,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "back_light";
     scene->id_name[light] = PEN_HASH("back_light");
-    scene->lights[light].colour = vec3f(0.6f, 0.6f, 0.6f);
-    scene->lights[light].direction = -vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f(0.6f, 0.6f, 0.6f);
+    scene->lights.write(light).direction = -vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -226,9 +226,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 chrome_cubemap_handle = pmfx::get_render_target(PEN_HASH("chrome"))->handle;
 
     // set material to cubemap
-    scene->material_resources[chorme_ball].id_technique = PEN_HASH("cubemap");
-    scene->material_resources[chorme_ball].shader_name = "pmfx_utility";
-    scene->material_resources[chorme_ball].id_shader = PEN_HASH("pmfx_utility");
+    scene->material_resources.write(chorme_ball).id_technique = PEN_HASH("cubemap");
+    scene->material_resources.write(chorme_ball).shader_name = "pmfx_utility";
+    scene->material_resources.write(chorme_ball).id_shader = PEN_HASH("pmfx_utility");
 
     scene->state_flags[chorme_ball] &= ~e_state::samplers_initialised;
     bake_material_handles(scene, chorme_ball);
@@ -257,9 +257,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 chrome2_cubemap_handle = pmfx::get_render_target(PEN_HASH("chrome2"))->handle;
 
     // set material to cubemap
-    scene->material_resources[glass_ball].id_technique = PEN_HASH("cubemap");
-    scene->material_resources[glass_ball].shader_name = "pmfx_utility";
-    scene->material_resources[glass_ball].id_shader = PEN_HASH("pmfx_utility");
+    scene->material_resources.write(glass_ball).id_technique = PEN_HASH("cubemap");
+    scene->material_resources.write(glass_ball).shader_name = "pmfx_utility";
+    scene->material_resources.write(glass_ball).id_shader = PEN_HASH("pmfx_utility");
     scene->state_flags[glass_ball] &= ~e_state::samplers_initialised;
 
     bake_material_handles(scene, glass_ball);
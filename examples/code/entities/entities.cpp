@@ -34,10 +34,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "cyan_light";
     scene->id_name[light] = PEN_HASH("cyan_light");
-    scene->lights[light].colour = vec3f(250.0f, 162.0f, 117.0f) / 255.0f;
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(250.0f, 162.0f, 117.0f) / 255.0f;
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -47,10 +47,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "magenta_light";
     scene->id_name[light] = PEN_HASH("magenta_light");
-    scene->lights[light].colour = vec3f(206.0f, 106.0f, 84.0f) / 255.0f;
-    scene->lights[light].direction = vec3f(-1.0f, 1.0f, 1.0f);
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(206.0f, 106.0f, 84.0f) / 255.0f;
+    scene->lights.write(light).direction = vec3f(-1.0f, 1.0f, 1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -60,10 +60,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "yellow_light";
     scene->id_name[light] = PEN_HASH("yellow_light");
-    scene->lights[light].colour = vec3f(152.0f, 82.0f, 119.0f) / 255.0f;
-    scene->lights[light].direction = vec3f(0.0f, 1.0f, 1.0f);
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(152.0f, 82.0f, 119.0f) / 255.0f;
+    scene->lights.write(light).direction = vec3f(0.0f, 1.0f, 1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -73,10 +73,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "red_light";
     scene->id_name[light] = PEN_HASH("red_light");
-    scene->lights[light].colour = vec3f(222.0f, 50.0f, 97.0f) / 255.0f;
-    scene->lights[light].direction = vec3f(0.0f, 1.0f, 1.0f);
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(222.0f, 50.0f, 97.0f) / 255.0f;
+    scene->lights.write(light).direction = vec3f(0.0f, 1.0f, 1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -205,7 +205,7 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
         vec2f xz = vec2f(cos(lr[i]), sin(lr[i]));
 
         vec3f dir = vec3f(xz.x, 1.0f, xz.y);
-        scene->lights[i].direction = dir;
+        scene->lights.write(i).direction = dir;
     }
 
     for (s32 i = master_node + 1; i < scene->num_entities; ++i)
@@ -220,11 +220,11 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
     pen::timer_start(timer);
     for (s32 i = 0; i < scene->num_nodes; ++i)
     {
-        if(!(scene->entities.data[i] & e_cmp::sdf_shadow))
+        if(!(scene->entities[i] & e_cmp::sdf_shadow))
             continue;
         
-        scene->transforms.data[i].rotation = scene->transforms.data[i].rotation * q;
-        scene->entities.data[i] |= e_cmp::transform;
+        scene->transforms[i].rotation = scene->transforms[i].rotation * q;
+        scene->entities[i] |= e_cmp::transform;
     }
     f32 operator_cost = pen::timer_elapsed_ms(timer);
     pen::timer_start(timer);
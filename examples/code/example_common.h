@@ -38,6 +38,15 @@ namespace physics
     extern void* physics_thread_main(void* params);
 }
 
+// examples may define these before including to step physics on the mt world, or at a fixed rate
+#ifndef EXAMPLE_PHYSICS_SOLVER_THREADS
+#define EXAMPLE_PHYSICS_SOLVER_THREADS 0
+#endif
+
+#ifndef EXAMPLE_PHYSICS_FIXED_RATE_HZ
+#define EXAMPLE_PHYSICS_FIXED_RATE_HZ 0
+#endif
+
 namespace
 {
     put::camera          main_camera;
@@ -52,7 +61,10 @@ namespace
         p_thread_info = job_params->job_info;
         pen::semaphore_post(p_thread_info->p_sem_continue, 1);
 
-        pen::jobs_create_job(physics::physics_thread_main, 1024 * 10, nullptr, pen::e_thread_start_flags::detached);
+        static physics::physics_thread_params physics_params;
+        physics_params.solver_threads = EXAMPLE_PHYSICS_SOLVER_THREADS;
+        physics_params.fixed_rate_hz = EXAMPLE_PHYSICS_FIXED_RATE_HZ;
+        pen::jobs_create_job(physics::physics_thread_main, 1024 * 10, &physics_params, pen::e_thread_start_flags::detached);
 
         // create the main scene and camera
         main_scene = put::ecs::create_scene("main_scene");
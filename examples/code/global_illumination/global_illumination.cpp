@@ -49,10 +49,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f(0.8f, 0.8f, 0.8f) * 0.5f;
-    scene->lights[light].direction = normalised(vec3f(-0.7f, 0.6f, -0.4f));
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map | e_light_flags::global_illumination;
+    scene->lights.write(light).colour = vec3f(0.8f, 0.8f, 0.8f) * 0.5f;
+    scene->lights.write(light).direction = normalised(vec3f(-0.7f, 0.6f, -0.4f));
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map | e_light_flags::global_illumination;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -63,10 +63,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "opposite_light";
     scene->id_name[light] = PEN_HASH("opposite_light");
-    scene->lights[light].colour = vec3f(0.8f, 0.8f, 0.8f) * 0.5f;
-    scene->lights[light].direction = normalised(vec3f(0.7f, 0.8f, 0.3f));
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(0.8f, 0.8f, 0.8f) * 0.5f;
+    scene->lights.write(light).direction = normalised(vec3f(0.7f, 0.8f, 0.3f));
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
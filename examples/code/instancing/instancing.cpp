@@ -29,9 +29,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -119,10 +119,23 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
     static pen::timer* timer = pen::timer_create();
 
     pen::timer_start(timer);
-    for (s32 i = 2; i < scene->num_entities; ++i)
+    for (u32 p = 0; p * k_cmp_dense_page_entities < scene->num_entities; ++p)
     {
-        scene->transforms.data[i].rotation = scene->transforms.data[i].rotation * q;
-        scene->entities.data[i] |= e_cmp::transform;
+        // components are contiguous within a page
+        cmp_transform* transforms = scene->transforms.pages[p];
+        u64*           entities = scene->entities.pages[p];
+
+        u32 page_start = p * k_cmp_dense_page_entities;
+        u32 start = page_start < 2 ? 2 : page_start;
+        u32 end = page_start + k_cmp_dense_page_entities;
+        if (end > scene->num_entities)
+            end = scene->num_entities;
+
+        for (u32 i = start; i < end; ++i)
+        {
+            transforms[i - page_start].rotation = transforms[i - page_start].rotation * q;
+            entities[i - page_start] |= e_cmp::transform;
+        }
     }
 
 #if 1 // debug / test array cost vs operator [] in component entity system
@@ -34,9 +34,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -56,8 +56,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_geometry(box, scene, hinge_x_body);
     instantiate_material(default_material, scene, hinge_x_body);
     instantiate_model_cbuffer(scene, hinge_x_body);
-    scene->physics_data[hinge_x_body].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[hinge_x_body].rigid_body.mass = 1.0f;
+    scene->physics_data.write(hinge_x_body).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(hinge_x_body).rigid_body.mass = 1.0f;
     instantiate_rigid_body(scene, hinge_x_body);
 
     u32 hinge_x_constraint = get_new_entity(scene);
@@ -67,11 +67,11 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[hinge_x_constraint].rotation = quat();
     scene->transforms[hinge_x_constraint].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[hinge_x_constraint] |= e_cmp::transform;
-    scene->physics_data[hinge_x_constraint].constraint.type = physics::e_constraint::hinge;
-    scene->physics_data[hinge_x_constraint].constraint.axis = vec3f::unit_x();
-    scene->physics_data[hinge_x_constraint].constraint.rb_indices[0] = scene->physics_handles[hinge_x_body];
-    scene->physics_data[hinge_x_constraint].constraint.lower_limit_rotation.x = -M_PI;
-    scene->physics_data[hinge_x_constraint].constraint.upper_limit_rotation.x = M_PI;
+    scene->physics_data.write(hinge_x_constraint).constraint.type = physics::e_constraint::hinge;
+    scene->physics_data.write(hinge_x_constraint).constraint.axis = vec3f::unit_x();
+    scene->physics_data.write(hinge_x_constraint).constraint.rb_indices[0] = scene->physics_handles[hinge_x_body];
+    scene->physics_data.write(hinge_x_constraint).constraint.lower_limit_rotation.x = -M_PI;
+    scene->physics_data.write(hinge_x_constraint).constraint.upper_limit_rotation.x = M_PI;
     instantiate_constraint(scene, hinge_x_constraint);
 
     // add hinge in the y-axis with rotational limits
@@ -87,8 +87,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_geometry(box, scene, hinge_y_body);
     instantiate_material(default_material, scene, hinge_y_body);
     instantiate_model_cbuffer(scene, hinge_y_body);
-    scene->physics_data[hinge_y_body].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[hinge_y_body].rigid_body.mass = 1.0f;
+    scene->physics_data.write(hinge_y_body).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(hinge_y_body).rigid_body.mass = 1.0f;
     instantiate_rigid_body(scene, hinge_y_body);
 
     u32 hinge_y_constraint = get_new_entity(scene);
@@ -98,11 +98,11 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[hinge_y_constraint].rotation = quat();
     scene->transforms[hinge_y_constraint].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[hinge_y_constraint] |= e_cmp::transform;
-    scene->physics_data[hinge_y_constraint].constraint.type = physics::e_constraint::hinge;
-    scene->physics_data[hinge_y_constraint].constraint.axis = vec3f::unit_y();
-    scene->physics_data[hinge_y_constraint].constraint.rb_indices[0] = scene->physics_handles[hinge_y_body];
-    scene->physics_data[hinge_y_constraint].constraint.lower_limit_rotation.x = -M_PI / 2;
-    scene->physics_data[hinge_y_constraint].constraint.upper_limit_rotation.x = M_PI / 2;
+    scene->physics_data.write(hinge_y_constraint).constraint.type = physics::e_constraint::hinge;
+    scene->physics_data.write(hinge_y_constraint).constraint.axis = vec3f::unit_y();
+    scene->physics_data.write(hinge_y_constraint).constraint.rb_indices[0] = scene->physics_handles[hinge_y_body];
+    scene->physics_data.write(hinge_y_constraint).constraint.lower_limit_rotation.x = -M_PI / 2;
+    scene->physics_data.write(hinge_y_constraint).constraint.upper_limit_rotation.x = M_PI / 2;
     instantiate_constraint(scene, hinge_y_constraint);
 
     // add box with a point to point constraint
@@ -118,8 +118,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_geometry(box, scene, p2p_body);
     instantiate_material(default_material, scene, p2p_body);
     instantiate_model_cbuffer(scene, p2p_body);
-    scene->physics_data[p2p_body].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[p2p_body].rigid_body.mass = 1.0f;
+    scene->physics_data.write(p2p_body).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(p2p_body).rigid_body.mass = 1.0f;
     instantiate_rigid_body(scene, p2p_body);
 
     u32 p2p_constraint = get_new_entity(scene);
@@ -129,8 +129,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[p2p_constraint].rotation = quat();
     scene->transforms[p2p_constraint].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[p2p_constraint] |= e_cmp::transform;
-    scene->physics_data[p2p_constraint].constraint.type = physics::e_constraint::p2p;
-    scene->physics_data[p2p_constraint].constraint.rb_indices[0] = scene->physics_handles[p2p_body];
+    scene->physics_data.write(p2p_constraint).constraint.type = physics::e_constraint::p2p;
+    scene->physics_data.write(p2p_constraint).constraint.rb_indices[0] = scene->physics_handles[p2p_body];
     instantiate_constraint(scene, p2p_constraint);
 
     // add slider constraint (six degrees of freedom in an axis)
@@ -146,8 +146,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_geometry(box, scene, slider_x_body);
     instantiate_material(default_material, scene, slider_x_body);
     instantiate_model_cbuffer(scene, slider_x_body);
-    scene->physics_data[slider_x_body].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[slider_x_body].rigid_body.mass = 1.0f;
+    scene->physics_data.write(slider_x_body).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(slider_x_body).rigid_body.mass = 1.0f;
     instantiate_rigid_body(scene, slider_x_body);
 
     u32 slider_x_constraint = get_new_entity(scene);
@@ -157,12 +157,12 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->transforms[slider_x_constraint].rotation = quat();
     scene->transforms[slider_x_constraint].scale = vec3f(1.0f, 1.0f, 1.0f);
     scene->entities[slider_x_constraint] |= e_cmp::transform;
-    scene->physics_data[slider_x_constraint].constraint.type = physics::e_constraint::dof6;
-    scene->physics_data[slider_x_constraint].constraint.rb_indices[0] = scene->physics_handles[slider_x_body];
-    scene->physics_data[slider_x_constraint].constraint.lower_limit_rotation = vec3f::zero();
-    scene->physics_data[slider_x_constraint].constraint.upper_limit_rotation = vec3f::zero();
-    scene->physics_data[slider_x_constraint].constraint.lower_limit_translation = -vec3f::unit_x() * 10.0f;
-    scene->physics_data[slider_x_constraint].constraint.upper_limit_translation = vec3f::unit_x() * 10.0f;
+    scene->physics_data.write(slider_x_constraint).constraint.type = physics::e_constraint::dof6;
+    scene->physics_data.write(slider_x_constraint).constraint.rb_indices[0] = scene->physics_handles[slider_x_body];
+    scene->physics_data.write(slider_x_constraint).constraint.lower_limit_rotation = vec3f::zero();
+    scene->physics_data.write(slider_x_constraint).constraint.upper_limit_rotation = vec3f::zero();
+    scene->physics_data.write(slider_x_constraint).constraint.lower_limit_translation = -vec3f::unit_x() * 10.0f;
+    scene->physics_data.write(slider_x_constraint).constraint.upper_limit_translation = vec3f::unit_x() * 10.0f;
     instantiate_constraint(scene, slider_x_constraint);
 
     // load physics stuff before calling update
@@ -97,7 +97,7 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
         }
 
         scene->entities[i] |= e_cmp::light;
-        scene->lights[i].radius = light_radius;
+        scene->lights.write(i).radius = light_radius;
 
         dir_index++;
     }
@@ -228,9 +228,9 @@ void example_setup(ecs::ecs_scene* scene, camera& main_camera)
         scene->entities[light] |= e_cmp::transform;
 
         instantiate_light(scene, light);
-        scene->lights[light].colour = col.xyz;
-        scene->lights[light].radius = light_radius;
-        scene->lights[light].type = e_light_type::point;
+        scene->lights.write(light).colour = col.xyz;
+        scene->lights.write(light).radius = light_radius;
+        scene->lights.write(light).type = e_light_type::point;
 
         anim_dir[i] = vec3f(rrx, rry, rrz) * vec3f(2.0f) - vec3f(1.0);
 
@@ -44,10 +44,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags = e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags = e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -66,8 +66,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_material(default_material, scene, ground);
     instantiate_model_cbuffer(scene, ground);
 
-    scene->physics_data[ground].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[ground].rigid_body.mass = 0.0f;
+    scene->physics_data.write(ground).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(ground).rigid_body.mass = 0.0f;
     instantiate_rigid_body(scene, ground);
 
     vec3f wall_pos[] = {vec3f(-51.0f, 2.0f, 0.0f), vec3f(51.0f, 2.0f, 0.0f), vec3f(0.0f, 2.0f, -51.0f),
@@ -86,8 +86,8 @@ void example_setup(ecs_scene* scene, camera& cam)
         scene->transforms[wall].scale = wall_size[i];
         scene->entities[wall] |= e_cmp::transform;
         scene->parents[wall] = wall;
-        scene->physics_data[wall].rigid_body.shape = physics::e_shape::box;
-        scene->physics_data[wall].rigid_body.mass = 0.0f;
+        scene->physics_data.write(wall).rigid_body.shape = physics::e_shape::box;
+        scene->physics_data.write(wall).rigid_body.mass = 0.0f;
         instantiate_geometry(box, scene, wall);
         instantiate_material(default_material, scene, wall);
         instantiate_model_cbuffer(scene, wall);
@@ -135,8 +135,8 @@ void example_setup(ecs_scene* scene, camera& cam)
                     instantiate_material(default_material, scene, new_prim);
                     instantiate_model_cbuffer(scene, new_prim);
 
-                    scene->physics_data[new_prim].rigid_body.shape = primitive_types[p];
-                    scene->physics_data[new_prim].rigid_body.mass = 1.0f;
+                    scene->physics_data.write(new_prim).rigid_body.shape = primitive_types[p];
+                    scene->physics_data.write(new_prim).rigid_body.mass = 1.0f;
                     instantiate_rigid_body(scene, new_prim);
 
                     simple_lighting* m = (simple_lighting*)&scene->material_data[new_prim].data[0];
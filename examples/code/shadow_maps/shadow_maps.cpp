@@ -45,10 +45,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one() * 0.3f;
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one() * 0.3f;
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -60,10 +60,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "point_light1";
     scene->id_name[light] = PEN_HASH("point_light1");
-    scene->lights[light].colour = vec3f(1.0f, 0.0f, 0.0f);
-    scene->lights[light].radius = 50.0f;
-    scene->lights[light].type = e_light_type::point;
-    scene->lights[light].flags |= e_light_flags::omni_shadow_map;
+    scene->lights.write(light).colour = vec3f(1.0f, 0.0f, 0.0f);
+    scene->lights.write(light).radius = 50.0f;
+    scene->lights.write(light).type = e_light_type::point;
+    scene->lights.write(light).flags |= e_light_flags::omni_shadow_map;
     scene->transforms[light].translation = vec3f(-16.0f, 30.0f, -16.0f);
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -74,10 +74,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "point_light2";
     scene->id_name[light] = PEN_HASH("point_light2");
-    scene->lights[light].colour = vec3f(0.0f, 0.0f, 1.0f);
-    scene->lights[light].radius = 50.0f;
-    scene->lights[light].type = e_light_type::point;
-    scene->lights[light].flags |= e_light_flags::omni_shadow_map;
+    scene->lights.write(light).colour = vec3f(0.0f, 0.0f, 1.0f);
+    scene->lights.write(light).radius = 50.0f;
+    scene->lights.write(light).type = e_light_type::point;
+    scene->lights.write(light).flags |= e_light_flags::omni_shadow_map;
     scene->transforms[light].translation = vec3f(16.0f, 30.0f, 16.0f);
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -89,12 +89,12 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "spot_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f(0.0f, 1.0f, 0.5f) * 0.3f;
-    scene->lights[light].cos_cutoff = 0.3f;
-    scene->lights[light].radius = 30.0f; // range
-    scene->lights[light].spot_falloff = 0.2f;
-    scene->lights[light].type = e_light_type::spot;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(0.0f, 1.0f, 0.5f) * 0.3f;
+    scene->lights.write(light).cos_cutoff = 0.3f;
+    scene->lights.write(light).radius = 30.0f; // range
+    scene->lights.write(light).spot_falloff = 0.2f;
+    scene->lights.write(light).type = e_light_type::spot;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f(75.0f, 30.0f, -50.0f);
     scene->transforms[light].rotation = quat(-45.0f, 0.0f, 0.0f);
     scene->transforms[light].scale = vec3f::one();
@@ -105,12 +105,12 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_light(scene, light);
     scene->names[light] = "spot_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f(1.0f, 0.5f, 0.0f) * 0.3f;
-    scene->lights[light].cos_cutoff = 0.3f;
-    scene->lights[light].radius = 30.0f; // range
-    scene->lights[light].spot_falloff = 0.2f;
-    scene->lights[light].type = e_light_type::spot;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f(1.0f, 0.5f, 0.0f) * 0.3f;
+    scene->lights.write(light).cos_cutoff = 0.3f;
+    scene->lights.write(light).radius = 30.0f; // range
+    scene->lights.write(light).spot_falloff = 0.2f;
+    scene->lights.write(light).type = e_light_type::spot;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f(-75.0f, 30.0f, 50.0f);
     scene->transforms[light].rotation = quat(45.0f, 0.0f, 0.0f);
     scene->transforms[light].scale = vec3f::one();
@@ -208,10 +208,10 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
         vec2f xz = vec2f(cos(lr[i]), sin(lr[i]));
 
         vec3f dir = vec3f(xz.x, 1.0f, xz.y);
-        scene->lights[i].direction = dir;
+        scene->lights.write(i).direction = dir;
 
-        scene->transforms.data[i].rotation = quat(xz.x, 0.0f, xz.y);
-        scene->entities.data[i] |= e_cmp::transform;
+        scene->transforms[i].rotation = quat(xz.x, 0.0f, xz.y);
+        scene->entities[i] |= e_cmp::transform;
     }
 
     static f32 t = 0.0;
@@ -236,7 +236,7 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
     pen::timer_start(timer);
     for (s32 i = pillar_start; i < scene->num_entities; ++i)
     {
-        scene->transforms.data[i].rotation = scene->transforms.data[i].rotation * q;
-        scene->entities.data[i] |= e_cmp::transform;
+        scene->transforms[i].rotation = scene->transforms[i].rotation * q;
+        scene->entities[i] |= e_cmp::transform;
     }
 }
@@ -39,10 +39,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags = e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags = e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -61,8 +61,8 @@ void example_setup(ecs_scene* scene, camera& cam)
     instantiate_material(default_material, scene, ground);
     instantiate_model_cbuffer(scene, ground);
 
-    scene->physics_data[ground].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[ground].rigid_body.mass = 0.0f;
+    scene->physics_data.write(ground).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(ground).rigid_body.mass = 0.0f;
     instantiate_rigid_body(scene, ground);
 
     vec3f start_positions[] = {vec3f(-4.f, 2.0f, -4.f)};
@@ -135,6 +135,6 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
         vec2f xz = vec2f(cos(lr[i]), sin(lr[i]));
 
         vec3f dir = vec3f(xz.x, 1.0f, xz.y);
-        scene->lights[i].direction = dir;
+        scene->lights.write(i).direction = dir;
     }
 }
@@ -1,4 +1,5 @@
 #include "../example_common.h"
+#include "ecs/ecs_skin.h"
 #include "shader_structs/forward_render.h"
 
 using namespace put;
@@ -34,10 +35,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags = e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags = e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -69,16 +70,47 @@ void example_setup(ecs_scene* scene, camera& cam)
     anim_handle ah = load_pma("data/models/characters/testcharacter/anims/testcharacter_idle.pma");
     bind_animation_to_rig(scene, ah, skinned_char);
 
-    scene->anim_controller_v2[skinned_char].blend.anim_a = 0;
-    scene->anim_controller_v2[skinned_char].blend.anim_b = 0;
-    scene->anim_controller_v2[skinned_char].blend.ratio = 0.0f;
+    scene->anim_controller_v2.write(skinned_char).blend.anim_a = 0;
+    scene->anim_controller_v2.write(skinned_char).blend.anim_b = 0;
+    scene->anim_controller_v2.write(skinned_char).blend.ratio = 0.0f;
 
     simple_lighting* m = (simple_lighting*)&scene->material_data[skinned_char].data[0];
     m->m_albedo = vec4f::white();
     m->m_roughness = 0.05f;
     m->m_reflectivity = 0.3f;
+
+    // skin on the cpu as well so the mouse can be ray cast against the animated triangles
+    for (u32 n = 0; n < scene->num_entities; ++n)
+        if (scene->entities[n] & e_cmp::skinned)
+            instantiate_cpu_skin(scene, n);
 }
 
 void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
 {
+    s32 w, h;
+    pen::window_get_size(w, h);
+
+    const pen::mouse_state& ms = pen::input_get_mouse_state();
+
+    vec2i vp = vec2i(w, h);
+    mat4  view_proj = cam.proj * cam.view;
+    vec3f r0 = maths::unproject_sc(vec3f(ms.x, h - ms.y, 0.0f), view_proj, vp);
+    vec3f r1 = maths::unproject_sc(vec3f(ms.x, h - ms.y, 1.0f), view_proj, vp);
+
+    // shorten the ray to each hit so the closest across entities is drawn
+    bool       hit = false;
+    u32        num_skinned = 0;
+    const u32* skinned = query_entities(scene, e_cmp::cpu_skinned, num_skinned);
+    for (u32 i = 0; i < num_skinned; ++i)
+    {
+        vec3f hit_pos;
+        if (cast_ray_cpu_skinned(scene, skinned[i], r0, r1, hit_pos))
+        {
+            r1 = hit_pos;
+            hit = true;
+        }
+    }
+
+    if (hit)
+        dbg::add_point(r1, 0.1f, vec4f::magenta());
 }
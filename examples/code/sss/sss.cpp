@@ -37,10 +37,10 @@ void example_setup(ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light";
     scene->id_name[light] = PEN_HASH("front_light");
-    scene->lights[light].colour = vec3f::one();
-    scene->lights[light].direction = vec3f::one();
-    scene->lights[light].type = e_light_type::dir;
-    scene->lights[light].flags |= e_light_flags::shadow_map;
+    scene->lights.write(light).colour = vec3f::one();
+    scene->lights.write(light).direction = vec3f::one();
+    scene->lights.write(light).type = e_light_type::dir;
+    scene->lights.write(light).flags |= e_light_flags::shadow_map;
     scene->transforms[light].translation = vec3f::zero();
     scene->transforms[light].rotation = quat();
     scene->transforms[light].scale = vec3f::one();
@@ -64,9 +64,9 @@ void example_setup(ecs_scene* scene, camera& cam)
     scene->samplers[head_model].sb[1].sampler_unit = 1;
 
     // set material to sss
-    scene->material_resources[head_model].id_technique = PEN_HASH("simple_lighting");
-    scene->material_resources[head_model].shader_name = "forward_render";
-    scene->material_resources[head_model].id_shader = PEN_HASH(scene->material_resources[head_model].shader_name);
+    scene->material_resources.write(head_model).id_technique = PEN_HASH("simple_lighting");
+    scene->material_resources.write(head_model).shader_name = "forward_render";
+    scene->material_resources.write(head_model).id_shader = PEN_HASH(scene->material_resources[head_model].shader_name);
     scene->material_permutation[head_model] |= SIMPLE_LIGHTING_SSS;
 
     simple_lighting_sss mat_data;
@@ -87,7 +87,7 @@ void example_setup(ecs_scene* scene, camera& cam)
 void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
 {
     // rotate light
-    cmp_light& snl = scene->lights[0];
+    cmp_light& snl = scene->lights.write(0);
     snl.azimuth += dt;
     snl.altitude = maths::deg_to_rad(108.0f);
     snl.direction = maths::azimuth_altitude_to_xyz(snl.azimuth, snl.altitude);
@@ -322,9 +322,9 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     u32 light = get_new_entity(scene);
     scene->names[light] = "front_light0";
     scene->id_name[light] = PEN_HASH("front_light0");
-    scene->lights[light].colour = vec3f(0.2f, 0.8f, 0.1f);
-    scene->lights[light].direction = vec3f::one() * vec3f(1.0f, 0.7f, 1.0f);
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f(0.2f, 0.8f, 0.1f);
+    scene->lights.write(light).direction = vec3f::one() * vec3f(1.0f, 0.7f, 1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
     maths::xyz_to_azimuth_altitude(scene->lights[light].direction, scene->lights[light].azimuth,
                                    scene->lights[light].altitude);
     scene->transforms[light].translation = vec3f::zero();
@@ -336,9 +336,9 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "front_light1";
     scene->id_name[light] = PEN_HASH("front_light1");
-    scene->lights[light].colour = vec3f(0.8f, 0.2f, 0.2f);
-    scene->lights[light].direction = vec3f::one() * vec3f(-1.0f, 0.7f, 1.0f);
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f(0.8f, 0.2f, 0.2f);
+    scene->lights.write(light).direction = vec3f::one() * vec3f(-1.0f, 0.7f, 1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
     maths::xyz_to_azimuth_altitude(scene->lights[light].direction, scene->lights[light].azimuth,
                                    scene->lights[light].altitude);
     scene->transforms[light].translation = vec3f::zero();
@@ -350,9 +350,9 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "front_light2";
     scene->id_name[light] = PEN_HASH("front_light2");
-    scene->lights[light].colour = vec3f(0.1f, 0.2f, 0.8f);
-    scene->lights[light].direction = vec3f::one() * vec3f(-1.0f, 0.7f, -1.0f);
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f(0.1f, 0.2f, 0.8f);
+    scene->lights.write(light).direction = vec3f::one() * vec3f(-1.0f, 0.7f, -1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
     maths::xyz_to_azimuth_altitude(scene->lights[light].direction, scene->lights[light].azimuth,
                                    scene->lights[light].altitude);
     scene->transforms[light].translation = vec3f::zero();
@@ -364,9 +364,9 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     light = get_new_entity(scene);
     scene->names[light] = "front_light4";
     scene->id_name[light] = PEN_HASH("front_light4");
-    scene->lights[light].colour = vec3f(0.6f, 0.1f, 0.8f);
-    scene->lights[light].direction = vec3f::one() * vec3f(1.0f, 0.7f, -1.0f);
-    scene->lights[light].type = e_light_type::dir;
+    scene->lights.write(light).colour = vec3f(0.6f, 0.1f, 0.8f);
+    scene->lights.write(light).direction = vec3f::one() * vec3f(1.0f, 0.7f, -1.0f);
+    scene->lights.write(light).type = e_light_type::dir;
     maths::xyz_to_azimuth_altitude(scene->lights[light].direction, scene->lights[light].azimuth,
                                    scene->lights[light].altitude);
     scene->transforms[light].translation = vec3f::zero();
@@ -383,8 +383,8 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
     scene->transforms[ground].scale = vec3f(30.0f, 1.0f, 30.0f);
     scene->entities[ground] |= e_cmp::transform;
     scene->parents[ground] = ground;
-    scene->physics_data[ground].rigid_body.shape = physics::e_shape::box;
-    scene->physics_data[ground].rigid_body.mass = 0.0f;
+    scene->physics_data.write(ground).rigid_body.shape = physics::e_shape::box;
+    scene->physics_data.write(ground).rigid_body.mass = 0.0f;
     instantiate_geometry(box, scene, ground);
     instantiate_material(default_material, scene, ground);
     instantiate_model_cbuffer(scene, ground);
@@ -420,8 +420,8 @@ void example_setup(ecs::ecs_scene* scene, camera& cam)
                 instantiate_material(default_material, scene, new_prim);
                 instantiate_model_cbuffer(scene, new_prim);
 
-                scene->physics_data[new_prim].rigid_body.shape = physics::e_shape::box;
-                scene->physics_data[new_prim].rigid_body.mass = 1.0f;
+                scene->physics_data.write(new_prim).rigid_body.shape = physics::e_shape::box;
+                scene->physics_data.write(new_prim).rigid_body.mass = 1.0f;
                 instantiate_rigid_body(scene, new_prim);
 
                 cube_start = min(new_prim, cube_start);
@@ -455,7 +455,7 @@ void example_update(ecs::ecs_scene* scene, camera& cam, f32 dt)
     // rotate lights
     for (u32 i = 0; i < 4; ++i)
     {
-        cmp_light& snl = scene->lights[i];
+        cmp_light& snl = scene->lights.write(i);
         snl.azimuth += dt * 10.0f;
 
         f32 dir = 1.0f;
@@ -38,10 +38,10 @@ void example_setup(ecs_scene* scene, camera& cam)
         u32 light = get_new_entity(scene);
         scene->names[light] = "front_light";
         scene->id_name[light] = PEN_HASH("front_light");
-        scene->lights[light].colour = light_cols[l];
-        scene->lights[light].direction = vec3f::one();
-        scene->lights[light].radius = 70.0f;
-        scene->lights[light].type = e_light_type::point;
+        scene->lights.write(light).colour = light_cols[l];
+        scene->lights.write(light).direction = vec3f::one();
+        scene->lights.write(light).radius = 70.0f;
+        scene->lights.write(light).type = e_light_type::point;
         scene->transforms[light].translation = light_pos[l];
         scene->transforms[light].rotation = quat();
         scene->transforms[light].scale = vec3f::one();
@@ -92,7 +92,7 @@ void example_setup(ecs_scene* scene, camera& cam)
 
     scene->geometries[master_node] = scene->geometries[skinned_char];
     scene->materials[master_node] = scene->materials[skinned_char];
-    scene->material_resources[master_node] = scene->material_resources[skinned_char];
+    scene->material_resources.write(master_node) = scene->material_resources[skinned_char];
     scene->cbuffer[master_node] = scene->cbuffer[skinned_char];
 
     s32 num = 20;
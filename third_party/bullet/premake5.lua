@@ -45,6 +45,9 @@ project "bullet_monolithic"
 	}
 	
 	includedirs { "include" }
+
+	-- parallel for and the mt world, pmtech supplies the task scheduler
+	defines { "BT_THREADSAFE=1" }
 				
 	configuration "Debug"
 		defines { "DEBUG" }
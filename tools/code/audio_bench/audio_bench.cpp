@@ -0,0 +1,610 @@
+// audio_bench.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Headless software mixer benchmarks, plays increasing numbers of voices through the audio api into a memory sink and
+// writes mix time and voices per core as json. Needs put built with the software mixer (premake --audio=software).
+// Also writes a music length wav and compares resident memory with it decoded into the sample cache and streamed, and
+// plays more voices than the real voice budget to check virtualisation. Exits with 1 if the voice checks fail.
+
+#include "audio/audio.h"
+
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "os.h"
+#include "pen.h"
+#include "pen_string.h"
+#include "str_utilities.h"
+#include "threads.h"
+#include "timer.h"
+
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+
+using namespace pen;
+
+namespace
+{
+    const u32 k_default_ticks = 200;
+    const u32 k_default_frames = 4096; // frames mixed per update, ~85ms at 48khz
+    const u32 k_sample_rate = 48000;
+    const u32 k_flush_cmds = 512; // the audio command buffer holds 1024, flush well before it wraps
+    const u32 k_music_seconds = 180;
+    const u32 k_music_rate = 44100;
+    const u32 k_shared_sounds = 8;
+    const u32 k_budget_voices = 64;
+    const u32 k_budget_real_voices = 16;
+    const u32 k_budget_seconds = 30;
+    const u32 k_budget_virtual_ms = 500; // virtual play time before promoting, longer than the updates which follow
+    const c8* k_music_file = "audio_bench_music.wav";
+
+    Str*                   s_args = nullptr;
+    put::audio_memory_sink s_memory_sink;
+
+    struct scenario
+    {
+        const c8* name;
+        u32       num_voices;
+        u32       num_groups;
+        u32       num_channels;
+        f32       source_rate; // anything but the sink rate takes the resampling path
+        bool      dsp;         // fft, three band eq and gain on every group
+
+        // results, scenarios are static so these start zeroed
+        u64 frames;
+        u64 voice_frames;
+        f64 mix_ms;
+        f64 wall_ms;
+    };
+
+    scenario s_scenarios[] = {
+        {"mono_64", 64, 4, 1, 48000.0f, false},
+        {"mono_1k", 1024, 16, 1, 48000.0f, false},
+        {"stereo_1k", 1024, 16, 2, 48000.0f, false},
+        {"stereo_4k", 4096, 32, 2, 48000.0f, false},
+        {"resampled_1k", 1024, 16, 2, 44100.0f, false},
+        {"dsp_groups_1k", 1024, 64, 2, 48000.0f, true},
+    };
+
+    // two consumes, the second only returns once the update started by the first has finished
+    void sync()
+    {
+        put::audio_consume_command_buffer();
+        put::audio_consume_command_buffer();
+    }
+
+    struct memory_result
+    {
+        u64 file_bytes;
+        u64 decoded_bytes;     // k_shared_sounds sounds of the file, they share one decoded copy
+        u32 num_cached_sounds;
+        u64 stream_bytes;      // streaming the file instead
+        u64 stream_file_bytes; // mapped, only paged in as it is decoded
+        u64 stream_underrun_frames;
+        f64 stream_mix_ms;
+    };
+
+    struct voices_result
+    {
+        u32  num_voices;
+        u32  num_real;
+        u32  num_virtual;
+        u32  wrong_real;  // voices whose real flag does not match their rank by volume
+        u32  tracked_ms;  // position of the promoted voice while it was virtual
+        u32  resumed_ms;  // its platform channel position after it was promoted
+        u32  max_resumed_ms;
+        bool promoted;
+        bool demoted;
+        bool passed;
+    };
+
+    memory_result s_memory;
+    voices_result s_voices;
+    u32           s_pending_cmds = 0;
+
+    void issued(u32 num_cmds = 1)
+    {
+        s_pending_cmds += num_cmds;
+        if (s_pending_cmds >= k_flush_cmds)
+        {
+            sync();
+            s_pending_cmds = 0;
+        }
+    }
+
+    void run_scenario(scenario& s, u32 ticks, u32 frames_per_update)
+    {
+        PEN_LOG("running: %s", s.name);
+
+        // a sine long enough that no voice runs out during the run, voices are spread along it
+        u32  num_frames = (u32)((f64)(ticks + 8) * (f64)frames_per_update * (f64)s.source_rate / (f64)k_sample_rate);
+        u32  num_samples = num_frames * s.num_channels;
+        f32* pcm = (f32*)pen::memory_alloc(num_samples * sizeof(f32));
+
+        for (u32 i = 0; i < num_frames; ++i)
+            for (u32 c = 0; c < s.num_channels; ++c)
+                pcm[i * s.num_channels + c] = 0.01f * sinf(2.0f * 3.14159265f * 440.0f * (f32)(i + c) / s.source_rate);
+
+        pen::music_file music;
+        music.pcm_data = pcm;
+        music.len = num_samples * sizeof(f32);
+        music.num_channels = s.num_channels;
+        music.sample_frequency = s.source_rate;
+
+        // every voice is real so the mixer is measured rather than the voice budget
+        put::audio_voice_params vp;
+        vp.max_real_voices = s.num_voices;
+        put::audio_set_voice_params(vp);
+
+        u32* resources = nullptr;
+
+        u32 sound = put::audio_create_sound(music);
+        sb_push(resources, sound);
+
+        u32* groups = nullptr;
+        for (u32 i = 0; i < s.num_groups; ++i)
+        {
+            u32 group = put::audio_create_channel_group();
+            sb_push(groups, group);
+            sb_push(resources, group);
+            issued();
+
+            if (!s.dsp)
+                continue;
+
+            u32 fft = put::audio_add_dsp_to_group(group, put::e_dsp::fft);
+            u32 eq = put::audio_add_dsp_to_group(group, put::e_dsp::three_band_eq);
+            u32 gain = put::audio_add_dsp_to_group(group, put::e_dsp::gain);
+            put::audio_dsp_set_three_band_eq(eq, -3.0f, 0.0f, 3.0f);
+            put::audio_dsp_set_gain(gain, -6.0f);
+
+            sb_push(resources, fft);
+            sb_push(resources, eq);
+            sb_push(resources, gain);
+            issued(5);
+        }
+
+        for (u32 i = 0; i < s.num_voices; ++i)
+        {
+            u32 channel = put::audio_create_channel_for_sound(sound);
+            put::audio_add_channel_to_group(channel, groups[i % s.num_groups]);
+            put::audio_channel_set_position(channel, (i * 37) % 1000);
+
+            sb_push(resources, channel);
+            issued(3);
+        }
+
+        sync();
+
+        put::audio_mixer_stats start;
+        put::audio_get_mixer_stats(&start);
+
+        f64 wall_start = pen::get_time_ms();
+
+        for (u32 t = 0; t < ticks; ++t)
+            put::audio_consume_command_buffer();
+
+        sync();
+
+        s.wall_ms = pen::get_time_ms() - wall_start;
+
+        put::audio_mixer_stats end;
+        put::audio_get_mixer_stats(&end);
+
+        s.frames = end.frames_mixed - start.frames_mixed;
+        s.voice_frames = end.voice_frames_mixed - start.voice_frames_mixed;
+        s.mix_ms = end.mix_ms - start.mix_ms;
+
+        // release and make sure the mixer is done with the pcm before freeing it
+        u32 num_resources = sb_count(resources);
+        for (u32 i = 0; i < num_resources; ++i)
+        {
+            put::audio_release_resource(resources[i]);
+            issued();
+        }
+
+        sync();
+
+        sb_free(resources);
+        sb_free(groups);
+        pen::memory_free(pcm);
+    }
+
+    // voice i plays at volume (i + 1) / k_budget_voices so the loudest k_budget_real_voices are real, then the quietest
+    // is made the loudest and must swap places with the quietest real voice, resuming where it got to while virtual
+    void run_voices(u32 frames_per_update)
+    {
+        PEN_LOG("running: voices");
+
+        s_voices = {};
+
+        u32  num_frames = k_budget_seconds * k_sample_rate;
+        f32* pcm = (f32*)pen::memory_alloc(num_frames * sizeof(f32));
+        for (u32 i = 0; i < num_frames; ++i)
+            pcm[i] = 0.01f * sinf(2.0f * 3.14159265f * 440.0f * (f32)i / (f32)k_sample_rate);
+
+        pen::music_file music;
+        music.pcm_data = pcm;
+        music.len = num_frames * sizeof(f32);
+        music.num_channels = 1;
+        music.sample_frequency = k_sample_rate;
+
+        put::audio_voice_params vp;
+        vp.max_real_voices = k_budget_real_voices;
+        put::audio_set_voice_params(vp);
+
+        u32 sound = put::audio_create_sound(music);
+
+        u32 channels[k_budget_voices];
+        for (u32 i = 0; i < k_budget_voices; ++i)
+        {
+            channels[i] = put::audio_create_channel_for_sound(sound);
+            put::audio_channel_set_volume(channels[i], (f32)(i + 1) / (f32)k_budget_voices);
+            issued(2);
+        }
+
+        sync();
+        sync();
+
+        put::audio_stats stats;
+        put::audio_get_stats(&stats);
+        s_voices.num_voices = stats.num_voices;
+        s_voices.num_real = stats.num_real_voices;
+        s_voices.num_virtual = stats.num_virtual_voices;
+
+        u32 first_real = k_budget_voices - k_budget_real_voices;
+        for (u32 i = 0; i < k_budget_voices; ++i)
+        {
+            put::audio_voice_state vs;
+            if (put::audio_channel_get_voice_state(channels[i], &vs) != PEN_ERR_OK || vs.real != (i >= first_real))
+                ++s_voices.wrong_real;
+        }
+
+        // virtual voices track wall time
+        pen::thread_sleep_ms(k_budget_virtual_ms);
+        sync();
+
+        put::audio_voice_state tracked;
+        put::audio_channel_get_voice_state(channels[0], &tracked);
+        s_voices.tracked_ms = tracked.position_ms;
+
+        f64 promote_start = pen::get_time_ms();
+        put::audio_channel_set_volume(channels[0], 2.0f);
+
+        // the platform channel state lags an update behind its creation
+        sync();
+        sync();
+
+        // virtual time until the promotion, then at most the frames mixed by the four updates since
+        f64 update_ms = (f64)frames_per_update * 1000.0 / (f64)k_sample_rate;
+        s_voices.max_resumed_ms = s_voices.tracked_ms + (u32)(pen::get_time_ms() - promote_start + update_ms * 4.0) + 1;
+
+        put::audio_voice_state promoted;
+        put::audio_voice_state demoted;
+        put::audio_channel_get_voice_state(channels[0], &promoted);
+        put::audio_channel_get_voice_state(channels[first_real], &demoted);
+        s_voices.promoted = promoted.real;
+        s_voices.demoted = !demoted.real;
+
+        put::audio_channel_state cs;
+        if (put::audio_channel_get_state(channels[0], &cs) == PEN_ERR_OK)
+            s_voices.resumed_ms = cs.position_ms;
+
+        s_voices.passed = true;
+        if (s_voices.num_voices != k_budget_voices || s_voices.num_real != k_budget_real_voices ||
+            s_voices.num_virtual != k_budget_voices - k_budget_real_voices)
+        {
+            PEN_LOG("[error] audio_bench: %u voices, %u real, %u virtual, expected %u with %u real", s_voices.num_voices,
+                    s_voices.num_real, s_voices.num_virtual, k_budget_voices, k_budget_real_voices);
+            s_voices.passed = false;
+        }
+
+        if (s_voices.wrong_real)
+        {
+            PEN_LOG("[error] audio_bench: %u voices are real or virtual out of volume order", s_voices.wrong_real);
+            s_voices.passed = false;
+        }
+
+        if (!s_voices.promoted || !s_voices.demoted)
+        {
+            PEN_LOG("[error] audio_bench: the loudest voice was not promoted in place of the quietest real voice");
+            s_voices.passed = false;
+        }
+
+        if (s_voices.tracked_ms < k_budget_virtual_ms || s_voices.resumed_ms < s_voices.tracked_ms ||
+            s_voices.resumed_ms > s_voices.max_resumed_ms)
+        {
+            PEN_LOG("[error] audio_bench: promoted voice at %ums, tracked at %ums while virtual, expected up to %ums",
+                    s_voices.resumed_ms, s_voices.tracked_ms, s_voices.max_resumed_ms);
+            s_voices.passed = false;
+        }
+
+        for (u32 i = 0; i < k_budget_voices; ++i)
+        {
+            put::audio_release_resource(channels[i]);
+            issued();
+        }
+
+        put::audio_release_resource(sound);
+        sync();
+
+        pen::memory_free(pcm);
+    }
+
+    // 16 bit stereo pcm
+    bool write_music_file()
+    {
+        u32 num_frames = k_music_seconds * k_music_rate;
+        u32 data_size = num_frames * 4;
+        u32 riff_size = 36 + data_size;
+        u32 fmt_size = 16;
+        u16 format = 1;
+        u16 channels = 2;
+        u32 rate = k_music_rate;
+        u32 byte_rate = k_music_rate * 4;
+        u16 block_align = 4;
+        u16 bits = 16;
+
+        std::ofstream ofs(k_music_file, std::ios::binary);
+        if (!ofs)
+            return false;
+
+        ofs.write("RIFF", 4);
+        ofs.write((const c8*)&riff_size, 4);
+        ofs.write("WAVEfmt ", 8);
+        ofs.write((const c8*)&fmt_size, 4);
+        ofs.write((const c8*)&format, 2);
+        ofs.write((const c8*)&channels, 2);
+        ofs.write((const c8*)&rate, 4);
+        ofs.write((const c8*)&byte_rate, 4);
+        ofs.write((const c8*)&block_align, 2);
+        ofs.write((const c8*)&bits, 2);
+        ofs.write("data", 4);
+        ofs.write((const c8*)&data_size, 4);
+
+        for (u32 i = 0; i < num_frames; ++i)
+        {
+            s16 frame[2];
+            frame[0] = (s16)(8000.0f * sinf(2.0f * 3.14159265f * 220.0f * (f32)i / (f32)k_music_rate));
+            frame[1] = (s16)(8000.0f * sinf(2.0f * 3.14159265f * 330.0f * (f32)i / (f32)k_music_rate));
+            ofs.write((const c8*)frame, 4);
+        }
+
+        return true;
+    }
+
+    void run_memory(u32 ticks)
+    {
+        PEN_LOG("running: memory");
+
+        s_memory = {};
+        if (!write_music_file())
+        {
+            PEN_LOG("[error] audio_bench: failed to write %s", k_music_file);
+            return;
+        }
+
+        s_memory.file_bytes = 44 + (u64)k_music_seconds * k_music_rate * 4;
+
+        // decoded on load, every sound of the same file shares the cached pcm
+        u32 sounds[k_shared_sounds];
+        for (u32 i = 0; i < k_shared_sounds; ++i)
+        {
+            sounds[i] = put::audio_create_sound(k_music_file);
+            issued();
+        }
+
+        sync();
+
+        put::audio_mixer_stats decoded;
+        put::audio_get_mixer_stats(&decoded);
+        s_memory.decoded_bytes = decoded.sample_cache_bytes;
+        s_memory.num_cached_sounds = decoded.num_cached_sounds;
+
+        for (u32 i = 0; i < k_shared_sounds; ++i)
+        {
+            put::audio_release_resource(sounds[i]);
+            issued();
+        }
+
+        sync();
+
+        // streamed, only the decode ring is resident
+        u32 stream = put::audio_create_stream(k_music_file);
+        u32 channel = put::audio_create_channel_for_sound(stream);
+        sync();
+
+        put::audio_mixer_stats start;
+        put::audio_get_mixer_stats(&start);
+
+        for (u32 t = 0; t < ticks; ++t)
+            put::audio_consume_command_buffer();
+
+        sync();
+
+        put::audio_mixer_stats end;
+        put::audio_get_mixer_stats(&end);
+        s_memory.stream_bytes = end.stream_buffer_bytes;
+        s_memory.stream_file_bytes = end.stream_file_bytes;
+        s_memory.stream_underrun_frames = end.stream_underrun_frames - start.stream_underrun_frames;
+        s_memory.stream_mix_ms = end.mix_ms - start.mix_ms;
+
+        put::audio_release_resource(channel);
+        put::audio_release_resource(stream);
+        sync();
+
+        remove(k_music_file);
+    }
+
+    Str write_results(u32 ticks, u32 frames_per_update)
+    {
+        Str out;
+        out.appendf("{\n");
+        out.appendf("    \"ticks\": %u,\n", ticks);
+        out.appendf("    \"frames_per_update\": %u,\n", frames_per_update);
+        out.appendf("    \"sample_rate\": %u,\n", k_sample_rate);
+        out.appendf("    \"scenarios\": [\n");
+
+        u32 num_scenarios = PEN_ARRAY_SIZE(s_scenarios);
+        for (u32 i = 0; i < num_scenarios; ++i)
+        {
+            scenario& s = s_scenarios[i];
+
+            f64 audio_ms = (f64)s.frames * 1000.0 / (f64)k_sample_rate;
+            f64 voice_ms = (f64)s.voice_frames * 1000.0 / (f64)k_sample_rate;
+
+            out.appendf("        {\n");
+            out.appendf("            \"name\": \"%s\",\n", s.name);
+            out.appendf("            \"voices\": %u,\n", s.num_voices);
+            out.appendf("            \"groups\": %u,\n", s.num_groups);
+            out.appendf("            \"channels\": %u,\n", s.num_channels);
+            out.appendf("            \"source_rate\": %.0f,\n", s.source_rate);
+            out.appendf("            \"dsp\": %s,\n", s.dsp ? "true" : "false");
+            out.appendf("            \"frames\": %llu,\n", (unsigned long long)s.frames);
+            out.appendf("            \"audio_ms\": %.4f,\n", audio_ms);
+            out.appendf("            \"mix_ms\": %.4f,\n", s.mix_ms);
+            out.appendf("            \"wall_ms\": %.4f,\n", s.wall_ms);
+            out.appendf("            \"realtime_factor\": %.2f,\n", s.mix_ms > 0.0 ? audio_ms / s.mix_ms : 0.0);
+            out.appendf("            \"voices_per_core\": %.1f\n", s.mix_ms > 0.0 ? voice_ms / s.mix_ms : 0.0);
+            out.appendf("        }%s\n", i == num_scenarios - 1 ? "" : ",");
+        }
+
+        out.appendf("    ],\n");
+        out.appendf("    \"voices\": {\n");
+        out.appendf("        \"voices\": %u,\n", s_voices.num_voices);
+        out.appendf("        \"max_real_voices\": %u,\n", k_budget_real_voices);
+        out.appendf("        \"real\": %u,\n", s_voices.num_real);
+        out.appendf("        \"virtual\": %u,\n", s_voices.num_virtual);
+        out.appendf("        \"wrong_real\": %u,\n", s_voices.wrong_real);
+        out.appendf("        \"promoted\": %s,\n", s_voices.promoted ? "true" : "false");
+        out.appendf("        \"demoted\": %s,\n", s_voices.demoted ? "true" : "false");
+        out.appendf("        \"tracked_ms\": %u,\n", s_voices.tracked_ms);
+        out.appendf("        \"resumed_ms\": %u,\n", s_voices.resumed_ms);
+        out.appendf("        \"passed\": %s\n", s_voices.passed ? "true" : "false");
+        out.appendf("    },\n");
+        out.appendf("    \"memory\": {\n");
+        out.appendf("        \"music_seconds\": %u,\n", k_music_seconds);
+        out.appendf("        \"file_bytes\": %llu,\n", (unsigned long long)s_memory.file_bytes);
+        out.appendf("        \"shared_sounds\": %u,\n", k_shared_sounds);
+        out.appendf("        \"cached_copies\": %u,\n", s_memory.num_cached_sounds);
+        out.appendf("        \"decoded_bytes\": %llu,\n", (unsigned long long)s_memory.decoded_bytes);
+        out.appendf("        \"stream_bytes\": %llu,\n", (unsigned long long)s_memory.stream_bytes);
+        out.appendf("        \"stream_file_bytes\": %llu,\n", (unsigned long long)s_memory.stream_file_bytes);
+        out.appendf("        \"stream_underrun_frames\": %llu,\n", (unsigned long long)s_memory.stream_underrun_frames);
+        out.appendf("        \"stream_mix_ms\": %.4f\n", s_memory.stream_mix_ms);
+        out.appendf("    }\n");
+        out.appendf("}\n");
+        return out;
+    }
+} // namespace
+
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        for (s32 i = 0; i < argc; ++i)
+            sb_push(s_args, argv[i]);
+
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "audio_bench";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+void show_help()
+{
+    PEN_LOG("audio_bench help");
+    PEN_LOG("    -help <show this dialog>");
+    PEN_LOG("    -o (optional) <output file> defaults to audio_bench.json");
+    PEN_LOG("    -ticks (optional) <number of mixer updates per scenario> defaults to %u", k_default_ticks);
+    PEN_LOG("    -frames (optional) <frames mixed each update> defaults to %u", k_default_frames);
+    PEN_LOG("    scenarios: mono and stereo voices at 64 to 4k, resampled voices and groups with fft, eq and gain.");
+    PEN_LOG("    voices: %u voices against %u real, checks the real set and that promoted voices resume.", k_budget_voices,
+            k_budget_real_voices);
+    PEN_LOG("    memory: %us of music decoded into the sample cache vs streamed.", k_music_seconds);
+}
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    Str output_file = "audio_bench.json";
+    u32 ticks = k_default_ticks;
+    u32 frames = k_default_frames;
+    u32 failed = 0;
+
+    u32 argc = sb_count(s_args);
+    for (u32 i = 0; i < argc; ++i)
+    {
+        if (s_args[i] == "-help")
+        {
+            show_help();
+            goto term;
+        }
+        else if (s_args[i] == "-o" && i + 1 < argc)
+        {
+            output_file = s_args[i + 1];
+        }
+        else if (s_args[i] == "-ticks" && i + 1 < argc)
+        {
+            ticks = (u32)atoi(s_args[i + 1].c_str());
+        }
+        else if (s_args[i] == "-frames" && i + 1 < argc)
+        {
+            frames = (u32)atoi(s_args[i + 1].c_str());
+        }
+    }
+
+    {
+        put::audio_mixer_stats stats;
+        if (put::audio_get_mixer_stats(&stats) != PEN_ERR_OK)
+        {
+            PEN_LOG("[error] audio_bench: put was built without the software mixer, generate with --audio=software");
+            goto term;
+        }
+
+        // offline, output is discarded and every update mixes a fixed number of frames as fast as possible
+        put::audio_sink sink;
+        sink.write = put::audio_memory_sink_write;
+        sink.user_data = &s_memory_sink;
+        sink.sample_rate = k_sample_rate;
+        sink.frames_per_update = frames;
+        put::audio_set_sink(sink);
+
+        pen::jobs_create_job(put::audio_thread_function, 1024 * 10, nullptr, pen::e_thread_start_flags::detached);
+
+        for (auto& s : s_scenarios)
+            run_scenario(s, ticks, frames);
+
+        run_voices(frames);
+        run_memory(ticks);
+
+        failed = s_voices.passed ? 0 : 1;
+
+        Str results = write_results(ticks, frames);
+
+        std::ofstream ofs(output_file.c_str());
+        ofs << results.c_str();
+        ofs.close();
+
+        PEN_LOG("%s", results.c_str());
+        PEN_LOG("written: %s", output_file.c_str());
+    }
+
+term:
+    // signal to the engine the thread has finished
+    pen::os_terminate(failed);
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,582 @@
+// ecs_tests.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Headless checks for ecs scene bookkeeping which does not need a renderer, exits with the number of failed tests.
+
+#include "ecs/ecs_cull.h"
+#include "ecs/ecs_scene.h"
+#include "ecs/ecs_stream.h"
+#include "ecs/ecs_utilities.h"
+
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "os.h"
+#include "pen.h"
+#include "threads.h"
+
+#include <stdio.h>
+#include <vector>
+
+using namespace pen;
+using namespace put;
+using namespace ecs;
+
+namespace
+{
+    struct test
+    {
+        const c8* name;
+        bool (*func)();
+    };
+
+    ecs_scene* create_test_scene()
+    {
+        // a bare scene, create_scene would also create render buffers
+        ecs_scene* scene = new ecs_scene();
+        resize_scene_buffers(scene, k_cmp_dense_page_entities);
+        return scene;
+    }
+
+    void destroy_test_scene(ecs_scene* scene)
+    {
+        free_scene_buffers(scene, true);
+        delete scene;
+    }
+
+    // deletes entities without the physics and renderer releases delete_entity does, which need their threads
+    void delete_test_entities(ecs_scene* scene, const u32* entities, u32 count)
+    {
+        for (u32 i = 0; i < count; ++i)
+            zero_entity_components(scene, entities[i]);
+    }
+
+    // every node reachable from the head must be free, linked both ways and visited once, and the set of nodes must
+    // match expected exactly
+    bool check_free_list(ecs_scene* scene, const std::vector<u32>& expected)
+    {
+        std::vector<u8> visited(scene->soa_size, 0);
+
+        u32             count = 0;
+        free_node_list* prev = nullptr;
+        for (free_node_list* l = scene->free_list_head; l; l = l->next)
+        {
+            if (l->node >= scene->soa_size || l != &scene->free_list[l->node])
+            {
+                PEN_LOG("    free list node %u does not match its slot", l->node);
+                return false;
+            }
+
+            if (visited[l->node])
+            {
+                PEN_LOG("    free list visits %u more than once", l->node);
+                return false;
+            }
+
+            if (scene->entities[l->node] & e_cmp::allocated)
+            {
+                PEN_LOG("    free list contains allocated entity %u", l->node);
+                return false;
+            }
+
+            if (prev && l->prev != prev)
+            {
+                PEN_LOG("    free list node %u has a stale prev link", l->node);
+                return false;
+            }
+
+            visited[l->node] = 1;
+            prev = l;
+            ++count;
+        }
+
+        for (u32 e : expected)
+        {
+            if (!visited[e])
+            {
+                PEN_LOG("    free entity %u is not reachable from the free list head", e);
+                return false;
+            }
+        }
+
+        if (count != expected.size())
+        {
+            PEN_LOG("    free list has %u nodes, expected %u", count, (u32)expected.size());
+            return false;
+        }
+
+        return true;
+    }
+
+    void append_range(std::vector<u32>& v, u32 start, u32 end)
+    {
+        for (u32 i = start; i < end; ++i)
+            v.push_back(i);
+    }
+
+    // the scene is full apart from slots freed out of order in the middle, so the last node in memory is allocated
+    bool grow_after_deletes()
+    {
+        ecs_scene* scene = create_test_scene();
+
+        for (u32 i = 0; i < k_cmp_dense_page_entities; ++i)
+            get_new_entity(scene);
+
+        const u32 deleted[] = {900, 17, 512, 3};
+        delete_test_entities(scene, deleted, PEN_ARRAY_SIZE(deleted));
+        initialise_free_list(scene);
+
+        // takes the lowest free slot
+        u32 reused = get_new_entity(scene);
+
+        u32 prev_size = scene->soa_size;
+        resize_scene_buffers(scene, k_cmp_dense_page_entities);
+
+        std::vector<u32> expected = {17, 512, 900};
+        append_range(expected, prev_size, scene->soa_size);
+
+        bool pass = reused == 3 && check_free_list(scene, expected);
+        destroy_test_scene(scene);
+        return pass;
+    }
+
+    // the last slot in memory was deleted but has not been relinked, so it is not part of the free list
+    bool grow_after_unlinked_delete()
+    {
+        ecs_scene* scene = create_test_scene();
+
+        for (u32 i = 0; i < k_cmp_dense_page_entities; ++i)
+            get_new_entity(scene);
+
+        const u32 deleted[] = {600, 40};
+        delete_test_entities(scene, deleted, PEN_ARRAY_SIZE(deleted));
+        initialise_free_list(scene);
+
+        const u32 last = k_cmp_dense_page_entities - 1;
+        delete_test_entities(scene, &last, 1);
+
+        u32 prev_size = scene->soa_size;
+        resize_scene_buffers(scene, k_cmp_dense_page_entities);
+
+        std::vector<u32> expected = {40, 600};
+        append_range(expected, prev_size, scene->soa_size);
+
+        bool pass = check_free_list(scene, expected);
+        destroy_test_scene(scene);
+        return pass;
+    }
+
+    // repeated growth with allocations in between must keep handing out unique slots
+    bool grow_repeatedly()
+    {
+        ecs_scene* scene = create_test_scene();
+
+        const u32        num = k_cmp_dense_page_entities * 3 + 100;
+        std::vector<u8>  used(num * 2, 0);
+        std::vector<u32> del;
+
+        bool pass = true;
+        for (u32 i = 0; i < num; ++i)
+        {
+            u32 e = get_new_entity(scene);
+            if (e >= used.size() || used[e])
+            {
+                PEN_LOG("    entity %u handed out twice", e);
+                pass = false;
+                break;
+            }
+
+            used[e] = 1;
+
+            // free a few slots behind the allocation point
+            if (i % 97 == 0)
+                del.push_back(e);
+        }
+
+        delete_test_entities(scene, del.data(), (u32)del.size());
+        initialise_free_list(scene);
+
+        u32 prev_size = scene->soa_size;
+        resize_scene_buffers(scene, k_cmp_dense_page_entities);
+
+        std::vector<u32> expected;
+        for (u32 i = 0; i < prev_size; ++i)
+            if (!(scene->entities[i] & e_cmp::allocated))
+                expected.push_back(i);
+
+        append_range(expected, prev_size, scene->soa_size);
+
+        pass &= check_free_list(scene, expected);
+        destroy_test_scene(scene);
+        return pass;
+    }
+
+    struct expected_cluster
+    {
+        u32 x, y, z;
+        u32 count;
+        u32 lights[2];
+    };
+
+    // a 90 degree square frustum from 1 to 256 split into 4x4x8 clusters, so z slice i spans depth 2^i to 2^(i+1)
+    // and the tiles of a slice are split at x and y = 0 and +/- depth / 2.
+    bool assign_point_light_clusters()
+    {
+        camera cam;
+        camera_create_perspective(&cam, 90.0f, 1.0f, 1.0f, 256.0f);
+        cam.view = mat4::create_identity();
+
+        // view space, the camera looks down -z
+        const cluster_light lights[] = {
+            {vec4f(0.75f, 0.75f, -3.0f, 0.2f), vec4f::zero()}, // inside tile 2, 2 of slice 1
+            {vec4f(1.0f, 1.0f, -8.0f, 0.4f), vec4f::zero()},   // straddles slices 2 and 3
+            {vec4f(1.0f, 0.75f, -3.5f, 0.2f), vec4f::zero()},  // straddles tiles 2 and 3 of slice 1
+            {vec4f(0.0f, 0.0f, -300.0f, 0.5f), vec4f::zero()}, // beyond the far plane
+            {vec4f(-100.0f, 0.0f, -3.0f, 0.5f), vec4f::zero()} // outside the frustum
+        };
+
+        const expected_cluster expected[] = {
+            {2, 2, 1, 2, {0, 2}},
+            {3, 2, 1, 1, {2}},
+            {2, 2, 2, 1, {1}},
+            {2, 2, 3, 1, {1}},
+        };
+
+        light_clusters lc;
+        lc.dims[0] = 4;
+        lc.dims[1] = 4;
+        lc.dims[2] = 8;
+
+        assign_light_clusters(lc, &cam, lights, PEN_ARRAY_SIZE(lights));
+
+        bool pass = true;
+
+        u32 num_tiles = lc.dims[0] * lc.dims[1];
+        u32 num_clusters = num_tiles * lc.dims[2];
+        u32 num_indices = sb_count(lc.indices);
+
+        if (sb_count(lc.offsets) != num_clusters * 2)
+        {
+            PEN_LOG("    %u offsets, expected %u", sb_count(lc.offsets), num_clusters * 2);
+            pass = false;
+        }
+
+        if (num_indices != 5)
+        {
+            PEN_LOG("    %u light indices, expected 5", num_indices);
+            pass = false;
+        }
+
+        for (u32 c = 0; pass && c < num_clusters; ++c)
+        {
+            u32 x = c % lc.dims[0];
+            u32 y = (c / lc.dims[0]) % lc.dims[1];
+            u32 z = c / num_tiles;
+
+            u32 start = lc.offsets[c * 2 + 0];
+            u32 count = lc.offsets[c * 2 + 1];
+
+            if (start + count > num_indices)
+            {
+                PEN_LOG("    cluster %u, %u, %u range %u + %u is outside of the indices", x, y, z, start, count);
+                pass = false;
+                break;
+            }
+
+            const expected_cluster* ec = nullptr;
+            for (auto& e : expected)
+                if (e.x == x && e.y == y && e.z == z)
+                    ec = &e;
+
+            u32 expected_count = ec ? ec->count : 0;
+            if (count != expected_count)
+            {
+                PEN_LOG("    cluster %u, %u, %u has %u lights, expected %u", x, y, z, count, expected_count);
+                pass = false;
+                break;
+            }
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                if (lc.indices[start + i] != ec->lights[i])
+                {
+                    PEN_LOG("    cluster %u, %u, %u light %u is %u, expected %u", x, y, z, i, lc.indices[start + i],
+                            ec->lights[i]);
+                    pass = false;
+                }
+            }
+        }
+
+        free_light_clusters(lc);
+        return pass;
+    }
+
+    // cells in a row along x, each holds roots with a child and is sized so a 1mb memory budget holds two of them
+    const u32    k_stream_cells = 4;
+    const f32    k_stream_cell_size = 10.0f;
+    const size_t k_stream_cell_bytes = 400 * 1024;
+    const u32    k_stream_max_updates = 10000;
+
+    // bytes of base components per entity, as the stream world estimates cell memory
+    size_t get_entity_memory(ecs_scene* scene)
+    {
+        size_t entity_memory = 0;
+        for (u32 c = 0; c < scene->num_base_components; ++c)
+            entity_memory += scene->get_component_array(c).size;
+
+        return entity_memory;
+    }
+
+    // returns the number of entities in each cell. entities have stale runtime handles as they would after being
+    // committed, no geometry, lights or physics so nothing needs the renderer or physics threads
+    u32 create_stream_source(ecs_scene* scene)
+    {
+        u32 num_roots = (u32)(k_stream_cell_bytes / (get_entity_memory(scene) * 2)) + 1;
+
+        for (u32 c = 0; c < k_stream_cells; ++c)
+        {
+            for (u32 r = 0; r < num_roots; ++r)
+            {
+                u32 root = get_new_entity(scene);
+                u32 child = get_new_entity(scene);
+
+                scene->parents[child] = root;
+                scene->transforms[root].translation = vec3f(c * k_stream_cell_size + 5.0f, 0.0f, 5.0f);
+                scene->transforms[child].translation = vec3f(0.0f, 1.0f, 0.0f);
+
+                if (r == 0)
+                {
+                    scene->entities[root] |= e_cmp::master_instance;
+                    scene->master_instances.write(root).instance_buffer = 300 + root;
+                }
+
+                u32 nodes[] = {root, child};
+                for (u32 n : nodes)
+                {
+                    scene->cbuffer[n] = 100 + n;
+                    scene->physics_handles[n] = 200 + n;
+                }
+            }
+        }
+
+        return num_roots * 2;
+    }
+
+    void remove_stream_files()
+    {
+        remove("world.pmw");
+
+        for (u32 c = 0; c < k_stream_cells; ++c)
+        {
+            Str fn = "";
+            fn.appendf("cell_%i_0.pms", c);
+            remove(fn.c_str());
+        }
+    }
+
+    // counts streamed entities and sets a bit for each cell with roots in the scene, false if any entity has a
+    // runtime handle it did not create or a parent outside of the scene. parents may already be deleted while a cell
+    // is unloading, once settled they must be streamed in as well.
+    bool check_streamed_entities(ecs_scene* scene, u32& count, u32& cells, bool settled)
+    {
+        count = 0;
+        cells = 0;
+
+        for (u32 n = 0; n < scene->num_entities; ++n)
+        {
+            if (!(scene->entities[n] & e_cmp::allocated))
+                continue;
+
+            ++count;
+
+            if (is_valid(scene->cbuffer[n]) || is_valid(scene->physics_handles[n]))
+            {
+                PEN_LOG("    entity %u has stale handles, cbuffer %u physics %u", n, scene->cbuffer[n],
+                        scene->physics_handles[n]);
+                return false;
+            }
+
+            if ((scene->entities[n] & e_cmp::master_instance) && scene->master_instances[n].instance_buffer)
+            {
+                PEN_LOG("    entity %u has a stale instance buffer %u", n, scene->master_instances[n].instance_buffer);
+                return false;
+            }
+
+            u32 p = scene->parents[n];
+            if (p >= scene->num_entities || (settled && !(scene->entities[p] & e_cmp::allocated)))
+            {
+                PEN_LOG("    entity %u has parent %u which is not streamed in", n, p);
+                return false;
+            }
+
+            if (p == n)
+                cells |= 1 << (u32)(scene->transforms[n].translation.x / k_stream_cell_size);
+        }
+
+        return true;
+    }
+
+    // updates until the scene holds count entities from cells and loaded cells are fully committed, false if it fails
+    // a check or takes too long
+    bool update_stream_until(stream_world* world, ecs_scene* scene, const vec3f& focus, u32 count, u32 cells,
+                             u32 loaded)
+    {
+        for (u32 i = 0; i < k_stream_max_updates; ++i)
+        {
+            update_stream_world(world, focus);
+
+            u32 c, cm;
+            if (!check_streamed_entities(scene, c, cm, false))
+                return false;
+
+            u32    lc;
+            size_t memory;
+            get_stream_stats(world, lc, memory);
+
+            if (c == count && cm == cells && lc == loaded)
+                return true;
+
+            pen::thread_sleep_ms(1);
+        }
+
+        PEN_LOG("    timed out waiting for %u entities in cells %x with %u loaded", count, cells, loaded);
+        return false;
+    }
+
+    // cells in memory includes cells which are committing or unloading
+    bool check_stream_stats(stream_world* world, u32 expected_loaded, u32 expected_in_memory, size_t cell_memory)
+    {
+        u32    loaded;
+        size_t memory;
+        get_stream_stats(world, loaded, memory);
+
+        if (loaded != expected_loaded || memory != expected_in_memory * cell_memory)
+        {
+            PEN_LOG("    %u cells loaded with %u bytes, expected %u loaded and %u bytes", loaded, (u32)memory,
+                    expected_loaded, (u32)(expected_in_memory * cell_memory));
+            return false;
+        }
+
+        return true;
+    }
+
+    bool stream_cells()
+    {
+        ecs_scene* source = create_test_scene();
+        u32        cell_entities = create_stream_source(source);
+        save_stream_cells(source, k_stream_cell_size, ".");
+        destroy_test_scene(source);
+
+        ecs_scene* scene = create_test_scene();
+
+        size_t cell_memory = cell_entities * get_entity_memory(scene);
+
+        // only the first cell is in range and commits never get any time, so it is placed but stays committing
+        stream_params params;
+        params.load_radius = 1.0f;
+        params.unload_radius = 20.0f;
+        params.commit_budget_ms = 0.000001;
+        params.memory_budget_mb = 1;
+
+        stream_world* world = create_stream_world(scene, ".", params);
+        if (!world)
+        {
+            destroy_test_scene(scene);
+            remove_stream_files();
+            return false;
+        }
+
+        vec3f start = vec3f(5.0f, 0.0f, 5.0f);
+
+        bool pass = update_stream_until(world, scene, start, cell_entities, 1 << 0, 0);
+        pass = pass && check_stream_stats(world, 0, 1, cell_memory);
+
+        // move away while it is still committing, it is unloaded within the budget
+        params.commit_budget_ms = 0.1;
+        set_stream_params(world, params);
+
+        vec3f away = vec3f(1000.0f, 0.0f, 5.0f);
+        pass = pass && update_stream_until(world, scene, away, 0, 0, 0);
+        pass = pass && check_stream_stats(world, 0, 0, cell_memory);
+
+        // the two nearest cells load and commit
+        params.load_radius = 12.0f;
+        params.commit_budget_ms = 2.0;
+        set_stream_params(world, params);
+
+        pass = pass && update_stream_until(world, scene, start, cell_entities * 2, (1 << 0) | (1 << 1), 2);
+        pass = pass && check_stream_stats(world, 2, 2, cell_memory);
+
+        // at the far end cell 0 unloads, cell 1 is inside the unload radius so it stays and the memory budget
+        // leaves room for cell 3 but not cell 2
+        vec3f end = vec3f(35.0f, 0.0f, 5.0f);
+        pass = pass && update_stream_until(world, scene, end, cell_entities * 2, (1 << 1) | (1 << 3), 2);
+
+        // and nothing else comes in once it has settled
+        for (u32 i = 0; pass && i < 100; ++i)
+            update_stream_world(world, end);
+
+        u32 count, cells;
+        pass = pass && check_streamed_entities(scene, count, cells, true);
+        pass = pass && count == cell_entities * 2 && cells == ((1 << 1) | (1 << 3));
+        pass = pass && check_stream_stats(world, 2, 2, cell_memory);
+
+        destroy_stream_world(world);
+
+        pass = pass && check_streamed_entities(scene, count, cells, true) && count == 0;
+
+        destroy_test_scene(scene);
+        remove_stream_files();
+        return pass;
+    }
+
+    test s_tests[] = {
+        {"grow after out of order deletes", grow_after_deletes},
+        {"grow after an unlinked delete", grow_after_unlinked_delete},
+        {"grow repeatedly", grow_repeatedly},
+        {"assign point light clusters", assign_point_light_clusters},
+        {"stream cells in and out", stream_cells},
+    };
+} // namespace
+
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "ecs_tests";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    u32 failed = 0;
+    for (auto& t : s_tests)
+    {
+        bool pass = t.func();
+        PEN_LOG("%s: %s", pass ? "passed" : "FAILED", t.name);
+
+        if (!pass)
+            ++failed;
+    }
+
+    PEN_LOG("%u / %u tests passed", (u32)PEN_ARRAY_SIZE(s_tests) - failed, (u32)PEN_ARRAY_SIZE(s_tests));
+
+    // signal to the engine the thread has finished
+    pen::os_terminate(failed);
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
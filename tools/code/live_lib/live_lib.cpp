@@ -172,9 +172,9 @@ struct live_lib
         u32 light = get_new_entity(scene);
         scene->names[light] = "front_light";
         scene->id_name[light] = PEN_HASH("front_light");
-        scene->lights[light].colour = vec3f::one();
-        scene->lights[light].direction = vec3f::one();
-        scene->lights[light].type = e_light_type::dir;
+        scene->lights.write(light).colour = vec3f::one();
+        scene->lights.write(light).direction = vec3f::one();
+        scene->lights.write(light).type = e_light_type::dir;
         //scene->lights[light].flags = e_light_flags::shadow_map;
         scene->transforms[light].translation = vec3f::zero();
         scene->transforms[light].rotation = quat();
@@ -185,9 +185,9 @@ struct live_lib
         light = get_new_entity(scene);
         scene->names[light] = "front_light";
         scene->id_name[light] = PEN_HASH("front_light");
-        scene->lights[light].colour = vec3f::one();
-        scene->lights[light].direction = vec3f(-1.0f, 0.0f, 1.0f);
-        scene->lights[light].type = e_light_type::dir;
+        scene->lights.write(light).colour = vec3f::one();
+        scene->lights.write(light).direction = vec3f(-1.0f, 0.0f, 1.0f);
+        scene->lights.write(light).type = e_light_type::dir;
         scene->transforms[light].translation = vec3f::zero();
         scene->transforms[light].rotation = quat();
         scene->transforms[light].scale = vec3f::one();
@@ -5,6 +5,7 @@
 #include "pen.h"
 #include "threads.h"
 #include "os.h"
+#include "str_utilities.h"
 
 using namespace pen;
 using namespace put;
@@ -35,9 +36,12 @@ void show_help()
 {
     PEN_LOG("mesh_opt help");
     PEN_LOG("    -help <show this dialog>");
-    PEN_LOG("    -i <input file>");
+    PEN_LOG("    -i <input file> (.pmm or .pma)");
     PEN_LOG("    -o (optional) <output file>");
     PEN_LOG("      if -o is not supplied input file will be overwritten in place.");
+    PEN_LOG("    .pmm files are re-indexed and get a chain of simplified lods for each submesh.");
+    PEN_LOG("    large static submeshes are also split into meshlets with bounds and normal cones for cluster culling.");
+    PEN_LOG("    static submeshes get collision cooked into a .pmc next to the output, a bvh mesh and a simplified hull.");
 }
 
 void* pen::user_entry(void* params)
@@ -80,7 +84,10 @@ void* pen::user_entry(void* params)
     }
     
     PEN_LOG("optimising: %s", input_file.c_str());
-    optimise_pmm(input_file.c_str(), output_file.c_str());
+    if(pen::str_ends_with(input_file, ".pma"))
+        optimise_pma(input_file.c_str(), output_file.c_str());
+    else
+        optimise_pmm(input_file.c_str(), output_file.c_str());
     
 term:
     // signal to the engine the thread has finished
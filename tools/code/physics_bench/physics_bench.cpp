@@ -0,0 +1,806 @@
+// physics_bench.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Headless physics benchmarks, builds standard scenarios through the physics api, steps each for a fixed number of
+// ticks and writes step time percentiles, command throughput and bullet memory as json. -sweep repeats the scenarios
+// at several solver thread counts to show how the mt world scales.
+
+#include "physics/physics.h"
+
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "os.h"
+#include "pen.h"
+#include "pen_string.h"
+#include "str_utilities.h"
+#include "threads.h"
+#include "timer.h"
+
+#include "bullet/src/LinearMath/btAlignedAllocator.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace pen;
+
+namespace physics
+{
+    extern void* physics_thread_main(void* params);
+}
+
+namespace
+{
+    const f32 k_dt = 1.0f / 60.0f;
+    const u32 k_default_ticks = 600;
+    const u32 k_flush_cmds = 512; // sync during setup so the physics thread works through commands as they are issued
+    const u32 k_num_storm_rays = 10000;
+    const u32 k_queue_cmds = 500;
+    const u32 k_stress_rate_hz = 1000; // fast enough that several ticks land while a read is held
+    const u32 k_stress_hold_us = 4000;
+    const u32 k_sweep_threads[] = {1, 2, 4, 8};
+
+    Str*                           s_args = nullptr;
+    physics::physics_thread_params s_physics_params;
+
+    // bullet allocations are tracked through its aligned allocator hooks, the header sits in front of the block
+    struct alloc_header
+    {
+        void*  base;
+        size_t size;
+    };
+
+    a_u64 s_bullet_bytes = {0};
+    a_u64 s_bullet_peak = {0};
+
+    void* tracked_alloc(size_t size, int alignment)
+    {
+        size_t    align = std::max<size_t>((size_t)alignment, sizeof(void*));
+        u8*       base = (u8*)malloc(size + align + sizeof(alloc_header));
+        uintptr_t mem = ((uintptr_t)base + sizeof(alloc_header) + align - 1) & ~(uintptr_t)(align - 1);
+
+        alloc_header* header = (alloc_header*)mem - 1;
+        header->base = base;
+        header->size = size;
+
+        u64 cur = (s_bullet_bytes += size);
+        u64 peak = s_bullet_peak;
+        while (cur > peak && !s_bullet_peak.compare_exchange_weak(peak, cur))
+            ;
+
+        return (void*)mem;
+    }
+
+    void tracked_free(void* mem)
+    {
+        if (!mem)
+            return;
+
+        alloc_header* header = (alloc_header*)mem - 1;
+        s_bullet_bytes -= header->size;
+        free(header->base);
+    }
+
+    // fence, a ray cast runs in command order on the physics thread so its callback marks everything before it done
+    a_u32 s_fence = {0};
+
+    void fence_callback(const physics::cast_result& result)
+    {
+        s_fence = 1;
+    }
+
+    void sync()
+    {
+        s_fence = 0;
+
+        physics::ray_cast_params rcp;
+        rcp.start = vec3f(1000.0f, 1000.0f, 1000.0f);
+        rcp.end = vec3f(1000.0f, 1001.0f, 1000.0f);
+        rcp.timestamp = 0;
+        rcp.callback = fence_callback;
+        physics::cast_ray(rcp);
+
+        physics::physics_consume_command_buffer();
+
+        while (!s_fence)
+            pen::thread_sleep_us(10);
+    }
+
+    // commands issued since the last sync
+    u32 s_pending_cmds = 0;
+
+    void issued(u32 num_cmds = 1)
+    {
+        s_pending_cmds += num_cmds;
+        if (s_pending_cmds >= k_flush_cmds)
+        {
+            sync();
+            s_pending_cmds = 0;
+        }
+    }
+
+    struct scenario
+    {
+        const c8* name;
+        void (*setup)(scenario& s);
+        void (*update)(scenario& s);     // optional, before each step
+        void (*after_step)(scenario& s); // optional, once the step is complete
+        const c8* extra_name;            // what extra_ms times, for the json
+
+        // created by setup, released after the run. scenarios are static so these start zeroed
+        u32*   bodies;
+        u32*   constraints;
+        void** allocations; // params the physics thread reads, freed once released
+
+        // results
+        f64* step_ms;
+        f64* extra_ms;    // scenario specific per tick time, cast or command drain time
+        u64  extra_count; // casts or commands in extra_ms
+        f64  setup_ms;
+        u64  setup_bytes;
+        u64  peak_bytes;
+    };
+
+    physics::rigid_body_params make_rb(physics::shape_type shape, const vec3f& pos, const vec3f& dim, f32 mass)
+    {
+        physics::rigid_body_params rb;
+        rb.position = pos;
+        rb.dimensions = dim;
+        rb.shape_up_axis = physics::e_up_axis::y;
+        rb.rotation = quat();
+        rb.shape = shape;
+        rb.mass = mass;
+        rb.start_matrix = mat::create_translation(pos);
+        rb.mesh_data.vertices = nullptr;
+        rb.mesh_data.indices = nullptr;
+        rb.mesh_data.num_floats = 0;
+        rb.mesh_data.num_indices = 0;
+        return rb;
+    }
+
+    u32 add_body(scenario& s, physics::shape_type shape, const vec3f& pos, const vec3f& dim, f32 mass)
+    {
+        u32 h = physics::add_rb(make_rb(shape, pos, dim, mass));
+        sb_push(s.bodies, h);
+        issued();
+        return h;
+    }
+
+    void add_ground(scenario& s)
+    {
+        add_body(s, physics::e_shape::box, vec3f(0.0f, -1.0f, 0.0f), vec3f(48.0f, 1.0f, 48.0f), 0.0f);
+    }
+
+    // child is held at offset in the parent frame, free to swing within limit radians
+    u32 add_joint(scenario& s, u32 parent, u32 child, const vec3f& offset, f32 limit)
+    {
+        physics::constraint_params cp;
+        cp.type = physics::e_constraint::dof6;
+        cp.axis = vec3f::zero();
+        cp.pivot = vec3f::zero();
+        cp.lower_limit_translation = offset;
+        cp.upper_limit_translation = offset;
+        cp.lower_limit_rotation = vec3f(-limit);
+        cp.upper_limit_rotation = vec3f(limit);
+        cp.linear_damping = 0.0f;
+        cp.angular_damping = 0.1f;
+        cp.rb_indices[0] = child;
+        cp.rb_indices[1] = parent;
+
+        u32 h = physics::add_constraint(cp);
+        sb_push(s.constraints, h);
+        issued();
+        return h;
+    }
+
+    void setup_box_stacks(scenario& s)
+    {
+        add_ground(s);
+
+        // 10 stacks of 20
+        for (u32 x = 0; x < 10; ++x)
+            for (u32 y = 0; y < 20; ++y)
+                add_body(s, physics::e_shape::box, vec3f(-18.0f + x * 4.0f, 0.5f + y * 1.0f, 0.0f), vec3f(0.5f), 1.0f);
+    }
+
+    void setup_pile(scenario& s)
+    {
+        add_ground(s);
+
+        // 25 x 25 x 16 = 10k bodies, alternating shapes so the pile collapses
+        for (u32 y = 0; y < 16; ++y)
+        {
+            for (u32 z = 0; z < 25; ++z)
+            {
+                for (u32 x = 0; x < 25; ++x)
+                {
+                    vec3f pos = vec3f(-13.2f + x * 1.1f, 0.5f + y * 1.1f, -13.2f + z * 1.1f);
+
+                    if ((x + y + z) & 1)
+                        add_body(s, physics::e_shape::sphere, pos, vec3f(0.5f), 1.0f);
+                    else
+                        add_body(s, physics::e_shape::box, pos, vec3f(0.45f), 1.0f);
+                }
+            }
+        }
+    }
+
+    void setup_compounds(scenario& s)
+    {
+        add_ground(s);
+
+        // 500 dumbbells, a bar and two end boxes each
+        for (u32 i = 0; i < 500; ++i)
+        {
+            vec3f pos = vec3f(-20.0f + (i % 10) * 4.0f, 1.0f + (i / 100) * 2.0f, -20.0f + ((i / 10) % 10) * 4.0f);
+
+            physics::rigid_body_params* children =
+                (physics::rigid_body_params*)pen::memory_alloc(sizeof(physics::rigid_body_params) * 3);
+
+            children[0] = make_rb(physics::e_shape::box, pos, vec3f(1.0f, 0.1f, 0.1f), 1.0f);
+            children[1] = make_rb(physics::e_shape::box, pos - vec3f(1.0f, 0.0f, 0.0f), vec3f(0.3f), 1.0f);
+            children[2] = make_rb(physics::e_shape::box, pos + vec3f(1.0f, 0.0f, 0.0f), vec3f(0.3f), 1.0f);
+            sb_push(s.allocations, children);
+
+            physics::compound_rb_params cp;
+            cp.base = make_rb(physics::e_shape::compound, pos, vec3f(1.0f), 3.0f);
+            cp.rb = children;
+            cp.num_shapes = 3;
+
+            u32* child_handles = nullptr;
+            sb_push(s.bodies, physics::add_compound_rb(cp, &child_handles));
+            for (u32 c = 0; c < sb_count(child_handles); ++c)
+                sb_push(s.bodies, child_handles[c]);
+
+            sb_free(child_handles);
+            issued();
+        }
+    }
+
+    void setup_chains(scenario& s)
+    {
+        // 50 chains of 20 links held out horizontally from a static anchor, they droop and swing under gravity
+        const vec3f offset = vec3f(0.8f, 0.0f, 0.0f);
+        for (u32 c = 0; c < 50; ++c)
+        {
+            vec3f pos = vec3f(-20.0f, 30.0f, -24.5f + c * 1.0f);
+            u32   parent = add_body(s, physics::e_shape::box, pos, vec3f(0.2f), 0.0f);
+
+            for (u32 l = 0; l < 20; ++l)
+            {
+                pos += offset;
+
+                u32 link = add_body(s, physics::e_shape::box, pos, vec3f(0.4f, 0.1f, 0.1f), 1.0f);
+                add_joint(s, parent, link, offset, 0.6f);
+                parent = link;
+            }
+        }
+    }
+
+    void setup_ragdolls(scenario& s)
+    {
+        add_ground(s);
+
+        struct part
+        {
+            s32   parent;
+            vec3f offset; // from the parent
+            vec3f dim;
+        };
+
+        static const part k_parts[] = {
+            {-1, vec3f(0.0f, 0.0f, 0.0f), vec3f(0.3f, 0.15f, 0.15f)},    // pelvis
+            {0, vec3f(0.0f, 0.35f, 0.0f), vec3f(0.3f, 0.2f, 0.15f)},     // spine
+            {1, vec3f(0.0f, 0.4f, 0.0f), vec3f(0.15f, 0.15f, 0.15f)},    // head
+            {1, vec3f(-0.45f, 0.15f, 0.0f), vec3f(0.2f, 0.08f, 0.08f)},  // upper arms
+            {1, vec3f(0.45f, 0.15f, 0.0f), vec3f(0.2f, 0.08f, 0.08f)},   //
+            {3, vec3f(-0.4f, 0.0f, 0.0f), vec3f(0.2f, 0.07f, 0.07f)},    // lower arms
+            {4, vec3f(0.4f, 0.0f, 0.0f), vec3f(0.2f, 0.07f, 0.07f)},     //
+            {0, vec3f(-0.15f, -0.45f, 0.0f), vec3f(0.1f, 0.22f, 0.1f)},  // thighs
+            {0, vec3f(0.15f, -0.45f, 0.0f), vec3f(0.1f, 0.22f, 0.1f)},   //
+            {7, vec3f(0.0f, -0.45f, 0.0f), vec3f(0.08f, 0.22f, 0.08f)},  // shins
+            {8, vec3f(0.0f, -0.45f, 0.0f), vec3f(0.08f, 0.22f, 0.08f)}}; //
+
+        static const u32 k_num_parts = PEN_ARRAY_SIZE(k_parts);
+
+        // 100 ragdolls dropped in layers
+        for (u32 r = 0; r < 100; ++r)
+        {
+            vec3f root = vec3f(-18.0f + (r % 10) * 4.0f, 2.0f + (r / 50) * 2.0f, -18.0f + ((r / 10) % 5) * 8.0f);
+
+            u32   handles[k_num_parts];
+            vec3f positions[k_num_parts];
+            for (u32 p = 0; p < k_num_parts; ++p)
+            {
+                const part& pt = k_parts[p];
+                positions[p] = pt.parent < 0 ? root : positions[pt.parent] + pt.offset;
+                handles[p] = add_body(s, physics::e_shape::box, positions[p], pt.dim, 1.0f);
+
+                if (pt.parent >= 0)
+                    add_joint(s, handles[pt.parent], handles[p], pt.offset, 0.5f);
+            }
+        }
+    }
+
+    // ray storm, a pile of bodies and a batch of rays cast on the workers after every step
+    struct ray_storm
+    {
+        physics::batch_cast       batch;
+        physics::ray_cast_params* rays = nullptr;
+        physics::cast_result*     results = nullptr;
+    };
+    ray_storm s_storm;
+
+    void setup_ray_storm(scenario& s)
+    {
+        add_ground(s);
+
+        for (u32 y = 0; y < 4; ++y)
+            for (u32 z = 0; z < 16; ++z)
+                for (u32 x = 0; x < 16; ++x)
+                    add_body(s, physics::e_shape::box, vec3f(-12.0f + x * 1.6f, 0.5f + y * 1.1f, -12.0f + z * 1.6f),
+                             vec3f(0.5f), 1.0f);
+
+        s_storm.rays = (physics::ray_cast_params*)pen::memory_alloc(sizeof(physics::ray_cast_params) * k_num_storm_rays);
+        s_storm.results = (physics::cast_result*)pen::memory_alloc(sizeof(physics::cast_result) * k_num_storm_rays);
+
+        // a grid of rays straight down through the pile
+        for (u32 i = 0; i < k_num_storm_rays; ++i)
+        {
+            f32 x = -15.0f + (i % 100) * 0.3f;
+            f32 z = -15.0f + (i / 100) * 0.3f;
+
+            physics::ray_cast_params& rcp = s_storm.rays[i];
+            rcp = physics::ray_cast_params();
+            rcp.start = vec3f(x, 20.0f, z);
+            rcp.end = vec3f(x, -5.0f, z);
+            rcp.timestamp = 0;
+        }
+
+        sb_push(s.allocations, s_storm.rays);
+        sb_push(s.allocations, s_storm.results);
+    }
+
+    void update_ray_storm(scenario& s)
+    {
+        physics::batch_cast& batch = s_storm.batch;
+        batch.rays = s_storm.rays;
+        batch.spheres = nullptr;
+        batch.num_casts = k_num_storm_rays;
+        batch.results = s_storm.results;
+        batch.single_threaded = false;
+        batch.complete = 0;
+
+        // runs after the step issued this tick, so the sync waits for it
+        physics::cast_batch(&batch);
+    }
+
+    void after_step_ray_storm(scenario& s)
+    {
+        PEN_ASSERT(s_storm.batch.complete);
+        sb_push(s.extra_ms, s_storm.batch.cast_ms);
+        s.extra_count += k_num_storm_rays;
+    }
+
+    // command queue, individual velocity sets synced on their own so only command execution is timed
+    void setup_command_queue(scenario& s)
+    {
+        add_ground(s);
+
+        for (u32 i = 0; i < 1000; ++i)
+            add_body(s, physics::e_shape::box, vec3f(-20.0f + (i % 32) * 1.2f, 5.0f, -20.0f + (i / 32) * 1.2f),
+                     vec3f(0.5f), 1.0f);
+    }
+
+    void update_command_queue(scenario& s)
+    {
+        u32 num_bodies = sb_count(s.bodies);
+
+        f64 start = pen::get_time_us();
+        for (u32 i = 0; i < k_queue_cmds; ++i)
+        {
+            vec3f v = vec3f(0.0f, (f32)(i & 7), 0.0f);
+            physics::set_v3(s.bodies[i % num_bodies], v, physics::e_cmd::set_linear_velocity);
+        }
+        sync();
+
+        sb_push(s.extra_ms, (pen::get_time_us() - start) / 1000.0);
+        s.extra_count += k_queue_cmds;
+    }
+
+    scenario s_scenarios[] = {{"box_stacks", setup_box_stacks, nullptr, nullptr, nullptr},
+                              {"pile_10k", setup_pile, nullptr, nullptr, nullptr},
+                              {"compounds", setup_compounds, nullptr, nullptr, nullptr},
+                              {"chains", setup_chains, nullptr, nullptr, nullptr},
+                              {"ragdolls", setup_ragdolls, nullptr, nullptr, nullptr},
+                              {"ray_storm", setup_ray_storm, update_ray_storm, after_step_ray_storm, "cast"},
+                              {"command_queue", setup_command_queue, update_command_queue, nullptr, "command"}};
+
+    void release_scenario(scenario& s)
+    {
+        // constraints before the bodies they reference
+        for (u32 i = 0; i < sb_count(s.constraints); ++i)
+        {
+            physics::release_entity(s.constraints[i]);
+            issued();
+        }
+
+        for (u32 i = 0; i < sb_count(s.bodies); ++i)
+        {
+            physics::release_entity(s.bodies[i]);
+            issued();
+        }
+
+        sync();
+        s_pending_cmds = 0;
+
+        for (u32 i = 0; i < sb_count(s.allocations); ++i)
+            pen::memory_free(s.allocations[i]);
+
+        sb_free(s.bodies);
+        sb_free(s.constraints);
+        sb_free(s.allocations);
+    }
+
+    void run_scenario(scenario& s, u32 ticks)
+    {
+        PEN_LOG("running: %s", s.name);
+
+        u64 base_bytes = s_bullet_bytes;
+        s_bullet_peak = base_bytes;
+
+        f64 start = pen::get_time_us();
+        s.setup(s);
+        sync();
+        s_pending_cmds = 0;
+        s.setup_ms = (pen::get_time_us() - start) / 1000.0;
+
+        for (u32 t = 0; t < ticks; ++t)
+        {
+            if (s.update)
+                s.update(s);
+
+            physics::step(k_dt);
+            sync();
+
+            if (s.after_step)
+                s.after_step(s);
+
+            sb_push(s.step_ms, physics::get_step_ms());
+
+            // moved bodies stay pending until acknowledged
+            physics::acknowledge_rb_transforms(physics::get_moved_rb_transforms());
+        }
+
+        s.setup_bytes = s_bullet_bytes > base_bytes ? s_bullet_bytes - base_bytes : 0;
+        s.peak_bytes = s_bullet_peak - base_bytes;
+
+        release_scenario(s);
+    }
+
+    u64 hash_moved_transforms(const physics::rb_transforms& moved)
+    {
+        u64 h = 14695981039346656037ull;
+        auto hash_bytes = [&h](const void* data, size_t size) {
+            const u8* b = (const u8*)data;
+            for (size_t i = 0; i < size; ++i)
+                h = (h ^ b[i]) * 1099511628211ull;
+        };
+
+        hash_bytes(&moved.count, sizeof(u32));
+        hash_bytes(&moved.step, sizeof(u32));
+        hash_bytes(moved.handles, moved.count * sizeof(u32));
+        hash_bytes(moved.positions, moved.count * sizeof(vec3f));
+        hash_bytes(moved.rotations, moved.count * sizeof(quat));
+        hash_bytes(moved.prev_positions, moved.count * sizeof(vec3f));
+        return h;
+    }
+
+    // fixed rate physics publishes moved transforms on its own clock, so it keeps stepping while the user thread reads
+    // them. holds each read across several ticks and checks the transforms did not change or tear underneath it.
+    u32 run_transform_stress(u32 ticks)
+    {
+        static scenario s = {"transform_stress", setup_box_stacks, nullptr, nullptr, nullptr};
+
+        PEN_LOG("running: %s at %uhz", s.name, k_stress_rate_hz);
+
+        s.setup(s);
+        sync();
+        s_pending_cmds = 0;
+
+        u32 max_handle = 0;
+        for (u32 i = 0; i < sb_count(s.bodies); ++i)
+            max_handle = std::max(max_handle, s.bodies[i]);
+
+        u32 failures = 0;
+        u32 last_step = 0;
+        u32 max_steps_per_read = 0;
+        for (u32 t = 0; t < ticks; ++t)
+        {
+            const physics::rb_transforms& moved = physics::get_moved_rb_transforms();
+
+            u64 before = hash_moved_transforms(moved);
+            pen::thread_sleep_us(k_stress_hold_us);
+
+            bool valid = moved.step >= last_step;
+            valid &= moved.count == sb_count(moved.handles) && moved.count == sb_count(moved.positions) &&
+                     moved.count == sb_count(moved.rotations) && moved.count == sb_count(moved.prev_positions) &&
+                     moved.count == sb_count(moved.prev_rotations);
+
+            for (u32 i = 0; valid && i < moved.count; ++i)
+                valid &= moved.handles[i] <= max_handle;
+
+            if (hash_moved_transforms(moved) != before)
+            {
+                PEN_LOG("    step %u changed while it was being read", moved.step);
+                ++failures;
+            }
+            else if (!valid)
+            {
+                PEN_LOG("    step %u is inconsistent", moved.step);
+                ++failures;
+            }
+
+            last_step = moved.step;
+            physics::acknowledge_rb_transforms(moved);
+
+            // moved is released by the next read, which picks up the latest step however many were published
+            u32 next = physics::get_moved_rb_transforms().step;
+            max_steps_per_read = std::max(max_steps_per_read, next - last_step);
+        }
+
+        if (max_steps_per_read < 2)
+            PEN_LOG("    warning: physics never published more than once per read, the stress was not exercised");
+
+        PEN_LOG("%s: %u reads, up to %u steps per read, %u failures", s.name, ticks, max_steps_per_read, failures);
+
+        release_scenario(s);
+        return failures;
+    }
+
+    f64 percentile(const f64* sorted, u32 count, f64 p)
+    {
+        if (count == 0)
+            return 0.0;
+
+        u32 i = (u32)(p * (f64)(count - 1) + 0.5);
+        return sorted[std::min(i, count - 1)];
+    }
+
+    void write_timings(Str& out, const c8* name, f64* samples)
+    {
+        u32 count = sb_count(samples);
+        std::sort(samples, samples + count);
+
+        f64 sum = 0.0;
+        for (u32 i = 0; i < count; ++i)
+            sum += samples[i];
+
+        out.appendf("            \"%s\": {\"samples\": %u, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, "
+                    "\"max\": %.4f}",
+                    name, count, count ? sum / count : 0.0, percentile(samples, count, 0.5),
+                    percentile(samples, count, 0.9), percentile(samples, count, 0.99), count ? samples[count - 1] : 0.0);
+    }
+
+    Str write_results(u32 ticks)
+    {
+        Str out;
+        out.appendf("{\n");
+        out.appendf("    \"ticks\": %u,\n", ticks);
+        out.appendf("    \"dt\": %.6f,\n", k_dt);
+        out.appendf("    \"solver_threads\": %u,\n", physics::get_solver_threads());
+        out.appendf("    \"scenarios\": [\n");
+
+        u32 num_scenarios = PEN_ARRAY_SIZE(s_scenarios);
+        for (u32 i = 0; i < num_scenarios; ++i)
+        {
+            scenario& s = s_scenarios[i];
+
+            out.appendf("        {\n");
+            out.appendf("            \"name\": \"%s\",\n", s.name);
+            out.appendf("            \"setup_ms\": %.4f,\n", s.setup_ms);
+            out.appendf("            \"bullet_bytes\": %llu,\n", (unsigned long long)s.setup_bytes);
+            out.appendf("            \"bullet_peak_bytes\": %llu,\n", (unsigned long long)s.peak_bytes);
+
+            write_timings(out, "step_ms", s.step_ms);
+
+            if (s.extra_ms)
+            {
+                f64 total_ms = 0.0;
+                for (u32 e = 0; e < sb_count(s.extra_ms); ++e)
+                    total_ms += s.extra_ms[e];
+
+                const c8* name = s.extra_name;
+                f64       per_sec = total_ms > 0.0 ? (f64)s.extra_count / (total_ms / 1000.0) : 0.0;
+
+                out.appendf(",\n");
+                Str timing_name;
+                timing_name.appendf("%s_ms", name);
+                write_timings(out, timing_name.c_str(), s.extra_ms);
+                out.appendf(",\n            \"%ss_per_sec\": %.1f", name, per_sec);
+            }
+
+            out.appendf("\n        }%s\n", i == num_scenarios - 1 ? "" : ",");
+
+            sb_free(s.step_ms);
+            sb_free(s.extra_ms);
+        }
+
+        out.appendf("    ]\n");
+        out.appendf("}\n");
+        return out;
+    }
+
+    // steps every scenario on the mt world at each of k_sweep_threads, counts above the number of workers are clamped
+    // so solver_threads is the count each run used
+    Str run_thread_sweep(u32 ticks)
+    {
+        Str out;
+        out.appendf("{\n");
+        out.appendf("    \"ticks\": %u,\n", ticks);
+        out.appendf("    \"dt\": %.6f,\n", k_dt);
+        out.appendf("    \"sweep\": [\n");
+
+        u32 num_counts = PEN_ARRAY_SIZE(k_sweep_threads);
+        u32 num_scenarios = PEN_ARRAY_SIZE(s_scenarios);
+        for (u32 c = 0; c < num_counts; ++c)
+        {
+            // the physics thread picks up the count on its next step
+            physics::set_solver_threads(k_sweep_threads[c]);
+            physics::step(k_dt);
+            sync();
+
+            u32 threads = physics::get_solver_threads();
+            PEN_LOG("solver threads: %u", threads);
+
+            for (u32 i = 0; i < num_scenarios; ++i)
+            {
+                scenario& s = s_scenarios[i];
+                run_scenario(s, ticks);
+
+                out.appendf("        {\n");
+                out.appendf("            \"solver_threads\": %u,\n", threads);
+                out.appendf("            \"name\": \"%s\",\n", s.name);
+
+                write_timings(out, "step_ms", s.step_ms);
+
+                bool last = c == num_counts - 1 && i == num_scenarios - 1;
+                out.appendf("\n        }%s\n", last ? "" : ",");
+
+                sb_free(s.step_ms);
+                sb_free(s.extra_ms);
+                s.step_ms = nullptr;
+                s.extra_ms = nullptr;
+                s.extra_count = 0;
+            }
+        }
+
+        out.appendf("    ]\n");
+        out.appendf("}\n");
+        return out;
+    }
+} // namespace
+
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        // before anything can allocate through bullet
+        btAlignedAllocSetCustomAligned(tracked_alloc, tracked_free);
+
+        for (u32 i = 0; i < argc; ++i)
+            sb_push(s_args, argv[i]);
+
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "physics_bench";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+void show_help()
+{
+    PEN_LOG("physics_bench help");
+    PEN_LOG("    -help <show this dialog>");
+    PEN_LOG("    -o (optional) <output file> defaults to physics_bench.json");
+    PEN_LOG("    -ticks (optional) <number of steps per scenario> defaults to %u", k_default_ticks);
+    PEN_LOG("    -threads (optional) <solver threads> steps the mt world, 0 for the single threaded world");
+    PEN_LOG("    -stress (optional) reads moved transforms while fixed rate physics steps, exits with the failures");
+    PEN_LOG("    -sweep (optional) step times of every scenario on the mt world at 1, 2, 4 and 8 solver threads");
+    PEN_LOG("    scenarios: box stacks, 10k pile, compounds, constraint chains, ragdolls, ray storm and command queue.");
+}
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    Str  output_file = "physics_bench.json";
+    u32  ticks = k_default_ticks;
+    bool stress = false;
+    bool sweep = false;
+    u32  failures = 0;
+
+    u32 argc = sb_count(s_args);
+    for (u32 i = 0; i < argc; ++i)
+    {
+        if (s_args[i] == "-help")
+        {
+            show_help();
+            goto term;
+        }
+        else if (s_args[i] == "-o" && i + 1 < argc)
+        {
+            output_file = s_args[i + 1];
+        }
+        else if (s_args[i] == "-ticks" && i + 1 < argc)
+        {
+            ticks = (u32)atoi(s_args[i + 1].c_str());
+        }
+        else if (s_args[i] == "-threads" && i + 1 < argc)
+        {
+            s_physics_params.solver_threads = (u32)atoi(s_args[i + 1].c_str());
+        }
+        else if (s_args[i] == "-stress")
+        {
+            stress = true;
+            s_physics_params.fixed_rate_hz = k_stress_rate_hz;
+        }
+        else if (s_args[i] == "-sweep")
+        {
+            sweep = true;
+        }
+    }
+
+    // the thread count can only change at run time on the mt world
+    if (sweep && s_physics_params.solver_threads == 0)
+        s_physics_params.solver_threads = 1;
+
+    {
+        pen::jobs_create_job(physics::physics_thread_main, 1024 * 10, &s_physics_params,
+                             pen::e_thread_start_flags::detached);
+
+        // the physics thread is up once it consumes commands
+        sync();
+
+        if (stress)
+        {
+            failures = run_transform_stress(ticks);
+            goto term;
+        }
+
+        Str results;
+        if (sweep)
+        {
+            results = run_thread_sweep(ticks);
+        }
+        else
+        {
+            for (auto& s : s_scenarios)
+                run_scenario(s, ticks);
+
+            results = write_results(ticks);
+        }
+
+        std::ofstream ofs(output_file.c_str());
+        ofs << results.c_str();
+        ofs.close();
+
+        PEN_LOG("%s", results.c_str());
+        PEN_LOG("written: %s", output_file.c_str());
+    }
+
+term:
+    // signal to the engine the thread has finished
+    pen::os_terminate(failures);
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -0,0 +1,248 @@
+// scene_bench.cpp
+// Copyright 2014 - 2019 Alex Dixon.
+// License: https://github.com/polymonster/pmtech/blob/master/license.md
+
+// Headless scene file benchmarks, builds a large scene of models with child nodes, saves it and times repeated
+// load_scene calls, writes save and load time percentiles and the file version and size as json.
+// Entities have no geometry, materials, lights or physics so no resources are created, the timings are the file format
+// alone. Only ecs load_scene and save_scene are used so the same file builds against older trees, run it on the commit
+// before a format change to compare against the previous version.
+
+#include "ecs/ecs_resources.h"
+#include "ecs/ecs_scene.h"
+#include "ecs/ecs_utilities.h"
+
+#include "console.h"
+#include "data_struct.h"
+#include "memory.h"
+#include "os.h"
+#include "pen.h"
+#include "pen_string.h"
+#include "str_utilities.h"
+#include "threads.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+
+using namespace pen;
+using namespace put;
+using namespace ecs;
+
+namespace
+{
+    const u32 k_default_entities = 10000;
+    const u32 k_default_loads = 20;
+    const u32 k_model_nodes = 8; // a root and its child nodes, like a model with several sub meshes
+    const c8* k_scene_file = "scene_bench.pms";
+
+    Str* s_args = nullptr;
+
+    struct results
+    {
+        u32  entities = 0;
+        s32  version = 0;
+        u32  file_bytes = 0;
+        f64  save_ms = 0.0;
+        f64* load_ms = nullptr;
+    };
+
+    results s_results;
+
+    // entities are named so the lookup string table holds one string per entity as well as the shared node names
+    void create_bench_scene(ecs_scene* scene, u32 num_entities)
+    {
+        for (u32 i = 0; i < num_entities; i += k_model_nodes)
+        {
+            u32 root = get_new_entity(scene);
+            u32 num_nodes = std::min(k_model_nodes, num_entities - i);
+
+            scene->transforms[root].translation = vec3f((f32)(i % 100), 0.0f, (f32)(i / 100));
+            scene->transforms[root].rotation = quat();
+            scene->transforms[root].scale = vec3f::one();
+            scene->entities[root] |= e_cmp::transform;
+
+            for (u32 n = 0; n < num_nodes; ++n)
+            {
+                u32 e = n == 0 ? root : get_new_entity(scene);
+
+                if (n > 0)
+                {
+                    scene->parents[e] = root;
+                    scene->transforms[e] = scene->transforms[root];
+                    scene->transforms[e].translation = vec3f(0.0f, (f32)n, 0.0f);
+                    scene->entities[e] |= e_cmp::transform;
+
+                    scene->geometry_names[e] = "";
+                    scene->geometry_names[e].appendf("submesh_%u", n);
+                }
+
+                // runtime handles are invalid as they would be for nodes with no resources
+                scene->cbuffer[e] = PEN_INVALID_HANDLE;
+                scene->physics_handles[e] = PEN_INVALID_HANDLE;
+                scene->physics_debug_cbuffer[e] = PEN_INVALID_HANDLE;
+            }
+        }
+    }
+
+    s32 read_file_version(const c8* filename, u32& file_bytes)
+    {
+        s32 header[2] = {0};
+
+        std::ifstream ifs(filename, std::ifstream::binary | std::ifstream::ate);
+        file_bytes = (u32)ifs.tellg();
+        ifs.seekg(0);
+        ifs.read((c8*)header, sizeof(header));
+
+        return header[1];
+    }
+
+    f64 percentile(const f64* sorted, u32 count, f64 p)
+    {
+        if (count == 0)
+            return 0.0;
+
+        u32 i = (u32)(p * (f64)(count - 1) + 0.5);
+        return sorted[std::min(i, count - 1)];
+    }
+
+    void run_bench(u32 num_entities, u32 num_loads)
+    {
+        pen::timer* timer = pen::timer_create();
+
+        ecs_scene* scene = new ecs_scene();
+        resize_scene_buffers(scene, num_entities);
+        create_bench_scene(scene, num_entities);
+
+        s_results.entities = scene->num_entities;
+
+        pen::timer_start(timer);
+        save_scene(k_scene_file, scene);
+        s_results.save_ms = pen::timer_elapsed_ms(timer);
+
+        s_results.version = read_file_version(k_scene_file, s_results.file_bytes);
+
+        // each load clears the scene first, as loading a level would
+        for (u32 i = 0; i < num_loads; ++i)
+        {
+            pen::timer_start(timer);
+            load_scene(k_scene_file, scene);
+            sb_push(s_results.load_ms, pen::timer_elapsed_ms(timer));
+        }
+
+        if (scene->num_entities != s_results.entities)
+            PEN_LOG("[error] scene_bench: loaded %u entities, saved %u", scene->num_entities, s_results.entities);
+
+        destroy_scene(scene);
+        delete scene;
+
+        pen::timer_destroy(timer);
+        remove(k_scene_file);
+    }
+
+    Str write_results()
+    {
+        f64* samples = s_results.load_ms;
+        u32  count = sb_count(samples);
+        std::sort(samples, samples + count);
+
+        f64 sum = 0.0;
+        for (u32 i = 0; i < count; ++i)
+            sum += samples[i];
+
+        Str out;
+        out.appendf("{\n");
+        out.appendf("    \"entities\": %u,\n", s_results.entities);
+        out.appendf("    \"version\": %i,\n", s_results.version);
+        out.appendf("    \"file_bytes\": %u,\n", s_results.file_bytes);
+        out.appendf("    \"save_ms\": %.4f,\n", s_results.save_ms);
+        out.appendf("    \"load_ms\": {\"samples\": %u, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"max\": %.4f}\n",
+                    count, count ? sum / count : 0.0, percentile(samples, count, 0.5), percentile(samples, count, 0.9),
+                    count ? samples[count - 1] : 0.0);
+        out.appendf("}\n");
+        return out;
+    }
+} // namespace
+
+namespace pen
+{
+    pen_creation_params pen_entry(int argc, char** argv)
+    {
+        for (s32 i = 0; i < argc; ++i)
+            sb_push(s_args, argv[i]);
+
+        pen::pen_creation_params p;
+        p.window_width = 1280;
+        p.window_height = 720;
+        p.window_title = "scene_bench";
+        p.window_sample_count = 4;
+        p.user_thread_function = user_entry;
+        p.flags = pen::e_pen_create_flags::console_app;
+        return p;
+    }
+} // namespace pen
+
+void show_help()
+{
+    PEN_LOG("scene_bench help");
+    PEN_LOG("    -help <show this dialog>");
+    PEN_LOG("    -o (optional) <output file> defaults to scene_bench.json");
+    PEN_LOG("    -entities (optional) <number of entities in the scene> defaults to %u", k_default_entities);
+    PEN_LOG("    -loads (optional) <number of times the scene is loaded> defaults to %u", k_default_loads);
+    PEN_LOG("    the version in the output is the file format the tree was built with.");
+}
+
+void* pen::user_entry(void* params)
+{
+    // unpack the params passed to the thread and signal to the engine it ok to proceed
+    pen::job_thread_params* job_params = (pen::job_thread_params*)params;
+    pen::job*               p_thread_info = job_params->job_info;
+    pen::semaphore_post(p_thread_info->p_sem_continue, 1);
+
+    Str output_file = "scene_bench.json";
+    u32 num_entities = k_default_entities;
+    u32 num_loads = k_default_loads;
+
+    u32 argc = sb_count(s_args);
+    for (u32 i = 0; i < argc; ++i)
+    {
+        if (s_args[i] == "-help")
+        {
+            show_help();
+            goto term;
+        }
+        else if (s_args[i] == "-o" && i + 1 < argc)
+        {
+            output_file = s_args[i + 1];
+        }
+        else if (s_args[i] == "-entities" && i + 1 < argc)
+        {
+            num_entities = std::max((u32)atoi(s_args[i + 1].c_str()), 1u);
+        }
+        else if (s_args[i] == "-loads" && i + 1 < argc)
+        {
+            num_loads = std::max((u32)atoi(s_args[i + 1].c_str()), 1u);
+        }
+    }
+
+    {
+        run_bench(num_entities, num_loads);
+
+        Str results = write_results();
+
+        std::ofstream ofs(output_file.c_str());
+        ofs << results.c_str();
+        ofs.close();
+
+        PEN_LOG("%s", results.c_str());
+        PEN_LOG("written: %s", output_file.c_str());
+    }
+
+term:
+    // signal to the engine the thread has finished
+    pen::os_terminate(0);
+    pen::semaphore_post(p_thread_info->p_sem_terminated, 1);
+
+    return PEN_THREAD_OK;
+}
@@ -302,6 +302,10 @@ for file in file_list:
                 cmd = " -i " + base_out_file + ".pmm"
                 p = subprocess.Popen(mesh_opt + cmd, shell=True)
                 p.wait()
+                if os.path.exists(base_out_file + ".pma"):
+                    cmd = " -i " + base_out_file + ".pma"
+                    p = subprocess.Popen(mesh_opt + cmd, shell=True)
+                    p.wait()
             dependencies.write_to_file_single(dep, depends_dest + ".dep")
 
 
@@ -16,7 +16,6 @@ local function setup_osx()
 		"Cocoa.framework",
 		"GameController.framework",
 		"iconv",
-		"fmod",
 		"IOKit.framework",
 		"MetalKit.framework",
 		"Metal.framework",
@@ -53,7 +52,6 @@ local function setup_linux()
 		"GLU",
 		"GL",
 		"X11",
-		"fmod",
 		"dl"
 	}
 end
@@ -97,7 +95,6 @@ local function setup_win32()
         "dxguid.lib",
         "winmm.lib", 
         "comctl32.lib", 
-        "fmod64_vc.lib",
         "Shlwapi.lib"	
     }
 
@@ -117,8 +114,7 @@ local function setup_ios()
 		"Metal.framework",
 		"AVFoundation.framework",
 		"AudioToolbox.framework",
-		"MediaPlayer.framework",
-		"fmod_iphoneos"
+		"MediaPlayer.framework"
 	}
 		
 	files 
@@ -217,7 +213,8 @@ local function setup_bullet()
 end
 
 local function setup_fmod()
-	if platform == "web" then
+	-- the software mixer needs no audio libs
+	if platform == "web" or audio_dir ~= "fmod" then
 		return
 	end
 
@@ -225,6 +222,14 @@ local function setup_fmod()
 	{
 		(pmtech_dir .. "third_party/fmod/lib/" .. platform_dir)
 	}
+	
+	if platform_dir == "win32" then
+		links { "fmod64_vc.lib" }
+	elseif platform_dir == "ios" then
+		links { "fmod_iphoneos" }
+	else
+		links { "fmod" }
+	end
 end
 
 function setup_modules()
@@ -4,6 +4,7 @@ platform = ""
 build_cmd = ""
 link_cmd = ""
 renderer_dir = ""
+audio_dir = "fmod"
 sdk_version = ""
 shared_libs_dir = ""
 pmtech_dir = "../"
@@ -14,6 +15,10 @@ function setup_from_options()
         renderer_dir = _OPTIONS["renderer"]
     end
 
+    if _OPTIONS["audio"] then
+        audio_dir = _OPTIONS["audio"]
+    end
+
     if _OPTIONS["sdk_version"] then
         sdk_version = _OPTIONS["sdk_version"]
     end
@@ -145,7 +150,8 @@ function setup_platform_defines()
 	defines
 	{
 		("PEN_PLATFORM_" .. string.upper(platform)),
-        ("PEN_RENDERER_" .. string.upper(renderer_dir))
+        ("PEN_RENDERER_" .. string.upper(renderer_dir)),
+        ("PEN_AUDIO_" .. string.upper(audio_dir))
 	}
 end
 
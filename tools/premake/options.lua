@@ -13,6 +13,18 @@ newoption
    }
 }
 
+newoption 
+{
+   trigger     = "audio",
+   value       = "API",
+   description = "Choose an audio backend",
+   allowed = 
+   {
+      { "fmod", "FMOD (default)" },
+      { "software",  "Built in software mixer, output goes to a sink instead of a device" }
+   }
+}
+
 newoption 
 {
    trigger     = "sdk_version",
@@ -17,6 +17,10 @@ dofile "../core/pen/project.lua"
 dofile "../core/put/project.lua"
 
 create_app_example("mesh_opt", script_path())
+create_app_example("physics_bench", script_path())
+create_app_example("audio_bench", script_path())
+create_app_example("ecs_tests", script_path())
+create_app_example("scene_bench", script_path())
 create_app_example("pmtech_editor", script_path())
 
 -- win32 needs to export a lib for the live lib to link against